@@ -0,0 +1,1801 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "MessageTypes/File/FileMessage.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include "MessageTypes/Hello/HelloMessage.h"
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "MessageTypes/Utilities/FileTransferQueue.h"
+#include "MessageTypes/Utilities/FrameHeader.hpp"
+#include "MessageTypes/Utilities/MessageRegistry.hpp"
+#include "MessageTypes/Utilities/TextSanitizer.h"
+#include "MessageTypes/Text/TextMessage.h"
+#include "MessageTypes/TextBatch/TextBatchMessage.h"
+#include "Server/HistoryLog.h"
+#include "Server/FanOut.h"
+#include "Server/HandlerMemory.hpp"
+#include "Server/MessageSender.h"
+#include "Server/OutboundQueue.h"
+#include "Server/ServerManager.h"
+#include "Server/TimerWheel.h"
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+// =====================================================================
+// HELPERS
+// =====================================================================
+using Clock = std::chrono::steady_clock;
+
+static double SecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Heap allocations made by the calling thread, for benchmarks that count them.
+// Every replaced form allocates with malloc / aligned_alloc and releases with free (the array and nothrow
+// forms forward to these). They stay out of line, so the compiler never pairs an inlined free() with a
+// call to operator new
+static thread_local uint64_t thread_allocations = 0;
+
+[[gnu::noinline]] void* operator new(std::size_t size)
+{
+    ++thread_allocations;
+    if (void* memory = std::malloc(size == 0 ? 1 : size)) return memory;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    ++thread_allocations;
+    const auto align = static_cast<std::size_t>(alignment);
+    // aligned_alloc wants a multiple of the alignment
+    if (void* memory = std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align))
+        return memory;
+    throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept { std::free(memory); }
+[[gnu::noinline]] void operator delete(void* memory, std::size_t) noexcept { std::free(memory); }
+[[gnu::noinline]] void operator delete(void* memory, std::align_val_t) noexcept { std::free(memory); }
+[[gnu::noinline]] void operator delete(void* memory, std::size_t, std::align_val_t) noexcept { std::free(memory); }
+
+static uint64_t ArgOr(const std::vector<std::string>& args, size_t index, uint64_t fallback)
+{
+    if (index >= args.size()) return fallback;
+    try { return std::stoull(args[index]); }
+    catch (...) { return fallback; }
+}
+
+static std::filesystem::path ScratchDir(const std::string& prefix)
+{
+    return std::filesystem::temp_directory_path() /
+           (prefix + "_" + std::to_string(std::random_device{}()));
+}
+
+// A realistic chat line as broadcast by the server
+static std::string ChatLine(uint64_t i)
+{
+    return "[TEXT] From 192.168.1." + std::to_string(i % 250) + ":5" + std::to_string(1000 + i % 9000) +
+           ": message number " + std::to_string(i) + ", see you at lunch";
+}
+
+// =====================================================================
+// BENCHMARK 1: HistoryLog append throughput and restart time
+// args: [messages=10000000] [recover=100]
+// =====================================================================
+static void BenchHistoryLog(const std::vector<std::string>& args)
+{
+    const uint64_t messages = ArgOr(args, 0, 10'000'000);
+    const uint64_t recover = ArgOr(args, 1, 100);
+    const auto dir = ScratchDir("bench_history_log");
+
+    uint64_t bytes = 0;
+    {
+        HistoryLog log(dir);
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < messages; ++i)
+        {
+            auto frame = std::make_shared<const std::vector<char>>(TextMessage(ChatLine(i)).serialize());
+            bytes += frame->size();
+            log.append(std::move(frame));
+        }
+        const double append_s = SecondsSince(start);
+        log.flush();
+        const double total_s = SecondsSince(start);
+
+        const auto stats = log.stats();
+        std::cout << "append:  " << messages << " frames, " << bytes / (1024 * 1024) << " MiB\n"
+                  << "         caller side " << append_s << " s (" << static_cast<double>(messages) / append_s << " msg/s)\n"
+                  << "         durable     " << total_s << " s (" << static_cast<double>(messages) / total_s << " msg/s, "
+                  << static_cast<double>(bytes) / total_s / (1024 * 1024) << " MiB/s)\n"
+                  << "         " << stats.batches << " group commits, " << stats.fsyncs << " fsyncs, "
+                  << stats.segments << " segments\n";
+    }
+
+    {
+        const auto start = Clock::now();
+        HistoryLog log(dir);
+        const auto frames = log.read_last(recover);
+        const double restart_s = SecondsSince(start);
+        std::cout << "restart: recovered last " << frames.size() << " of " << log.size() << " frames in "
+                  << restart_s * 1000.0 << " ms\n";
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(dir, ec);
+}
+
+// =====================================================================
+// BENCHMARK 2: per-message fan-out latency against room size, inline vs lanes
+// args: [max_room=8000] [messages=200] [threads=hardware]
+// =====================================================================
+// Benchmarks that are not about flood protection run without ingress budgets and room caps
+static void DisableRateLimits(ServerManager& server)
+{
+    server.SetIngressLimits({0, 0, 0, 0});
+    server.SetRoomBroadcastLimit(0, 0);
+}
+
+static double Percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) return 0.0;
+    std::sort(values.begin(), values.end());
+    const auto index = static_cast<std::size_t>(p * static_cast<double>(values.size() - 1));
+    return values[index];
+}
+
+static void BenchFanOut(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t max_room = ArgOr(args, 0, 8000);
+    const std::size_t messages = ArgOr(args, 1, 200);
+    const std::size_t threads = ArgOr(args, 2, std::max(1u, std::thread::hardware_concurrency()));
+
+    boost::asio::io_context io;
+    auto guard = boost::asio::make_work_guard(io);
+    FanOut fan_out(io, FanOut::Options{0, threads});
+
+    // Loopback connections: the accepted side is what the server writes to, the peers only receive
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+    std::vector<std::shared_ptr<tcp::socket>> peers;
+    std::vector<FanOut::Recipient> members;
+    for (std::size_t i = 0; i < max_room; ++i)
+    {
+        auto peer = std::make_shared<tcp::socket>(io);
+        auto accepted = std::make_shared<tcp::socket>(io);
+        boost::system::error_code ec;
+        peer->connect(acceptor.local_endpoint(), ec);
+        if (!ec) acceptor.accept(*accepted, ec);
+        if (ec)
+        {
+            std::cerr << "stopped at " << i << " connections: " << ec.message() << "\n";
+            break;
+        }
+        peers.push_back(std::move(peer));
+        FanOut::Recipient member;
+        member.socket = std::move(accepted);
+        members.push_back(std::move(member));
+    }
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 0; i < threads; ++i) pool.emplace_back([&io]() { io.run(); });
+
+    const auto frame = std::make_shared<const std::vector<char>>(TextMessage(ChatLine(42), 1).serialize());
+    std::cout << members.size() << " connections, " << threads << " io threads, " << messages
+              << " messages per point, latency in us\n"
+              << "room size | inline p50 / p99 | lanes p50 / p99\n";
+
+    std::vector<std::size_t> sizes;
+    for (std::size_t n = 10; n < members.size(); n *= 10) sizes.push_back(n);
+    sizes.push_back(members.size());
+
+    for (const std::size_t n : sizes)
+    {
+        const auto recipients = fan_out.Partition({members.begin(), members.begin() + static_cast<long>(n)});
+        std::cout << n;
+        for (const std::size_t threshold : {n, std::size_t{0}})
+        {
+            fan_out.SetInlineThreshold(threshold);
+            auto stream = std::make_shared<FanOut::Stream>();
+            std::vector<double> latencies;
+            latencies.reserve(messages);
+            for (std::size_t m = 0; m < messages; ++m)
+            {
+                std::atomic<std::size_t> delivered{0};
+                const auto start = Clock::now();
+                fan_out.Deliver(stream, recipients, [&delivered, &frame](const FanOut::Recipient& r)
+                {
+                    SendFrames(r.socket, {frame});
+                    delivered.fetch_add(1, std::memory_order_release);
+                });
+                while (delivered.load(std::memory_order_acquire) < n) std::this_thread::yield();
+                latencies.push_back(SecondsSince(start) * 1e6);
+            }
+            std::cout << " | " << Percentile(latencies, 0.5) << " / " << Percentile(latencies, 0.99);
+        }
+        std::cout << "\n";
+    }
+
+    guard.reset();
+    io.stop();
+    for (auto& t : pool) t.join();
+}
+
+// =====================================================================
+// BENCHMARK 3: connection storm, accepts per second against concurrent async_accepts
+// args: [clients=5000] [backlog=4096] [port=7700]
+// =====================================================================
+static void BenchConnectionStorm(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t clients = ArgOr(args, 0, 5000);
+    const int backlog = static_cast<int>(ArgOr(args, 1, 4096));
+    const int base_port = static_cast<int>(ArgOr(args, 2, 7700));
+
+    std::cout << clients << " clients connecting at once, listen backlog " << backlog << "\n"
+              << "concurrent accepts | accepted | seconds | accepts/s\n";
+
+    int port = base_port;
+    for (const unsigned int accepts : {1u, 4u, 16u})
+    {
+        // the server logs every connection; keep the benchmark output readable
+        auto* console = std::cout.rdbuf(nullptr);
+
+        ServerManager server(port, port + 1, "127.0.0.1");
+        server.SetAcceptOptions(accepts, backlog);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        boost::asio::io_context io;
+        const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), static_cast<unsigned short>(port));
+        std::vector<std::shared_ptr<tcp::socket>> sockets;
+        sockets.reserve(clients);
+
+        const auto start = Clock::now();
+        for (std::size_t i = 0; i < clients; ++i)
+        {
+            auto sock = std::make_shared<tcp::socket>(io);
+            sock->async_connect(endpoint, [](const boost::system::error_code&) {});
+            sockets.push_back(std::move(sock));
+        }
+        std::thread client_thread([&io]() { io.run(); });
+
+        const auto deadline = start + std::chrono::seconds(60);
+        while (server.GetConnectionCount() < clients && Clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        const double seconds = SecondsSince(start);
+        const std::size_t accepted = server.GetConnectionCount();
+
+        client_thread.join();
+        for (auto& sock : sockets)
+        {
+            boost::system::error_code ec;
+            sock->close(ec);
+        }
+        server.StopServer();
+        server_thread.join();
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        std::cout << accepts << " | " << accepted << " | " << seconds << " | " << static_cast<double>(accepted) / seconds << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 4: chat latency while the file port is saturated
+// args: [uploaders=4] [file_kb=4096] [pings=300] [port=7800]
+// Compares the file port sharing the chat io_context with its own io_context + CPU workers
+// =====================================================================
+// Reads frames until one whose text ends with `marker` arrived
+static void ReadUntilMarker(boost::asio::ip::tcp::socket& socket, const std::string& marker)
+{
+    std::vector<char> header(sizeof(uint32_t) + sizeof(uint64_t));
+    std::vector<char> frame;
+    for (bool found = false; !found;)
+    {
+        boost::asio::read(socket, boost::asio::buffer(header));
+        uint64_t length = 0;
+        for (std::size_t b = 0; b < sizeof(uint64_t); ++b)
+            length = (length << 8) | static_cast<unsigned char>(header[sizeof(uint32_t) + b]);
+        frame.assign(header.begin(), header.end());
+        frame.resize(header.size() + length);
+        boost::asio::read(socket, boost::asio::buffer(frame.data() + header.size(), length));
+        const std::string_view body(frame.data() + header.size(), frame.size() - header.size());
+        const auto at = body.rfind(marker);
+        found = at != std::string_view::npos && at + marker.size() == body.size();
+    }
+}
+
+static void BenchFileContention(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t uploaders = ArgOr(args, 0, 4);
+    const std::size_t file_bytes = ArgOr(args, 1, 4096) * 1024;
+    const std::size_t pings = ArgOr(args, 2, 300);
+    const int base_port = static_cast<int>(ArgOr(args, 3, 7800));
+
+    const auto file_frame = FileMessage("bulk.bin", std::vector<uint8_t>(file_bytes, 0x5A)).serialize();
+    std::cout << uploaders << " uploaders sending " << file_bytes / 1024 << " KiB files, " << pings
+              << " chat pings\n"
+              << "file port | uploaded MiB | ping p50 ms | ping p99 ms | ping max ms\n";
+
+    int port = base_port;
+    for (const bool isolated : {false, true})
+    {
+        auto* console = std::cout.rdbuf(nullptr);
+        auto* errors = std::cerr.rdbuf(nullptr);
+
+        ServerManager server(port, port + 1, "127.0.0.1");
+        DisableRateLimits(server);
+        if (!isolated) server.SetFileExecutorOptions(0, false);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        boost::asio::io_context io;
+        const auto address = boost::asio::ip::make_address_v4("127.0.0.1");
+        tcp::socket pinger(io), listener(io);
+        pinger.connect({address, static_cast<unsigned short>(port)});
+        listener.connect({address, static_cast<unsigned short>(port)});
+        while (server.GetConnectionCount() < 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // Uploaders push file frames back to back until the pings are done
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> uploaded{0};
+        std::vector<std::thread> upload_threads;
+        for (std::size_t u = 0; u < uploaders; ++u)
+        {
+            upload_threads.emplace_back([&, u]()
+            {
+                boost::asio::io_context upload_io;
+                tcp::socket sock(upload_io);
+                boost::system::error_code ec;
+                sock.connect({address, static_cast<unsigned short>(port + 1)}, ec);
+                while (!ec && !stop.load())
+                {
+                    boost::asio::write(sock, boost::asio::buffer(file_frame), ec);
+                    if (!ec) uploaded += file_frame.size();
+                }
+                sock.close(ec);
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        // Each ping is timed from the pinger's write until the listener has read it back
+        std::vector<double> latencies;
+        latencies.reserve(pings);
+        for (std::size_t i = 0; i < pings; ++i)
+        {
+            const std::string marker = "ping " + std::to_string(i);
+            const auto start = Clock::now();
+            boost::asio::write(pinger, boost::asio::buffer(TextMessage(marker).serialize()));
+            ReadUntilMarker(listener, marker);
+            latencies.push_back(SecondsSince(start) * 1000.0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        stop = true;
+        for (auto& t : upload_threads) t.join();
+        boost::system::error_code ec;
+        pinger.close(ec);
+        listener.close(ec);
+        server.StopServer();
+        server_thread.join();
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        std::cerr.clear();
+        std::cerr.rdbuf(errors);
+        std::cout << (isolated ? "isolated" : "shared") << " | " << uploaded.load() / (1024 * 1024) << " | "
+                  << Percentile(latencies, 0.50) << " | " << Percentile(latencies, 0.99) << " | "
+                  << *std::max_element(latencies.begin(), latencies.end()) << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 5: one client stops reading while the room keeps chatting
+// args: [messages=200000] [port=7900]
+// Reports the server's memory growth and how often each outbound policy fired
+// =====================================================================
+static std::size_t ResidentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    std::size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static void BenchSlowConsumer(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t messages = ArgOr(args, 0, 200000);
+    const int base_port = static_cast<int>(ArgOr(args, 1, 7900));
+    const std::string line(200, 'x');
+
+    std::cout << messages << " chat messages of " << line.size() << " bytes, one member never reads\n"
+              << "policy | RSS growth MiB | high-water hits | dropped oldest | dropped new | disconnects\n";
+
+    int port = base_port;
+    for (const auto policy : {OutboundQueue::Policy::DropOldest, OutboundQueue::Policy::DropNew,
+                              OutboundQueue::Policy::Disconnect})
+    {
+        auto* console = std::cout.rdbuf(nullptr);
+        auto* errors = std::cerr.rdbuf(nullptr);
+
+        ServerManager server(port, port + 1, "127.0.0.1");
+        OutboundQueue::Limits limits;
+        limits.policy = policy;
+        limits.grace = std::chrono::milliseconds(500);
+        server.SetOutboundLimits(limits);
+        DisableRateLimits(server);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        boost::asio::io_context io;
+        const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), static_cast<unsigned short>(port));
+        tcp::socket sender(io), stalled(io);
+        sender.connect(endpoint);
+        stalled.connect(endpoint);
+        while (server.GetConnectionCount() < 2) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        const std::size_t before = ResidentBytes();
+        const auto frame = TextMessage(line).serialize();
+        for (std::size_t i = 0; i < messages; ++i) boost::asio::write(sender, boost::asio::buffer(frame));
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        const std::size_t after = ResidentBytes();
+        const auto stats = server.GetOutboundStats();
+
+        boost::system::error_code ec;
+        sender.close(ec);
+        stalled.close(ec);
+        server.StopServer();
+        server_thread.join();
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        std::cerr.clear();
+        std::cerr.rdbuf(errors);
+        const char* name = policy == OutboundQueue::Policy::DropOldest ? "drop_oldest"
+                         : policy == OutboundQueue::Policy::DropNew    ? "drop_new"
+                                                                        : "disconnect";
+        std::cout << name << " | " << static_cast<double>(after > before ? after - before : 0) / (1024.0 * 1024.0) << " | "
+                  << stats.high_water_hits << " | " << stats.dropped_oldest << " | " << stats.dropped_new << " | "
+                  << stats.disconnects << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 6: one client floods a room, with and without flood protection
+// args: [listeners=50] [seconds=3] [port=8000]
+// Reports the traffic the flood generates and the chat latency of a well-behaved member
+// =====================================================================
+static void BenchFlood(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t listeners = ArgOr(args, 0, 50);
+    const std::size_t seconds = ArgOr(args, 1, 3);
+    const int base_port = static_cast<int>(ArgOr(args, 2, 8000));
+    const auto flood_frame = TextMessage(std::string(100, 'f')).serialize();
+
+    std::cout << "1 flooder, " << listeners << " listeners, " << seconds << " s\n"
+              << "limits | flood msgs/s fanned out | egress MiB/s | ping p50 ms | ping p99 ms | throttled | room drops\n";
+
+    int port = base_port;
+    for (const bool limited : {false, true})
+    {
+        auto* console = std::cout.rdbuf(nullptr);
+        auto* errors = std::cerr.rdbuf(nullptr);
+
+        ServerManager server(port, port + 1, "127.0.0.1");
+        if (!limited) DisableRateLimits(server);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), static_cast<unsigned short>(port));
+        boost::asio::io_context io;
+        tcp::socket pinger(io), probe(io), flooder(io);
+        pinger.connect(endpoint);
+        probe.connect(endpoint);
+        flooder.connect(endpoint);
+
+        // Listeners only count what they receive
+        boost::asio::io_context drain_io;
+        std::atomic<uint64_t> received{0};
+        std::vector<std::shared_ptr<tcp::socket>> sinks;
+        std::vector<char> scratch(64 * 1024);
+        std::function<void(const std::shared_ptr<tcp::socket>&)> drain = [&](const std::shared_ptr<tcp::socket>& sink)
+        {
+            sink->async_read_some(boost::asio::buffer(scratch), [&, sink](const boost::system::error_code& ec, std::size_t n)
+            {
+                if (ec) return;
+                received += n;
+                drain(sink);
+            });
+        };
+        for (std::size_t i = 0; i < listeners; ++i)
+        {
+            auto sink = std::make_shared<tcp::socket>(drain_io);
+            sink->connect(endpoint);
+            drain(sink);
+            sinks.push_back(std::move(sink));
+        }
+        while (server.GetConnectionCount() < listeners + 3) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::thread drain_thread([&drain_io]() { drain_io.run(); });
+
+        std::atomic<bool> stop{false};
+        std::thread flood_thread([&]()
+        {
+            boost::system::error_code ec;
+            while (!ec && !stop.load()) boost::asio::write(flooder, boost::asio::buffer(flood_frame), ec);
+        });
+
+        // A well-behaved member chats at 10 messages per second meanwhile
+        const auto start = Clock::now();
+        std::vector<double> latencies;
+        std::vector<char> header(sizeof(uint32_t) + sizeof(uint64_t));
+        std::vector<char> frame;
+        for (std::size_t i = 0; SecondsSince(start) < static_cast<double>(seconds); ++i)
+        {
+            const std::string marker = "ping " + std::to_string(i);
+            const auto sent = Clock::now();
+            boost::asio::write(pinger, boost::asio::buffer(TextMessage(marker).serialize()));
+            for (bool found = false; !found;)
+            {
+                boost::asio::read(probe, boost::asio::buffer(header));
+                uint64_t length = 0;
+                for (std::size_t b = 0; b < sizeof(uint64_t); ++b)
+                    length = (length << 8) | static_cast<unsigned char>(header[sizeof(uint32_t) + b]);
+                frame.resize(length);
+                boost::asio::read(probe, boost::asio::buffer(frame));
+                const std::string_view body(frame.data(), frame.size());
+                const auto at = body.rfind(marker);
+                found = at != std::string_view::npos && at + marker.size() == body.size();
+            }
+            latencies.push_back(SecondsSince(sent) * 1000.0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        const double elapsed = SecondsSince(start);
+        const uint64_t egress = received.load();
+
+        stop = true;
+        boost::system::error_code ec;
+        flooder.shutdown(tcp::socket::shutdown_both, ec);
+        flood_thread.join();
+        const auto ingress = server.GetIngressStats();
+        const uint64_t room_drops = server.GetRoomRateLimitedCount();
+        server.StopServer();
+        server_thread.join();
+        drain_io.stop();
+        drain_thread.join();
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        std::cerr.clear();
+        std::cerr.rdbuf(errors);
+        // a fanned-out line also carries the sender prefix and its sequence number
+        const std::size_t fanned_bytes = flood_frame.size() + std::string("[TEXT] From 127.0.0.1:65535: ").size() +
+                                         sizeof(uint64_t);
+        const double flood_rate = static_cast<double>(egress) / static_cast<double>(fanned_bytes) /
+                                  static_cast<double>(listeners) / elapsed;
+        std::cout << (limited ? "on" : "off") << " | " << flood_rate << " | "
+                  << static_cast<double>(egress) / (1024.0 * 1024.0) / elapsed << " | "
+                  << Percentile(latencies, 0.50) << " | " << Percentile(latencies, 0.99) << " | "
+                  << ingress.throttled << " | " << room_drops << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 7: keepalive cost, and dead connections being reclaimed
+// args: [timers=100000] [connections=2000] [port=8100]
+// 1. one wheel holding a keepalive timer per connection, re-armed on expiry like the server does
+// 2. a server with short timeouts and many clients that said Hello but never answer its pings
+// =====================================================================
+static void BenchKeepalive(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t timers = ArgOr(args, 0, 100000);
+    const std::size_t connections = ArgOr(args, 1, 2000);
+    const int port = static_cast<int>(ArgOr(args, 2, 8100));
+
+    {
+        // 30 s heartbeat interval, 1 s tick: every timer fires (and re-arms) once per 30 ticks
+        using namespace std::chrono_literals;
+        TimerWheel wheel(1s, 512);
+        const auto t0 = TimerWheel::Clock::now();
+        wheel.Advance(t0);
+        std::function<void(TimerWheel::Clock::time_point)> arm = [&](TimerWheel::Clock::time_point deadline)
+        {
+            wheel.Schedule(deadline, [&, deadline]() { arm(deadline + 30s); });
+        };
+        for (std::size_t i = 0; i < timers; ++i) arm(t0 + 1s + (30s * i) / timers);
+
+        const std::size_t ticks = 300;
+        std::size_t fired = 0;
+        const auto start = Clock::now();
+        for (std::size_t tick = 1; tick <= ticks; ++tick) fired += wheel.Advance(t0 + tick * 1s);
+        const double elapsed = SecondsSince(start);
+        std::cout << "wheel: " << timers << " timers, " << ticks << " ticks, " << fired << " fired | "
+                  << elapsed / ticks * 1e6 << " us/tick | " << elapsed / static_cast<double>(fired) * 1e9
+                  << " ns/timer\n";
+    }
+
+    auto* console = std::cout.rdbuf(nullptr);
+    ServerManager server(port, port + 1, "127.0.0.1");
+    server.SetKeepaliveOptions(std::chrono::milliseconds(500), std::chrono::milliseconds(1500));
+    std::thread server_thread([&server]() { server.StartServer(); });
+    while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // Clients that say Hello and then never read nor write stand in for peers that silently went away
+    // (a client that never says Hello cannot answer pings and is not expired)
+    boost::asio::io_context io;
+    const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), static_cast<unsigned short>(port));
+    const auto hello = HelloMessage(ConnectionProtocol::VERSION, 0, 0, {ConnectionProtocol::Codec::Identity}).serialize();
+    std::vector<std::unique_ptr<tcp::socket>> silent;
+    silent.reserve(connections);
+    for (std::size_t i = 0; i < connections; ++i)
+    {
+        silent.push_back(std::make_unique<tcp::socket>(io));
+        silent.back()->connect(endpoint);
+        boost::asio::write(*silent.back(), boost::asio::buffer(hello));
+    }
+
+    const auto start = Clock::now();
+    const auto deadline = start + std::chrono::seconds(30);
+    while (server.GetIdleExpiredCount() < connections && Clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const double seconds = SecondsSince(start);
+    const uint64_t expired = server.GetIdleExpiredCount();
+    const uint64_t heartbeats = server.GetHeartbeatsSent();
+
+    // every silent client must see its connection closed by the server
+    std::size_t closed = 0;
+    std::vector<char> scratch(4096);
+    for (auto& sock : silent)
+    {
+        boost::system::error_code ec;
+        while (!ec) sock->read_some(boost::asio::buffer(scratch), ec);
+        if (ec == boost::asio::error::eof || ec == boost::asio::error::connection_reset) ++closed;
+    }
+    server.StopServer();
+    server_thread.join();
+
+    std::cout.clear();
+    std::cout.rdbuf(console);
+    std::cout << "server: " << connections << " silent clients, heartbeat 500 ms, idle timeout 1500 ms | "
+              << heartbeats << " pings | " << expired << " expired after " << seconds << " s | " << closed
+              << " saw the close\n";
+}
+
+// =====================================================================
+// BENCHMARK 8: chat latency of a client that uploads files at the same time
+// args: [file_kb=4096] [pings=300] [port=8200]
+// Compares a separate file connection with files multiplexed onto the text connection as chunks
+// =====================================================================
+static void BenchMultiplexed(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t file_bytes = ArgOr(args, 0, 4096) * 1024;
+    const std::size_t pings = ArgOr(args, 1, 300);
+    const int base_port = static_cast<int>(ArgOr(args, 2, 8200));
+
+    const auto file_frame = std::make_shared<const std::vector<char>>(
+        FileMessage("bulk.bin", std::vector<uint8_t>(file_bytes, 0x5A)).serialize());
+    std::cout << "one client uploading " << file_bytes / 1024 << " KiB files back to back while sending " << pings
+              << " chat pings\n"
+              << "files | server connections | uploaded MiB | ping p50 ms | ping p99 ms | ping max ms\n";
+
+    int port = base_port;
+    for (const bool multiplexed : {false, true})
+    {
+        auto* console = std::cout.rdbuf(nullptr);
+        auto* errors = std::cerr.rdbuf(nullptr);
+
+        ServerManager server(port, port + 1, "127.0.0.1");
+        DisableRateLimits(server);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        boost::asio::io_context io;
+        const auto address = boost::asio::ip::make_address_v4("127.0.0.1");
+        tcp::socket listener(io);
+        listener.connect({address, static_cast<unsigned short>(port)});
+        auto pinger = std::make_shared<tcp::socket>(io);
+        pinger->connect({address, static_cast<unsigned short>(port)});
+        tcp::socket file_socket(io);
+        if (!multiplexed) file_socket.connect({address, static_cast<unsigned short>(port + 1)});
+        const std::size_t expected = multiplexed ? 2 : 3;
+        while (server.GetConnectionCount() < expected) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        // The pinger's own writes: one thread on a file socket, or its text socket's bulk lane
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> uploaded{0};
+        std::shared_ptr<OutboundQueue> outbound;
+        OutboundQueue::BulkDone next = [&](const boost::system::error_code& ec)
+        {
+            if (ec || stop.load()) return;
+            uploaded += file_frame->size();
+            outbound->SendBulk(file_frame, next);
+        };
+        std::thread upload_thread;
+        if (multiplexed)
+        {
+            OutboundQueue::Limits limits;
+            limits.max_bytes = 1ull << 32;
+            limits.max_frames = 1ull << 24;
+            outbound = std::make_shared<OutboundQueue>(pinger, limits, nullptr);
+            outbound->SendBulk(file_frame, next);
+            upload_thread = std::thread([&io]() { io.run(); });
+        }
+        else
+        {
+            upload_thread = std::thread([&]()
+            {
+                boost::system::error_code ec;
+                while (!ec && !stop.load())
+                {
+                    boost::asio::write(file_socket, boost::asio::buffer(*file_frame), ec);
+                    if (!ec) uploaded += file_frame->size();
+                }
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        std::vector<double> latencies;
+        latencies.reserve(pings);
+        for (std::size_t i = 0; i < pings; ++i)
+        {
+            const std::string marker = "ping " + std::to_string(i);
+            const auto start = Clock::now();
+            auto frame = std::make_shared<const std::vector<char>>(TextMessage(marker).serialize());
+            if (multiplexed) outbound->Send(std::move(frame));
+            else boost::asio::write(*pinger, boost::asio::buffer(*frame));
+            ReadUntilMarker(listener, marker);
+            latencies.push_back(SecondsSince(start) * 1000.0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+
+        stop = true;
+        boost::system::error_code ec;
+        if (!multiplexed) file_socket.shutdown(tcp::socket::shutdown_both, ec);
+        server.StopServer();
+        server_thread.join();
+        upload_thread.join();
+        pinger->close(ec);
+        listener.close(ec);
+        file_socket.close(ec);
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        std::cerr.clear();
+        std::cerr.rdbuf(errors);
+        std::cout << (multiplexed ? "multiplexed" : "file port") << " | " << expected - 1 << " | "
+                  << uploaded.load() / (1024 * 1024) << " | " << Percentile(latencies, 0.50) << " | "
+                  << Percentile(latencies, 0.99) << " | " << *std::max_element(latencies.begin(), latencies.end())
+                  << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 9: compact frame headers
+// args: [iterations=10000000] [listeners=20] [messages=2000] [port=8300]
+// 1. encode/decode cost of the legacy and the compact header
+// 2. bytes a room's listeners receive for a chat trace, legacy vs compact headers
+// =====================================================================
+// Chat lines as people type them: mostly short, a long tail (median about 25 characters)
+static std::vector<std::string> ChatTrace(std::size_t messages)
+{
+    std::mt19937 rng(42);
+    std::lognormal_distribution<double> length(3.2, 0.8);
+    std::vector<std::string> trace;
+    trace.reserve(messages);
+    for (std::size_t i = 0; i < messages; ++i)
+    {
+        const auto chars = std::clamp<std::size_t>(static_cast<std::size_t>(length(rng)), 1, 400);
+        trace.emplace_back(chars, static_cast<char>('a' + i % 26));
+    }
+    return trace;
+}
+
+// Reads frames of either header until the one whose text ends with `marker`
+// returns the bytes read and how many of them were headers
+static std::pair<std::size_t, std::size_t> ReadBytesUntilMarker(boost::asio::ip::tcp::socket& socket,
+                                                                const std::string& marker)
+{
+    using Utils::FrameHeader;
+    std::vector<char> buffer;
+    std::size_t parsed = 0;
+    std::size_t header_bytes = 0;
+    std::vector<char> chunk(64 * 1024);
+    for (;;)
+    {
+        FrameHeader::Parsed header;
+        const auto result = FrameHeader::decode(buffer.data() + parsed, buffer.size() - parsed, header);
+        if (result == FrameHeader::Result::Ok && buffer.size() - parsed >= header.header_size + header.body_length)
+        {
+            const std::string_view body(buffer.data() + parsed + header.header_size, header.body_length);
+            parsed += header.header_size + header.body_length;
+            header_bytes += header.header_size;
+            if (body.size() >= marker.size() && body.substr(body.size() - marker.size()) == marker)
+                return {parsed, header_bytes};
+            continue;
+        }
+        if (result == FrameHeader::Result::Invalid) return {parsed, header_bytes};
+        const std::size_t n = socket.read_some(boost::asio::buffer(chunk));
+        buffer.insert(buffer.end(), chunk.begin(), chunk.begin() + n);
+    }
+}
+
+static void BenchFrameHeader(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    using Utils::FrameHeader;
+    const std::size_t iterations = ArgOr(args, 0, 10000000);
+    const std::size_t listeners = ArgOr(args, 1, 20);
+    const std::size_t messages = ArgOr(args, 2, 2000);
+    const int base_port = static_cast<int>(ArgOr(args, 3, 8300));
+
+    const auto trace = ChatTrace(std::max<std::size_t>(messages, 1));
+    {
+        // headers of the trace's frame lengths, encoded into and decoded from a ring of slots
+        constexpr std::size_t slots = 4096;
+        std::vector<uint64_t> lengths(slots);
+        for (std::size_t i = 0; i < slots; ++i) lengths[i] = trace[i % trace.size()].size() + 40;
+        std::vector<char> legacy(slots * FrameHeader::LEGACY_SIZE);
+        std::vector<char> compact(slots * FrameHeader::COMPACT_MAX_SIZE);
+        uint64_t sink = 0;
+
+        auto time_ns = [&](auto&& body)
+        {
+            const auto start = Clock::now();
+            for (std::size_t i = 0; i < iterations; ++i) body(i % slots);
+            return SecondsSince(start) * 1e9 / static_cast<double>(iterations);
+        };
+        const double legacy_encode = time_ns([&](std::size_t slot)
+        {
+            FrameHeader::encode_legacy(3, lengths[slot], legacy.data() + slot * FrameHeader::LEGACY_SIZE);
+        });
+        const double compact_encode = time_ns([&](std::size_t slot)
+        {
+            sink += FrameHeader::encode_compact(3, lengths[slot], compact.data() + slot * FrameHeader::COMPACT_MAX_SIZE);
+        });
+        const double legacy_decode = time_ns([&](std::size_t slot)
+        {
+            FrameHeader::Parsed parsed;
+            FrameHeader::decode(legacy.data() + slot * FrameHeader::LEGACY_SIZE, FrameHeader::LEGACY_SIZE, parsed);
+            sink += parsed.body_length;
+        });
+        const double compact_decode = time_ns([&](std::size_t slot)
+        {
+            FrameHeader::Parsed parsed;
+            FrameHeader::decode(compact.data() + slot * FrameHeader::COMPACT_MAX_SIZE, FrameHeader::COMPACT_MAX_SIZE,
+                                parsed);
+            sink += parsed.body_length;
+        });
+        std::cout << "codec (" << iterations << " headers, ns/header) | legacy encode " << legacy_encode
+                  << " decode " << legacy_decode << " | compact encode " << compact_encode << " decode "
+                  << compact_decode << " | checksum " << sink % 10 << "\n";
+    }
+
+    std::size_t text_bytes = 0;
+    for (std::size_t i = 0; i < messages; ++i) text_bytes += trace[i].size();
+    std::cout << messages << " chat lines (" << static_cast<double>(text_bytes) / static_cast<double>(messages)
+              << " characters on average) to " << listeners << " listeners\n"
+              << "headers | bytes per listener | bytes per message | header share\n";
+
+    int port = base_port;
+    double legacy_bytes = 0.0;
+    for (const bool compact : {false, true})
+    {
+        auto* console = std::cout.rdbuf(nullptr);
+        ServerManager server(port, port + 1, "127.0.0.1");
+        DisableRateLimits(server);
+        std::thread server_thread([&server]() { server.StartServer(); });
+        while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        boost::asio::io_context io;
+        const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), static_cast<unsigned short>(port));
+        std::vector<std::unique_ptr<tcp::socket>> room;
+        for (std::size_t i = 0; i < listeners; ++i)
+        {
+            room.push_back(std::make_unique<tcp::socket>(io));
+            room.back()->connect(endpoint);
+            // a listener that agrees on compact headers, or one that never says hello
+            if (compact)
+                boost::asio::write(*room.back(), boost::asio::buffer(HelloMessage(
+                    ConnectionProtocol::VERSION, ConnectionProtocol::COMPACT_HEADERS, 0,
+                    {ConnectionProtocol::Codec::Identity}).serialize()));
+        }
+        tcp::socket sender(io);
+        sender.connect(endpoint);
+        while (server.GetConnectionCount() < listeners + 1) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+
+        const std::string marker = "end of trace";
+        for (std::size_t i = 0; i < messages; ++i)
+            boost::asio::write(sender, boost::asio::buffer(TextMessage(trace[i]).serialize()));
+        boost::asio::write(sender, boost::asio::buffer(TextMessage(marker).serialize()));
+
+        std::size_t received = 0;
+        std::size_t headers = 0;
+        for (auto& listener : room)
+        {
+            const auto [bytes, header_bytes] = ReadBytesUntilMarker(*listener, marker);
+            received += bytes;
+            headers += header_bytes;
+        }
+        server.StopServer();
+        server_thread.join();
+
+        std::cout.clear();
+        std::cout.rdbuf(console);
+        const double per_listener = static_cast<double>(received) / static_cast<double>(std::max<std::size_t>(listeners, 1));
+        const double per_message = per_listener / static_cast<double>(messages + 1);
+        if (!compact) legacy_bytes = per_listener;
+        std::cout << (compact ? "compact" : "legacy") << " | " << per_listener << " | " << per_message << " | "
+                  << static_cast<double>(headers) / static_cast<double>(std::max<std::size_t>(received, 1)) * 100.0
+                  << "%";
+        if (compact && legacy_bytes > 0.0) std::cout << " | " << (1.0 - per_listener / legacy_bytes) * 100.0 << "% fewer bytes";
+        std::cout << "\n";
+        port += 2;
+    }
+}
+
+// =====================================================================
+// BENCHMARK 10: per-message dispatch cost of the receiver
+// args: [messages=2000000]
+// Frames of a chat trace (texts, sequenced texts, one heartbeat in 16) are decoded and handed to
+// their handler. "factory" is the former path: a switch creating a unique_ptr, its conversion to
+// shared_ptr, a handler map lookup and a dynamic_pointer_cast in the handler. "registry" is
+// MessageReceiver::dispatch with typed handlers.
+// =====================================================================
+static std::unique_ptr<IMessage> CreateBySwitch(TextTypes id)
+{
+    switch (id)
+    {
+    case TextTypes::Text:
+    case TextTypes::SequencedText:
+        return std::make_unique<TextMessage>();
+    case TextTypes::Heartbeat:
+        return std::make_unique<HeartbeatMessage>();
+    default:
+        throw std::runtime_error("Unknown message type ID");
+    }
+}
+
+static void BenchDispatch(const std::vector<std::string>& args)
+{
+    const std::size_t messages = std::max<std::size_t>(ArgOr(args, 0, 2000000), 1);
+
+    const auto trace = ChatTrace(4096);
+    std::vector<std::vector<char>> frames;
+    frames.reserve(trace.size());
+    for (std::size_t i = 0; i < trace.size(); ++i)
+    {
+        if (i % 16 == 15) frames.push_back(HeartbeatMessage(HeartbeatMessage::Kind::Ping).serialize());
+        else if (i % 2 == 0) frames.push_back(TextMessage(trace[i]).serialize());
+        else frames.push_back(TextMessage(trace[i], i).serialize());
+    }
+    uint64_t sink = 0;
+
+    using Callback = std::function<void(std::shared_ptr<boost::asio::ip::tcp::socket>, std::shared_ptr<IMessage>)>;
+    std::unordered_map<TextTypes, Callback> handlers;
+    auto on_text = [&sink](std::shared_ptr<boost::asio::ip::tcp::socket>, std::shared_ptr<IMessage> msg)
+    {
+        if (auto text = std::dynamic_pointer_cast<TextMessage>(msg)) sink += text->get_text().size();
+    };
+    handlers[TextTypes::Text] = on_text;
+    handlers[TextTypes::SequencedText] = on_text;
+    handlers[TextTypes::Heartbeat] = [&sink](std::shared_ptr<boost::asio::ip::tcp::socket>, std::shared_ptr<IMessage> msg)
+    {
+        if (auto heartbeat = std::dynamic_pointer_cast<HeartbeatMessage>(msg)) sink += static_cast<uint64_t>(heartbeat->get_kind());
+    };
+
+    MessageReceiver receiver;
+    auto on_typed_text = [&sink](const auto&, std::shared_ptr<TextMessage> text) { sink += text->get_text().size(); };
+    receiver.register_handler<TextTypes::Text>(on_typed_text);
+    receiver.register_handler<TextTypes::SequencedText>(on_typed_text);
+    receiver.register_handler<TextTypes::Heartbeat>([&sink](const auto&, std::shared_ptr<HeartbeatMessage> heartbeat)
+    {
+        sink += static_cast<uint64_t>(heartbeat->get_kind());
+    });
+
+    const std::shared_ptr<boost::asio::ip::tcp::socket> sender;
+    auto time_ns = [&](auto&& dispatch)
+    {
+        const auto start = Clock::now();
+        for (std::size_t i = 0; i < messages; ++i) dispatch(frames[i % frames.size()]);
+        return SecondsSince(start) * 1e9 / static_cast<double>(messages);
+    };
+    const double factory = time_ns([&](const std::vector<char>& frame)
+    {
+        uint32_t id = 0;
+        Utils::HeaderHelper::read_u32(frame, 0, id);
+        const auto type = static_cast<TextTypes>(id);
+        std::unique_ptr<IMessage> message = CreateBySwitch(type);
+        message->deserialize(frame);
+        auto it = handlers.find(type);
+        if (it == handlers.end()) return;
+        std::shared_ptr<IMessage> shared(message.release());
+        it->second(sender, shared);
+    });
+    const double registry = time_ns([&](const std::vector<char>& frame) { receiver.dispatch(sender, frame); });
+
+    std::cout << messages << " frames (" << frames.size() << " distinct) | ns/message\n";
+    std::cout << "factory | " << factory << "\n";
+    std::cout << "registry | " << registry << " | " << (1.0 - registry / factory) * 100.0 << "% less"
+              << " | checksum " << sink % 10 << "\n";
+}
+
+// =====================================================================
+// BENCHMARK 11: frame encoding, fixed-layout writer against field-by-field appends and memcpy
+// args: [iterations=5000000]
+// 1. a 12-byte header plus two fields (the FileChunk layout): appended with vector::insert per
+//    field (the former HeaderHelper), written by HeaderHelper::Writer, memcpy of the same bytes
+// 2. whole frames, each into a new vector: serialize() of a chat line and of a 64 KiB chunk,
+//    the former append path, and a copy of the already encoded frame (allocation + memcpy)
+// =====================================================================
+static void AppendByInsert(std::vector<char>& buffer, const void* field, std::size_t size)
+{
+    const char* bytes = static_cast<const char*>(field);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+static std::vector<char> SerializeByInsert(uint32_t id, uint64_t sequence, std::string_view text)
+{
+    const uint64_t length = sizeof(sequence) + text.size();
+    std::vector<char> buffer;
+    buffer.reserve(Utils::HeaderHelper::HEADER_SIZE + length);
+    const uint32_t net_id = htonl(id);
+    const uint64_t net_length = __builtin_bswap64(length);
+    const uint64_t net_sequence = __builtin_bswap64(sequence);
+    AppendByInsert(buffer, &net_id, sizeof(net_id));
+    AppendByInsert(buffer, &net_length, sizeof(net_length));
+    AppendByInsert(buffer, &net_sequence, sizeof(net_sequence));
+    buffer.insert(buffer.end(), text.begin(), text.end());
+    return buffer;
+}
+
+static void BenchHeaderCodec(const std::vector<std::string>& args)
+{
+    const std::size_t iterations = std::max<std::size_t>(ArgOr(args, 0, 5000000), 1);
+    constexpr std::size_t layout = FileChunkMessage::HEADER_SIZE;
+    uint64_t sink = 0;
+
+    auto time_ns = [&](std::size_t count, auto&& body)
+    {
+        const auto start = Clock::now();
+        for (std::size_t i = 0; i < count; ++i) body(i);
+        return SecondsSince(start) * 1e9 / static_cast<double>(count);
+    };
+
+    {
+        std::vector<char> appended;
+        appended.reserve(layout);
+        const double insert = time_ns(iterations, [&](std::size_t i)
+        {
+            appended.clear();
+            const uint32_t id = htonl(8);
+            const uint64_t length = __builtin_bswap64(12 + i);
+            const uint64_t channel = __builtin_bswap64(i);
+            const uint32_t flags = htonl(static_cast<uint32_t>(i & 1));
+            AppendByInsert(appended, &id, sizeof(id));
+            AppendByInsert(appended, &length, sizeof(length));
+            AppendByInsert(appended, &channel, sizeof(channel));
+            AppendByInsert(appended, &flags, sizeof(flags));
+            sink += static_cast<uint8_t>(appended[11]);
+        });
+        char out[layout];
+        const double writer = time_ns(iterations, [&](std::size_t i)
+        {
+            Utils::HeaderHelper::Writer(out).header(8, 12 + i).u64(i).u32(static_cast<uint32_t>(i & 1));
+            sink += static_cast<uint8_t>(out[11]);
+        });
+        const auto encoded = FileChunkMessage::encode_header(1, false, 0);
+        const double copy = time_ns(iterations, [&](std::size_t i)
+        {
+            std::memcpy(out, encoded.data(), layout);
+            out[11] = static_cast<char>(i);
+            sink += static_cast<uint8_t>(out[11]);
+        });
+        std::cout << "header + 2 fields (" << layout << " bytes, ns) | insert per field " << insert << " | writer "
+                  << writer << " | memcpy " << copy << "\n";
+    }
+
+    const std::string line = ChatLine(7);
+    const TextMessage text(line, 42);
+    const auto text_frame = text.serialize();
+    const FileChunkMessage chunk(3, false, std::vector<char>(64 * 1024, 'x'));
+    const auto chunk_frame = chunk.serialize();
+    const std::size_t chunk_iterations = std::max<std::size_t>(iterations / 100, 1);
+
+    const double text_insert = time_ns(iterations, [&](std::size_t)
+    {
+        sink += SerializeByInsert(static_cast<uint32_t>(TextTypes::SequencedText), 42, line).size();
+    });
+    const double text_writer = time_ns(iterations, [&](std::size_t) { sink += text.serialize().size(); });
+    const double text_copy = time_ns(iterations, [&](std::size_t)
+    {
+        sink += std::vector<char>(text_frame.begin(), text_frame.end()).size();
+    });
+    const double chunk_writer = time_ns(chunk_iterations, [&](std::size_t) { sink += chunk.serialize().size(); });
+    const double chunk_copy = time_ns(chunk_iterations, [&](std::size_t)
+    {
+        sink += std::vector<char>(chunk_frame.begin(), chunk_frame.end()).size();
+    });
+
+    std::cout << "frame | bytes | former appends ns | serialize ns | copy of encoded frame ns\n";
+    std::cout << "chat line | " << text_frame.size() << " | " << text_insert << " | " << text_writer << " | "
+              << text_copy << "\n";
+    std::cout << "64 KiB chunk | " << chunk_frame.size() << " | - | " << chunk_writer << " | " << chunk_copy << "\n";
+    std::cout << "checksum " << sink % 10 << "\n";
+}
+
+// =====================================================================
+// BENCHMARK 12: batched chat, frames and writes per recipient against the batching window
+// args: [members=20] [messages=20000] [rate=20000]
+// A room publishes `messages` lines at `rate` per second from 4 of its members to loopback members
+// that agreed to batches. Member 0 never sends and decodes everything it gets, for the latency from
+// publish to receipt.
+// =====================================================================
+struct BatchingPeer
+{
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    std::array<char, 64 * 1024> buffer{};
+    std::vector<char> pending;
+    uint64_t frames = 0;
+    uint64_t lines = 0;
+};
+
+static void BenchChatBatching(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t member_count = std::max<std::size_t>(ArgOr(args, 0, 20), 5);
+    const std::size_t messages = std::max<std::size_t>(ArgOr(args, 1, 20000), 1);
+    const double rate = static_cast<double>(std::max<uint64_t>(ArgOr(args, 2, 20000), 1));
+    constexpr std::size_t SENDERS = 4;
+
+    std::cout << member_count << " batched members, " << messages << " lines at " << rate
+              << "/s from " << SENDERS << " members\n"
+              << "window us | frames per recipient | writes per recipient | lines per frame | latency p50 / p99 us\n";
+
+    for (const auto window : {std::chrono::microseconds(0), std::chrono::microseconds(250),
+                              std::chrono::microseconds(1000), std::chrono::microseconds(5000)})
+    {
+        boost::asio::io_context io;
+        auto guard = boost::asio::make_work_guard(io);
+        FanOut fan_out(io, FanOut::Options{});
+        Room::Options options;
+        options.batch_window = window;
+        Room room("bench", io, fan_out, options);
+
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+        auto protocol = std::make_shared<ConnectionProtocol>();
+        protocol->version = ConnectionProtocol::VERSION;
+        protocol->features = ConnectionProtocol::BATCHED_TEXT;
+        std::vector<std::shared_ptr<tcp::socket>> members;
+        std::vector<std::shared_ptr<OutboundQueue>> queues;
+        std::vector<std::unique_ptr<BatchingPeer>> peers;
+        for (std::size_t i = 0; i < member_count; ++i)
+        {
+            auto peer = std::make_unique<BatchingPeer>();
+            peer->socket = std::make_shared<tcp::socket>(io);
+            peer->socket->connect(acceptor.local_endpoint());
+            auto accepted = std::make_shared<tcp::socket>(io);
+            acceptor.accept(*accepted);
+            accepted->set_option(tcp::no_delay(true));  // the window alone decides when lines leave
+            queues.push_back(std::make_shared<OutboundQueue>(accepted, OutboundQueue::Limits{}, nullptr));
+            room.Join(accepted, queues.back(), nullptr, false, true, protocol);
+            members.push_back(std::move(accepted));
+            peers.push_back(std::move(peer));
+        }
+
+        // publish time of every sequence number, in ns since `origin`
+        const auto origin = Clock::now();
+        std::vector<std::atomic<int64_t>> published(messages + 1);
+        std::vector<double> latencies;
+        latencies.reserve(messages);
+        std::atomic<uint64_t> observed{0};
+
+        std::function<void(BatchingPeer&, bool)> read = [&](BatchingPeer& peer, bool observer)
+        {
+            peer.socket->async_read_some(boost::asio::buffer(peer.buffer),
+                [&, observer, p = &peer](const boost::system::error_code& ec, std::size_t n)
+                {
+                    if (ec) return;
+                    const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count();
+                    p->pending.insert(p->pending.end(), p->buffer.data(), p->buffer.data() + n);
+                    std::size_t offset = 0;
+                    uint64_t length = 0;
+                    while (p->pending.size() - offset >= Utils::HeaderHelper::HEADER_SIZE &&
+                           (length = Utils::HeaderHelper::load_u64(p->pending.data() + offset + 4),
+                            p->pending.size() - offset >= Utils::HeaderHelper::HEADER_SIZE + length))
+                    {
+                        const std::size_t frame_size = Utils::HeaderHelper::HEADER_SIZE + length;
+                        ++p->frames;
+                        if (observer)
+                        {
+                            std::vector<char> frame(p->pending.begin() + offset, p->pending.begin() + offset + frame_size);
+                            std::vector<uint64_t> sequences;
+                            if (Utils::HeaderHelper::load_u32(frame.data()) == static_cast<uint32_t>(TextTypes::TextBatch))
+                            {
+                                TextBatchMessage batch;
+                                batch.deserialize(frame);
+                                for (const auto& record : batch.get_records()) sequences.push_back(record.sequence);
+                            }
+                            else
+                            {
+                                TextMessage text;
+                                text.deserialize(frame);
+                                sequences.push_back(text.get_sequence());
+                            }
+                            for (const uint64_t sequence : sequences)
+                            {
+                                latencies.push_back(static_cast<double>(now - published[sequence].load()) / 1000.0);
+                                ++p->lines;
+                            }
+                            observed.store(p->lines, std::memory_order_release);
+                        }
+                        offset += frame_size;
+                    }
+                    p->pending.erase(p->pending.begin(), p->pending.begin() + static_cast<long>(offset));
+                    read(*p, observer);
+                });
+        };
+        for (std::size_t i = 0; i < peers.size(); ++i) read(*peers[i], i == 0);
+        std::thread io_thread([&io]() { io.run(); });
+
+        const std::string line = ChatLine(3);
+        const std::string prefix = "[TEXT] From 127.0.0.1:50000: ";
+        for (std::size_t i = 0; i < messages; ++i)
+        {
+            const auto due = origin + std::chrono::duration_cast<Clock::duration>(
+                std::chrono::duration<double>(static_cast<double>(i) / rate));
+            if (Clock::now() < due) std::this_thread::sleep_until(due);
+            const auto sender = members[1 + i % SENDERS];
+            boost::asio::post(room.GetStrand(), [&room, &published, &origin, &line, &prefix, sender, i]()
+            {
+                published[i + 1].store(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - origin).count());
+                room.PublishText(sender, prefix, line);
+            });
+        }
+
+        const auto give_up = Clock::now() + std::chrono::seconds(10);
+        while (observed.load(std::memory_order_acquire) < messages && Clock::now() < give_up)
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+        uint64_t writes = 0;
+        uint64_t frames = 0;
+        for (const auto& queue : queues) writes += queue->GetWriteCount();
+        for (const auto& peer : peers) frames += peer->frames;
+        guard.reset();
+        io.stop();
+        io_thread.join();
+
+        const double recipients = static_cast<double>(member_count);
+        std::cout << window.count() << " | " << static_cast<double>(frames) / recipients << " | "
+                  << static_cast<double>(writes) / recipients << " | "
+                  << static_cast<double>(peers[0]->lines) / static_cast<double>(std::max<uint64_t>(peers[0]->frames, 1))
+                  << " | " << Percentile(latencies, 0.5) << " / " << Percentile(latencies, 0.99) << "\n";
+    }
+}
+
+// =====================================================================
+// BENCHMARK 13: heap allocations per broadcast chat line
+// args: [messages=100000]
+// A received frame is decoded and re-encoded with the sender's prefix, for a short chat line and a
+// 1 KiB one:
+// 1. baseline: text in a vector, "[TEXT] From " + sender + ": " + text concatenated into a new message
+// 2. vector storage: the same message class, encoded from the cached prefix (serialize_prefixed)
+// 3. inline storage: TextMessage as decoded by the receiver, then serialize_prefixed
+// 4. 3. plus Room::PublishText on the room's strand (history ring, sequence numbers, fan-out call)
+// =====================================================================
+struct VectorText
+{
+    std::vector<char> text;
+    uint64_t sequence = 0;
+};
+
+static void BenchBroadcastAllocations(const std::vector<std::string>& args)
+{
+    const std::size_t messages = std::max<std::size_t>(ArgOr(args, 0, 100000), 1);
+    const std::string sender_info = "192.168.1.17:51234";
+    const std::string prefix = "[TEXT] From " + sender_info + ": ";
+    constexpr std::size_t BODY = Utils::HeaderHelper::HEADER_SIZE;
+    uint64_t sink = 0;
+
+    auto per_message = [&](auto&& body)
+    {
+        const uint64_t before = thread_allocations;
+        for (std::size_t i = 0; i < messages; ++i) body(i);
+        return static_cast<double>(thread_allocations - before) / static_cast<double>(messages);
+    };
+
+    std::cout << "text bytes | baseline | vector storage | inline storage | inline + Room::PublishText\n";
+    for (const std::size_t size : {std::size_t{40}, std::size_t{1024}})
+    {
+        const auto received = TextMessage(std::string(size, 'x')).serialize();
+
+        const double baseline = per_message([&](std::size_t i)
+        {
+            auto message = std::make_shared<VectorText>();
+            message->text.assign(received.begin() + BODY, received.end());
+            const std::string text(message->text.data(), message->text.size());
+            const std::string line = "[TEXT] From " + sender_info + ": " + text;
+            auto numbered = std::make_shared<VectorText>(VectorText{{line.begin(), line.end()}, i + 1});
+            auto frame = std::make_shared<const std::vector<char>>(SerializeByInsert(
+                static_cast<uint32_t>(TextTypes::SequencedText), numbered->sequence,
+                {numbered->text.data(), numbered->text.size()}));
+            sink += frame->size();
+        });
+        const double vector_storage = per_message([&](std::size_t i)
+        {
+            auto message = std::make_shared<VectorText>();
+            message->text.assign(received.begin() + BODY, received.end());
+            auto frame = std::make_shared<const std::vector<char>>(TextMessage::serialize_prefixed(
+                prefix, {message->text.data(), message->text.size()}, i + 1));
+            sink += frame->size();
+        });
+        const auto decode = Utils::MessageRegistry::lookup(static_cast<uint32_t>(TextTypes::Text)).decode;
+        const double inline_storage = per_message([&](std::size_t i)
+        {
+            const auto message = std::static_pointer_cast<TextMessage>(decode(received));
+            auto frame = std::make_shared<const std::vector<char>>(
+                TextMessage::serialize_prefixed(prefix, message->get_text(), i + 1));
+            sink += frame->size();
+        });
+
+        boost::asio::io_context io;
+        auto guard = boost::asio::make_work_guard(io);
+        FanOut fan_out(io, FanOut::Options{});
+        Room room("bench", io, fan_out, Room::Options{});
+        const double published = per_message([&](std::size_t)
+        {
+            std::shared_ptr<const TextMessage> message = std::static_pointer_cast<TextMessage>(decode(received));
+            boost::asio::post(room.GetStrand(), [&room, &prefix, message]()
+            {
+                room.PublishText(nullptr, prefix, message->get_text());
+            });
+            io.poll();
+        });
+        sink += room.GetLastSequence();
+
+        std::cout << size << " | " << baseline << " | " << vector_storage << " | " << inline_storage << " | "
+                  << published << "\n";
+    }
+    std::cout << "checksum " << sink % 10 << "\n";
+}
+
+// =====================================================================
+// BENCHMARK 14: inbound text check, vector kernels against the scalar byte loop
+// args: [megabytes=256]
+// GB/s of TextSanitizer::is_clean over chat lines of three kinds, as 64 KiB buffers and as single
+// 80-byte lines (the size of most chat messages, where call overhead and the tail count)
+// =====================================================================
+static void BenchTextSanitizer(const std::vector<std::string>& args)
+{
+    using Sanitizer = Utils::TextSanitizer;
+    const double bytes_total = static_cast<double>(std::max<uint64_t>(ArgOr(args, 0, 256), 1)) * 1024 * 1024;
+    const std::vector<std::pair<const char*, std::string>> samples = {
+        {"ascii", "see you at lunch, the build is green again "},
+        {"polish", "Zażółć gęślą jaźń, widzimy się o dwunastej "},
+        {"cjk", "\xE4\xBB\x8A\xE5\xA4\xA9\xE7\x9A\x84\xE6\x9E\x84\xE5\xBB\xBA\xE9\x80\x9A\xE8\xBF\x87\xE4\xBA\x86 "},
+    };
+    const std::vector<std::pair<const char*, Sanitizer::Kernel>> kernels = {
+        {"scalar", Sanitizer::Kernel::Scalar}, {"sse2", Sanitizer::Kernel::Sse2}, {"avx2", Sanitizer::Kernel::Avx2}};
+    uint64_t sink = 0;
+
+    std::cout << "text | size | scalar GB/s | sse2 GB/s | avx2 GB/s\n";
+    for (const auto& [label, sample] : samples)
+    {
+        for (const std::size_t size : {std::size_t{64 * 1024}, std::size_t{80}})
+        {
+            std::string text;
+            while (text.size() < size) text += sample;
+            // cut at a character boundary at or below `size`
+            std::size_t cut = std::min(size, text.size());
+            while (cut > 0 && (static_cast<uint8_t>(text[cut]) & 0xC0) == 0x80) --cut;
+            text.resize(cut);
+
+            std::cout << label << " | " << text.size();
+            for (const auto& [name, kernel] : kernels)
+            {
+                if (!Sanitizer::supported(kernel))
+                {
+                    std::cout << " | -";
+                    continue;
+                }
+                const std::size_t rounds = std::max<std::size_t>(
+                    static_cast<std::size_t>(bytes_total / static_cast<double>(text.size())), 1);
+                const auto start = Clock::now();
+                for (std::size_t i = 0; i < rounds; ++i) sink += Sanitizer::is_clean(text, kernel);
+                std::cout << " | " << static_cast<double>(rounds * text.size()) / SecondsSince(start) / 1e9;
+            }
+            std::cout << "\n";
+        }
+    }
+    std::cout << "checksum " << sink % 10 << "\n";
+}
+
+// =====================================================================
+// BENCHMARK 15: connection loops, coroutines against callback chains
+// args: [connections=8] [messages=400000] [window=16]
+// Clients on one thread send chat frames over loopback, `window` per socket at a time, and read them back.
+// The server side is MessageReceiver, a handler that echoes each text, and an OutboundQueue per socket, all
+// on one io thread. Reported: heap allocations on the io thread per echoed message (steady state, the
+// decoded message and the echoed frame included), the asynchronous operations served by HandlerMemory
+// and how many of them needed the heap, and messages per second. The loops are built as coroutines or
+// callback chains by CHAT_USE_COROUTINES, so run this from both builds.
+// =====================================================================
+static void BenchConnectionLoops(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t connections = std::max<std::size_t>(ArgOr(args, 0, 8), 1);
+    const std::size_t messages = std::max<std::size_t>(ArgOr(args, 1, 400000), 1);
+    const std::size_t window = std::max<std::size_t>(ArgOr(args, 2, 16), 1);
+    const std::size_t rounds = std::max<std::size_t>(messages / (connections * window), 8);
+    const std::size_t total = rounds * connections * window;
+    const std::size_t warmup = 4 * connections * window;  // the first rounds set up buffers and caches
+
+#ifdef CHAT_USE_COROUTINES
+    std::cout << "loops: coroutines\n";
+#else
+    std::cout << "loops: callbacks\n";
+#endif
+
+    boost::asio::io_context io;
+    boost::asio::io_context client_io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+    std::vector<tcp::socket> clients;
+    std::vector<std::shared_ptr<OutboundQueue>> queues;
+    std::unordered_map<tcp::socket*, OutboundQueue*> queue_of;
+    OutboundQueue::Limits limits;
+    limits.max_frames = 4 * window;
+    for (std::size_t i = 0; i < connections; ++i)
+    {
+        clients.emplace_back(client_io);
+        clients.back().connect(acceptor.local_endpoint());
+        clients.back().set_option(tcp::no_delay(true));
+        auto server_socket = std::make_shared<tcp::socket>(io);
+        acceptor.accept(*server_socket);
+        server_socket->set_option(tcp::no_delay(true));
+        queues.push_back(std::make_shared<OutboundQueue>(server_socket, limits, nullptr));
+        queue_of[server_socket.get()] = queues.back().get();
+    }
+
+    std::size_t echoed = 0;
+    uint64_t allocations_before = 0;
+    uint64_t allocations_after = 0;
+    Utils::HandlerMemory::Stats handlers_before;
+    Utils::HandlerMemory::Stats handlers_after;
+    Clock::time_point steady_start;
+    double seconds = 0;
+    MessageReceiver receiver;
+    receiver.register_handler<TextTypes::Text>([&](const std::shared_ptr<tcp::socket>& sender,
+                                                   std::shared_ptr<TextMessage> message)
+    {
+        queue_of[sender.get()]->Send(std::make_shared<const std::vector<char>>(message->serialize()));
+        if (++echoed == warmup)
+        {
+            allocations_before = thread_allocations;
+            handlers_before = Utils::HandlerMemory::stats();
+            steady_start = Clock::now();
+        }
+        else if (echoed == total)
+        {
+            allocations_after = thread_allocations;
+            handlers_after = Utils::HandlerMemory::stats();
+            seconds = SecondsSince(steady_start);
+        }
+    });
+    for (const auto& queue : queues) receiver.start_read_header(queue->GetSocket());
+
+    std::thread io_thread([&io]() { io.run(); });
+
+    const std::vector<char> frame = TextMessage(ChatLine(42)).serialize();
+    std::vector<char> burst;
+    for (std::size_t i = 0; i < window; ++i) burst.insert(burst.end(), frame.begin(), frame.end());
+    std::vector<char> echoes(burst.size());
+    for (std::size_t round = 0; round < rounds; ++round)
+    {
+        for (auto& client : clients) boost::asio::write(client, boost::asio::buffer(burst));
+        for (auto& client : clients) boost::asio::read(client, boost::asio::buffer(echoes));
+    }
+
+    for (const auto& queue : queues)
+    {
+        boost::system::error_code ec;
+        queue->GetSocket()->shutdown(tcp::socket::shutdown_both, ec);
+    }
+    io_thread.join();
+
+    const std::size_t steady = total - warmup;
+    std::cout << "connections " << connections << ", window " << window << ", messages " << steady << "\n";
+    std::cout << "allocations per message (io thread): "
+              << static_cast<double>(allocations_after - allocations_before) / static_cast<double>(steady) << "\n";
+    std::cout << "recycled handler operations per message: "
+              << static_cast<double>(handlers_after.allocations - handlers_before.allocations) / static_cast<double>(steady)
+              << ", taken from the heap: " << handlers_after.heap_allocations - handlers_before.heap_allocations << "\n";
+    std::cout << "messages/s: " << static_cast<double>(steady) / seconds << "\n";
+}
+
+// =====================================================================
+// BENCHMARK 16: resident memory of idle connections
+// args: [clients=4000] [with_file=1] [port=8400]
+// Clients connect to the text port (and, like the real client, to the file port) and stay silent.
+// Reported: growth of the server process's resident set and of its heap in use per idle client, measured
+// after one client has already set up the default room. Client sockets are plain descriptors and add
+// nothing to either.
+// =====================================================================
+static int ConnectRaw(int port)
+{
+    const int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || ::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0)
+    {
+        if (fd >= 0) ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void BenchIdleConnections(const std::vector<std::string>& args)
+{
+    const std::size_t clients = ArgOr(args, 0, 4000);
+    const bool with_file = ArgOr(args, 1, 1) != 0;
+    const int port = static_cast<int>(ArgOr(args, 2, 8400));
+
+    auto* console = std::cout.rdbuf(nullptr);
+    ServerManager server(port, port + 1, "127.0.0.1");
+    std::thread server_thread([&server]() { server.StartServer(); });
+    while (!server.GetStatusUP()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    const auto wait_for = [&server](std::size_t count)
+    {
+        const auto deadline = Clock::now() + std::chrono::seconds(60);
+        while (server.GetConnectionCount() < count && Clock::now() < deadline)
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));  // the greetings are sent by now
+    };
+
+    const std::size_t per_client = with_file ? 2 : 1;
+    std::vector<int> fds;
+    fds.reserve(per_client * (clients + 1));
+    const auto connect_client = [&]()
+    {
+        fds.push_back(ConnectRaw(port));
+        if (with_file) fds.push_back(ConnectRaw(port + 1));
+    };
+    connect_client();
+    wait_for(per_client);
+    const std::size_t before = ResidentBytes();
+    const std::size_t heap_before = mallinfo2().uordblks;
+
+    for (std::size_t i = 0; i < clients; ++i) connect_client();
+    wait_for(per_client * (clients + 1));
+    const std::size_t after = ResidentBytes();
+    const std::size_t heap_after = mallinfo2().uordblks;
+    const std::size_t connected = server.GetConnectionCount() / per_client - 1;
+    const SessionSlab::Stats slab = server.GetSessionSlabStats();
+
+    for (const int fd : fds)
+        if (fd >= 0) ::close(fd);
+    server.StopServer();
+    server_thread.join();
+
+    std::cout.clear();
+    std::cout.rdbuf(console);
+    std::cout << connected << " idle clients" << (with_file ? " (text and file connection each)" : " (text only)")
+              << ", resident growth " << (after - before) / 1024 << " KiB\n";
+    std::cout << "resident bytes per idle client: " << (after - before) / std::max<std::size_t>(connected, 1)
+              << ", heap bytes in use: " << (heap_after - heap_before) / std::max<std::size_t>(connected, 1) << "\n";
+    if (connected < clients) std::cout << "only " << connected << " clients connected, raise the open files limit\n";
+    std::cout << "session slab: " << slab.blocks_in_use << " blocks of " << slab.block_bytes << " bytes in "
+              << slab.slabs << " slabs\n";
+}
+
+// =====================================================================
+// BENCHMARK 17: fanning out large files on the file port, copied and zero-copy
+// args: [recipients=4] [file_mb=16] [files=16] [rounds=5]
+// Every file goes to `recipients` FileTransferQueues, each writing to its own loopback socket that a
+// reader thread drains. Modes: each queue serializing the FileMessage itself (before this change), one
+// shared encoded frame written the plain way, and the shared frame with MSG_ZEROCOPY, adaptive (back to
+// plain sends once the kernel reports it copied) and forced. Reported, from the best of `rounds` runs:
+// CPU seconds per GB fanned out of the sending side (process CPU minus the readers' threads; on loopback
+// it includes the kernel's receive processing) and of the readers, and the kernel's zero-copy completions.
+// Loopback has no NIC to DMA from, so the kernel copies zero-copy sends anyway and reports them as copied.
+// =====================================================================
+static double CpuSeconds(int who)
+{
+    rusage usage{};
+    ::getrusage(who, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           static_cast<double>(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void BenchZeroCopyFanout(const std::vector<std::string>& args)
+{
+    using boost::asio::ip::tcp;
+    const std::size_t recipients = std::max<std::size_t>(ArgOr(args, 0, 4), 1);
+    const std::size_t file_mb = std::max<std::size_t>(ArgOr(args, 1, 16), 1);
+    const std::size_t files = std::max<std::size_t>(ArgOr(args, 2, 16), 1);
+    const std::size_t rounds = std::max<std::size_t>(ArgOr(args, 3, 5), 1);
+
+    const auto file = std::make_shared<FileMessage>("fanout.bin", std::vector<uint8_t>(file_mb << 20, 0x5a));
+    const std::size_t frame_bytes = file->serialize().size();
+    const double gigabytes = static_cast<double>(frame_bytes * files * recipients) / 1e9;
+
+    enum class Mode { PerRecipient, Shared, ZeroCopy, ZeroCopyForced };
+    struct Run
+    {
+        double send_cpu = 0;
+        double reader_cpu = 0;
+        double seconds = 0;
+        ZeroCopySender::Stats stats;
+    };
+
+    const auto run_once = [&](Mode mode)
+    {
+        boost::asio::io_context io;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+        std::vector<std::shared_ptr<tcp::socket>> senders;
+        std::vector<std::unique_ptr<tcp::socket>> receivers;
+        std::vector<std::unique_ptr<FileTransferQueue>> queues;
+        for (std::size_t i = 0; i < recipients; ++i)
+        {
+            senders.push_back(std::make_shared<tcp::socket>(io));
+            senders.back()->connect(acceptor.local_endpoint());
+            receivers.push_back(std::make_unique<tcp::socket>(io));
+            acceptor.accept(*receivers.back());
+            std::weak_ptr<tcp::socket> socket = senders.back();
+            queues.push_back(std::make_unique<FileTransferQueue>([socket] { return socket.lock(); }));
+            if (mode == Mode::ZeroCopy) queues.back()->set_zero_copy({256 * 1024, false});
+            if (mode == Mode::ZeroCopyForced) queues.back()->set_zero_copy({256 * 1024, true});
+        }
+
+        Run run;
+        std::mutex reader_mutex;
+        std::vector<std::thread> readers;
+        for (auto& receiver : receivers)
+        {
+            readers.emplace_back([&, socket = receiver.get()]()
+            {
+                std::vector<char> buffer(1 << 20);
+                boost::system::error_code ec;
+                for (std::size_t left = frame_bytes * files; left > 0 && !ec;)
+                    left -= boost::asio::read(*socket, boost::asio::buffer(buffer.data(), std::min(left, buffer.size())), ec);
+                std::scoped_lock lock(reader_mutex);
+                run.reader_cpu += CpuSeconds(RUSAGE_THREAD);
+            });
+        }
+
+        const double cpu_before = CpuSeconds(RUSAGE_SELF);
+        const auto start = Clock::now();
+        for (std::size_t f = 0; f < files; ++f)
+        {
+            if (mode == Mode::PerRecipient)
+            {
+                for (auto& queue : queues) queue->enqueue(file);
+                continue;
+            }
+            const auto frame = std::make_shared<const std::vector<char>>(file->serialize());
+            for (auto& queue : queues) queue->enqueue(frame);
+        }
+        for (auto& reader : readers) reader.join();
+        for (auto& queue : queues)
+        {
+            queue->stop();
+            const auto stats = queue->zero_copy_stats();
+            run.stats.zero_copy_frames += stats.zero_copy_frames;
+            run.stats.completions += stats.completions;
+            run.stats.copied_completions += stats.copied_completions;
+        }
+        run.seconds = SecondsSince(start);
+        run.send_cpu = CpuSeconds(RUSAGE_SELF) - cpu_before - run.reader_cpu;
+        return run;
+    };
+
+    std::cout << recipients << " recipients, " << files << " files of " << file_mb << " MiB, " << gigabytes
+              << " GB fanned out per run, best of " << rounds << "\n";
+    const std::vector<std::pair<const char*, Mode>> modes = {
+        {"serialize per recipient", Mode::PerRecipient},
+        {"shared frame, plain send", Mode::Shared},
+        {"shared frame, zero-copy", Mode::ZeroCopy},
+        {"shared frame, zero-copy forced", Mode::ZeroCopyForced}};
+    for (const auto& [label, mode] : modes)
+    {
+        Run best;
+        for (std::size_t r = 0; r < rounds; ++r)
+        {
+            const Run run = run_once(mode);
+            if (r == 0 || run.send_cpu + run.reader_cpu < best.send_cpu + best.reader_cpu) best = run;
+        }
+        std::cout << label << ": " << (best.send_cpu + best.reader_cpu) / gigabytes << " CPU s/GB ("
+                  << best.send_cpu / gigabytes << " sending, " << best.reader_cpu / gigabytes << " reading), "
+                  << gigabytes / best.seconds << " GB/s\n";
+        if (mode == Mode::ZeroCopy || mode == Mode::ZeroCopyForced)
+            std::cout << "  zero-copy frames " << best.stats.zero_copy_frames << ", sends completed "
+                      << best.stats.completions << ", of them copied by the kernel " << best.stats.copied_completions
+                      << "\n";
+    }
+}
+
+// =====================================================================
+// Main Runner
+// =====================================================================
+struct BenchmarkEntry
+{
+    const char* name;
+    const char* usage;
+    std::function<void(const std::vector<std::string>&)> run;
+};
+
+int main(int argc, char** argv)
+{
+    const std::vector<BenchmarkEntry> benchmarks = {
+        {"history_log", "[messages=10000000] [recover=100]", BenchHistoryLog},
+        {"fan_out", "[max_room=8000] [messages=200] [threads=hardware]", BenchFanOut},
+        {"connection_storm", "[clients=5000] [backlog=4096] [port=7700]", BenchConnectionStorm},
+        {"file_contention", "[uploaders=4] [file_kb=4096] [pings=300] [port=7800]", BenchFileContention},
+        {"slow_consumer", "[messages=200000] [port=7900]", BenchSlowConsumer},
+        {"flood", "[listeners=50] [seconds=3] [port=8000]", BenchFlood},
+        {"keepalive", "[timers=100000] [connections=2000] [port=8100]", BenchKeepalive},
+        {"multiplexed", "[file_kb=4096] [pings=300] [port=8200]", BenchMultiplexed},
+        {"frame_header", "[iterations=10000000] [listeners=20] [messages=2000] [port=8300]", BenchFrameHeader},
+        {"dispatch", "[messages=2000000]", BenchDispatch},
+        {"header_codec", "[iterations=5000000]", BenchHeaderCodec},
+        {"chat_batching", "[members=20] [messages=20000] [rate=20000]", BenchChatBatching},
+        {"broadcast_allocations", "[messages=100000]", BenchBroadcastAllocations},
+        {"text_sanitizer", "[megabytes=256]", BenchTextSanitizer},
+        {"connection_loops", "[connections=8] [messages=400000] [window=16]", BenchConnectionLoops},
+        {"idle_connections", "[clients=4000] [with_file=1] [port=8400]", BenchIdleConnections},
+        {"zero_copy_fanout", "[recipients=4] [file_mb=16] [files=16] [rounds=5]", BenchZeroCopyFanout},
+    };
+
+    if (argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " <benchmark> [args...]\n";
+        for (const auto& b : benchmarks) std::cout << "  " << b.name << " " << b.usage << "\n";
+        return 0;
+    }
+
+    const std::string name = argv[1];
+    const std::vector<std::string> args(argv + 2, argv + argc);
+    for (const auto& b : benchmarks)
+    {
+        if (name != b.name) continue;
+        std::cout << "=== " << b.name << " ===\n";
+        b.run(args);
+        return 0;
+    }
+
+    std::cerr << "Unknown benchmark: " << name << "\n";
+    return 1;
+}
@@ -1,22 +1,50 @@
 #pragma once
 #include <iostream>
+#include <utility>
 #include <boost/asio.hpp>
 #include <memory>
 #include <functional> //  For std::function
 #include <MessageTypes/Interface/IMessage.hpp>
 #include <Server/MessageReceiver.h>
 #include <MessageTypes/Utilities/FileTransferQueue.h>
+#include <MessageTypes/Utilities/ChunkAssembler.h>
+#include <Server/OutboundQueue.h>
 #include <MessageTypes/File/FileMessage.h> // For the callback signature
 
 class ClientServerConnectionManager : public std::enable_shared_from_this<ClientServerConnectionManager>
 {
 private:
     std::atomic<bool> askedforhistory = false;
+    // newest room sequence number received, sent with SendHistory so the server only replays the delta
+    std::atomic<uint64_t> last_seen_sequence_ = 0;
+    // oldest room sequence received, older pages are requested before it (/more)
+    std::atomic<uint64_t> oldest_seen_sequence_ = 0;
     MessageReceiver textMessageReceiver_;
     MessageReceiver fileMessageReceiver_;
 
     std::shared_ptr<FileTransferQueue> file_queue_;
 
+    // one connection for text and files (file port 0): no file socket, files travel as chunks
+    const bool multiplexed_;
+    // single writer of the text socket: frames leave in order, file chunks only between chat frames.
+    // Set once the text socket connected.
+    std::shared_ptr<OutboundQueue> text_outbound_;
+    mutable std::mutex text_outbound_mutex_;
+    ChunkAssembler chunks_;
+    // protocol of the text connection, legacy until the server answered our Hello
+    const std::shared_ptr<ConnectionProtocol> protocol_ = std::make_shared<ConnectionProtocol>();
+
+    /**
+     * @brief Sends a message on the text connection (through its queue once connected)
+     **/
+    void SendText(const std::shared_ptr<IMessage>& message) const;
+    std::shared_ptr<OutboundQueue> TextOutbound() const;
+    /**
+     * @brief Writes a file frame as chunks on the text connection, blocking until it was sent
+     **/
+    void SendFileMultiplexed(std::vector<char> frame, boost::system::error_code& ec) const;
+    static void ReceiveFile(const std::shared_ptr<FileMessage>& file);
+
     void try_request_history();
     /**
      * @brief Handles connection to a specified socket
@@ -37,6 +65,9 @@ protected:
     std::shared_ptr<boost::asio::ip::tcp::socket> client_file_socket;
 
 public:
+    /**
+     * @param fileport file port of the server; 0 sends files over the text connection (one connection per client)
+     **/
     explicit ClientServerConnectionManager(boost::asio::io_context& io, std::string ip, unsigned short int textport,
                                  unsigned short int fileport);
 
@@ -72,4 +103,20 @@ public:
     * @param id id of the file held by the FileTransferQueue
     **/
     void RetryFile(uint64_t id) const;
+
+    /**
+    * @brief Ask the server for a page of messages older than the oldest one received so far
+    * @param limit maximum number of messages in the page
+    **/
+    void RequestOlderHistory(uint32_t limit) const;
+
+    /**
+    * @brief Move this connection to another room (created on first join); the server replies with its history
+    * @param room room name (letters, digits, '_' or '-')
+    **/
+    void JoinRoom(const std::string& room) const;
+    /**
+    * @brief Leave the current room and go back to the default one
+    **/
+    void LeaveRoom() const;
 };
\ No newline at end of file
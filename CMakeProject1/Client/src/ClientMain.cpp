@@ -1,4 +1,5 @@
 ﻿#include <iostream>
+#include <utility>
 #include <string>
 #include <memory>
 #include <boost/asio.hpp>
@@ -14,12 +15,11 @@
 #include <arpa/inet.h>
 #endif
 
-void send_text_message(const ClientServerConnectionManager& mng, const std::string& line)
+void send_text_message(const ClientServerConnectionManager& mng, std::string line)
 {
     try
     {
-        TextMessage text(line);
-        const std::shared_ptr<IMessage> pointer = std::make_shared<TextMessage>(text);
+        const std::shared_ptr<IMessage> pointer = std::make_shared<TextMessage>(std::move(line));
         mng.Message(TextTypes::Text, pointer);
     }
     catch (const std::exception& e)
@@ -28,8 +28,8 @@ void send_text_message(const ClientServerConnectionManager& mng, const std::stri
     }
 }
 
-// Helper function to get valid port input
-int get_port_input(const std::string& prompt, const int default_port)
+// Helper function to get valid port input (0 is only accepted with allow_zero)
+int get_port_input(const std::string& prompt, const int default_port, const bool allow_zero = false)
 {
     std::cout << prompt << " [" << default_port << "]: ";
     std::string input;
@@ -39,7 +39,7 @@ int get_port_input(const std::string& prompt, const int default_port)
 
     try {
         int port = std::stoi(input);
-        if (port < 1 || port > 65535) {
+        if (port < (allow_zero ? 0 : 1) || port > 65535) {
             std::cerr << "Invalid port. Using default: " << default_port << std::endl;
             return default_port;
         }
@@ -82,12 +82,12 @@ int main()
         // Get configuration from user
         std::string server_ip = get_ip_input("Enter server IP address", "0.0.0.0");
         int text_port = get_port_input("Enter text message port", 5555);
-        int file_port = get_port_input("Enter file transfer port", 5556);
+        int file_port = get_port_input("Enter file transfer port (0 = files over the text connection)", 5556, true);
 
         std::cout << "\n=== Connecting to Server ===" << std::endl;
         std::cout << "Server IP: " << server_ip << std::endl;
         std::cout << "Text Port: " << text_port << std::endl;
-        std::cout << "File Port: " << file_port << std::endl;
+        std::cout << "File Port: " << (file_port == 0 ? std::string("none, multiplexed") : std::to_string(file_port)) << std::endl;
         std::cout << "===========================\n" << std::endl;
 
         boost::asio::io_context io_context;
@@ -130,7 +130,7 @@ int main()
             if (!command_processor.process(mng, line))
             {
                 // Not a command, send as a text message
-                send_text_message(mng, line);
+                send_text_message(mng, std::move(line));
             }
         }
 
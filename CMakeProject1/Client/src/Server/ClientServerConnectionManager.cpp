@@ -6,24 +6,50 @@
 #include <boost/asio.hpp>
 
 #include "MessageTypes/SendHistory/SendHistoryMessage.h"
+#include "MessageTypes/HistorySync/HistorySyncMessage.h"
+#include "MessageTypes/HistoryQuery/HistoryQueryMessage.h"
+#include "MessageTypes/Room/RoomMessage.h"
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include "MessageTypes/Hello/HelloMessage.h"
+#include "MessageTypes/TextBatch/TextBatchMessage.h"
+#include "MessageTypes/Utilities/FrameHeader.hpp"
+#include <future>
 
 using boost::asio::ip::tcp;
 
+// partially received files kept while multiplexing
+static constexpr std::size_t MAX_CHUNKED_FILE_BYTES = 1024ull * 1024 * 1024;
+// largest frame accepted on the text connection once the server agreed to a protocol
+static constexpr uint64_t MAX_TEXT_FRAME_BYTES = 16ull * 1024 * 1024;
+
+static HelloMessage LocalHello()
+{
+    return HelloMessage(ConnectionProtocol::VERSION,
+                        ConnectionProtocol::COMPACT_HEADERS | ConnectionProtocol::MULTIPLEXED_FILES |
+                        ConnectionProtocol::BATCHED_TEXT,
+                        MAX_TEXT_FRAME_BYTES, {ConnectionProtocol::Codec::Identity});
+}
+
 // add inside ClientServerConnectionManager class:
 void ClientServerConnectionManager::try_request_history()
 {
     if (askedforhistory) return;
 
-    // ensure both sockets exist and are open
+    // ensure both sockets exist and are open (only the text socket when multiplexing)
     if (client_socket && client_socket->is_open()
-        && client_file_socket && client_file_socket->is_open())
+        && (multiplexed_ || (client_file_socket && client_file_socket->is_open())))
     {
-        // Get the local port of our file socket
+        // Get the local port of our file socket; 0 tells the server to send files on the text connection
         boost::system::error_code ec;
-        auto local_ep = client_file_socket->local_endpoint(ec);
+        auto local_ep = multiplexed_ ? tcp::endpoint() : client_file_socket->local_endpoint(ec);
         unsigned short file_port = 0;
 
-        if (!ec)
+        if (multiplexed_)
+        {
+            std::cout << "Requesting history, files multiplexed on the text connection" << std::endl;
+        }
+        else if (!ec)
         {
             file_port = local_ep.port();
             std::cout << "Requesting history with file port: " << file_port << std::endl;
@@ -33,16 +59,55 @@ void ClientServerConnectionManager::try_request_history()
             std::cerr << "Failed to get file socket local port: " << ec.message() << std::endl;
         }
 
-        auto histMsg = std::make_shared<SendHistoryMessage>(file_port);
-        boost::system::error_code err;
-        SendMessage(client_socket, histMsg, err);
+        SendText(std::make_shared<SendHistoryMessage>(file_port, last_seen_sequence_.load()));
+        askedforhistory = true;
+    }
+}
+
+std::shared_ptr<OutboundQueue> ClientServerConnectionManager::TextOutbound() const
+{
+    std::scoped_lock lock(text_outbound_mutex_);
+    return text_outbound_;
+}
 
-        if (err) {
-            std::cerr << "Failed to send SendHistoryMessage: " << err.message() << std::endl;
-        } else {
-            askedforhistory = true;
+void ClientServerConnectionManager::SendText(const std::shared_ptr<IMessage>& message) const
+{
+    if (const auto outbound = TextOutbound())
+    {
+        auto frame = std::make_shared<const std::vector<char>>(message->serialize());
+        // the server closes connections that send more than it said it accepts
+        const uint64_t limit = protocol_->peer_max_frame_bytes.load(std::memory_order_relaxed);
+        if (limit != 0 && frame->size() - Utils::FrameHeader::LEGACY_SIZE > limit)
+        {
+            std::cerr << "Message too large for the server (" << frame->size() << " bytes), not sent\n";
+            return;
         }
+        outbound->Send(std::move(frame), OutboundQueue::Priority::Control);
+        return;
     }
+    boost::system::error_code err;
+    SendMessage(client_socket, message, err);
+}
+
+void ClientServerConnectionManager::SendFileMultiplexed(std::vector<char> frame, boost::system::error_code& ec) const
+{
+    const auto outbound = TextOutbound();
+    if (!outbound)
+    {
+        ec = boost::asio::error::not_connected;
+        return;
+    }
+    std::promise<boost::system::error_code> sent;
+    auto result = sent.get_future();
+    outbound->SendBulk(std::make_shared<const std::vector<char>>(std::move(frame)),
+                       [&sent](const boost::system::error_code& e) { sent.set_value(e); });
+    ec = result.get();
+}
+
+void ClientServerConnectionManager::ReceiveFile(const std::shared_ptr<FileMessage>& file)
+{
+    std::cout << file->to_string() << std::endl;
+    file->save_file();
 }
 
 
@@ -65,7 +130,17 @@ void ClientServerConnectionManager::handle_connect(
     // Start the correct receiver for the correct socket
     if (socket_name == "TextSocket")
     {
-        textMessageReceiver_.start_read_header(socket);
+        // the client never drops its own frames: the limits only stop a dead connection from growing forever
+        OutboundQueue::Limits limits;
+        limits.max_bytes = 1ull << 32;
+        limits.max_frames = 1ull << 24;
+        {
+            std::scoped_lock lock(text_outbound_mutex_);
+            text_outbound_ = std::make_shared<OutboundQueue>(socket, limits, nullptr);
+        }
+        textMessageReceiver_.start_read_header(socket, protocol_);
+        // first frame on the connection, the agreed protocol is used from the server's answer on
+        SendText(std::make_shared<HelloMessage>(LocalHello()));
     }
     else if (socket_name == "FileSocket")
     {
@@ -78,7 +153,8 @@ void ClientServerConnectionManager::handle_connect(
 ClientServerConnectionManager::ClientServerConnectionManager(
     boost::asio::io_context& io, std::string ip,
     unsigned short int textport,
-    unsigned short int fileport) : io_context_(io)
+    unsigned short int fileport)
+    : multiplexed_(fileport == 0), chunks_(MAX_CHUNKED_FILE_BYTES), io_context_(io)
 {
     try
     {
@@ -86,55 +162,135 @@ ClientServerConnectionManager::ClientServerConnectionManager(
         endpoint_file = tcp::endpoint(boost::asio::ip::make_address(ip), fileport);
 
         client_socket = std::make_shared<tcp::socket>(io_context_);
-        client_file_socket = std::make_shared<tcp::socket>(io_context_);
+        if (!multiplexed_) client_file_socket = std::make_shared<tcp::socket>(io_context_);
 
-        // Create file queue
+        // Create file queue; when multiplexing, files are written as chunks through the text socket's queue
+        FrameWriter frame_writer;
+        if (multiplexed_)
+            frame_writer = [this](std::vector<char> frame, boost::system::error_code& ec)
+            {
+                SendFileMultiplexed(std::move(frame), ec);
+            };
         file_queue_ = std::make_shared<FileTransferQueue>([this]() -> std::shared_ptr<boost::asio::ip::tcp::socket>
         {
             return this->client_file_socket;
-        });
+        }, std::move(frame_writer));
 
         // Configure the callbacks for both receiver instances
 
         // 1. Configure the TEXT receiver
         // Now we just need to set the callback that TextMessage.handle() will invoke
-        textMessageReceiver_.register_handler(TextTypes::Text,
-        [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
+        auto remember_sequence = [this](uint64_t sequence)
+            {
+                // Remember the newest room message we have seen
+                uint64_t seen = last_seen_sequence_.load();
+                while (sequence > seen && !last_seen_sequence_.compare_exchange_weak(seen, sequence))
+                {
+                }
+            };
+        auto text_handler = [remember_sequence](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<TextMessage> textMsg)
             {
                 // Display the message
-                const auto textMsg = std::dynamic_pointer_cast<TextMessage>(msg);
                 std::cout << textMsg->to_string() << std::endl;
-
+                remember_sequence(textMsg->get_sequence());
+            };
+        textMessageReceiver_.register_handler<TextTypes::Text>(text_handler);
+        textMessageReceiver_.register_handler<TextTypes::SequencedText>(text_handler);
+        // Busy rooms send their lines in batches, shown in order as if they came one by one
+        textMessageReceiver_.register_handler<TextTypes::TextBatch>(
+        [remember_sequence](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<TextBatchMessage> batch)
+            {
+                for (const auto& record : batch->get_records())
+                {
+                    std::cout << record.sender << record.text << '\n';
+                    remember_sequence(record.sequence);
+                }
+                std::cout << std::flush;
             });
 
-        // 2. Configure the FILE receiver
-        // Now we just need to set the callback that FileMessage.handle() will invoke
-        fileMessageReceiver_.register_handler(TextTypes::File,
-        [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
+        textMessageReceiver_.register_handler<TextTypes::HistorySync>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<HistorySyncMessage> syncMsg)
             {
-                if (msg)
+                switch (syncMsg->get_status())
                 {
-                    try
+                case HistorySyncMessage::Status::FullResync:
+                    if (last_seen_sequence_ != 0)
                     {
-                        // Deserialize the raw data into a FileMessage
-                        auto fm = std::dynamic_pointer_cast<FileMessage>(msg);
-                        auto rawData = std::make_shared<std::vector<char>>(msg->serialize());
-                        fm->deserialize(*rawData);
-
-                        // Display info about the file
-                        std::string msg_str = fm->to_string();
-                        std::cout << msg_str << std::endl;
-
-                        // Save the file to disk
-                        fm->save_file();
+                        std::cout << "--- Missed too many messages, full history resync ---" << std::endl;
+                        last_seen_sequence_ = 0;
                     }
-                    catch (const std::exception& e)
+                    oldest_seen_sequence_ = syncMsg->get_first_sequence();
+                    break;
+                case HistorySyncMessage::Status::Delta:
+                    if (oldest_seen_sequence_ == 0) oldest_seen_sequence_ = syncMsg->get_first_sequence();
+                    break;
+                case HistorySyncMessage::Status::Page:
+                    if (syncMsg->get_first_sequence() == 0)
                     {
-                        std::cerr << "Client file deserialize error: " << e.what() << "\n";
+                        std::cout << "(no older messages)" << std::endl;
+                        break;
                     }
+                    std::cout << "--- Older messages ---" << std::endl;
+                    oldest_seen_sequence_ = syncMsg->get_first_sequence();
+                    break;
+                }
+            });
+
+        // Room confirmation: sequence numbers are per room, so start tracking from scratch
+        textMessageReceiver_.register_handler<TextTypes::Room>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<RoomMessage> roomMsg)
+            {
+                last_seen_sequence_ = 0;
+                oldest_seen_sequence_ = 0;
+                std::cout << "--- Now in room " << roomMsg->get_room() << " ---" << std::endl;
+            });
+
+        // Keepalive: answer the server's pings, or a quiet client is taken for a dead connection
+        textMessageReceiver_.register_handler<TextTypes::Heartbeat>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<HeartbeatMessage> heartbeat)
+            {
+                if (heartbeat->get_kind() != HeartbeatMessage::Kind::Ping) return;
+                SendText(std::make_shared<HeartbeatMessage>(HeartbeatMessage::Kind::Pong));
+            });
+
+        // The server's answer to our Hello: its frames after it and ours from now on use the agreed protocol
+        textMessageReceiver_.register_handler<TextTypes::Hello>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<HelloMessage> hello)
+            {
+                protocol_->apply(LocalHello(), *hello);
+                if (multiplexed_ && !protocol_->has(ConnectionProtocol::MULTIPLEXED_FILES))
+                    std::cerr << "The server does not accept files on the text connection\n";
+                if (const auto outbound = TextOutbound(); outbound && protocol_->has(ConnectionProtocol::COMPACT_HEADERS))
+                    outbound->SetCompactHeaders(true);
+            });
+
+        // Files multiplexed on the text connection arrive in chunks
+        textMessageReceiver_.register_handler<TextTypes::FileChunk>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<FileChunkMessage> chunk)
+            {
+                try
+                {
+                    const auto frame = chunks_.add(*chunk);
+                    if (!frame) return;
+                    auto fm = std::make_shared<FileMessage>();
+                    fm->deserialize(*frame);
+                    ReceiveFile(fm);
+                }
+                catch (const std::exception& e)
+                {
+                    std::cerr << "Client file chunk error: " << e.what() << "\n";
                 }
             });
 
+        // 2. Configure the FILE receiver
+        // Now we just need to set the callback that FileMessage.handle() will invoke
+        fileMessageReceiver_.register_handler<TextTypes::File>(
+        [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<FileMessage> fm)
+            {
+                // already decoded by the receiver
+                ReceiveFile(fm);
+            });
+
         // Connect for text messages
         client_socket->async_connect(endpoint,
             [this](const boost::system::error_code& ec)
@@ -143,11 +299,14 @@ ClientServerConnectionManager::ClientServerConnectionManager(
             });
 
         // Connect for file transfers
-        client_file_socket->async_connect(endpoint_file,
-            [this](const boost::system::error_code& ec)
-            {
-                this->handle_connect(ec, "FileSocket", client_file_socket);
-            });
+        if (!multiplexed_)
+        {
+            client_file_socket->async_connect(endpoint_file,
+                [this](const boost::system::error_code& ec)
+                {
+                    this->handle_connect(ec, "FileSocket", client_file_socket);
+                });
+        }
     }
     catch (const std::exception& e)
     {
@@ -193,7 +352,7 @@ void ClientServerConnectionManager::Message(const TextTypes type, const std::sha
     case TextTypes::Text:
         if (client_socket && client_socket->is_open())
         {
-            SendMessage(client_socket, message, err);
+            SendText(message);
         }
         else
         {
@@ -202,7 +361,11 @@ void ClientServerConnectionManager::Message(const TextTypes type, const std::sha
         break;
 
     case TextTypes::File:
-        if (client_file_socket && client_file_socket->is_open())
+        if (multiplexed_)
+        {
+            file_queue_->enqueue(std::static_pointer_cast<FileMessage>(message));
+        }
+        else if (client_file_socket && client_file_socket->is_open())
         {
             SendMessage(client_file_socket, message, err);
         }
@@ -239,6 +402,14 @@ uint64_t ClientServerConnectionManager::EnqueueFile(const std::filesystem::path&
 
 void ClientServerConnectionManager::CancelAndReconnectFileSocket()
 {
+    if (multiplexed_)
+    {
+        // there is no file socket to reset; the chat connection is left alone
+        if (file_queue_) file_queue_->cancel_all();
+        std::cout << "File transfer queue cancelled.\n";
+        return;
+    }
+
     // 1) pause queue so worker won't immediately start new items
     if (file_queue_) file_queue_->pause();
 
@@ -264,36 +435,17 @@ void ClientServerConnectionManager::CancelAndReconnectFileSocket()
     }
 
     // Preserve and re-register the handler to clear the receiver's stale state
-    auto file_handler = [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
+    auto file_handler = [this](const std::shared_ptr<tcp::socket>& /*sender*/, std::shared_ptr<FileMessage> fm)
     {
-        if (msg)
-        {
-            try
-            {
-                // Deserialize the raw data into a FileMessage
-                auto fm = std::dynamic_pointer_cast<FileMessage>(msg);
-                auto rawData = std::make_shared<std::vector<char>>(msg->serialize());
-                fm->deserialize(*rawData);
-
-                // Display info about the file
-                std::string msg_str = fm->to_string();
-                std::cout << msg_str << std::endl;
-
-                // Save the file to disk
-                fm->save_file();
-            }
-            catch (const std::exception& e)
-            {
-                std::cerr << "Client file deserialize error: " << e.what() << "\n";
-            }
-        }
+        // already decoded by the receiver
+        ReceiveFile(fm);
     };
 
     // Re-create the receiver object to clear all its buffers and state
     fileMessageReceiver_ = MessageReceiver();
 
     // Re-register the handler on the new receiver instance
-    fileMessageReceiver_.register_handler(TextTypes::File, file_handler);
+    fileMessageReceiver_.register_handler<TextTypes::File>(file_handler);
 
     // 4) create new socket and async_connect it.
     client_file_socket = std::make_shared<boost::asio::ip::tcp::socket>(io_context_);
@@ -336,4 +488,41 @@ void ClientServerConnectionManager::CancelFile(uint64_t id) const
 void ClientServerConnectionManager::RetryFile(uint64_t id) const
 {
     if (file_queue_) file_queue_->retry(id);
+}
+
+void ClientServerConnectionManager::RequestOlderHistory(uint32_t limit) const
+{
+    if (!client_socket || !client_socket->is_open())
+    {
+        std::cerr << "TextSocket is not connected.\n";
+        return;
+    }
+    if (oldest_seen_sequence_ == 1)
+    {
+        std::cout << "(no older messages)" << std::endl;
+        return;
+    }
+
+    // 0 asks for the newest page if we have not received any numbered message yet
+    SendText(std::make_shared<HistoryQueryMessage>(oldest_seen_sequence_.load(), limit));
+}
+
+void ClientServerConnectionManager::JoinRoom(const std::string& room) const
+{
+    if (!client_socket || !client_socket->is_open())
+    {
+        std::cerr << "TextSocket is not connected.\n";
+        return;
+    }
+    SendText(std::make_shared<RoomMessage>(RoomMessage::Action::Join, room));
+}
+
+void ClientServerConnectionManager::LeaveRoom() const
+{
+    if (!client_socket || !client_socket->is_open())
+    {
+        std::cerr << "TextSocket is not connected.\n";
+        return;
+    }
+    SendText(std::make_shared<RoomMessage>(RoomMessage::Action::Leave, std::string()));
 }
\ No newline at end of file
@@ -19,6 +19,9 @@ namespace
                 "  /file <path>     - enqueue a file to send\n"
                 "  /queue           - show queued files and their states\n"
                 "  /history         - list successfully sent files (log)\n"
+                "  /more [n]        - load n older chat messages (default 20)\n"
+                "  /join <room>     - switch to another chat room\n"
+                "  /leave           - go back to the default room\n"
                 "  /pause           - pause the file sending queue\n"
                 "  /resume          - resume the file sending queue\n"
                 "  /cancel <id>     - cancel a queued/sending file by id\n"
@@ -164,6 +167,51 @@ namespace
             mng.CancelAndReconnectFileSocket();
         }
     };
+
+    class MoreHistoryCommand : public ICommand
+    {
+    public:
+        void execute(ClientServerConnectionManager& mng, const std::string& args) override
+        {
+            uint32_t limit = 20;
+            if (!args.empty())
+            {
+                try
+                {
+                    limit = static_cast<uint32_t>(std::stoul(args));
+                }
+                catch (...)
+                {
+                    std::cerr << "Invalid count for /more. Usage: /more [n]\n";
+                    return;
+                }
+            }
+            mng.RequestOlderHistory(limit);
+        }
+    };
+
+    class JoinRoomCommand : public ICommand
+    {
+    public:
+        void execute(ClientServerConnectionManager& mng, const std::string& args) override
+        {
+            if (args.empty())
+            {
+                std::cerr << "Usage: /join <room>\n";
+                return;
+            }
+            mng.JoinRoom(args);
+        }
+    };
+
+    class LeaveRoomCommand : public ICommand
+    {
+    public:
+        void execute(ClientServerConnectionManager& mng, const std::string& /*args*/) override
+        {
+            mng.LeaveRoom();
+        }
+    };
 } // end anonymous namespace
 
 
@@ -182,6 +230,9 @@ CommandProcessor::CommandProcessor()
     commands_["/pause"] = std::make_unique<PauseQueueCommand>();
     commands_["/resume"] = std::make_unique<ResumeQueueCommand>();
     commands_["/cancelall"] = std::make_unique<CancelAllCommand>();
+    commands_["/more"] = std::make_unique<MoreHistoryCommand>();
+    commands_["/join"] = std::make_unique<JoinRoomCommand>();
+    commands_["/leave"] = std::make_unique<LeaveRoomCommand>();
 }
 
 bool CommandProcessor::process(ClientServerConnectionManager& mng, const std::string& line)
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+#include <MessageTypes/Utilities/FileTransferQueue.h>
+#include <Server/OutboundQueue.h>
+#include <Server/ConnectionProtocol.h>
+
+/**
+ * @brief Delivers one message to a large recipient set on all io threads instead of one.
+ *
+ * Recipients are split into lanes by a stable hash of their socket, and every lane is serialized
+ * on its own strand. Small rooms are delivered inline on the caller's thread; above the inline
+ * threshold each non-empty lane is posted to its strand, so the io threads share the work.
+ * Because a recipient always lands in the same lane, messages reach it in publish order.
+ **/
+class FanOut
+{
+public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+
+    struct Options
+    {
+        std::size_t inline_threshold = 512;  // rooms up to this size are delivered inline
+        std::size_t lanes = 0;               // 0 = one lane per hardware thread
+    };
+
+    struct Recipient
+    {
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+        std::shared_ptr<OutboundQueue> outbound;        // every frame to the member goes through its queue
+        std::shared_ptr<FileTransferQueue> file_queue;  // null until the client linked its file connection
+        bool multiplexed = false;                       // files go as chunks on the text connection instead
+        bool batched = false;                           // chat lines go in TextBatch frames (see Room::Options)
+        std::shared_ptr<const ConnectionProtocol> protocol;  // null until known: the legacy protocol
+
+        // A member that never exchanged Hello messages only decodes legacy frames (plain Text, no sequence)
+        bool legacy() const { return !protocol || protocol->version.load(std::memory_order_acquire) == 0; }
+    };
+
+    // Immutable recipient set, already partitioned into lanes; shared by every delivery until it changes
+    struct Recipients
+    {
+        std::vector<std::vector<Recipient>> lanes;
+        std::size_t size = 0;
+    };
+
+    // Ordering state of one publisher (e.g. a room)
+    struct Stream
+    {
+        std::atomic<std::size_t> pending_lanes{0};  // lane batches posted but not yet delivered
+        std::atomic<bool> saw_closed{false};        // a delivery met a closed socket
+    };
+
+    struct Stats
+    {
+        uint64_t inline_deliveries = 0;
+        uint64_t parallel_deliveries = 0;
+        uint64_t lane_batches = 0;
+    };
+
+    using Delivery = std::function<void(const Recipient&)>;
+
+    FanOut(boost::asio::io_context& io, Options options);
+
+    FanOut(const FanOut&) = delete;
+    FanOut& operator=(const FanOut&) = delete;
+
+    /**
+     * @brief Partitions recipients into lanes (done once per membership change, not per message)
+     **/
+    std::shared_ptr<const Recipients> Partition(const std::vector<Recipient>& recipients) const;
+
+    /**
+     * @brief Calls `delivery` once for every recipient with an open socket.
+     *        Inline delivery is only used while none of the stream's earlier lane batches is pending,
+     *        otherwise a message could overtake an earlier one.
+     **/
+    void Deliver(const std::shared_ptr<Stream>& stream, const std::shared_ptr<const Recipients>& recipients,
+                 Delivery delivery);
+
+    void SetInlineThreshold(std::size_t threshold) { inline_threshold_.store(threshold, std::memory_order_relaxed); }
+    std::size_t GetInlineThreshold() const { return inline_threshold_.load(std::memory_order_relaxed); }
+    std::size_t GetLaneCount() const { return lanes_.size(); }
+    Stats GetStats() const;
+
+private:
+    std::size_t LaneOf(const Recipient& recipient) const;
+    static void DeliverLane(Stream& stream, const std::vector<Recipient>& lane, const Delivery& delivery);
+
+    std::vector<Strand> lanes_;
+    std::atomic<std::size_t> inline_threshold_;
+
+    std::atomic<uint64_t> inline_deliveries_{0};
+    std::atomic<uint64_t> parallel_deliveries_{0};
+    std::atomic<uint64_t> lane_batches_{0};
+};
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct HistoryLogOptions
+{
+    std::size_t segment_bytes = 64ull * 1024 * 1024;       // roll to a new segment after this many data bytes
+    std::chrono::milliseconds fsync_interval{50};          // at most one fdatasync per interval
+};
+
+class HistoryLog;
+
+/**
+ * @brief Background thread that writes and syncs any number of HistoryLogs, so a server with many
+ *        rooms does not run a writer thread per room. A log is served by one writer at a time; logs
+ *        without a writer of their own share the one passed to their constructor.
+ **/
+class HistoryLogWriter
+{
+public:
+    HistoryLogWriter();
+    ~HistoryLogWriter();
+
+    HistoryLogWriter(const HistoryLogWriter&) = delete;
+    HistoryLogWriter& operator=(const HistoryLogWriter&) = delete;
+
+private:
+    friend class HistoryLog;
+    using Clock = std::chrono::steady_clock;
+
+    void attach(HistoryLog* log);
+    // Returns once no round of `log` runs any more; the log is not served afterwards
+    void detach(HistoryLog* log);
+    // Schedules a round of `log` (new frames or a flush request)
+    void wake(HistoryLog* log);
+    void run();
+
+    std::unordered_set<HistoryLog*> logs_;
+    std::unordered_set<HistoryLog*> ready_;
+    std::unordered_map<HistoryLog*, Clock::time_point> sync_due_;   // dirty logs and when to sync them
+    std::vector<HistoryLog*> busy_;                                  // logs of the round in progress
+    bool running_ = true;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::thread thread_;
+};
+
+/**
+ * @brief Persistent, segmented, append-only log of encoded chat frames.
+ *
+ * Every segment is a pair of files: `<base>.log` holds the frames back to back and `<base>.idx`
+ * holds one fixed-size (offset, length) entry per frame. append() only hands the frame to a
+ * background writer (HistoryLogWriter), which group-commits everything queued since its last round
+ * with a single write per file and batches fdatasync calls, so callers never wait for the disk.
+ *
+ * On startup the index of the newest segments is memory-mapped, which makes recovering the last
+ * N frames independent of the size of the log. A torn tail (crash mid-write) is truncated away, and so
+ * is a batch the kernel only partly took (disk full, file size limit), which is then dropped.
+ **/
+class HistoryLog
+{
+public:
+    using Frame = std::shared_ptr<const std::vector<char>>;
+
+    struct Stats
+    {
+        uint64_t records = 0;       // frames durably handed to the kernel
+        uint64_t batches = 0;       // group commits
+        uint64_t fsyncs = 0;
+        std::size_t segments = 0;
+    };
+
+    explicit HistoryLog(std::filesystem::path dir);
+    /**
+     * @param writer writer thread shared with other logs; null starts one for this log alone
+     **/
+    HistoryLog(std::filesystem::path dir, HistoryLogOptions options, std::shared_ptr<HistoryLogWriter> writer = nullptr);
+    ~HistoryLog();
+
+    HistoryLog(const HistoryLog&) = delete;
+    HistoryLog& operator=(const HistoryLog&) = delete;
+
+    /**
+     * @brief Queue a frame for the writer thread (never blocks on disk)
+     **/
+    void append(Frame frame);
+
+    /**
+     * @brief Block until everything appended so far is written and synced
+     **/
+    void flush();
+
+    /**
+     * @brief Read up to `count` committed frames starting at record `first` (0-based, oldest first)
+     **/
+    std::vector<Frame> read_range(uint64_t first, std::size_t count) const;
+
+    /**
+     * @brief Read the newest `count` committed frames (oldest first)
+     **/
+    std::vector<Frame> read_last(std::size_t count) const;
+
+    /**
+     * @brief Number of committed frames in the log
+     **/
+    uint64_t size() const;
+
+    Stats stats() const;
+
+    /**
+     * @brief Flush pending frames and stop being served by the writer
+     **/
+    void stop();
+
+private:
+    friend class HistoryLogWriter;
+    struct IndexEntry
+    {
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct Segment
+    {
+        uint64_t base = 0;          // record number of the first frame in the segment
+        uint64_t records = 0;
+        uint64_t data_bytes = 0;
+        std::filesystem::path data_path;
+        std::filesystem::path index_path;
+    };
+
+    void recover();
+    void open_segment_for_append(const Segment& segment);
+    void start_new_segment(uint64_t base);
+    void close_files();
+    /**
+     * @brief One round of the writer: writes what was queued and syncs when due
+     * @return when the log has to be synced next, if it holds unsynced writes
+     **/
+    std::optional<std::chrono::steady_clock::time_point> write_round();
+    // false if the batch could not be written; it is dropped and the segment left as it was
+    bool write_batch(const std::vector<Frame>& batch);
+    void sync_files();
+
+    std::vector<Frame> read_from_segment(const Segment& segment, uint64_t first, std::size_t count) const;
+
+    std::filesystem::path dir_;
+    HistoryLogOptions options_;
+
+    // committed segment layout, shared with readers
+    std::vector<Segment> segments_;
+    mutable std::mutex segments_mutex_;
+
+    // writer state (the round in progress only)
+    int data_fd_ = -1;
+    int index_fd_ = -1;
+    bool dirty_ = false;
+    std::chrono::steady_clock::time_point last_sync_{};
+
+    // hand-off between append() and the writer
+    std::vector<Frame> pending_;
+    uint64_t appended_ = 0;
+    uint64_t synced_ = 0;
+    bool flush_requested_ = false;
+    bool running_ = true;
+    Stats stats_;
+    mutable std::mutex mutex_;
+    std::condition_variable flushed_cv_;
+    std::shared_ptr<HistoryLogWriter> writer_;
+};
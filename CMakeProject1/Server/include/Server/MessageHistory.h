@@ -0,0 +1,149 @@
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <filesystem>
+#include <boost/asio/any_io_executor.hpp>
+#include <MessageTypes/Interface/IMessage.hpp>
+
+/**
+ * @brief Chat history bounded by both entry count and total payload bytes.
+ *
+ * Text entries are stored as already-encoded frames so replaying them never serializes again.
+ * Every entry remembers how many payload bytes it pins in memory. When the resident
+ * bytes go over budget, the oldest file blobs are demoted to an on-disk spill directory
+ * (only a small stub stays in memory); when the spill itself goes over budget or the
+ * entry count is exceeded, the oldest entries are evicted.
+ **/
+class MessageHistory
+{
+public:
+    struct Limits
+    {
+        std::size_t max_entries = 100;
+        std::size_t max_resident_bytes = 64ull * 1024 * 1024;  // payload bytes kept in RAM
+        std::size_t max_spilled_bytes = 1024ull * 1024 * 1024; // payload bytes kept on disk
+    };
+
+    // Footprint metric exposed by the server
+    struct Stats
+    {
+        std::size_t entries = 0;
+        std::size_t resident_bytes = 0;
+        std::size_t spilled_entries = 0;
+        std::size_t spilled_bytes = 0;
+        uint64_t evicted_entries = 0;
+        uint64_t generation = 0;
+    };
+
+    using Frame = std::shared_ptr<const std::vector<char>>;
+
+    // A demoted file blob on disk; the file is removed with the last entry or snapshot that refers to it
+    struct SpillFile
+    {
+        std::filesystem::path path;
+
+        explicit SpillFile(std::filesystem::path p) : path(std::move(p)) {}
+        ~SpillFile();
+        SpillFile(const SpillFile&) = delete;
+        SpillFile& operator=(const SpillFile&) = delete;
+    };
+
+    struct Entry
+    {
+        Frame frame;                        // pre-encoded frame (text entries)
+        std::shared_ptr<IMessage> message;  // file blob, null once spilled to disk
+        std::shared_ptr<const SpillFile> spill; // set if the entry has been spilled to disk
+        std::size_t bytes = 0;              // bytes the entry pins (frame size or file payload size)
+        uint64_t sequence = 0;              // room sequence number (a file shares it with its announcement)
+
+        bool is_file() const { return !frame; }
+    };
+
+    // Immutable view of the history, shared between replays until the next push
+    struct Snapshot
+    {
+        uint64_t generation = 0;
+        std::vector<Entry> entries;
+
+        /**
+         * @brief Index of the first entry with a sequence number greater than `sequence`
+         **/
+        std::size_t first_after(uint64_t sequence) const;
+    };
+
+    /**
+     * @param limits      count/byte budgets
+     * @param spill_dir   directory used for demoted file blobs; an empty path disables spilling
+     **/
+    explicit MessageHistory(Limits limits, std::filesystem::path spill_dir = {});
+    ~MessageHistory();
+
+    MessageHistory(const MessageHistory&) = delete;
+    MessageHistory& operator=(const MessageHistory&) = delete;
+
+    /**
+     * @brief Append a message and enforce the budgets. Sequence numbers must be pushed in order.
+     * @return the encoded frame for text entries (nullptr for file entries)
+     **/
+    Frame push(const std::shared_ptr<IMessage>& message, uint64_t sequence = 0);
+
+    /**
+     * @brief Append an already-encoded text frame (e.g. recovered from the persistent log)
+     **/
+    void push_frame(Frame frame, uint64_t sequence = 0);
+
+    /**
+     * @brief Immutable view of the current entries (oldest first); spilled entries are not loaded.
+     *        The view is rebuilt only when the generation changed, so concurrent replays share it.
+     **/
+    std::shared_ptr<const Snapshot> snapshot() const;
+
+    /**
+     * @brief Returns the file message of an entry, reloading it from the spill if needed
+     * @return nullptr for text entries or if the spilled blob is no longer available
+     **/
+    static std::shared_ptr<IMessage> load(const Entry& entry);
+
+    /**
+     * @brief Moves the disk writes of spilling onto `executor` instead of doing them inside push().
+     *        Until the background spill caught up, the resident budget may be exceeded (up to twice).
+     *        An empty executor restores inline spilling. The executor must not outlive the history.
+     **/
+    void set_spill_executor(boost::asio::any_io_executor executor);
+    /**
+     * @brief Whether a background spill is queued or running; the history must not go away until it is not
+     **/
+    bool spill_pending() const;
+
+    Stats stats() const;
+    const Limits& limits() const { return limits_; }
+
+private:
+    void enforce_limits_locked();
+    bool spill_locked(Entry& entry);
+    void mark_spilled_locked(Entry& entry, std::filesystem::path path);
+    /**
+     * @brief Runs on the spill executor: writes the oldest resident blobs without holding the lock
+     **/
+    void spill_in_background();
+    void evict_front_locked();
+
+    Limits limits_;
+    std::filesystem::path spill_dir_;
+
+    std::deque<Entry> entries_;
+    std::size_t resident_bytes_ = 0;
+    std::size_t spilled_bytes_ = 0;
+    std::size_t spilled_entries_ = 0;
+    uint64_t evicted_entries_ = 0;
+    uint64_t next_spill_id_ = 1;
+    uint64_t generation_ = 0;
+    mutable std::shared_ptr<const Snapshot> cached_snapshot_;
+    boost::asio::any_io_executor spill_executor_;
+    bool spill_scheduled_ = false;
+    mutable std::mutex mutex_;
+};
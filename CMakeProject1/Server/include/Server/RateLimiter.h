@@ -0,0 +1,93 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <Server/MessageReceiver.h>
+
+/**
+ * @brief Classic token bucket: refills at `rate` tokens per second up to `burst`.
+ *        A rate of 0 means unlimited. Not thread-safe, owners serialize access.
+ **/
+class TokenBucket
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TokenBucket(double rate, double burst);
+
+    /**
+     * @brief Takes `amount` tokens even if the balance goes negative
+     * @return how long until the balance is back to zero (zero if it never went negative)
+     **/
+    Clock::duration Take(double amount, Clock::time_point now);
+    /**
+     * @brief Takes `amount` tokens only if they are available
+     **/
+    bool TryTake(double amount, Clock::time_point now);
+
+    bool IsUnlimited() const { return rate_ <= 0.0; }
+
+private:
+    void Refill(Clock::time_point now);
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    Clock::time_point last_{};
+};
+
+/**
+ * @brief Ingress budget of one connection: messages per second and bytes per second.
+ *
+ * Every received message is charged to both buckets. When either is in debt the receiver stops
+ * reading from the socket until the debt is paid off, so a flooding client is throttled by TCP
+ * flow control instead of being buffered by the server. A client that stays throttled for longer
+ * than `offender_grace` is disconnected.
+ **/
+class IngressLimiter
+{
+public:
+    struct Limits
+    {
+        double messages_per_second = 20.0;
+        double message_burst = 40.0;
+        double bytes_per_second = 256.0 * 1024;
+        double byte_burst = 1024.0 * 1024;
+        std::chrono::milliseconds offender_grace{10000};
+    };
+
+    struct Stats
+    {
+        uint64_t throttled = 0;    // messages whose dispatch (and the next read) was delayed
+        uint64_t disconnects = 0;  // persistent offenders dropped
+    };
+
+    // Counters shared by all limiters of a server
+    struct Metrics
+    {
+        std::atomic<uint64_t> throttled{0};
+        std::atomic<uint64_t> disconnects{0};
+
+        Stats Load() const;
+    };
+
+    IngressLimiter(const Limits& limits, std::shared_ptr<Metrics> metrics);
+
+    /**
+     * @brief Charges one received frame and decides when the connection may be read again
+     **/
+    MessageReceiver::Admission Admit(std::size_t frame_bytes, TokenBucket::Clock::time_point now);
+
+private:
+    const std::chrono::milliseconds offender_grace_;
+    const std::shared_ptr<Metrics> metrics_;
+
+    std::mutex mutex_;
+    TokenBucket messages_;
+    TokenBucket bytes_;
+    bool throttled_ = false;
+    TokenBucket::Clock::time_point throttled_since_;
+};
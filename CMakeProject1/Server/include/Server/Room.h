@@ -0,0 +1,211 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <filesystem>
+#include <boost/asio.hpp>
+#include <MessageTypes/Utilities/FileTransferQueue.h>
+#include <Server/MessageHistory.h>
+#include <Server/HistoryLog.h>
+#include <Server/FanOut.h>
+#include <Server/RateLimiter.h>
+#include <MessageTypes/TextBatch/TextBatchMessage.h>
+
+class FileMessage;
+
+/**
+ * @brief One chat room: its subscribers, its history (ring + optional persistent log) and its
+ *        sequence counter.
+ *
+ * A room is never guarded by a mutex. Everything that touches its members, history or sequence
+ * runs on the room's own strand, so rooms proceed in parallel on the io threads and a busy room
+ * never blocks a quiet one. Callers post work with boost::asio::post(room->GetStrand(), ...).
+ * Delivering a message to the members is handed to the shared FanOut engine, which spreads large
+ * rooms over all io threads.
+ *
+ * Members that agreed to batched text get the chat lines of a short window (or up to a byte
+ * threshold) in one TextBatch frame instead of one frame and one write per line.
+ **/
+class Room
+{
+public:
+    using Strand = boost::asio::strand<boost::asio::io_context::executor_type>;
+    using Frame = MessageHistory::Frame;
+
+    static constexpr std::size_t INITIAL_HISTORY_PAGE = 20; // messages replayed on join, older ones on demand
+    static constexpr std::size_t MAX_HISTORY_PAGE = 100;    // upper bound for a single HistoryQuery
+    static constexpr std::size_t MAX_NAME_LENGTH = 32;
+
+    struct Options
+    {
+        MessageHistory::Limits history_limits;
+        std::filesystem::path spill_dir;    // file blobs demoted out of RAM; empty disables spilling
+        std::filesystem::path log_dir;      // persistent history log; empty keeps history in memory only
+        std::shared_ptr<HistoryLogWriter> log_writer;  // writer thread shared by the logs; null: one for this log
+        double broadcasts_per_second = 0;   // room-wide cap on chat broadcasts; 0 = unlimited
+        double broadcast_burst = 0;
+        std::chrono::microseconds batch_window{0};  // chat lines collected per TextBatch frame; 0 = no batching
+        std::size_t batch_max_bytes = 16 * 1024;    // a batch this large is sent before its window ends
+    };
+
+    /**
+     * @brief Room names double as directory names: 1-32 characters out of [A-Za-z0-9_-]
+     **/
+    static bool IsValidName(const std::string& name);
+
+    /**
+     * @brief Creates the room and recovers the newest messages from its log, if it has one
+     **/
+    Room(std::string name, boost::asio::io_context& io, FanOut& fan_out, const Options& options);
+
+    Room(const Room&) = delete;
+    Room& operator=(const Room&) = delete;
+
+    const std::string& GetName() const { return name_; }
+    Strand& GetStrand() { return strand_; }
+
+    // --- Must be called on GetStrand() ---
+
+    /**
+     * @brief Adds a member; `protocol` is its connection's (null: a member that speaks the legacy protocol)
+     **/
+    void Join(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket, std::shared_ptr<OutboundQueue> outbound,
+              std::shared_ptr<FileTransferQueue> file_queue, bool multiplexed = false, bool batched = false,
+              std::shared_ptr<const ConnectionProtocol> protocol = nullptr);
+    void Leave(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket);
+    /**
+     * @brief Forgets members whose connection closed (delivery also does this as it notices them)
+     **/
+    void PruneClosedMembers();
+    /**
+     * @brief Attaches the member's file connection once the client linked it (SendHistory), or with
+     *        `multiplexed` sends it files as chunks on its text connection. `batched` members get chat
+     *        lines in TextBatch frames.
+     **/
+    void LinkFileQueue(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket,
+                       std::shared_ptr<FileTransferQueue> file_queue, bool multiplexed = false, bool batched = false);
+    /**
+     * @brief Replaces the room-wide broadcast cap (0 = unlimited)
+     **/
+    void SetBroadcastLimit(double broadcasts_per_second, double burst);
+    /**
+     * @brief Replaces the batching window and byte threshold (a zero window sends every line on its own)
+     **/
+    void SetBatching(std::chrono::microseconds window, std::size_t max_bytes);
+    /**
+     * @brief Sends the chat lines collected for batched members now, instead of at the end of the window
+     **/
+    void FlushBatch();
+
+    /**
+     * @brief Numbers a chat line (`prefix` + `text`), records it and sends it to every member except the sender.
+     *        Members on the legacy protocol get it as a plain Text frame, without the sequence number.
+     *        Lines over the room's broadcast cap are dropped (and counted) instead.
+     **/
+    void PublishText(const std::shared_ptr<boost::asio::ip::tcp::socket>& sender, std::string_view prefix,
+                     std::string_view text);
+    /**
+     * @brief Numbers a file and its announcement, records both, announces it to every member and
+     *        sends the file to every member except the sender (the text connection it belongs to).
+     *        `file_frame` is the encoded file, encoded by the caller so that it never runs on the room's strand
+     **/
+    void PublishFile(const std::shared_ptr<boost::asio::ip::tcp::socket>& sender, const std::string& announcement,
+                     const std::shared_ptr<FileMessage>& file, Frame file_frame);
+
+    /**
+     * @brief Replays the history to one member: a delta after `last_seen` when possible, otherwise the newest
+     *        page. `prefix` (optional) is written in the same gather-write, ahead of the history.
+     *        A member on the legacy protocol gets the page as plain Text frames, without the HistorySync header.
+     **/
+    void ReplayHistory(const std::shared_ptr<OutboundQueue>& outbound,
+                       const std::shared_ptr<FileTransferQueue>& file_queue, uint64_t last_seen,
+                       Frame prefix = nullptr);
+
+    /**
+     *  @brief Answers a HistoryQuery with CollectHistoryPage. The ring is read here; a page that reaches
+     *         into the persistent log is read and sent from the bulk executor, never from the strand.
+     **/
+    void SendHistoryPage(const std::shared_ptr<OutboundQueue>& outbound, uint64_t before_sequence, uint32_t limit);
+
+    /**
+     *  @brief Builds the answer to a HistoryQuery: a HistorySync(Page) frame followed by up to `limit`
+     *         text frames older than `before_sequence`, taken from the ring and then the persistent log.
+     *         Reads the log on the calling thread.
+     **/
+    std::vector<Frame> CollectHistoryPage(uint64_t before_sequence, uint32_t limit) const;
+
+    // --- Thread-safe ---
+
+    MessageHistory::Stats GetHistoryStats() const { return history_.stats(); }
+    uint64_t GetLastSequence() const { return last_sequence_.load(std::memory_order_relaxed); }
+    std::size_t GetMemberCount() const { return member_count_.load(std::memory_order_relaxed); }
+    uint64_t GetRateLimitedCount() const { return rate_limited_.load(std::memory_order_relaxed); }
+    uint64_t GetBatchCount() const { return batches_.load(std::memory_order_relaxed); }
+    /**
+     * @brief True if the room has had no members since `cutoff` and no spill of its history is pending
+     **/
+    bool IsIdleSince(std::chrono::steady_clock::time_point cutoff) const;
+    /**
+     * @brief Writes spilled file blobs, and reloads and encodes the files a replay sends, on `executor`
+     *        instead of on the strand (empty: on the strand). Set it before the room is in use.
+     **/
+    void SetBulkExecutor(boost::asio::any_io_executor executor);
+    /**
+     * @brief Blocks until the persistent log (if any) is durable
+     **/
+    void FlushHistoryLog();
+
+private:
+    static std::vector<Frame> CollectHistoryPage(const MessageHistory::Snapshot& snapshot, const HistoryLog* log,
+                                                 uint64_t before_sequence, uint32_t limit);
+    void UpdateMemberCount();
+    /**
+     * @brief Lane-partitioned view of the members, rebuilt lazily after membership changes
+     **/
+    const std::shared_ptr<const FanOut::Recipients>& CurrentRecipients();
+    /**
+     * @brief Adds a numbered chat line to the pending batch, armed with the window timer on the first one
+     **/
+    void AddToBatch(const std::shared_ptr<boost::asio::ip::tcp::socket>& sender, std::string_view prefix,
+                    std::string_view text, uint64_t sequence, Frame frame);
+
+    const std::string name_;
+    Strand strand_;
+
+    FanOut& fan_out_;
+    const std::shared_ptr<FanOut::Stream> fan_out_stream_;
+    std::vector<FanOut::Recipient> members_;
+    std::shared_ptr<const FanOut::Recipients> recipients_;
+    bool recipients_dirty_ = true;
+    bool has_batched_members_ = false;
+    bool has_legacy_members_ = false;   // may stay set after the last one sent Hello, until the next change
+    std::atomic<std::size_t> member_count_{0};
+    std::atomic<std::chrono::steady_clock::rep> idle_since_;  // when the last member left
+
+    MessageHistory history_;
+    std::shared_ptr<HistoryLog> history_log_;   // shared with the page reads running on the bulk executor
+    boost::asio::any_io_executor bulk_executor_;
+    std::atomic<uint64_t> last_sequence_{0};    // written on the strand only
+
+    TokenBucket broadcast_budget_;
+    std::atomic<uint64_t> rate_limited_{0};
+
+    // Lines waiting for the batched members: the records, and per record its sender and its own frame
+    // (a batch of one line is sent as that line's frame, and a sender gets the other lines' frames)
+    struct PendingLine
+    {
+        std::shared_ptr<boost::asio::ip::tcp::socket> sender;
+        Frame frame;
+    };
+    std::vector<TextBatchMessage::Record> batch_;
+    std::vector<PendingLine> batch_lines_;
+    std::size_t batch_bytes_ = 0;
+    std::chrono::microseconds batch_window_;
+    std::size_t batch_max_bytes_;
+    boost::asio::steady_timer batch_timer_;
+    std::atomic<uint64_t> batches_{0};
+};
@@ -10,28 +10,135 @@
 #include <memory>
 #include <filesystem>
 #include <MessageTypes/Utilities/FileTransferQueue.h>
+#include <MessageTypes/Utilities/ChunkAssembler.h>
+#include <Server/MessageHistory.h>
+#include <Server/Room.h>
+#include <Server/Session.h>
+#include <Server/SessionSlab.h>
+#include <Server/OutboundQueue.h>
+#include <Server/RateLimiter.h>
+#include <Server/TimerWheel.h>
+#include <MessageTypes/Text/TextMessage.h>
+#include <shared_mutex>
+#include <condition_variable>
+#include <optional>
 
 using boost::asio::ip::tcp;
 
+class FileMessage;
+
 class ServerManager
 {
     friend class TestableServerManager;
 
 private:
     static constexpr size_t MAX_HISTORY_MESSAGES = 100;
+    static constexpr size_t MAX_HISTORY_BYTES = 64ull * 1024 * 1024;        // file blobs kept in RAM
+    static constexpr size_t MAX_HISTORY_SPILL_BYTES = 1024ull * 1024 * 1024; // file blobs demoted to disk
+    static constexpr size_t FAN_OUT_INLINE_THRESHOLD = 512;  // rooms larger than this fan out on all io threads
+    static constexpr unsigned int DEFAULT_CONCURRENT_ACCEPTS = 4;
+    static constexpr int DEFAULT_LISTEN_BACKLOG = 4096;      // the kernel caps it at net.core.somaxconn
+    static constexpr unsigned int DEFAULT_FILE_IO_THREADS = 2;   // threads of the file port's own io_context
+    static constexpr unsigned int CPU_WORKERS = 2;               // decoding and spilling of large file messages
+    static constexpr size_t FILE_OFFLOAD_BYTES = 64 * 1024;      // file bodies this large are decoded on the workers
+    static constexpr size_t MAX_FILES_IN_FLIGHT = 8;             // decoded files waiting for their room
+    static constexpr size_t MAX_CHUNKED_FILE_BYTES = 128ull * 1024 * 1024;  // partial uploads per multiplexed connection
+    static constexpr double DEFAULT_ROOM_BROADCASTS_PER_SECOND = 200.0;  // chat lines a room fans out, all senders
+    static constexpr double DEFAULT_ROOM_BROADCAST_BURST = 400.0;
+    static constexpr std::chrono::microseconds DEFAULT_CHAT_BATCH_WINDOW{1000};  // batched chat waits at most this
+    static constexpr size_t DEFAULT_CHAT_BATCH_BYTES = 16 * 1024;                // or until a batch is this large
+    static constexpr std::chrono::seconds DEFAULT_HEARTBEAT_INTERVAL{30};  // ping text connections this quiet
+    static constexpr std::chrono::seconds DEFAULT_IDLE_TIMEOUT{90};        // drop connections this quiet
+    static constexpr std::chrono::minutes DEFAULT_LEGACY_IDLE_TIMEOUT{30}; // or this quiet, if they cannot be pinged
+    static constexpr std::size_t KEEPALIVE_WHEEL_SLOTS = 512;
+    static constexpr uint64_t MAX_TEXT_FRAME_BYTES = 1024 * 1024;  // text connections that said hello, files use chunks
+    static constexpr std::size_t DEFAULT_MAX_ROOMS = 256;               // joining another room is refused
+    static constexpr std::chrono::minutes DEFAULT_ROOM_IDLE_TIMEOUT{10};  // empty rooms this quiet are reclaimed
+
+    // Time of the last message received from a connection, in steady_clock ticks
+    using LastRead = std::atomic<TimerWheel::Clock::rep>;
+
+    // Per-connection state. The session (identity) is immutable; room, file queue and owner change on join/link.
+    struct Connection
+    {
+        std::shared_ptr<const Session> session;
+        std::shared_ptr<LastRead> last_read;            // text connections: refreshed by every received message
+        std::weak_ptr<tcp::socket> socket;
+        std::shared_ptr<OutboundQueue> outbound;        // text connections: bounded writer for everything sent
+        std::shared_ptr<IngressLimiter> ingress;        // text connections: message and byte budgets
+        std::shared_ptr<Room> room;                     // text connections: current room
+        std::shared_ptr<FileTransferQueue> file_queue;  // text connections: queue of their linked file connection
+        std::shared_ptr<ChunkAssembler> chunks;         // text connections: files uploaded over the connection
+        std::shared_ptr<ConnectionProtocol> protocol;   // text connections: agreed by the Hello exchange
+        bool multiplexed = false;                       // text connections: files are sent to it as chunks
+        std::weak_ptr<tcp::socket> owner;               // file connections: the text connection they belong to
+    };
+
+    // What one accepted connection owns, allocated as one SessionSlab block: the socket, its identity and
+    // the per-connection state sit together and go away together. Connection hands out pointers into the
+    // block that share its reference count. The OutboundQueue takes a block of its own slab.
+    struct SessionBlock
+    {
+        explicit SessionBlock(const boost::asio::any_io_executor& executor) : socket(executor) {}
 
-    using HistoryMessage = std::shared_ptr<IMessage>;
+        tcp::socket socket;
+        std::optional<Session> session;          // set once the socket is accepted
+        LastRead last_read{0};
+        ConnectionProtocol protocol;
+        std::optional<IngressLimiter> ingress;   // text connections
+        std::optional<ChunkAssembler> chunks;    // text connections
+    };
 
-    //history for the current chatroom to send to a textsocket after someone joins
-    std::deque<HistoryMessage> message_history_;
-    std::mutex history_mutex_;
+    //rooms by name, created on first join; each room serializes its own state on its strand
+    std::unordered_map<std::string, std::shared_ptr<Room>> rooms_;
+    mutable std::shared_mutex rooms_mutex_;
+    //held while a room is built (outside rooms_mutex_), so two joins never recover the same log at once
+    std::mutex room_creation_mutex_;
+    //at most max_rooms_ rooms; empty ones idle for room_idle_timeout_ are reclaimed. Guarded by rooms_mutex_
+    std::size_t max_rooms_ = DEFAULT_MAX_ROOMS;
+    std::chrono::milliseconds room_idle_timeout_ = DEFAULT_ROOM_IDLE_TIMEOUT;
+    std::size_t rooms_reclaim_at_ = 16;
+    //persistent history root: the default room logs here, other rooms under rooms/<name>
+    std::filesystem::path history_dir_;
+    //one writer thread for the history logs of all rooms
+    std::shared_ptr<HistoryLogWriter> history_writer_;
+
+    //every accepted connection, created at accept time. Read on every message (shared lock),
+    //written only on connect/join/link.
+    std::unordered_map<const tcp::socket*, Connection> connections_;
+    //file connections by "ip:port", used to link a client's file connection to its text connection
+    std::unordered_map<std::string, std::weak_ptr<tcp::socket>> file_connections_by_endpoint_;
+    std::size_t connections_prune_at_ = 64;
+    //connection state and outbound queues, each from its own slab of same-sized blocks
+    const std::shared_ptr<SessionSlab> session_slab_ = std::make_shared<SessionSlab>();
+    const std::shared_ptr<SessionSlab> outbound_slab_ = std::make_shared<SessionSlab>();
+    uint64_t next_session_id_ = 1;
+    mutable std::shared_mutex connections_mutex_;
+    //high-water marks and slow-consumer policy of new text connections, and how often the policies fired
+    OutboundQueue::Limits outbound_limits_;
+    const std::shared_ptr<OutboundQueue::Metrics> outbound_metrics_ = std::make_shared<OutboundQueue::Metrics>();
+    //ingress budgets of new text connections, and how often they throttled or disconnected someone
+    IngressLimiter::Limits ingress_limits_;
+    const std::shared_ptr<IngressLimiter::Metrics> ingress_metrics_ = std::make_shared<IngressLimiter::Metrics>();
+    double room_broadcasts_per_second_ = DEFAULT_ROOM_BROADCASTS_PER_SECOND;  // guarded by rooms_mutex_
+    double room_broadcast_burst_ = DEFAULT_ROOM_BROADCAST_BURST;
+    std::chrono::microseconds chat_batch_window_ = DEFAULT_CHAT_BATCH_WINDOW;  // guarded by rooms_mutex_
+    std::size_t chat_batch_bytes_ = DEFAULT_CHAT_BATCH_BYTES;
 
     //threads used to run the multithreaded IO_Context
     std::vector<std::thread> threads;
-    std::vector<std::shared_ptr<tcp::socket>> text_port_clients_;
-    std::vector<std::shared_ptr<tcp::socket>> file_port_clients_;
-    std::mutex text_port_clients_mutex_;
-    std::mutex file_port_clients_mutex_;
+    // Connected sockets of one port keyed by session id: O(1) registration, closed ones pruned amortized
+    struct ClientList
+    {
+        std::unordered_map<uint64_t, std::shared_ptr<tcp::socket>> sockets;
+        std::size_t prune_at = 64;
+        std::mutex mutex;
+    };
+    ClientList text_port_clients_;
+    ClientList file_port_clients_;
+    //how many async_accept operations are kept outstanding per acceptor, and the listen backlog
+    unsigned int concurrent_accepts_ = DEFAULT_CONCURRENT_ACCEPTS;
+    int listen_backlog_ = DEFAULT_LISTEN_BACKLOG;
 
     //helper classes that recieve and parse data from sockets
     MessageReceiver messageReciever_;
@@ -40,13 +147,42 @@ private:
     int port;
     int fileport;
     std::string address;
+    //chat traffic: text acceptor, text sockets and the room strands. Kept free of bulk file work.
     boost::asio::io_context io_context;
+    //bulk traffic: file acceptor and file sockets, on their own threads
+    boost::asio::io_context file_io_context_;
+    std::vector<std::thread> file_threads_;
+    //CPU- and disk-heavy work (decoding multi-megabyte file messages, spilling them out of the room
+    //histories), kept off both io contexts. Declared after rooms_ so it is joined before they go away.
+    boost::asio::thread_pool cpu_pool_{CPU_WORKERS};
+    //0 file io threads runs the file port on the chat io_context
+    unsigned int file_io_threads_ = DEFAULT_FILE_IO_THREADS;
+    bool offload_heavy_work_ = true;
+    //bulk ingest backpressure: a worker holding a decoded file waits while MAX_FILES_IN_FLIGHT files are
+    //queued for their rooms, which stops reading from that file socket until the rooms caught up
+    std::size_t files_in_flight_ = 0;
+    bool file_ingest_open_ = true;
+    std::mutex file_ingest_mutex_;
+    std::condition_variable file_ingest_cv_;
+
+    //keepalive: every connection has one timer in the wheel, driven by a single steady_timer tick.
+    //Silent text connections are pinged, connections silent past the idle timeout are dropped.
+    std::chrono::milliseconds heartbeat_interval_ = DEFAULT_HEARTBEAT_INTERVAL;
+    std::chrono::milliseconds idle_timeout_ = DEFAULT_IDLE_TIMEOUT;  // 0 disables keepalive
+    std::chrono::milliseconds legacy_idle_timeout_ = DEFAULT_LEGACY_IDLE_TIMEOUT;
+    std::unique_ptr<TimerWheel> keepalive_wheel_;
+    std::unique_ptr<boost::asio::steady_timer> keepalive_timer_;
+    std::atomic<uint64_t> heartbeats_sent_{0};
+    std::atomic<uint64_t> idle_expired_{0};
+    //spreads delivery to large rooms over all io threads (one lane per io thread)
+    FanOut fan_out_;
     std::shared_ptr<boost::asio::ip::tcp::acceptor> acceptor_;
     std::shared_ptr<boost::asio::ip::tcp::acceptor> file_acceptor_;
 
     // per-file-client transfer queues
     std::unordered_map<std::uintptr_t, std::shared_ptr<FileTransferQueue>> file_queues_;
     std::mutex file_queues_mutex_;
+    ZeroCopySender::Options zero_copy_options_;  // guarded by file_queues_mutex_
 
     //server status
     bool serverup_ = false;
@@ -64,54 +200,221 @@ private:
     std::shared_ptr<FileTransferQueue> GetOrCreateFileQueueForSocket(const std::shared_ptr<tcp::socket>& sock);
     void RemoveFileQueueForSocket(const std::shared_ptr<tcp::socket>& sock);
     void SetStatusUP(bool status);
+    /**
+    *  @brief Blocks the calling CPU worker until fewer than MAX_FILES_IN_FLIGHT files wait for their rooms
+    **/
+    void WaitForFileSlot();
+    /**
+    *  @brief Opens, binds and listens with the configured backlog
+    **/
+    std::shared_ptr<tcp::acceptor> MakeAcceptor(boost::asio::io_context& io, int listen_port);
+    /**
+    *  @brief io_context serving the file port (the chat io_context when file traffic is not isolated)
+    **/
+    boost::asio::io_context& FileIoContext();
 
     /**
-    *  @brief Broadcasts a specific text message to every client connected to the chatroom except the sender
+    *  @brief Returns the room with this name, creating it (and recovering its log) on first use
+    *  @return nullptr if the room does not exist and the room limit is reached
+    **/
+    std::shared_ptr<Room> GetOrCreateRoom(const std::string& name);
+    /**
+    *  @brief Takes the rooms out that nobody is in or refers to and that have been empty for the idle
+    *         timeout (never the default room); the caller destroys them after releasing the lock.
+    *         Rooms still listing closed connections are asked to forget them, for a later pass.
     **/
-    void Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::string& text);
+    std::vector<std::shared_ptr<Room>> ReclaimIdleRoomsLocked();
     /**
-    *  @brief Broadcasts a specific file message to every client connected to the chatroom except the sender
+    *  @brief Slab block of a connection about to be accepted, its socket bound to `executor`
+    **/
+    std::shared_ptr<SessionBlock> NewSessionBlock(const boost::asio::any_io_executor& executor);
+    static std::shared_ptr<tcp::socket> SocketOf(const std::shared_ptr<SessionBlock>& block)
+    {
+        return std::shared_ptr<tcp::socket>(block, &block->socket);
+    }
+    /**
+    *  @brief Fills in the session of a freshly accepted connection and registers it
+    **/
+    const Session& RegisterConnection(const std::shared_ptr<SessionBlock>& block, bool is_file);
+    /**
+    *  @brief Snapshot of a connection's state (empty for unknown sockets)
+    **/
+    Connection GetConnection(const std::shared_ptr<tcp::socket>& socket) const;
+    /**
+    *  @brief Room the text connection is currently in (the default room if it never joined one)
+    **/
+    std::shared_ptr<Room> GetRoomOf(const std::shared_ptr<tcp::socket>& text_socket);
+    /**
+    *  @brief Moves a text connection into a room. With `announce` the client gets a RoomMessage(Join)
+    *         confirmation followed by the newest page of the room's history.
+    **/
+    void JoinRoom(const std::shared_ptr<tcp::socket>& text_socket, const std::string& name, bool announce);
+    /**
+    *  @brief Forgets closed connections, amortized over connects
+    **/
+    void PruneConnectionsLocked();
+
+    /**
+    *  @brief Starts the keepalive tick (one timer for all connections) if keepalive is enabled
+    **/
+    void StartKeepalive();
+    void KeepaliveTick();
+    /**
+    *  @brief Keepalive check of one connection, run by its wheel timer; re-arms the timer while the connection lives.
+    *         Text connections are pinged when quiet and expired when silent for the idle timeout. File connections
+    *         live as long as the text connection that owns them, or the idle timeout if they never get one.
+    **/
+    void CheckKeepalive(const std::weak_ptr<tcp::socket>& weak_socket, bool is_file);
+    void ScheduleKeepalive(const std::shared_ptr<tcp::socket>& socket, bool is_file,
+                           TimerWheel::Clock::time_point deadline);
+    /**
+    *  @brief Drops a connection that stopped responding: shutting it down wakes its pending read, and the
+    *         receiver closes it like any other disconnect. File connections also stop their transfer queue.
+    **/
+    void ExpireConnection(const std::shared_ptr<tcp::socket>& socket, bool is_file);
+
+    /**
+    *  @brief Publishes a text message to the sender's room (every member except the sender receives it)
+    **/
+    void Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::shared_ptr<const TextMessage>& message);
+    void Broadcast(const std::shared_ptr<tcp::socket>& sender, std::string text);
+    /**
+    *  @brief Publishes a file message to the room of the text connection that owns the sending file connection
     **/
     void Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::shared_ptr<std::vector<char>>& rawData);
+    void Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::shared_ptr<FileMessage>& file);
 
 public:
+    static constexpr const char* DEFAULT_ROOM = "lobby";
+
     std::string GetIpAddress();
+    /**
+     * @brief Current footprint of the default room's chat history (entries, resident and spilled bytes)
+     **/
+    MessageHistory::Stats GetHistoryStats() const;
+    std::size_t GetRoomCount() const;
+    FanOut& GetFanOut() { return fan_out_; }
+    /**
+     * @brief Number of registered (not yet pruned) text and file connections
+     **/
+    std::size_t GetConnectionCount() const;
+    /**
+     * @brief Slab blocks of connection state in use and reserved (see SessionSlab)
+     **/
+    SessionSlab::Stats GetSessionSlabStats() const { return session_slab_->GetStats(); }
+    /**
+     * @brief Outbound high-water marks and slow-consumer policy, applied to connections accepted afterwards
+     **/
+    void SetOutboundLimits(const OutboundQueue::Limits& limits);
+    /**
+     * @brief How often the outbound limits were hit and each policy fired, over all connections
+     **/
+    OutboundQueue::Stats GetOutboundStats() const { return outbound_metrics_->Load(); }
+    /**
+     * @brief Per-connection ingress budgets (messages/s, bytes/s), applied to connections accepted afterwards
+     **/
+    void SetIngressLimits(const IngressLimiter::Limits& limits);
+    IngressLimiter::Stats GetIngressStats() const { return ingress_metrics_->Load(); }
+    /**
+     * @brief Room-wide cap on chat broadcasts (0 = unlimited), applied to every room
+     **/
+    void SetRoomBroadcastLimit(double broadcasts_per_second, double burst);
+    /**
+     * @brief Batching of chat lines for connections that agreed to it, applied to every room
+     * @param window    lines are collected this long before they are sent (0 sends every line on its own)
+     * @param max_bytes a batch this large is sent before its window ends
+     **/
+    void SetChatBatching(std::chrono::microseconds window, std::size_t max_bytes);
+    /**
+     * @brief Limits the number of rooms: joining a new room is refused once `max_rooms` exist. Rooms nobody
+     *        has been in for `idle_timeout` are reclaimed (their history stays in the persistent log, if any).
+     **/
+    void SetRoomLimits(std::size_t max_rooms, std::chrono::milliseconds idle_timeout);
+    /**
+     * @brief Chat lines dropped by the room-wide broadcast caps, over all rooms
+     **/
+    uint64_t GetRoomRateLimitedCount() const;
+    /**
+     * @brief Keepalive timing, takes effect on the next StartServer()
+     * @param heartbeat_interval a text connection silent this long is sent a Ping
+     * @param idle_timeout       a connection silent this long is dropped (0 disables keepalive)
+     * @param legacy_idle_timeout a text connection that never sent Hello (a legacy client) cannot answer a Ping,
+     *        so it is never pinged and only dropped once it has been silent this long
+     **/
+    void SetKeepaliveOptions(std::chrono::milliseconds heartbeat_interval, std::chrono::milliseconds idle_timeout,
+                             std::chrono::milliseconds legacy_idle_timeout = DEFAULT_LEGACY_IDLE_TIMEOUT);
+    uint64_t GetHeartbeatsSent() const { return heartbeats_sent_.load(std::memory_order_relaxed); }
+    /**
+     * @brief Connections dropped by the idle timeout
+     **/
+    uint64_t GetIdleExpiredCount() const { return idle_expired_.load(std::memory_order_relaxed); }
+    /**
+     * @brief Accept tuning, takes effect on the next StartServer()
+     * @param concurrent_accepts async_accept operations kept outstanding per acceptor (at least 1)
+     * @param listen_backlog     backlog passed to listen()
+     **/
+    void SetAcceptOptions(unsigned int concurrent_accepts, int listen_backlog);
+    /**
+     * @brief Execution domains of the file port, takes effect on the next StartServer()
+     * @param file_io_threads threads of the file port's own io_context; 0 shares the chat io_context
+     * @param offload_heavy_work decode large files, spill history blobs and reload replayed ones on the
+     *                           CPU workers (false does all of it on the io threads / room strands)
+     **/
+    void SetFileExecutorOptions(unsigned int file_io_threads, bool offload_heavy_work);
+    /**
+     * @brief MSG_ZEROCOPY for large frames on the file port (see ZeroCopySender), applied to file
+     *        connections accepted afterwards; off by default
+     **/
+    void SetZeroCopyOptions(const ZeroCopySender::Options& options);
+    /**
+     * @brief Number of threads running the io_context (and of fan-out lanes)
+     **/
+    static unsigned int IoThreadCount();
 
-    ServerManager(int port, int fileport, std::string&& ipAddress);
+    /**
+     * @param history_dir root directory of the persistent room history logs; empty keeps history in memory only
+     **/
+    ServerManager(int port, int fileport, std::string&& ipAddress, const std::filesystem::path& history_dir = {});
+    ~ServerManager();
     void StartServer();
     void StopServer();
     static std::string GetSocketIP(const std::shared_ptr<tcp::socket>& sock);
     /**
  * @brief Asynchronously accept one incoming connection, register it, start receiving messages/files,
- *        optionally send a greeting + recent message history, and re-arm the acceptor.
+ *        and re-arm the acceptor.
  *
  * This function calls async_accept(...) on `acceptor` and installs a handler that:
  *  - validates the accept result and ignores expected shutdown errors,
- *  - deduplicates and adds the accepted socket to `client_list` (protected by `client_list_mutex`),
+ *  - creates the connection's Session and adds the socket to `clients` under its session id (O(1)),
  *  - for file clients, creates/gets a per-socket FileTransferQueue,
+ *  - registers text connections as members of the default room,
+ *  - optionally sends a greeting when `sendGreeting` is true,
  *  - starts the receiver (calls receiver.start_read_header),
- *  - optionally sends a greeting and the message history to the new client when `sendGreeting` is true,
- *  - pushes file/text entries into message_history_ where appropriate,
  *  - re-arms itself (calls AcceptConnection again) unless io_context was stopped or acceptor shutdown is detected.
  *
- * Thread-safety: caller must provide the correct mutex that protects `client_list`. `acceptor` and `receiver`
- * must outlive the asynchronous handler.
+ * StartServer() starts several of these chains per acceptor, so a burst of connections is not
+ * limited to one pending accept. `acceptor`, `clients` and `receiver` must outlive the asynchronous handler.
  *
  * @param acceptor            shared_ptr<tcp::acceptor> Acceptor to accept the connection on (must remain valid).
- * @param client_list         std::vector<std::shared_ptr<tcp::socket>>&
- *                            Container holding connected client sockets; the accepted socket will be added here
- *                            (guarded by client_list_mutex).
- * @param client_list_mutex   std::mutex& Mutex protecting `client_list`.
+ * @param clients             ClientList& Connected sockets of this port; the accepted socket is added here.
  * @param receiver            MessageReciever& The object responsible for parsing incoming data from the socket;
  *                            receiver.start_read_header(...) is invoked for the new socket.
- * @param sendGreeting        bool If true, send a hello message and the stored message history to the newly
- *                            connected socket (used for text clients; typically false for file-only clients).
- * @param clientType          const TextTypes& Enum/value describing the client type (e.g., Text vs File).
- *                            Used by the handler to perform client-type-specific logic (e.g. create a file queue).
+ * @param sendGreeting        bool If true, send a hello message to the newly connected socket.
  */
-    void AcceptConnection(const std::shared_ptr<tcp::acceptor>& acceptor,
-                          std::vector<std::shared_ptr<tcp::socket>>& client_list, std::mutex& client_list_mutex,
+#ifdef CHAT_USE_COROUTINES
+    /**
+     * @brief Coroutine form of AcceptConnection(): accepts on `acceptor` until it is shut down, handling each
+     *        connection like the callback chain does. StartServer() spawns several per acceptor.
+     */
+    boost::asio::awaitable<void> AcceptLoop(std::shared_ptr<tcp::acceptor> acceptor, ClientList& clients,
+                                            MessageReceiver& receiver, bool sendGreeting);
+#else
+    void AcceptConnection(const std::shared_ptr<tcp::acceptor>& acceptor, ClientList& clients,
                           MessageReceiver& receiver, bool sendGreeting);
+#endif
+    // Registers an accepted connection and starts reading from it (the handler part of AcceptConnection())
+    void OnAccepted(const std::shared_ptr<SessionBlock>& block, ClientList& clients,
+                    MessageReceiver& receiver, bool sendGreeting);
     int GetPort() const;
     int GetFilePort() const;
     bool GetStatusUP() const;
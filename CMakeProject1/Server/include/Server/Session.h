@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <boost/asio.hpp>
+
+/**
+ * @brief Identity of one accepted connection, computed once at accept time.
+ *
+ * The remote endpoint never changes during a connection, so everything the hot paths need to
+ * label a message (display name, "[TEXT] From ...: " prefix) is formatted here once. Sessions are
+ * immutable and shared freely between threads. The server keeps each one in its connection's slab
+ * block, next to the socket (see ServerManager::SessionBlock).
+ **/
+class Session
+{
+public:
+    Session(uint64_t id, std::string ip, unsigned short port, std::string display_name);
+    /**
+     * @brief Reads the remote endpoint of a freshly accepted socket (the only syscall a session costs)
+     **/
+    Session(uint64_t id, const boost::asio::ip::tcp::socket& socket);
+
+    /**
+     * @brief Pseudo session used for messages that do not come from a connection
+     **/
+    static const std::shared_ptr<const Session>& Server();
+
+    uint64_t GetId() const { return id_; }
+    const std::string& GetIp() const { return ip_; }
+    unsigned short GetPort() const { return port_; }
+    const std::string& GetDisplayName() const { return display_name_; }
+    const std::string& GetTextPrefix() const { return text_prefix_; }
+    const std::string& GetFilePrefix() const { return file_prefix_; }
+
+private:
+    struct Remote
+    {
+        std::string ip;
+        unsigned short port = 0;
+        std::string display_name;
+    };
+    static Remote RemoteOf(const boost::asio::ip::tcp::socket& socket);
+    Session(uint64_t id, Remote remote);
+
+    const uint64_t id_;
+    const std::string ip_;
+    const unsigned short port_;
+    const std::string display_name_;    // "ip:port"
+    const std::string text_prefix_;     // "[TEXT] From ip:port: "
+    const std::string file_prefix_;     // "[FILE] From ip:port: "
+};
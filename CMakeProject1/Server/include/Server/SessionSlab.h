@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Fixed-size blocks for per-connection objects, carved out of slabs of BLOCKS_PER_SLAB blocks.
+ *
+ * The block size is taken from the first allocation; larger requests fall back to the heap. Blocks
+ * are cache-line aligned, so two connections served by different io threads never share a line, and
+ * a connection's objects sit in one block instead of a dozen scattered heap nodes. Freed blocks are
+ * reused most-recently-freed first; slabs are kept until the slab allocator itself goes away, so the
+ * memory of a connection peak stays reserved for the next one. Thread-safe.
+ **/
+class SessionSlab
+{
+public:
+    static constexpr std::size_t BLOCKS_PER_SLAB = 64;
+    static constexpr std::size_t BLOCK_ALIGNMENT = 64;  // a cache line
+
+    struct Stats
+    {
+        std::size_t block_bytes = 0;
+        std::size_t blocks_in_use = 0;
+        std::size_t slabs = 0;
+    };
+
+    SessionSlab() = default;
+    SessionSlab(const SessionSlab&) = delete;
+    SessionSlab& operator=(const SessionSlab&) = delete;
+    ~SessionSlab();
+
+    void* Allocate(std::size_t bytes);
+    void Deallocate(void* block, std::size_t bytes) noexcept;
+
+    Stats GetStats() const;
+
+private:
+    struct FreeBlock
+    {
+        FreeBlock* next;
+    };
+
+    void AddSlabLocked();
+
+    mutable std::mutex mutex_;
+    std::size_t block_bytes_ = 0;  // fixed by the first allocation
+    FreeBlock* free_ = nullptr;
+    std::vector<void*> slabs_;
+    std::size_t in_use_ = 0;
+};
+
+/**
+ * @brief Allocator for std::allocate_shared: the object and its reference count share one slab block.
+ *        Every control block holds the slab, so the slab outlives the last object allocated from it.
+ **/
+template <typename T>
+class SlabAllocator
+{
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<SessionSlab> slab) noexcept : slab_(std::move(slab)) {}
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) noexcept : slab_(other.slab_) {}
+
+    T* allocate(std::size_t n) { return static_cast<T*>(slab_->Allocate(n * sizeof(T))); }
+    void deallocate(T* block, std::size_t n) noexcept { slab_->Deallocate(block, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const noexcept { return slab_ == other.slab_; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const noexcept { return slab_ != other.slab_; }
+
+private:
+    template <typename U>
+    friend class SlabAllocator;
+
+    std::shared_ptr<SessionSlab> slab_;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Hashed timer wheel: one slot per tick, deadlines hashed into slot (tick % slots).
+ *
+ * Scheduling is O(1) and a tick only visits the slot it lands on, so the cost of a tick depends on
+ * the timers due in it, not on how many timers exist. Deadlines further away than one rotation
+ * stay in their slot until their round comes. Timers cannot be cancelled; the callback decides
+ * whether the thing it watched still matters. Thread-safe; callbacks run outside the lock and may
+ * schedule again.
+ **/
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+
+    TimerWheel(Clock::duration tick, std::size_t slots);
+
+    /**
+     * @brief Runs `callback` from the first Advance() at or after `deadline` (rounded up to a tick)
+     **/
+    void Schedule(Clock::time_point deadline, Callback callback);
+    /**
+     * @brief Moves the wheel to `now` and runs every callback that became due
+     * @return number of callbacks run
+     **/
+    std::size_t Advance(Clock::time_point now);
+
+    std::size_t Size() const;
+    Clock::duration GetTick() const { return tick_; }
+
+private:
+    struct Entry
+    {
+        uint64_t expiry;  // absolute tick
+        Callback callback;
+    };
+
+    uint64_t TickOf(Clock::time_point time) const;
+    void StartLocked(Clock::time_point now);
+
+    const Clock::duration tick_;
+    mutable std::mutex mutex_;
+    std::vector<std::vector<Entry>> slots_;
+    std::size_t size_ = 0;
+    Clock::time_point origin_{};  // tick 0, set by the first call
+    uint64_t current_ = 0;        // last tick processed
+};
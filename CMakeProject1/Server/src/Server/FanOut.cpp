@@ -0,0 +1,83 @@
+#include <Server/FanOut.h>
+#include <algorithm>
+#include <thread>
+
+FanOut::FanOut(boost::asio::io_context& io, Options options)
+    : inline_threshold_(options.inline_threshold)
+{
+    const std::size_t lanes = options.lanes != 0 ? options.lanes
+                                                 : std::max(1u, std::thread::hardware_concurrency());
+    lanes_.reserve(lanes);
+    for (std::size_t i = 0; i < lanes; ++i) lanes_.push_back(boost::asio::make_strand(io));
+}
+
+std::size_t FanOut::LaneOf(const Recipient& recipient) const
+{
+    // sockets are heap objects: drop the alignment bits and mix before reducing
+    auto key = reinterpret_cast<std::uintptr_t>(recipient.socket.get()) >> 4;
+    key *= 0x9E3779B97F4A7C15ull;
+    return static_cast<std::size_t>(key >> 32) % lanes_.size();
+}
+
+std::shared_ptr<const FanOut::Recipients> FanOut::Partition(const std::vector<Recipient>& recipients) const
+{
+    auto partitioned = std::make_shared<Recipients>();
+    partitioned->lanes.resize(lanes_.size());
+    for (const auto& recipient : recipients)
+    {
+        if (!recipient.socket) continue;
+        partitioned->lanes[LaneOf(recipient)].push_back(recipient);
+        ++partitioned->size;
+    }
+    return partitioned;
+}
+
+void FanOut::DeliverLane(Stream& stream, const std::vector<Recipient>& lane, const Delivery& delivery)
+{
+    for (const auto& recipient : lane)
+    {
+        if (!recipient.socket->is_open())
+        {
+            stream.saw_closed.store(true, std::memory_order_relaxed);
+            continue;
+        }
+        delivery(recipient);
+    }
+}
+
+void FanOut::Deliver(const std::shared_ptr<Stream>& stream, const std::shared_ptr<const Recipients>& recipients,
+                     Delivery delivery)
+{
+    if (!stream || !recipients || recipients->size == 0) return;
+
+    if (recipients->size <= GetInlineThreshold() && stream->pending_lanes.load(std::memory_order_acquire) == 0)
+    {
+        for (const auto& lane : recipients->lanes) DeliverLane(*stream, lane, delivery);
+        inline_deliveries_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // One shared copy of the delivery for every lane batch of this message
+    auto shared_delivery = std::make_shared<const Delivery>(std::move(delivery));
+    for (std::size_t i = 0; i < recipients->lanes.size(); ++i)
+    {
+        if (recipients->lanes[i].empty()) continue;
+        stream->pending_lanes.fetch_add(1, std::memory_order_acq_rel);
+        boost::asio::post(lanes_[i], [stream, recipients, shared_delivery, i]()
+        {
+            DeliverLane(*stream, recipients->lanes[i], *shared_delivery);
+            stream->pending_lanes.fetch_sub(1, std::memory_order_acq_rel);
+        });
+        lane_batches_.fetch_add(1, std::memory_order_relaxed);
+    }
+    parallel_deliveries_.fetch_add(1, std::memory_order_relaxed);
+}
+
+FanOut::Stats FanOut::GetStats() const
+{
+    Stats s;
+    s.inline_deliveries = inline_deliveries_.load(std::memory_order_relaxed);
+    s.parallel_deliveries = parallel_deliveries_.load(std::memory_order_relaxed);
+    s.lane_batches = lane_batches_.load(std::memory_order_relaxed);
+    return s;
+}
@@ -0,0 +1,488 @@
+#include <Server/HistoryLog.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string SegmentName(uint64_t base, const char* extension)
+    {
+        std::ostringstream oss;
+        oss << std::setw(20) << std::setfill('0') << base << extension;
+        return oss.str();
+    }
+
+    bool WriteAll(int fd, const char* data, std::size_t size)
+    {
+        while (size > 0)
+        {
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool ReadAll(int fd, char* data, std::size_t size, uint64_t offset)
+    {
+        while (size > 0)
+        {
+            const ssize_t n = ::pread(fd, data, size, static_cast<off_t>(offset));
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<std::size_t>(n);
+            offset += static_cast<uint64_t>(n);
+        }
+        return true;
+    }
+
+    // Read-only mapping of a segment index, unmapped when it goes out of scope
+    class MappedIndex
+    {
+    public:
+        MappedIndex(const std::filesystem::path& path, std::size_t bytes) : size_(bytes)
+        {
+            if (size_ == 0) return;
+            const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) return;
+            void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            ::close(fd);
+            if (addr != MAP_FAILED) addr_ = addr;
+        }
+        ~MappedIndex()
+        {
+            if (addr_) ::munmap(addr_, size_);
+        }
+        MappedIndex(const MappedIndex&) = delete;
+        MappedIndex& operator=(const MappedIndex&) = delete;
+
+        const void* data() const { return addr_; }
+
+    private:
+        void* addr_ = nullptr;
+        std::size_t size_ = 0;
+    };
+}
+
+HistoryLogWriter::HistoryLogWriter() : thread_([this]() { run(); })
+{
+}
+
+HistoryLogWriter::~HistoryLogWriter()
+{
+    {
+        std::scoped_lock lk(mutex_);
+        running_ = false;
+    }
+    cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+}
+
+void HistoryLogWriter::attach(HistoryLog* log)
+{
+    std::scoped_lock lk(mutex_);
+    logs_.insert(log);
+}
+
+void HistoryLogWriter::detach(HistoryLog* log)
+{
+    std::unique_lock lk(mutex_);
+    logs_.erase(log);
+    ready_.erase(log);
+    sync_due_.erase(log);
+    idle_cv_.wait(lk, [this, log]() { return std::find(busy_.begin(), busy_.end(), log) == busy_.end(); });
+}
+
+void HistoryLogWriter::wake(HistoryLog* log)
+{
+    {
+        std::scoped_lock lk(mutex_);
+        if (!logs_.count(log)) return;
+        ready_.insert(log);
+    }
+    cv_.notify_one();
+}
+
+void HistoryLogWriter::run()
+{
+    std::unique_lock lk(mutex_);
+    for (;;)
+    {
+        auto next_sync = Clock::time_point::max();
+        for (const auto& [log, due] : sync_due_) next_sync = std::min(next_sync, due);
+        auto ready = [this]() { return !ready_.empty() || !running_; };
+        if (next_sync == Clock::time_point::max())
+            cv_.wait(lk, ready);
+        else
+            cv_.wait_until(lk, next_sync, ready);
+        // every log holds the writer, so all of them are stopped (and flushed) by the time it goes
+        if (!running_) break;
+
+        // The logs that got frames or a flush request, and those whose sync is due
+        const auto now = Clock::now();
+        busy_.assign(ready_.begin(), ready_.end());
+        ready_.clear();
+        for (auto it = sync_due_.begin(); it != sync_due_.end();)
+        {
+            const bool due = it->second <= now;
+            const bool queued = std::find(busy_.begin(), busy_.end(), it->first) != busy_.end();
+            if (due && !queued) busy_.push_back(it->first);
+            if (due || queued) it = sync_due_.erase(it);
+            else ++it;
+        }
+        const std::vector<HistoryLog*> round = busy_;
+        lk.unlock();
+
+        std::vector<std::pair<HistoryLog*, std::optional<Clock::time_point>>> results;
+        results.reserve(round.size());
+        for (HistoryLog* log : round) results.emplace_back(log, log->write_round());
+
+        lk.lock();
+        for (const auto& [log, due] : results)
+        {
+            if (due && logs_.count(log)) sync_due_[log] = *due;
+        }
+        busy_.clear();
+        idle_cv_.notify_all();
+    }
+}
+
+HistoryLog::HistoryLog(std::filesystem::path dir) : HistoryLog(std::move(dir), HistoryLogOptions{})
+{
+}
+
+HistoryLog::HistoryLog(std::filesystem::path dir, HistoryLogOptions options, std::shared_ptr<HistoryLogWriter> writer)
+    : dir_(std::move(dir)), options_(options), writer_(writer ? std::move(writer) : std::make_shared<HistoryLogWriter>())
+{
+    std::filesystem::create_directories(dir_);
+    recover();
+
+    if (segments_.empty())
+        start_new_segment(0);
+    else
+        open_segment_for_append(segments_.back());
+
+    last_sync_ = std::chrono::steady_clock::now();
+    stats_.records = size();
+    writer_->attach(this);
+}
+
+HistoryLog::~HistoryLog()
+{
+    stop();
+}
+
+void HistoryLog::recover()
+{
+    std::vector<Segment> found;
+    for (const auto& file : std::filesystem::directory_iterator(dir_))
+    {
+        if (file.path().extension() != ".log") continue;
+
+        Segment seg;
+        try { seg.base = std::stoull(file.path().stem().string()); }
+        catch (const std::exception&) { continue; }
+        seg.data_path = file.path();
+        seg.index_path = dir_ / SegmentName(seg.base, ".idx");
+        if (!std::filesystem::exists(seg.index_path)) continue;
+
+        seg.data_bytes = std::filesystem::file_size(seg.data_path);
+        seg.records = std::filesystem::file_size(seg.index_path) / sizeof(IndexEntry);
+        found.push_back(std::move(seg));
+    }
+    std::sort(found.begin(), found.end(), [](const Segment& a, const Segment& b) { return a.base < b.base; });
+
+    // Only the newest segment can have a torn tail; drop index entries pointing past the data
+    if (!found.empty())
+    {
+        Segment& last = found.back();
+        uint64_t data_end = 0;
+        {
+            MappedIndex index(last.index_path, last.records * sizeof(IndexEntry));
+            const auto* entries = static_cast<const IndexEntry*>(index.data());
+            while (entries && last.records > 0)
+            {
+                const IndexEntry& e = entries[last.records - 1];
+                if (e.offset + e.length <= last.data_bytes)
+                {
+                    data_end = e.offset + e.length;
+                    break;
+                }
+                --last.records;
+            }
+            if (!entries) last.records = 0;
+        }
+
+        std::error_code ec;
+        std::filesystem::resize_file(last.index_path, last.records * sizeof(IndexEntry), ec);
+        std::filesystem::resize_file(last.data_path, data_end, ec);
+        if (ec) std::cerr << "HistoryLog: failed to truncate torn tail: " << ec.message() << "\n";
+        last.data_bytes = data_end;
+    }
+
+    std::scoped_lock lk(segments_mutex_);
+    segments_ = std::move(found);
+}
+
+void HistoryLog::open_segment_for_append(const Segment& segment)
+{
+    data_fd_ = ::open(segment.data_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    index_fd_ = ::open(segment.index_path.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (data_fd_ < 0 || index_fd_ < 0)
+        std::cerr << "HistoryLog: cannot open segment " << segment.data_path << ": " << std::strerror(errno) << "\n";
+}
+
+void HistoryLog::start_new_segment(uint64_t base)
+{
+    Segment seg;
+    seg.base = base;
+    seg.data_path = dir_ / SegmentName(base, ".log");
+    seg.index_path = dir_ / SegmentName(base, ".idx");
+    open_segment_for_append(seg);
+
+    std::scoped_lock lk(segments_mutex_);
+    segments_.push_back(std::move(seg));
+}
+
+void HistoryLog::close_files()
+{
+    if (data_fd_ >= 0) ::close(data_fd_);
+    if (index_fd_ >= 0) ::close(index_fd_);
+    data_fd_ = -1;
+    index_fd_ = -1;
+}
+
+void HistoryLog::append(Frame frame)
+{
+    if (!frame) return;
+    {
+        std::scoped_lock lk(mutex_);
+        if (!running_) return;
+        pending_.push_back(std::move(frame));
+        ++appended_;
+    }
+    writer_->wake(this);
+}
+
+void HistoryLog::flush()
+{
+    std::unique_lock lk(mutex_);
+    const uint64_t target = appended_;
+    if (synced_ >= target) return;
+    flush_requested_ = true;
+    lk.unlock();
+    writer_->wake(this);
+    lk.lock();
+    flushed_cv_.wait(lk, [this, target]() { return synced_ >= target; });
+}
+
+void HistoryLog::stop()
+{
+    {
+        std::scoped_lock lk(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    // once detached no round runs any more, the last one (write and sync the rest) is ours
+    writer_->detach(this);
+    write_round();
+    close_files();
+}
+
+std::optional<std::chrono::steady_clock::time_point> HistoryLog::write_round()
+{
+    // Group commit: everything queued since the last round goes out together
+    std::unique_lock lk(mutex_);
+    std::vector<Frame> batch;
+    batch.swap(pending_);
+    const uint64_t batch_end = appended_;
+    const bool stopping = !running_;
+    const bool flush = flush_requested_;
+    flush_requested_ = false;
+    lk.unlock();
+
+    const bool written = !batch.empty() && write_batch(batch);
+
+    bool synced_now = false;
+    if (dirty_ && (stopping || flush ||
+                   std::chrono::steady_clock::now() >= last_sync_ + options_.fsync_interval))
+    {
+        sync_files();
+        synced_now = true;
+    }
+
+    lk.lock();
+    if (written)
+    {
+        ++stats_.batches;
+        stats_.records += batch.size();
+    }
+    if (synced_now) ++stats_.fsyncs;
+    if (!dirty_)
+    {
+        synced_ = batch_end;
+        flushed_cv_.notify_all();
+        return std::nullopt;
+    }
+    return last_sync_ + options_.fsync_interval;
+}
+
+bool HistoryLog::write_batch(const std::vector<Frame>& batch)
+{
+    Segment current;
+    {
+        std::scoped_lock lk(segments_mutex_);
+        current = segments_.back();
+    }
+
+    if (current.data_bytes >= options_.segment_bytes && current.records > 0)
+    {
+        sync_files();
+        close_files();
+        start_new_segment(current.base + current.records);
+        std::scoped_lock lk(segments_mutex_);
+        current = segments_.back();
+    }
+
+    std::size_t total = 0;
+    for (const auto& frame : batch) total += frame->size();
+
+    std::vector<char> data;
+    data.reserve(total);
+    std::vector<IndexEntry> index;
+    index.reserve(batch.size());
+    uint64_t offset = current.data_bytes;
+    for (const auto& frame : batch)
+    {
+        data.insert(data.end(), frame->begin(), frame->end());
+        index.push_back({offset, frame->size()});
+        offset += frame->size();
+    }
+
+    // data first, so an index entry never points at bytes that were not written
+    if (!WriteAll(data_fd_, data.data(), data.size()) ||
+        !WriteAll(index_fd_, reinterpret_cast<const char*>(index.data()), index.size() * sizeof(IndexEntry)))
+    {
+        std::cerr << "HistoryLog: write failed, batch of " << batch.size() << " dropped: " << std::strerror(errno)
+                  << "\n";
+        // Whatever part of the batch made it must go, or the next batch would be indexed at stale offsets
+        if (::ftruncate(data_fd_, static_cast<off_t>(current.data_bytes)) != 0 ||
+            ::ftruncate(index_fd_, static_cast<off_t>(current.records * sizeof(IndexEntry))) != 0)
+        {
+            std::cerr << "HistoryLog: cannot truncate " << current.data_path << ": " << std::strerror(errno)
+                      << ", rolling to a new segment\n";
+            close_files();
+            start_new_segment(current.base + current.records);
+        }
+        return false;
+    }
+    dirty_ = true;
+
+    std::scoped_lock lk(segments_mutex_);
+    segments_.back().records += batch.size();
+    segments_.back().data_bytes += total;
+    return true;
+}
+
+void HistoryLog::sync_files()
+{
+    if (data_fd_ >= 0) ::fdatasync(data_fd_);
+    if (index_fd_ >= 0) ::fdatasync(index_fd_);
+    dirty_ = false;
+    last_sync_ = std::chrono::steady_clock::now();
+}
+
+std::vector<HistoryLog::Frame> HistoryLog::read_from_segment(const Segment& segment, uint64_t first,
+                                                             std::size_t count) const
+{
+    std::vector<Frame> out;
+    if (first < segment.base || first >= segment.base + segment.records || count == 0) return out;
+
+    const uint64_t local = first - segment.base;
+    const std::size_t n = static_cast<std::size_t>(std::min<uint64_t>(count, segment.records - local));
+
+    MappedIndex index(segment.index_path, segment.records * sizeof(IndexEntry));
+    const auto* entries = static_cast<const IndexEntry*>(index.data());
+    if (!entries) return out;
+
+    // one pread for the whole contiguous range, then slice it into frames
+    const uint64_t begin = entries[local].offset;
+    const uint64_t end = entries[local + n - 1].offset + entries[local + n - 1].length;
+    std::vector<char> data(static_cast<std::size_t>(end - begin));
+
+    const int fd = ::open(segment.data_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return out;
+    const bool ok = ReadAll(fd, data.data(), data.size(), begin);
+    ::close(fd);
+    if (!ok) return out;
+
+    out.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        const IndexEntry& e = entries[local + i];
+        const auto* start = data.data() + (e.offset - begin);
+        out.push_back(std::make_shared<const std::vector<char>>(start, start + e.length));
+    }
+    return out;
+}
+
+std::vector<HistoryLog::Frame> HistoryLog::read_range(uint64_t first, std::size_t count) const
+{
+    std::vector<Segment> segments;
+    {
+        std::scoped_lock lk(segments_mutex_);
+        segments = segments_;
+    }
+
+    std::vector<Frame> out;
+    for (const auto& seg : segments)
+    {
+        if (out.size() >= count) break;
+        if (first >= seg.base + seg.records) continue;
+
+        auto part = read_from_segment(seg, first, count - out.size());
+        if (part.empty()) break;
+        first += part.size();
+        out.insert(out.end(), std::make_move_iterator(part.begin()), std::make_move_iterator(part.end()));
+    }
+    return out;
+}
+
+std::vector<HistoryLog::Frame> HistoryLog::read_last(std::size_t count) const
+{
+    const uint64_t total = size();
+    const uint64_t first = total > count ? total - count : 0;
+    return read_range(first, count);
+}
+
+uint64_t HistoryLog::size() const
+{
+    std::scoped_lock lk(segments_mutex_);
+    if (segments_.empty()) return 0;
+    return segments_.back().base + segments_.back().records;
+}
+
+HistoryLog::Stats HistoryLog::stats() const
+{
+    Stats s;
+    {
+        std::scoped_lock lk(mutex_);
+        s = stats_;
+    }
+    std::scoped_lock lk(segments_mutex_);
+    s.segments = segments_.size();
+    return s;
+}
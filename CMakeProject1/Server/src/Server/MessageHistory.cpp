@@ -0,0 +1,275 @@
+#include <Server/MessageHistory.h>
+#include <MessageTypes/File/FileMessage.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <boost/asio/post.hpp>
+
+namespace
+{
+    bool WriteSpill(const std::filesystem::path& path, const IMessage& message)
+    {
+        const auto data = message.serialize();
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+        if (out) return true;
+
+        std::cerr << "MessageHistory: failed to spill to " << path << "\n";
+        out.close();
+        std::error_code ec;
+        std::filesystem::remove(path, ec);
+        return false;
+    }
+}
+
+MessageHistory::MessageHistory(Limits limits, std::filesystem::path spill_dir)
+    : limits_(limits), spill_dir_(std::move(spill_dir))
+{
+    if (spill_dir_.empty()) return;
+
+    std::error_code ec;
+    std::filesystem::create_directories(spill_dir_, ec);
+    if (ec)
+    {
+        std::cerr << "MessageHistory: cannot create spill dir " << spill_dir_ << ": " << ec.message() << "\n";
+        spill_dir_.clear();
+    }
+}
+
+MessageHistory::SpillFile::~SpillFile()
+{
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+}
+
+MessageHistory::~MessageHistory()
+{
+    std::scoped_lock lock(mutex_);
+    // snapshots still held by replays keep their spill files until they are done
+    entries_.clear();
+    cached_snapshot_.reset();
+    std::error_code ec;
+    if (!spill_dir_.empty()) std::filesystem::remove(spill_dir_, ec); // only succeeds if empty
+}
+
+MessageHistory::Frame MessageHistory::push(const std::shared_ptr<IMessage>& message, uint64_t sequence)
+{
+    if (!message) return nullptr;
+
+    // Encode outside of the lock; file blobs stay as messages because they go through the file queues
+    Entry entry;
+    entry.sequence = sequence;
+    if (std::dynamic_pointer_cast<FileMessage>(message))
+    {
+        entry.message = message;
+        entry.bytes = message->payload_size();
+    }
+    else
+    {
+        entry.frame = std::make_shared<const std::vector<char>>(message->serialize());
+        entry.bytes = entry.frame->size();
+    }
+
+    Frame frame = entry.frame;
+    std::scoped_lock lock(mutex_);
+    resident_bytes_ += entry.bytes;
+    entries_.push_back(std::move(entry));
+    ++generation_;
+    enforce_limits_locked();
+    return frame;
+}
+
+void MessageHistory::push_frame(Frame frame, uint64_t sequence)
+{
+    if (!frame) return;
+
+    Entry entry;
+    entry.sequence = sequence;
+    entry.bytes = frame->size();
+    entry.frame = std::move(frame);
+
+    std::scoped_lock lock(mutex_);
+    resident_bytes_ += entry.bytes;
+    entries_.push_back(std::move(entry));
+    ++generation_;
+    enforce_limits_locked();
+}
+
+std::shared_ptr<const MessageHistory::Snapshot> MessageHistory::snapshot() const
+{
+    std::scoped_lock lock(mutex_);
+    if (!cached_snapshot_ || cached_snapshot_->generation != generation_)
+    {
+        auto snap = std::make_shared<Snapshot>();
+        snap->generation = generation_;
+        snap->entries.assign(entries_.begin(), entries_.end());
+        cached_snapshot_ = std::move(snap);
+    }
+    return cached_snapshot_;
+}
+
+std::size_t MessageHistory::Snapshot::first_after(uint64_t sequence) const
+{
+    auto it = std::upper_bound(entries.begin(), entries.end(), sequence,
+                               [](uint64_t seq, const Entry& e) { return seq < e.sequence; });
+    return static_cast<std::size_t>(it - entries.begin());
+}
+
+std::shared_ptr<IMessage> MessageHistory::load(const Entry& entry)
+{
+    if (!entry.is_file()) return nullptr;
+    if (entry.message) return entry.message;
+    if (!entry.spill) return nullptr;
+
+    std::ifstream in(entry.spill->path, std::ios::binary);
+    if (!in) return nullptr;
+
+    std::vector<char> data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    auto fm = std::make_shared<FileMessage>();
+    try { fm->deserialize(data); }
+    catch (const std::exception& ex)
+    {
+        std::cerr << "MessageHistory: failed to reload " << entry.spill->path << ": " << ex.what() << "\n";
+        return nullptr;
+    }
+    return fm;
+}
+
+bool MessageHistory::spill_pending() const
+{
+    std::scoped_lock lock(mutex_);
+    return spill_scheduled_;
+}
+
+MessageHistory::Stats MessageHistory::stats() const
+{
+    std::scoped_lock lock(mutex_);
+    Stats s;
+    s.entries = entries_.size();
+    s.resident_bytes = resident_bytes_;
+    s.spilled_entries = spilled_entries_;
+    s.spilled_bytes = spilled_bytes_;
+    s.evicted_entries = evicted_entries_;
+    s.generation = generation_;
+    return s;
+}
+
+void MessageHistory::enforce_limits_locked()
+{
+    while (entries_.size() > limits_.max_entries)
+        evict_front_locked();
+
+    // Demote the oldest file blobs first, they are what actually blows the budget
+    std::size_t resident_limit = limits_.max_resident_bytes;
+    if (spill_executor_ && !spill_dir_.empty())
+    {
+        // the writes happen on the spill executor; meanwhile the blobs stay resident
+        if (resident_bytes_ > limits_.max_resident_bytes && !spill_scheduled_)
+        {
+            spill_scheduled_ = true;
+            boost::asio::post(spill_executor_, [this]() { spill_in_background(); });
+        }
+        resident_limit = 2 * limits_.max_resident_bytes;
+    }
+    else
+    {
+        for (auto& entry : entries_)
+        {
+            if (resident_bytes_ <= limits_.max_resident_bytes) break;
+            if (entry.is_file() && entry.message)
+                spill_locked(entry);
+        }
+    }
+
+    while (resident_bytes_ > resident_limit && !entries_.empty())
+        evict_front_locked();
+
+    while (spilled_bytes_ > limits_.max_spilled_bytes && !entries_.empty())
+        evict_front_locked();
+}
+
+bool MessageHistory::spill_locked(Entry& entry)
+{
+    if (spill_dir_.empty() || !entry.message) return false;
+
+    auto path = spill_dir_ / ("history_" + std::to_string(next_spill_id_++) + ".bin");
+    if (!WriteSpill(path, *entry.message)) return false;
+    mark_spilled_locked(entry, std::move(path));
+    return true;
+}
+
+void MessageHistory::mark_spilled_locked(Entry& entry, std::filesystem::path path)
+{
+    entry.message.reset();
+    entry.spill = std::make_shared<const SpillFile>(std::move(path));
+    resident_bytes_ -= entry.bytes;
+    spilled_bytes_ += entry.bytes;
+    ++spilled_entries_;
+    // the cached snapshot still holds the blob; the next one must not
+    ++generation_;
+}
+
+void MessageHistory::set_spill_executor(boost::asio::any_io_executor executor)
+{
+    std::scoped_lock lock(mutex_);
+    spill_executor_ = std::move(executor);
+}
+
+void MessageHistory::spill_in_background()
+{
+    for (;;)
+    {
+        std::shared_ptr<IMessage> message;
+        std::filesystem::path path;
+        {
+            std::scoped_lock lock(mutex_);
+            auto it = std::find_if(entries_.begin(), entries_.end(),
+                                   [](const Entry& e) { return e.is_file() && e.message; });
+            if (resident_bytes_ <= limits_.max_resident_bytes || it == entries_.end())
+            {
+                spill_scheduled_ = false;
+                return;
+            }
+            message = it->message;
+            path = spill_dir_ / ("history_" + std::to_string(next_spill_id_++) + ".bin");
+        }
+
+        // serialize and write without the lock, pushes and replays go on meanwhile
+        const bool written = WriteSpill(path, *message);
+
+        std::scoped_lock lock(mutex_);
+        auto it = std::find_if(entries_.begin(), entries_.end(),
+                               [&](const Entry& e) { return e.is_file() && e.message == message; });
+        if (!written || it == entries_.end())
+        {
+            // evicted while it was being written (or the disk failed): nothing to demote
+            std::error_code ec;
+            if (written) std::filesystem::remove(path, ec);
+            spill_scheduled_ = false;
+            return;
+        }
+        mark_spilled_locked(*it, std::move(path));
+        while (spilled_bytes_ > limits_.max_spilled_bytes && !entries_.empty())
+            evict_front_locked();
+    }
+}
+
+void MessageHistory::evict_front_locked()
+{
+    // a spill file goes with the last snapshot still replaying it
+    const Entry& front = entries_.front();
+    if (!front.spill)
+    {
+        resident_bytes_ -= front.bytes;
+    }
+    else
+    {
+        spilled_bytes_ -= front.bytes;
+        --spilled_entries_;
+        // the stale cached snapshot must not keep the file as well
+        cached_snapshot_.reset();
+    }
+    entries_.pop_front();
+    ++evicted_entries_;
+    ++generation_;
+}
@@ -0,0 +1,78 @@
+#include <Server/RateLimiter.h>
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : rate_(rate), burst_(std::max(burst, 1.0)), tokens_(burst_)
+{
+}
+
+void TokenBucket::Refill(Clock::time_point now)
+{
+    // the bucket starts full at its first use
+    if (last_ == Clock::time_point{}) last_ = now;
+    if (now <= last_) return;
+    const double elapsed = std::chrono::duration<double>(now - last_).count();
+    tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+    last_ = now;
+}
+
+TokenBucket::Clock::duration TokenBucket::Take(double amount, Clock::time_point now)
+{
+    if (IsUnlimited()) return Clock::duration::zero();
+    Refill(now);
+    tokens_ -= amount;
+    if (tokens_ >= 0.0) return Clock::duration::zero();
+    return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(-tokens_ / rate_));
+}
+
+bool TokenBucket::TryTake(double amount, Clock::time_point now)
+{
+    if (IsUnlimited()) return true;
+    Refill(now);
+    if (tokens_ < amount) return false;
+    tokens_ -= amount;
+    return true;
+}
+
+IngressLimiter::Stats IngressLimiter::Metrics::Load() const
+{
+    Stats s;
+    s.throttled = throttled.load(std::memory_order_relaxed);
+    s.disconnects = disconnects.load(std::memory_order_relaxed);
+    return s;
+}
+
+IngressLimiter::IngressLimiter(const Limits& limits, std::shared_ptr<Metrics> metrics)
+    : offender_grace_(limits.offender_grace),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<Metrics>()),
+      messages_(limits.messages_per_second, limits.message_burst),
+      bytes_(limits.bytes_per_second, limits.byte_burst)
+{
+}
+
+MessageReceiver::Admission IngressLimiter::Admit(std::size_t frame_bytes, TokenBucket::Clock::time_point now)
+{
+    std::scoped_lock lock(mutex_);
+    MessageReceiver::Admission admission;
+    admission.pause = std::max(messages_.Take(1.0, now), bytes_.Take(static_cast<double>(frame_bytes), now));
+    if (admission.pause == TokenBucket::Clock::duration::zero())
+    {
+        throttled_ = false;
+        return admission;
+    }
+
+    // Throttled without ever catching up for the whole grace period: a flood, not a burst
+    if (!throttled_)
+    {
+        throttled_ = true;
+        throttled_since_ = now;
+    }
+    if (now - throttled_since_ >= offender_grace_)
+    {
+        metrics_->disconnects.fetch_add(1, std::memory_order_relaxed);
+        admission.disconnect = true;
+        return admission;
+    }
+    metrics_->throttled.fetch_add(1, std::memory_order_relaxed);
+    return admission;
+}
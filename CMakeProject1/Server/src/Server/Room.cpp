@@ -0,0 +1,484 @@
+#include <Server/Room.h>
+#include <MessageTypes/Text/TextMessage.h>
+#include <MessageTypes/File/FileMessage.h>
+#include <Server/HandlerMemory.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <limits>
+#include <unordered_set>
+
+#include "MessageTypes/HistorySync/HistorySyncMessage.h"
+
+using boost::asio::ip::tcp;
+
+namespace
+{
+    // pre-encoded markers framing every history replay, shared by all rooms
+    const Room::Frame& HistoryBeginFrame()
+    {
+        static const Room::Frame frame = std::make_shared<const std::vector<char>>(
+            TextMessage("--- Begin Message History ---").serialize());
+        return frame;
+    }
+
+    const Room::Frame& HistoryEndFrame()
+    {
+        static const Room::Frame frame = std::make_shared<const std::vector<char>>(
+            TextMessage("--- End Message History ---").serialize());
+        return frame;
+    }
+
+    // A numbered history line re-encoded as the plain Text frame a legacy member can read
+    Room::Frame LegacyTextFrame(const Room::Frame& frame)
+    {
+        TextMessage text;
+        try { text.deserialize(*frame); }
+        catch (const std::exception&) { return frame; }
+        if (text.get_sequence() == 0) return frame;
+        return std::make_shared<const std::vector<char>>(TextMessage::serialize_prefixed({}, text.get_text(), 0));
+    }
+}
+
+bool Room::IsValidName(const std::string& name)
+{
+    if (name.empty() || name.size() > MAX_NAME_LENGTH) return false;
+    return std::all_of(name.begin(), name.end(), [](char c)
+    {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_' || c == '-';
+    });
+}
+
+Room::Room(std::string name, boost::asio::io_context& io, FanOut& fan_out, const Options& options)
+    : name_(std::move(name)),
+      strand_(boost::asio::make_strand(io)),
+      fan_out_(fan_out),
+      fan_out_stream_(std::make_shared<FanOut::Stream>()),
+      idle_since_(std::chrono::steady_clock::now().time_since_epoch().count()),
+      history_(options.history_limits, options.spill_dir),
+      broadcast_budget_(options.broadcasts_per_second, options.broadcast_burst),
+      batch_window_(options.batch_window),
+      batch_max_bytes_(options.batch_max_bytes),
+      batch_timer_(strand_)
+{
+    if (options.log_dir.empty()) return;
+    try
+    {
+        const auto start = std::chrono::steady_clock::now();
+        history_log_ = std::make_shared<HistoryLog>(options.log_dir, HistoryLogOptions{}, options.log_writer);
+        const auto frames = history_log_->read_last(options.history_limits.max_entries);
+        uint64_t last_sequence = 0;
+        for (const auto& frame : frames)
+        {
+            TextMessage recovered;
+            try { recovered.deserialize(*frame); }
+            catch (const std::exception&) { continue; }
+            last_sequence = std::max(last_sequence, recovered.get_sequence());
+            history_.push_frame(frame, recovered.get_sequence());
+        }
+        // frames written before sequence numbers existed still count towards the room sequence
+        last_sequence_ = std::max(last_sequence, history_log_->size());
+        const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start);
+        std::cout << "Room " << name_ << ": history log " << options.log_dir << " (" << history_log_->size()
+                  << " records, recovered " << frames.size() << " in " << elapsed.count() << " us)" << std::endl;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Room " << name_ << ": history log disabled: " << e.what() << std::endl;
+        history_log_.reset();
+    }
+}
+
+void Room::Join(const std::shared_ptr<tcp::socket>& socket, std::shared_ptr<OutboundQueue> outbound,
+                std::shared_ptr<FileTransferQueue> file_queue, bool multiplexed, bool batched,
+                std::shared_ptr<const ConnectionProtocol> protocol)
+{
+    if (!socket || !outbound) return;
+    auto it = std::find_if(members_.begin(), members_.end(),
+                           [&](const FanOut::Recipient& m) { return m.socket == socket; });
+    if (it != members_.end()) return;
+
+    // the pending lines are already in the history a new member is replayed
+    FlushBatch();
+    members_.push_back({socket, std::move(outbound), std::move(file_queue), multiplexed, batched, std::move(protocol)});
+    recipients_dirty_ = true;
+    UpdateMemberCount();
+}
+
+void Room::Leave(const std::shared_ptr<tcp::socket>& socket)
+{
+    FlushBatch();
+    members_.erase(std::remove_if(members_.begin(), members_.end(),
+                                  [&](const FanOut::Recipient& m) { return m.socket == socket; }),
+                   members_.end());
+    recipients_dirty_ = true;
+    UpdateMemberCount();
+}
+
+void Room::LinkFileQueue(const std::shared_ptr<tcp::socket>& socket, std::shared_ptr<FileTransferQueue> file_queue,
+                         bool multiplexed, bool batched)
+{
+    // a member switching to batches already got the pending lines one by one
+    FlushBatch();
+    for (auto& member : members_)
+    {
+        if (member.socket != socket) continue;
+        member.file_queue = file_queue;
+        member.multiplexed = multiplexed;
+        member.batched = batched;
+    }
+    recipients_dirty_ = true;
+}
+
+void Room::SetBulkExecutor(boost::asio::any_io_executor executor)
+{
+    history_.set_spill_executor(executor);
+    bulk_executor_ = std::move(executor);
+}
+
+void Room::SetBroadcastLimit(double broadcasts_per_second, double burst)
+{
+    broadcast_budget_ = TokenBucket(broadcasts_per_second, burst);
+}
+
+void Room::SetBatching(std::chrono::microseconds window, std::size_t max_bytes)
+{
+    FlushBatch();
+    batch_window_ = window;
+    batch_max_bytes_ = max_bytes;
+}
+
+void Room::PruneClosedMembers()
+{
+    members_.erase(std::remove_if(members_.begin(), members_.end(),
+                                  [](const FanOut::Recipient& m) { return !m.socket || !m.socket->is_open(); }),
+                   members_.end());
+    recipients_dirty_ = true;
+    UpdateMemberCount();
+}
+
+void Room::UpdateMemberCount()
+{
+    if (members_.empty() && member_count_.load(std::memory_order_relaxed) != 0)
+        idle_since_.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+    member_count_.store(members_.size(), std::memory_order_release);
+}
+
+bool Room::IsIdleSince(std::chrono::steady_clock::time_point cutoff) const
+{
+    if (member_count_.load(std::memory_order_acquire) != 0) return false;
+    return idle_since_.load(std::memory_order_relaxed) <= cutoff.time_since_epoch().count() &&
+           !history_.spill_pending();
+}
+
+const std::shared_ptr<const FanOut::Recipients>& Room::CurrentRecipients()
+{
+    // closed connections are noticed during delivery and dropped here, not scanned for on every message
+    if (fan_out_stream_->saw_closed.exchange(false, std::memory_order_relaxed)) PruneClosedMembers();
+    if (recipients_dirty_)
+    {
+        recipients_ = fan_out_.Partition(members_);
+        recipients_dirty_ = false;
+        has_batched_members_ = std::any_of(members_.begin(), members_.end(),
+                                           [](const FanOut::Recipient& m) { return m.batched; });
+        // protocols only move up from the legacy one, so a stale answer costs an unused frame at most
+        has_legacy_members_ = std::any_of(members_.begin(), members_.end(),
+                                          [](const FanOut::Recipient& m) { return m.legacy(); });
+    }
+    return recipients_;
+}
+
+void Room::PublishText(const std::shared_ptr<tcp::socket>& sender, std::string_view prefix, std::string_view text)
+{
+    // The room-wide cap bounds amplification: at most `broadcasts_per_second` x members frames per second
+    if (!broadcast_budget_.TryTake(1.0, TokenBucket::Clock::now()))
+    {
+        rate_limited_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    // Number the message and encode it ONCE, straight from the sender's cached prefix;
+    // the frame is shared by the history, the log and every recipient
+    const uint64_t sequence = last_sequence_.load(std::memory_order_relaxed) + 1;
+    last_sequence_.store(sequence, std::memory_order_relaxed);
+    const Frame frame = std::make_shared<const std::vector<char>>(TextMessage::serialize_prefixed(prefix, text, sequence));
+    history_.push_frame(frame, sequence);
+    if (history_log_) history_log_->append(frame);
+
+    // Batched members get the line with the rest of the window, everyone else right away;
+    // members that never sent Hello get it the way they can read it, without the sequence number
+    const auto& recipients = CurrentRecipients();
+    const bool batching = batch_window_.count() > 0 && has_batched_members_;
+    const Frame legacy = has_legacy_members_
+                             ? std::make_shared<const std::vector<char>>(TextMessage::serialize_prefixed(prefix, text, 0))
+                             : nullptr;
+    fan_out_.Deliver(fan_out_stream_, recipients, [frame, legacy, sender, batching](const FanOut::Recipient& member)
+    {
+        if (sender && member.socket == sender) return;
+        if (batching && member.batched) return;
+        member.outbound->Send(legacy && member.legacy() ? legacy : frame);
+    });
+    if (batching) AddToBatch(sender, prefix, text, sequence, frame);
+}
+
+void Room::AddToBatch(const std::shared_ptr<tcp::socket>& sender, std::string_view prefix, std::string_view text,
+                      uint64_t sequence, Frame frame)
+{
+    TextBatchMessage::Record record{sequence, std::string(prefix), std::string(text)};
+    batch_bytes_ += TextBatchMessage::record_size(record);
+    batch_.push_back(std::move(record));
+    batch_lines_.push_back({sender, std::move(frame)});
+
+    if (batch_bytes_ >= batch_max_bytes_)
+    {
+        FlushBatch();
+        return;
+    }
+    if (batch_.size() > 1) return;
+    batch_timer_.expires_after(batch_window_);
+    batch_timer_.async_wait(Utils::recycled([this](const boost::system::error_code& ec)
+    {
+        // a handler that was already due when an earlier flush re-armed the timer only flushes early
+        if (!ec) FlushBatch();
+    }));
+}
+
+void Room::FlushBatch()
+{
+    if (batch_.empty()) return;
+    batch_timer_.cancel();
+    const auto records = std::move(batch_);
+    const auto lines = std::make_shared<const std::vector<PendingLine>>(std::move(batch_lines_));
+    batch_.clear();
+    batch_lines_.clear();
+    batch_bytes_ = 0;
+    batches_.fetch_add(1, std::memory_order_relaxed);
+
+    // The batch is encoded once, for the members that sent none of its lines (a single line goes as its
+    // own frame). A member never gets its own lines back: a sender gets the others' lines as their own,
+    // already encoded frames instead, in one gather-write, picked while its lane delivers
+    const Frame everyone = lines->size() == 1
+                               ? lines->front().frame
+                               : std::make_shared<const std::vector<char>>(TextBatchMessage::serialize_records(records));
+    auto senders = std::make_shared<std::unordered_set<const tcp::socket*>>();
+    for (const auto& line : *lines)
+    {
+        if (line.sender) senders->insert(line.sender.get());
+    }
+
+    fan_out_.Deliver(fan_out_stream_, CurrentRecipients(), [everyone, lines, senders](const FanOut::Recipient& member)
+    {
+        if (!member.batched) return;
+        if (!senders->count(member.socket.get()))
+        {
+            member.outbound->Send(everyone);
+            return;
+        }
+        std::vector<Frame> others;
+        for (const auto& line : *lines)
+        {
+            if (line.sender != member.socket) others.push_back(line.frame);
+        }
+        if (!others.empty()) member.outbound->Send(std::move(others), OutboundQueue::Priority::Chat);
+    });
+}
+
+void Room::PublishFile(const std::shared_ptr<tcp::socket>& sender, const std::string& announcement,
+                       const std::shared_ptr<FileMessage>& file, Frame file_frame)
+{
+    // The file shares the sequence number of its announcement
+    const uint64_t sequence = last_sequence_.load(std::memory_order_relaxed) + 1;
+    last_sequence_.store(sequence, std::memory_order_relaxed);
+    const Frame frame = history_.push(std::make_shared<TextMessage>(announcement, sequence), sequence);
+    history_.push(file, sequence);
+    if (history_log_) history_log_->append(frame);
+    const auto& recipients = CurrentRecipients();
+    const Frame legacy = has_legacy_members_
+                             ? std::make_shared<const std::vector<char>>(TextMessage(announcement).serialize())
+                             : nullptr;
+
+    // Multiplexed members get the file as chunks on their text connection, the others on their file
+    // connection; all of them share the one frame
+    fan_out_.Deliver(fan_out_stream_, recipients,
+                     [frame, legacy, file_frame = std::move(file_frame), sender](const FanOut::Recipient& member)
+    {
+        // Announce to ALL members (including the sender), the file itself goes to everyone else
+        member.outbound->Send(legacy && member.legacy() ? legacy : frame);
+        if (sender && member.socket == sender) return;
+        if (member.multiplexed) member.outbound->SendBulk(file_frame);
+        else if (member.file_queue) member.file_queue->enqueue(file_frame);
+    });
+}
+
+void Room::ReplayHistory(const std::shared_ptr<OutboundQueue>& outbound,
+                         const std::shared_ptr<FileTransferQueue>& file_queue, uint64_t last_seen, Frame prefix)
+{
+    if (!outbound || !outbound->GetSocket()->is_open()) return;
+    const auto& socket = outbound->GetSocket();
+    const auto member = std::find_if(members_.begin(), members_.end(),
+                                     [&](const FanOut::Recipient& m) { return m.socket == socket; });
+    const bool multiplexed = member != members_.end() && member->multiplexed;
+    const bool legacy = member == members_.end() || member->legacy();
+
+    // Immutable snapshot, shared with every other replay until the next message
+    const auto snapshot = history_.snapshot();
+    const uint64_t room_sequence = GetLastSequence();
+
+    // Delta if nothing newer than the client's last seen message has been evicted yet,
+    // otherwise (new client, too far behind, or a room restarted without persistence) a full resync
+    auto status = HistorySyncMessage::Status::FullResync;
+    std::size_t first = 0;
+    if (last_seen != 0 && last_seen <= room_sequence &&
+        (snapshot->entries.empty() || snapshot->entries.front().sequence <= last_seen + 1))
+    {
+        status = HistorySyncMessage::Status::Delta;
+        first = snapshot->first_after(last_seen);
+    }
+
+    // Never replay more than one page on join; older messages are fetched on demand (HistoryQuery)
+    std::size_t page_start = snapshot->entries.size();
+    for (std::size_t text_entries = 0; page_start > 0 && text_entries < INITIAL_HISTORY_PAGE; --page_start)
+    {
+        if (!snapshot->entries[page_start - 1].is_file()) ++text_entries;
+    }
+    if (page_start > first)
+    {
+        first = page_start;
+        status = HistorySyncMessage::Status::FullResync;
+    }
+    const uint64_t first_sequence = first < snapshot->entries.size() ? snapshot->entries[first].sequence : 0;
+
+    // Text portion: already-encoded frames, sent as one gather-write between the markers.
+    // A legacy member knows neither the HistorySync header nor numbered lines, its page is re-encoded
+    std::vector<Frame> frames;
+    frames.reserve(snapshot->entries.size() - first + 4);
+    if (prefix) frames.push_back(std::move(prefix));
+    if (!legacy)
+        frames.push_back(std::make_shared<const std::vector<char>>(
+            HistorySyncMessage(status, first_sequence, room_sequence).serialize()));
+    if (first < snapshot->entries.size())
+    {
+        frames.push_back(HistoryBeginFrame());
+        for (std::size_t i = first; i < snapshot->entries.size(); ++i)
+        {
+            const auto& entry = snapshot->entries[i];
+            if (entry.is_file()) continue;
+            frames.push_back(legacy ? LegacyTextFrame(entry.frame) : entry.frame);
+        }
+        frames.push_back(HistoryEndFrame());
+    }
+    outbound->Send(std::move(frames), OutboundQueue::Priority::Control);
+
+    // File portion goes through the member's file queue or bulk lane. Reloading spilled blobs and encoding
+    // whole files is left to the bulk executor; the snapshot keeps the entries, and their spill files, alive until
+    // it is done
+    auto send_files = [snapshot, first, multiplexed, outbound, file_queue, name = name_]()
+    {
+        for (std::size_t i = first; i < snapshot->entries.size(); ++i)
+        {
+            const auto& entry = snapshot->entries[i];
+            if (!entry.is_file()) continue;
+            if (!multiplexed && !file_queue)
+            {
+                std::cerr << "Room " << name << ": error replaying history: no file connection\n";
+                return;
+            }
+            auto msg_ptr = MessageHistory::load(entry);
+            if (!msg_ptr) continue;
+            // Only the encoded frame is queued, as in PublishFile: the reloaded file is dropped right here
+            // instead of staying in memory with a finished queue item
+            const Frame frame = std::make_shared<const std::vector<char>>(msg_ptr->serialize());
+            if (multiplexed) outbound->SendBulk(frame);
+            else file_queue->enqueue(frame);
+        }
+    };
+    const bool has_files = std::any_of(snapshot->entries.begin() + static_cast<std::ptrdiff_t>(first),
+                                       snapshot->entries.end(), [](const auto& e) { return e.is_file(); });
+    if (has_files && bulk_executor_) boost::asio::post(bulk_executor_, std::move(send_files));
+    else if (has_files) send_files();
+
+    std::cout << "Room " << name_ << ": history sent ("
+              << (status == HistorySyncMessage::Status::Delta ? "delta" : "full") << ", "
+              << snapshot->entries.size() - first << " entries)" << std::endl;
+}
+
+void Room::SendHistoryPage(const std::shared_ptr<OutboundQueue>& outbound, uint64_t before_sequence, uint32_t limit)
+{
+    if (!outbound) return;
+    // The snapshot pins the ring as it is now; the log is append-only, so reading it later is as good
+    auto send_page = [snapshot = history_.snapshot(), log = history_log_, outbound, before_sequence, limit]()
+    {
+        outbound->Send(CollectHistoryPage(*snapshot, log.get(), before_sequence, limit),
+                       OutboundQueue::Priority::Control);
+    };
+    if (history_log_ && bulk_executor_) boost::asio::post(bulk_executor_, std::move(send_page));
+    else send_page();
+}
+
+std::vector<Room::Frame> Room::CollectHistoryPage(uint64_t before_sequence, uint32_t limit) const
+{
+    return CollectHistoryPage(*history_.snapshot(), history_log_.get(), before_sequence, limit);
+}
+
+std::vector<Room::Frame> Room::CollectHistoryPage(const MessageHistory::Snapshot& snapshot, const HistoryLog* log,
+                                                  uint64_t before_sequence, uint32_t limit)
+{
+    if (before_sequence == 0) before_sequence = std::numeric_limits<uint64_t>::max();
+    const std::size_t wanted = std::min<std::size_t>(limit == 0 ? INITIAL_HISTORY_PAGE : limit, MAX_HISTORY_PAGE);
+
+    // Collected newest first, reversed at the end
+    std::vector<Frame> page;
+    page.reserve(wanted + 1);
+    uint64_t oldest = before_sequence;
+    uint64_t newest = 0;
+
+    // 1. the in-memory ring
+    for (std::size_t i = snapshot.first_after(before_sequence - 1); i > 0 && page.size() < wanted; --i)
+    {
+        const auto& entry = snapshot.entries[i - 1];
+        if (entry.is_file()) continue;
+        page.push_back(entry.frame);
+        oldest = entry.sequence;
+        newest = std::max(newest, entry.sequence);
+    }
+
+    // 2. the persistent log for anything older than the ring.
+    //    Sequences grow with the record number and start at 1, so record r holds sequence r + 1 at most
+    //    (less only if the log dropped a batch); every record still says which sequence it holds.
+    if (log && oldest > 1)
+    {
+        uint64_t end = std::min<uint64_t>(oldest - 1, log->size());
+        while (page.size() < wanted && end > 0)
+        {
+            const uint64_t count = std::min<uint64_t>(wanted - page.size(), end);
+            const uint64_t begin = end - count;
+            auto older = log->read_range(begin, static_cast<std::size_t>(count));
+            if (older.empty()) break;
+            for (std::size_t i = older.size(); i > 0; --i)
+            {
+                TextMessage text;
+                try { text.deserialize(*older[i - 1]); }
+                catch (const std::exception&) { continue; }
+                // frames logged before sequence numbers existed have none, but were never dropped
+                const uint64_t sequence = text.get_sequence() != 0 ? text.get_sequence() : begin + i;
+                if (sequence >= oldest) continue;
+                page.push_back(older[i - 1]);
+                oldest = sequence;
+                newest = std::max(newest, sequence);
+            }
+            end = begin;
+        }
+    }
+
+    std::reverse(page.begin(), page.end());
+    const uint64_t first_sequence = page.empty() ? 0 : oldest;
+    page.insert(page.begin(), std::make_shared<const std::vector<char>>(
+        HistorySyncMessage(HistorySyncMessage::Status::Page, first_sequence, newest).serialize()));
+    return page;
+}
+
+void Room::FlushHistoryLog()
+{
+    if (history_log_) history_log_->flush();
+}
@@ -1,13 +1,23 @@
 #include <Server/ServerManager.h>
 #include <iostream>
 #include <thread>
-#include <Server/MessageSender.h>
+#include <chrono>
 #include <algorithm>
+#include <limits>
+#include <stdexcept>
 #include <boost/asio.hpp>
 #include <MessageTypes/Text/TextMessage.h>
+#include <MessageTypes/Utilities/TextSanitizer.h>
+#include <Server/HandlerMemory.hpp>
 #include <MessageTypes/File/FileMessage.h>
 
 #include "MessageTypes/SendHistory/SendHistoryMessage.h"
+#include "MessageTypes/HistoryQuery/HistoryQueryMessage.h"
+#include "MessageTypes/Room/RoomMessage.h"
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include "MessageTypes/Hello/HelloMessage.h"
+#include <unistd.h>
 
 using boost::asio::ip::tcp;
 
@@ -18,140 +28,704 @@ using boost::asio::ip::tcp;
 #define LOG(x) ((void)0)
 #endif
 
-ServerManager::ServerManager(int port, int fileport, std::string&& ipAddress)
+// Spill directory for file blobs demoted out of a room's in-memory history
+static std::filesystem::path HistorySpillDir(int port, const std::string& room)
+{
+    std::error_code ec;
+    auto tmp = std::filesystem::temp_directory_path(ec);
+    if (ec) return {};
+    return tmp / ("boostchatroom_history_" + std::to_string(getpid()) + "_" + std::to_string(port) + "_" + room);
+}
+
+// Pre-encoded keepalive probe, shared by every ping
+static const OutboundQueue::Frame& PingFrame()
+{
+    static const OutboundQueue::Frame frame = std::make_shared<const std::vector<char>>(
+        HeartbeatMessage(HeartbeatMessage::Kind::Ping).serialize());
+    return frame;
+}
+
+ServerManager::ServerManager(int port, int fileport, std::string&& ipAddress, const std::filesystem::path& history_dir)
+    : history_dir_(history_dir),
+      history_writer_(history_dir.empty() ? nullptr : std::make_shared<HistoryLogWriter>()),
+      fan_out_(io_context, FanOut::Options{FAN_OUT_INLINE_THRESHOLD, IoThreadCount()})
 {
     this->port = port;
     this->fileport = fileport;
     this->address = std::move(ipAddress);
     std::cout << "Server configured at address: " << this->address
         << "\nText Port: " << port << "\nFile Port: " << this->fileport << std::endl;
+
+    // the default room exists from the start so its history is recovered before anyone connects
+    GetOrCreateRoom(DEFAULT_ROOM);
+}
+
+ServerManager::~ServerManager()
+{
+    // CPU workers run spills, replays and file decodes against the rooms: finish them before the rooms go.
+    // A worker held back by the ingest gate is let go, queued tasks that did not start are dropped
+    {
+        std::scoped_lock lock(file_ingest_mutex_);
+        file_ingest_open_ = false;
+    }
+    file_ingest_cv_.notify_all();
+    cpu_pool_.stop();
+    cpu_pool_.join();
+
+    // rooms (and the connections holding them) own strands of io_context, release them while it still exists
+    std::scoped_lock lock(connections_mutex_, rooms_mutex_);
+    connections_.clear();
+    rooms_.clear();
 }
 
 
 std::string ServerManager::GetIpAddress() { return this->address; }
 int ServerManager::GetPort() const { return this->port; }
 
+MessageHistory::Stats ServerManager::GetHistoryStats() const
+{
+    std::shared_lock lock(rooms_mutex_);
+    auto it = rooms_.find(DEFAULT_ROOM);
+    return it != rooms_.end() ? it->second->GetHistoryStats() : MessageHistory::Stats{};
+}
+
+unsigned int ServerManager::IoThreadCount()
+{
+    return std::max(4u, std::thread::hardware_concurrency());
+}
+
+std::size_t ServerManager::GetConnectionCount() const
+{
+    std::shared_lock lock(connections_mutex_);
+    return connections_.size();
+}
+
+void ServerManager::SetOutboundLimits(const OutboundQueue::Limits& limits)
+{
+    std::scoped_lock lock(connections_mutex_);
+    outbound_limits_ = limits;
+}
+
+void ServerManager::SetZeroCopyOptions(const ZeroCopySender::Options& options)
+{
+    std::scoped_lock lock(file_queues_mutex_);
+    zero_copy_options_ = options;
+}
+
+void ServerManager::SetIngressLimits(const IngressLimiter::Limits& limits)
+{
+    std::scoped_lock lock(connections_mutex_);
+    ingress_limits_ = limits;
+}
+
+void ServerManager::SetRoomBroadcastLimit(double broadcasts_per_second, double burst)
+{
+    std::scoped_lock lock(rooms_mutex_);
+    room_broadcasts_per_second_ = broadcasts_per_second;
+    room_broadcast_burst_ = burst;
+    for (const auto& [name, room] : rooms_)
+    {
+        boost::asio::post(room->GetStrand(), [room, broadcasts_per_second, burst]()
+        {
+            room->SetBroadcastLimit(broadcasts_per_second, burst);
+        });
+    }
+}
+
+void ServerManager::SetChatBatching(std::chrono::microseconds window, std::size_t max_bytes)
+{
+    std::scoped_lock lock(rooms_mutex_);
+    chat_batch_window_ = window;
+    chat_batch_bytes_ = max_bytes;
+    for (const auto& [name, room] : rooms_)
+    {
+        boost::asio::post(room->GetStrand(), [room, window, max_bytes]()
+        {
+            room->SetBatching(window, max_bytes);
+        });
+    }
+}
+
+void ServerManager::SetRoomLimits(std::size_t max_rooms, std::chrono::milliseconds idle_timeout)
+{
+    std::scoped_lock lock(rooms_mutex_);
+    max_rooms_ = std::max<std::size_t>(1, max_rooms);
+    room_idle_timeout_ = idle_timeout;
+}
+
+uint64_t ServerManager::GetRoomRateLimitedCount() const
+{
+    std::shared_lock lock(rooms_mutex_);
+    uint64_t total = 0;
+    for (const auto& [name, room] : rooms_) total += room->GetRateLimitedCount();
+    return total;
+}
+
+void ServerManager::SetKeepaliveOptions(std::chrono::milliseconds heartbeat_interval,
+                                        std::chrono::milliseconds idle_timeout,
+                                        std::chrono::milliseconds legacy_idle_timeout)
+{
+    heartbeat_interval_ = heartbeat_interval;
+    idle_timeout_ = idle_timeout;
+    legacy_idle_timeout_ = legacy_idle_timeout;
+}
+
+void ServerManager::SetAcceptOptions(unsigned int concurrent_accepts, int listen_backlog)
+{
+    concurrent_accepts_ = std::max(1u, concurrent_accepts);
+    listen_backlog_ = listen_backlog;
+}
+
+void ServerManager::SetFileExecutorOptions(unsigned int file_io_threads, bool offload_heavy_work)
+{
+    file_io_threads_ = file_io_threads;
+    offload_heavy_work_ = offload_heavy_work;
+
+    std::shared_lock lock(rooms_mutex_);
+    for (const auto& [name, room] : rooms_)
+        room->SetBulkExecutor(offload_heavy_work_ ? cpu_pool_.get_executor() : boost::asio::any_io_executor());
+}
+
+boost::asio::io_context& ServerManager::FileIoContext()
+{
+    return file_io_threads_ > 0 ? file_io_context_ : io_context;
+}
+
+std::shared_ptr<tcp::acceptor> ServerManager::MakeAcceptor(boost::asio::io_context& io, int listen_port)
+{
+    if (listen_port < 0 || listen_port > std::numeric_limits<unsigned short>::max())
+        throw std::invalid_argument("port out of range: " + std::to_string(listen_port));
+    const tcp::endpoint endpoint(boost::asio::ip::make_address_v4(this->address),
+                                 static_cast<unsigned short>(listen_port));
+    auto acceptor = std::make_shared<tcp::acceptor>(io);
+    acceptor->open(endpoint.protocol());
+    acceptor->set_option(tcp::acceptor::reuse_address(true));
+    acceptor->bind(endpoint);
+    acceptor->listen(listen_backlog_);
+    return acceptor;
+}
+
+std::size_t ServerManager::GetRoomCount() const
+{
+    std::shared_lock lock(rooms_mutex_);
+    return rooms_.size();
+}
+
+std::shared_ptr<Room> ServerManager::GetOrCreateRoom(const std::string& name)
+{
+    {
+        std::shared_lock lock(rooms_mutex_);
+        auto it = rooms_.find(name);
+        if (it != rooms_.end()) return it->second;
+    }
+
+    // Recovering a room's log takes disk I/O: it runs without rooms_mutex_, so lookups of the existing rooms
+    // go on meanwhile, and reclaimed rooms are destroyed (their logs flushed) without it as well
+    std::scoped_lock creating(room_creation_mutex_);
+    std::vector<std::shared_ptr<Room>> reclaimed;
+    Room::Options options;
+    {
+        std::scoped_lock lock(rooms_mutex_);
+        auto it = rooms_.find(name);
+        if (it != rooms_.end()) return it->second;
+
+        if (rooms_.size() >= std::min(rooms_reclaim_at_, max_rooms_))
+        {
+            reclaimed = ReclaimIdleRoomsLocked();
+            rooms_reclaim_at_ = std::max<std::size_t>(16, 2 * rooms_.size());
+        }
+        if (rooms_.size() >= max_rooms_)
+        {
+            std::cerr << "Room " << name << " not created: limit of " << max_rooms_ << " rooms reached" << std::endl;
+            return nullptr;
+        }
+
+        options.history_limits = {MAX_HISTORY_MESSAGES, MAX_HISTORY_BYTES, MAX_HISTORY_SPILL_BYTES};
+        options.spill_dir = HistorySpillDir(port, name);
+        options.broadcasts_per_second = room_broadcasts_per_second_;
+        options.broadcast_burst = room_broadcast_burst_;
+        options.batch_window = chat_batch_window_;
+        options.batch_max_bytes = chat_batch_bytes_;
+        if (!history_dir_.empty())
+            options.log_dir = name == DEFAULT_ROOM ? history_dir_ : history_dir_ / "rooms" / name;
+        options.log_writer = history_writer_;
+    }
+    reclaimed.clear();
+
+    auto room = std::make_shared<Room>(name, io_context, fan_out_, options);
+    if (offload_heavy_work_) room->SetBulkExecutor(cpu_pool_.get_executor());
+
+    std::scoped_lock lock(rooms_mutex_);
+    return rooms_.try_emplace(name, std::move(room)).first->second;
+}
+
+std::vector<std::shared_ptr<Room>> ServerManager::ReclaimIdleRoomsLocked()
+{
+    std::vector<std::shared_ptr<Room>> reclaimed;
+    const auto cutoff = std::chrono::steady_clock::now() - room_idle_timeout_;
+    for (auto it = rooms_.begin(); it != rooms_.end();)
+    {
+        auto& room = it->second;
+        // a connection in the room, or a task posted to its strand, holds it too
+        if (it->first == DEFAULT_ROOM || room.use_count() > 1)
+        {
+            ++it;
+            continue;
+        }
+        if (room->IsIdleSince(cutoff))
+        {
+            reclaimed.push_back(std::move(room));
+            it = rooms_.erase(it);
+            continue;
+        }
+        if (room->GetMemberCount() > 0)
+            boost::asio::post(room->GetStrand(), [room]() { room->PruneClosedMembers(); });
+        ++it;
+    }
+    if (!reclaimed.empty())
+        std::cout << "Reclaimed " << reclaimed.size() << " idle room(s), " << rooms_.size() << " left" << std::endl;
+    return reclaimed;
+}
+
+std::shared_ptr<ServerManager::SessionBlock> ServerManager::NewSessionBlock(
+    const boost::asio::any_io_executor& executor)
+{
+    return std::allocate_shared<SessionBlock>(SlabAllocator<SessionBlock>(session_slab_), executor);
+}
+
+const Session& ServerManager::RegisterConnection(const std::shared_ptr<SessionBlock>& block, bool is_file)
+{
+    const auto socket = SocketOf(block);
+    std::scoped_lock lock(connections_mutex_);
+    PruneConnectionsLocked();
+
+    const Session& session = block->session.emplace(next_session_id_++, block->socket);
+    Connection connection;
+    connection.session = std::shared_ptr<const Session>(block, &session);
+    connection.socket = socket;
+    if (!is_file)
+    {
+        block->last_read.store(TimerWheel::Clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        connection.last_read = std::shared_ptr<LastRead>(block, &block->last_read);
+        connection.outbound = std::allocate_shared<OutboundQueue>(SlabAllocator<OutboundQueue>(outbound_slab_),
+                                                                  socket, outbound_limits_, outbound_metrics_);
+        connection.ingress = std::shared_ptr<IngressLimiter>(block, &block->ingress.emplace(ingress_limits_,
+                                                                                            ingress_metrics_));
+        connection.chunks = std::shared_ptr<ChunkAssembler>(block, &block->chunks.emplace(MAX_CHUNKED_FILE_BYTES));
+        connection.protocol = std::shared_ptr<ConnectionProtocol>(block, &block->protocol);
+    }
+    connections_[socket.get()] = std::move(connection);
+    if (is_file) file_connections_by_endpoint_[session.GetDisplayName()] = socket;
+    return session;
+}
+
+ServerManager::Connection ServerManager::GetConnection(const std::shared_ptr<tcp::socket>& socket) const
+{
+    if (!socket) return {};
+    std::shared_lock lock(connections_mutex_);
+    auto it = connections_.find(socket.get());
+    if (it == connections_.end() || it->second.socket.lock() != socket) return {};
+    return it->second;
+}
+
+std::shared_ptr<Room> ServerManager::GetRoomOf(const std::shared_ptr<tcp::socket>& text_socket)
+{
+    auto room = GetConnection(text_socket).room;
+    return room ? room : GetOrCreateRoom(DEFAULT_ROOM);
+}
+
+void ServerManager::JoinRoom(const std::shared_ptr<tcp::socket>& text_socket, const std::string& name, bool announce)
+{
+    if (!text_socket) return;
+    auto room = GetOrCreateRoom(name);
+    if (!room)
+    {
+        if (auto outbound = GetConnection(text_socket).outbound; outbound && announce)
+            outbound->Send(std::make_shared<const std::vector<char>>(
+                               TextMessage("Room " + name + " not joined: too many rooms").serialize()),
+                           OutboundQueue::Priority::Control);
+        return;
+    }
+
+    std::shared_ptr<Room> previous;
+    std::shared_ptr<OutboundQueue> outbound;
+    std::shared_ptr<FileTransferQueue> file_queue;
+    bool multiplexed = false;
+    bool batched = false;
+    std::shared_ptr<const ConnectionProtocol> protocol;
+    {
+        std::scoped_lock lock(connections_mutex_);
+        auto it = connections_.find(text_socket.get());
+        if (it == connections_.end() || it->second.socket.lock() != text_socket) return;
+        previous = it->second.room;
+        it->second.room = room;
+        outbound = it->second.outbound;
+        file_queue = it->second.file_queue;
+        multiplexed = it->second.multiplexed;
+        batched = it->second.protocol && it->second.protocol->has(ConnectionProtocol::BATCHED_TEXT);
+        protocol = it->second.protocol;
+    }
+
+    if (previous && previous != room)
+        boost::asio::post(previous->GetStrand(), [previous, text_socket]() { previous->Leave(text_socket); });
+
+    boost::asio::post(room->GetStrand(), [room, text_socket, outbound, file_queue, multiplexed, batched, protocol,
+                                          announce]()
+    {
+        room->Join(text_socket, outbound, file_queue, multiplexed, batched, protocol);
+        if (!announce) return;
+        auto confirmation = std::make_shared<const std::vector<char>>(
+            RoomMessage(RoomMessage::Action::Join, room->GetName()).serialize());
+        room->ReplayHistory(outbound, file_queue, 0, std::move(confirmation));
+    });
+}
+
+void ServerManager::PruneConnectionsLocked()
+{
+    if (connections_.size() < connections_prune_at_) return;
+
+    for (auto it = connections_.begin(); it != connections_.end();)
+    {
+        auto sock = it->second.socket.lock();
+        if (!sock || !sock->is_open()) it = connections_.erase(it);
+        else ++it;
+    }
+    for (auto it = file_connections_by_endpoint_.begin(); it != file_connections_by_endpoint_.end();)
+    {
+        auto sock = it->second.lock();
+        if (!sock || !sock->is_open()) it = file_connections_by_endpoint_.erase(it);
+        else ++it;
+    }
+    connections_prune_at_ = std::max<std::size_t>(64, 2 * connections_.size());
+}
+
+void ServerManager::StartKeepalive()
+{
+    keepalive_timer_.reset();
+    keepalive_wheel_.reset();
+    if (idle_timeout_ <= std::chrono::milliseconds::zero()) return;
+
+    // the tick is an eighth of the shortest period (10 ms - 1 s): deadlines are met to within that
+    std::chrono::milliseconds shortest = idle_timeout_;
+    if (heartbeat_interval_ > std::chrono::milliseconds::zero()) shortest = std::min(shortest, heartbeat_interval_);
+    const auto tick = std::clamp<std::chrono::milliseconds>(shortest / 8, std::chrono::milliseconds(10),
+                                                            std::chrono::milliseconds(1000));
+    keepalive_wheel_ = std::make_unique<TimerWheel>(tick, KEEPALIVE_WHEEL_SLOTS);
+    keepalive_timer_ = std::make_unique<boost::asio::steady_timer>(io_context);
+    KeepaliveTick();
+}
+
+void ServerManager::KeepaliveTick()
+{
+    keepalive_timer_->expires_after(keepalive_wheel_->GetTick());
+    keepalive_timer_->async_wait(Utils::recycled([this](const boost::system::error_code& ec)
+    {
+        if (ec) return;
+        keepalive_wheel_->Advance(TimerWheel::Clock::now());
+        KeepaliveTick();
+    }));
+}
+
+void ServerManager::ScheduleKeepalive(const std::shared_ptr<tcp::socket>& socket, bool is_file,
+                                      TimerWheel::Clock::time_point deadline)
+{
+    if (!keepalive_wheel_ || !socket) return;
+    keepalive_wheel_->Schedule(deadline, [this, weak_socket = std::weak_ptr<tcp::socket>(socket), is_file]()
+    {
+        CheckKeepalive(weak_socket, is_file);
+    });
+}
+
+void ServerManager::CheckKeepalive(const std::weak_ptr<tcp::socket>& weak_socket, bool is_file)
+{
+    auto socket = weak_socket.lock();
+    if (!socket) return;
+    if (!socket->is_open())
+    {
+        // gone meanwhile: its transfer thread is reclaimed now instead of at the next accept sweep
+        if (is_file) RemoveFileQueueForSocket(socket);
+        return;
+    }
+
+    const auto now = TimerWheel::Clock::now();
+    const Connection connection = GetConnection(socket);
+    if (is_file)
+    {
+        // file connections carry no heartbeats; they live as long as the text connection they belong to
+        const auto owner = connection.owner.lock();
+        if (owner && owner->is_open()) ScheduleKeepalive(socket, true, now + idle_timeout_);
+        else ExpireConnection(socket, true);
+        return;
+    }
+
+    if (!connection.last_read) return;
+    const TimerWheel::Clock::time_point last_read(
+        TimerWheel::Clock::duration(connection.last_read->load(std::memory_order_relaxed)));
+    // A peer that never sent Hello cannot answer a Ping, so it is not pinged and gets the longer timeout
+    // (checked again after idle_timeout_ at the latest, in case its Hello is still on the way)
+    if (connection.protocol && connection.protocol->version.load(std::memory_order_acquire) == 0)
+    {
+        if (now - last_read >= legacy_idle_timeout_) ExpireConnection(socket, false);
+        else ScheduleKeepalive(socket, false, std::min(last_read + legacy_idle_timeout_, now + idle_timeout_));
+        return;
+    }
+    if (now - last_read >= idle_timeout_)
+    {
+        ExpireConnection(socket, false);
+        return;
+    }
+
+    auto next = last_read + idle_timeout_;
+    if (heartbeat_interval_ > std::chrono::milliseconds::zero() && heartbeat_interval_ < idle_timeout_)
+    {
+        if (now - last_read >= heartbeat_interval_)
+        {
+            connection.outbound->Send(PingFrame(), OutboundQueue::Priority::Control);
+            heartbeats_sent_.fetch_add(1, std::memory_order_relaxed);
+            next = std::min(next, now + heartbeat_interval_);
+        }
+        else
+        {
+            next = last_read + heartbeat_interval_;
+        }
+    }
+    ScheduleKeepalive(socket, false, next);
+}
+
+void ServerManager::ExpireConnection(const std::shared_ptr<tcp::socket>& socket, bool is_file)
+{
+    idle_expired_.fetch_add(1, std::memory_order_relaxed);
+    const auto session = GetConnection(socket).session;
+    std::cout << (is_file ? "File" : "Text") << " client " << (session ? session->GetDisplayName() : "?")
+              << " timed out" << std::endl;
+
+    boost::system::error_code ec;
+    socket->shutdown(tcp::socket::shutdown_both, ec);
+    if (is_file) RemoveFileQueueForSocket(socket);
+}
+
 void ServerManager::StartServer()
 {
-    // text message callback
-    messageReciever_.register_handler(TextTypes::Text,
-                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
+    // clients that never said hello send files on the file port only, their text frames are as small as anyone's
+    messageReciever_.set_legacy_max_frame_bytes(MAX_TEXT_FRAME_BYTES);
+    fileReciever.set_legacy_max_frame_bytes(ConnectionProtocol::LEGACY_MAX_FRAME_BYTES);
+
+    // every text message refreshes its sender's keepalive and is charged to its budgets before it is dispatched
+    // (file chunks are bulk traffic and, like the file port, not metered)
+    messageReciever_.set_admission([this](const std::shared_ptr<tcp::socket>& sender, TextTypes type,
+                                          std::size_t frame_bytes)
+                                   {
+                                       const auto now = TokenBucket::Clock::now();
+                                       const Connection connection = GetConnection(sender);
+                                       if (connection.last_read)
+                                           connection.last_read->store(now.time_since_epoch().count(),
+                                                                       std::memory_order_relaxed);
+                                       if (!connection.ingress || type == TextTypes::FileChunk)
+                                           return MessageReceiver::Admission{};
+                                       return connection.ingress->Admit(frame_bytes, now);
+                                   });
+
+    // heartbeat callback: receiving it already counted as a sign of life, pings are answered
+    messageReciever_.register_handler<TextTypes::Heartbeat>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<HeartbeatMessage> heartbeat)
+                                      {
+                                          if (heartbeat->get_kind() != HeartbeatMessage::Kind::Ping) return;
+                                          if (auto outbound = GetConnection(sender).outbound)
+                                              outbound->Send(std::make_shared<const std::vector<char>>(
+                                                                 HeartbeatMessage(HeartbeatMessage::Kind::Pong).serialize()),
+                                                             OutboundQueue::Priority::Control);
+                                      });
+
+    // hello callback: settles the connection's protocol and answers with it. The answer is the last
+    // legacy frame; everything queued after it uses what was agreed.
+    messageReciever_.register_handler<TextTypes::Hello>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<HelloMessage> hello)
                                       {
-                                          // Cast to specific type
-                                          auto textMsg = std::dynamic_pointer_cast<TextMessage>(msg);
-                                          if (textMsg)
+                                          const Connection connection = GetConnection(sender);
+                                          if (!connection.protocol || !connection.outbound) return;
+                                          // only once per connection: a version-0 Hello settles the protocol too
+                                          if (connection.protocol->hello_received.exchange(true, std::memory_order_acq_rel))
                                           {
+                                              std::cerr << "Hello: protocol already agreed, ignored\n";
+                                              return;
+                                          }
+
+                                          const HelloMessage local(ConnectionProtocol::VERSION,
+                                                                   ConnectionProtocol::COMPACT_HEADERS |
+                                                                   ConnectionProtocol::MULTIPLEXED_FILES |
+                                                                   ConnectionProtocol::BATCHED_TEXT,
+                                                                   MAX_TEXT_FRAME_BYTES, {ConnectionProtocol::Codec::Identity});
+                                          auto& protocol = *connection.protocol;
+                                          protocol.apply(local, *hello);
+                                          connection.outbound->Send(std::make_shared<const std::vector<char>>(
+                                                                        HelloMessage(protocol.version.load(),
+                                                                                     protocol.features.load(),
+                                                                                     MAX_TEXT_FRAME_BYTES,
+                                                                                     {protocol.codec.load()}).serialize()),
+                                                                    OutboundQueue::Priority::Control);
+                                          if (protocol.has(ConnectionProtocol::COMPACT_HEADERS))
+                                              connection.outbound->SetCompactHeaders(true);
+                                      });
+
+    // text message callback
+    messageReciever_.register_handler<TextTypes::Text>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<TextMessage> textMsg)
+                                      {
+                                          // Checked once here, before the line reaches history and every member:
+                                          // invalid UTF-8 and control characters (escape sequences) become '?'
+                                          textMsg->sanitize();
 #ifdef _DEBUG
-                                              std::cout << textMsg->to_string() << std::endl;
+                                          std::cout << textMsg->to_string() << std::endl;
 #endif
-                                              this->Broadcast(sender, textMsg->to_string());
+                                          this->Broadcast(sender, textMsg);
+                                      });
+
+    // room callback: Join moves the connection, Leave sends it back to the default room
+    messageReciever_.register_handler<TextTypes::Room>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<RoomMessage> roomMsg)
+                                      {
+                                          if (!sender || !sender->is_open()) return;
+
+                                          const std::string target = roomMsg->get_action() == RoomMessage::Action::Join
+                                                                         ? roomMsg->get_room()
+                                                                         : std::string(DEFAULT_ROOM);
+                                          if (!Room::IsValidName(target))
+                                          {
+                                              if (auto outbound = GetConnection(sender).outbound)
+                                                  outbound->Send(std::make_shared<const std::vector<char>>(TextMessage(
+                                                                     "Invalid room name (1-32 characters: letters, digits, '_' or '-')")
+                                                                     .serialize()),
+                                                                 OutboundQueue::Priority::Control);
+                                              return;
                                           }
+                                          JoinRoom(sender, target, true);
                                       });
 
-    // filemessages callback
-    fileReciever.register_handler(TextTypes::File,
-                                  [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
-                                  {
-                                      auto fileMsg = std::dynamic_pointer_cast<FileMessage>(msg);
-                                      if (fileMsg)
+    // file chunk callback: files uploaded over a multiplexed text connection. A completed file is decoded
+    // on the CPU workers, like a large file on the file port.
+    messageReciever_.register_handler<TextTypes::FileChunk>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<FileChunkMessage> chunk)
                                       {
-                                          auto rawData = std::make_shared<std::vector<char>>(msg->serialize());
-                                          this->Broadcast(sender, rawData);
-                                      }
+                                          const auto chunks = GetConnection(sender).chunks;
+                                          if (!chunks) return;
+
+                                          std::shared_ptr<std::vector<char>> frame;
+                                          try { frame = chunks->add(*chunk); }
+                                          catch (const std::exception& e)
+                                          {
+                                              std::cerr << "FileChunk: " << e.what() << "\n";
+                                              boost::system::error_code ec;
+                                              sender->shutdown(tcp::socket::shutdown_both, ec);
+                                              return;
+                                          }
+                                          if (!frame) return;
+
+                                          if (!offload_heavy_work_)
+                                          {
+                                              this->Broadcast(sender, frame);
+                                              return;
+                                          }
+                                          boost::asio::post(cpu_pool_, [this, sender, frame]()
+                                          {
+                                              WaitForFileSlot();
+                                              this->Broadcast(sender, frame);
+                                          });
+                                      });
+
+    // filemessages callback, runs on the CPU workers for large files (see SetFileExecutorOptions)
+    fileReciever.register_handler<TextTypes::File>(
+                                  [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<FileMessage> fileMsg)
+                                  {
+                                      if (cpu_pool_.get_executor().running_in_this_thread())
+                                          WaitForFileSlot();
+                                      this->Broadcast(sender, fileMsg);
                                   });
     //sendhistory callback
     // Handler for SendHistory: when a client sends this to the text socket,
     // server sends the stored history only to that client.
     // SIMPLIFIED: SendHistory handler - send files only to requesting client's IP
 // In StartServer(), update the SendHistory handler:
-messageReciever_.register_handler(TextTypes::SendHistory,
-[this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<IMessage> msg)
+messageReciever_.register_handler<TextTypes::SendHistory>(
+[this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<SendHistoryMessage> histMsg)
 {
     if (!sender || !sender->is_open())
         return;
 
-    // Cast to get the file port
-    auto histMsg = std::dynamic_pointer_cast<SendHistoryMessage>(msg);
-    if (!histMsg)
-    {
-        std::cerr << "SendHistory: failed to cast message\n";
-        return;
-    }
-
     unsigned short client_file_port = histMsg->get_file_port();
 
-    // Get sender's IP
-    std::string sender_ip = GetSocketIP(sender);
-    if (sender_ip.empty())
+    // Identity was captured at accept time, no syscalls needed here
+    const Connection sender_connection = GetConnection(sender);
+    const auto& session = sender_connection.session;
+    const auto& outbound = sender_connection.outbound;
+    if (!session || session->GetIp().empty())
     {
-        std::cerr << "SendHistory: couldn't get sender IP\n";
+        std::cerr << "SendHistory: unknown sender\n";
         return;
     }
+    const std::string& sender_ip = session->GetIp();
 
     std::cout << "Client requested history from " << sender_ip
               << " with file port " << client_file_port << std::endl;
 
-    // Begin sending history
-    boost::system::error_code ec;
-    SendMessage(sender, std::make_shared<TextMessage>("--- Begin Message History ---"), ec);
-
-    // Find the EXACT file socket matching IP AND port
+    // Find the EXACT file connection matching IP AND port, then link it to this text connection.
+    // File port 0: the client has no file connection, its files are multiplexed on this one.
+    const bool multiplexed = client_file_port == 0;
+    const std::string file_endpoint = sender_ip + ":" + std::to_string(client_file_port);
     std::shared_ptr<tcp::socket> matching_file_socket;
+    std::shared_ptr<Room> room;
+    std::shared_ptr<FileTransferQueue> file_q = nullptr;
     {
-        std::scoped_lock lk(file_port_clients_mutex_);
-        for (const auto& file_sock : file_port_clients_)
+        std::scoped_lock lock(connections_mutex_);
+        auto file_it = multiplexed ? file_connections_by_endpoint_.end() : file_connections_by_endpoint_.find(file_endpoint);
+        if (file_it != file_connections_by_endpoint_.end()) matching_file_socket = file_it->second.lock();
+        if (multiplexed)
         {
-            if (!file_sock || !file_sock->is_open()) continue;
-
-            boost::system::error_code ep_ec;
-            auto ep = file_sock->remote_endpoint(ep_ec);
-            if (ep_ec) continue;
-
-            std::string file_sock_ip = ep.address().to_string();
-            unsigned short file_sock_port = ep.port();
-
-            // Match by BOTH IP and port
-            if (file_sock_ip == sender_ip && file_sock_port == client_file_port)
-            {
-                matching_file_socket = file_sock;
-                std::cout << "Found matching file socket: " << file_sock_ip
-                         << ":" << file_sock_port << std::endl;
-                break;
-            }
+            std::cout << "Client " << session->GetDisplayName() << " multiplexes files on its text connection" << std::endl;
         }
-    }
-
-    // Get the queue for this specific file socket
-    std::shared_ptr<FileTransferQueue> file_q = nullptr;
-    if (matching_file_socket && matching_file_socket->is_open())
-    {
-        file_q = GetOrCreateFileQueueForSocket(matching_file_socket);
-    }
-    else
-    {
-        std::cerr << "SendHistory: no file socket found for " << sender_ip
-                 << ":" << client_file_port << "\n";
-    }
-
-    // Send history
-    {
-        std::scoped_lock lock(history_mutex_);
-
-        for (const auto& msg_ptr : message_history_)
+        else if (matching_file_socket && matching_file_socket->is_open())
         {
-            if (!msg_ptr) continue;
-
-            boost::system::error_code sendErr;
-            msg_ptr->dispatch_send(sender, file_q, sendErr);
-            if (sendErr)
-                std::cerr << "SendHistory: error sending message: " << sendErr.message() << "\n";
+            std::cout << "Found matching file socket: " << file_endpoint << std::endl;
+            file_q = GetOrCreateFileQueueForSocket(matching_file_socket);
+            connections_[matching_file_socket.get()].owner = sender;
         }
+        else
+        {
+            std::cerr << "SendHistory: no file socket found for " << file_endpoint << "\n";
+        }
+
+        auto& connection = connections_[sender.get()];
+        if (!connection.room) connection.room = GetOrCreateRoom(DEFAULT_ROOM);
+        connection.file_queue = file_q;
+        connection.multiplexed = multiplexed;
+        room = connection.room;
     }
 
-    SendMessage(sender, std::make_shared<TextMessage>("--- End Message History ---"), ec);
-    std::cout << "History sent to " << sender_ip << ":" << client_file_port << std::endl;
+    // The Hello exchange, if any, came first on this connection, so the protocol is settled by now
+    const bool batched = sender_connection.protocol &&
+                         sender_connection.protocol->has(ConnectionProtocol::BATCHED_TEXT);
+    const uint64_t last_seen = histMsg->get_last_seen_sequence();
+    boost::asio::post(room->GetStrand(), [room, sender, outbound, file_q, multiplexed, batched, last_seen]()
+    {
+        room->LinkFileQueue(sender, file_q, multiplexed, batched);
+        room->ReplayHistory(outbound, file_q, last_seen);
+    });
 });
 
+    // HistoryQuery callback: one page of older messages for the requesting client only
+    messageReciever_.register_handler<TextTypes::HistoryQuery>(
+                                      [this](const std::shared_ptr<tcp::socket>& sender, std::shared_ptr<HistoryQueryMessage> query)
+                                      {
+                                          if (!sender || !sender->is_open()) return;
+                                          const Connection connection = GetConnection(sender);
+                                          if (!connection.outbound) return;
+                                          auto room = connection.room ? connection.room : GetOrCreateRoom(DEFAULT_ROOM);
+                                          boost::asio::post(room->GetStrand(), [room, outbound = connection.outbound, query]()
+                                          {
+                                              room->SendHistoryPage(outbound, query->get_before_sequence(),
+                                                                    query->get_limit());
+                                          });
+                                      });
+
 
     try
     {
@@ -160,32 +734,52 @@ messageReciever_.register_handler(TextTypes::SendHistory,
         {
             io_context.reset();
         }
+        if (file_io_context_.stopped())
+        {
+            file_io_context_.reset();
+        }
 
-        // Use member variables for acceptors
-        acceptor_ = std::make_shared<tcp::acceptor>(
-            io_context,
-            tcp::endpoint(boost::asio::ip::make_address_v4(this->address), this->port));
+        // Large file messages are assembled and decoded on the CPU workers instead of an io thread
+        {
+            std::scoped_lock lock(file_ingest_mutex_);
+            file_ingest_open_ = true;
+        }
+        if (offload_heavy_work_)
+            fileReciever.set_offload(cpu_pool_.get_executor(), FILE_OFFLOAD_BYTES);
+        else
+            fileReciever.set_offload({}, 0);
 
-        file_acceptor_ = std::make_shared<tcp::acceptor>(
-            io_context,
-            tcp::endpoint(boost::asio::ip::make_address_v4(this->address), this->fileport));
+        // Use member variables for acceptors; the file port lives in its own execution domain
+        acceptor_ = MakeAcceptor(io_context, this->port);
+        file_acceptor_ = MakeAcceptor(FileIoContext(), this->fileport);
 
         AcceptTextConnection(acceptor_);
         AcceptFileConnection(file_acceptor_);
+        StartKeepalive();
 
-        const unsigned int thread_count = std::max(4u, std::thread::hardware_concurrency());
+        const unsigned int thread_count = IoThreadCount();
         threads.reserve(thread_count);
 
         for (unsigned int i = 0; i < thread_count; ++i)
             threads.emplace_back([this]() { io_context.run(); });
 
+        if (file_io_threads_ > 0)
+        {
+            file_threads_.reserve(file_io_threads_);
+            for (unsigned int i = 0; i < file_io_threads_; ++i)
+                file_threads_.emplace_back([this]() { file_io_context_.run(); });
+        }
+
         this->SetStatusUP(true);
 
         // This loop now correctly blocks until StopServer() is called
         for (auto& t : threads)
             t.join();
+        for (auto& t : file_threads_)
+            t.join();
 
         threads.clear();
+        file_threads_.clear();
     }
     catch (std::exception& e)
     {
@@ -193,17 +787,50 @@ messageReciever_.register_handler(TextTypes::SendHistory,
     }
 }
 
+#ifdef CHAT_USE_COROUTINES
+
+boost::asio::awaitable<void> ServerManager::AcceptLoop(
+    std::shared_ptr<tcp::acceptor> acceptor,
+    ClientList& clients,
+    MessageReceiver& receiver,
+    bool sendGreeting)
+{
+    boost::system::error_code error;
+    for (;;)
+    {
+        // the socket belongs to the acceptor's execution domain (chat or file io_context)
+        auto block = NewSessionBlock(acceptor->get_executor());
+        co_await acceptor->async_accept(block->socket, boost::asio::redirect_error(boost::asio::use_awaitable, error));
+
+        const bool is_shutdown_error = (error == boost::asio::error::operation_aborted ||
+            error == boost::asio::error::bad_descriptor);
+        if (error && !is_shutdown_error)
+        {
+            std::cerr << "Accept error: " << error.message() << std::endl;
+        }
+
+        if (!error && block->socket.is_open())
+        {
+            OnAccepted(block, clients, receiver, sendGreeting);
+        }
+
+        if (io_context.stopped() || is_shutdown_error) co_return;
+    }
+}
+
+#else
+
 void ServerManager::AcceptConnection(
     const std::shared_ptr<tcp::acceptor>& acceptor,
-    std::vector<std::shared_ptr<tcp::socket>>& client_list,
-    std::mutex& client_list_mutex,
+    ClientList& clients,
     MessageReceiver& receiver,
     bool sendGreeting)
 {
-    auto socket = std::make_shared<tcp::socket>(io_context);
+    // the socket belongs to the acceptor's execution domain (chat or file io_context)
+    auto block = NewSessionBlock(acceptor->get_executor());
 
-    acceptor->async_accept(*socket,
-        [this, acceptor, socket, &client_list, &client_list_mutex, &receiver, sendGreeting]
+    acceptor->async_accept(block->socket,
+        Utils::recycled([this, acceptor, block, &clients, &receiver, sendGreeting]
         (const boost::system::error_code& error)
         {
             const bool is_shutdown_error = (error == boost::asio::error::operation_aborted ||
@@ -217,69 +844,105 @@ void ServerManager::AcceptConnection(
                 }
             }
 
-            if (!error && socket && socket->is_open())
+            if (!error && block->socket.is_open())
             {
-                // Add socket to client list
-                {
-                    std::scoped_lock lock(client_list_mutex);
-                    bool exists = std::any_of(client_list.begin(), client_list.end(),
-                        [&](const auto& s)
-                        {
-                            return s && s->native_handle() == socket->native_handle();
-                        });
-                    if (!exists) client_list.push_back(socket);
-                }
+                OnAccepted(block, clients, receiver, sendGreeting);
+            }
 
-                // Get client IP for logging
-                boost::system::error_code ec;
-                auto ep = socket->remote_endpoint(ec);
-                std::string client_ip = "unknown";
-                if (!ec)
-                {
-                    client_ip = ep.address().to_string() + ":" + std::to_string(ep.port());
-                }
+            // Re-arm accept
+            if (!io_context.stopped() && !is_shutdown_error)
+            {
+                AcceptConnection(acceptor, clients, receiver, sendGreeting);
+            }
+        }));
+}
 
-                // If this is a file socket, create its queue
-                if (&client_list == &file_port_clients_)
-                {
-                    GetOrCreateFileQueueForSocket(socket);
-                    std::cout << "File client connected from " << client_ip << std::endl;
-                }
-                else
-                {
-                    std::cout << "Text client connected from " << client_ip << std::endl;
-                }
+#endif
 
-                // GREETING
-                if (sendGreeting)
+void ServerManager::OnAccepted(const std::shared_ptr<SessionBlock>& block, ClientList& clients,
+                               MessageReceiver& receiver, bool sendGreeting)
+{
+    // Identity is captured once here; text sockets start in the default room
+    const bool is_file = &clients == &file_port_clients_;
+    const auto socket = SocketOf(block);
+    const Session& session = RegisterConnection(block, is_file);
+
+    // Add socket to client list; connections closed since the last sweep are dropped
+    // once the list has doubled, keeping registration amortized O(1)
+    std::vector<std::shared_ptr<tcp::socket>> closed;
+    {
+        std::scoped_lock lock(clients.mutex);
+        if (clients.sockets.size() >= clients.prune_at)
+        {
+            for (auto it = clients.sockets.begin(); it != clients.sockets.end();)
+            {
+                if (!it->second || !it->second->is_open())
                 {
-                    auto helloMessage = std::make_shared<TextMessage>("Hello client");
-                    boost::system::error_code sendErr;
-                    SendMessage(socket, helloMessage, sendErr);
-                    if (sendErr && sendErr != boost::asio::error::operation_aborted)
-                        std::cerr << "ERROR sending hello: " << sendErr.message() << std::endl;
+                    if (it->second) closed.push_back(it->second);
+                    it = clients.sockets.erase(it);
                 }
-
-                // Start receiving from this socket
-                receiver.start_read_header(socket);
+                else ++it;
             }
+            clients.prune_at = std::max<std::size_t>(64, 2 * clients.sockets.size());
+        }
+        clients.sockets.emplace(session.GetId(), socket);
+    }
+    for (const auto& s : closed) RemoveFileQueueForSocket(s);
 
-            // Re-arm accept
-            if (!io_context.stopped() && !is_shutdown_error)
-            {
-                AcceptConnection(acceptor, client_list, client_list_mutex, receiver, sendGreeting);
-            }
-        });
+    if (is_file)
+    {
+        GetOrCreateFileQueueForSocket(socket);
+        std::cout << "File client connected from " << session.GetDisplayName() << std::endl;
+    }
+    else
+    {
+        JoinRoom(socket, DEFAULT_ROOM, false);
+        std::cout << "Text client connected from " << session.GetDisplayName() << std::endl;
+    }
+
+    // GREETING
+    if (sendGreeting)
+    {
+        if (auto outbound = GetConnection(socket).outbound)
+            outbound->Send(std::make_shared<const std::vector<char>>(TextMessage("Hello client").serialize()),
+                           OutboundQueue::Priority::Control);
+    }
+
+    // One keepalive timer per connection: text connections are checked after a heartbeat
+    // interval of silence, file connections once they had the idle timeout to get linked
+    const auto now = TimerWheel::Clock::now();
+    ScheduleKeepalive(socket, is_file, now + (is_file || heartbeat_interval_ <= std::chrono::milliseconds::zero()
+                                                  ? idle_timeout_
+                                                  : std::min(heartbeat_interval_, idle_timeout_)));
+
+    // Start receiving from this socket; file connections keep the legacy protocol of their block
+    receiver.start_read_header(socket, std::shared_ptr<const ConnectionProtocol>(block, &block->protocol));
 }
 
 void ServerManager::AcceptTextConnection(const std::shared_ptr<tcp::acceptor>& acceptor)
 {
-    AcceptConnection(acceptor, text_port_clients_, text_port_clients_mutex_, messageReciever_, false);
+    for (unsigned int i = 0; i < concurrent_accepts_; ++i)
+    {
+#ifdef CHAT_USE_COROUTINES
+        boost::asio::co_spawn(acceptor->get_executor(),
+                              AcceptLoop(acceptor, text_port_clients_, messageReciever_, false), boost::asio::detached);
+#else
+        AcceptConnection(acceptor, text_port_clients_, messageReciever_, false);
+#endif
+    }
 }
 
 void ServerManager::AcceptFileConnection(const std::shared_ptr<tcp::acceptor>& acceptor)
 {
-    AcceptConnection(acceptor, file_port_clients_, file_port_clients_mutex_, fileReciever, false);
+    for (unsigned int i = 0; i < concurrent_accepts_; ++i)
+    {
+#ifdef CHAT_USE_COROUTINES
+        boost::asio::co_spawn(acceptor->get_executor(),
+                              AcceptLoop(acceptor, file_port_clients_, fileReciever, false), boost::asio::detached);
+#else
+        AcceptConnection(acceptor, file_port_clients_, fileReciever, false);
+#endif
+    }
 }
 
 std::shared_ptr<FileTransferQueue> ServerManager::GetOrCreateFileQueueForSocket(
@@ -300,6 +963,7 @@ std::shared_ptr<FileTransferQueue> ServerManager::GetOrCreateFileQueueForSocket(
     auto q = std::make_shared<FileTransferQueue>(std::move(getter));
     {
         std::scoped_lock lk(file_queues_mutex_);
+        q->set_zero_copy(zero_copy_options_);
         file_queues_.emplace(key, q);
     }
     return q;
@@ -335,136 +999,69 @@ void ServerManager::Broadcast(const std::shared_ptr<tcp::socket>& sender,
         std::cerr << "Broadcast: failed to deserialize FileMessage: " << ex.what() << "\n";
         return;
     }
+    Broadcast(sender, fm);
+}
 
-    std::string sender_info = "<Server>";
-    if (sender)
-    {
-        boost::system::error_code ec;
-        auto ep = sender->remote_endpoint(ec);
-        if (!ec)
-        {
-            sender_info = ep.address().to_string() + ":" + std::to_string(ep.port());
-        }
-    }
+// --- Broadcast overload for decoded files ---
+void ServerManager::Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::shared_ptr<FileMessage>& fm)
+{
+    if (!fm) return;
 
-    // Create text log and add to history
-    auto text_log = std::make_shared<TextMessage>("[FILE] From " + sender_info + ": " + fm->to_string());
-    {
-        std::scoped_lock lock(history_mutex_);
-        message_history_.push_back(text_log);
-        message_history_.push_back(fm);
-        if (message_history_.size() > MAX_HISTORY_MESSAGES)
-        {
-            message_history_.pop_front();
-        }
-    }
+    // The file goes to the room of the text connection that sent it: the owner of the sending file
+    // connection, or the sender itself when it multiplexes files on its text connection
+    const Connection connection = GetConnection(sender);
+    const auto& session = connection.session ? connection.session : Session::Server();
+    auto sender_text = connection.outbound ? sender : connection.owner.lock();
+    auto room = GetRoomOf(sender_text);
+    std::string announcement = session->GetFilePrefix() + fm->to_string();
+    // the file name is the client's text too
+    Utils::TextSanitizer::sanitize(announcement.data(), announcement.size());
 
-    // --- 1. Enqueue file for FILE clients (except sender) ---
-    std::vector<std::shared_ptr<tcp::socket>> fileClientsCopy;
-    std::vector<std::shared_ptr<tcp::socket>> deadClients;
-    {
-        std::scoped_lock lk(file_port_clients_mutex_);
-        auto it = std::remove_if(file_port_clients_.begin(), file_port_clients_.end(),
-                                 [&deadClients](const auto& s)
-                                 {
-                                     bool dead = (!s || !s->is_open());
-                                     if (dead && s) deadClients.push_back(s);
-                                     return dead;
-                                 });
-        file_port_clients_.erase(it, file_port_clients_.end());
-        fileClientsCopy = file_port_clients_;
-    }
+    // Encoded here, on the thread that decoded it (a CPU worker for large files), not on the room's strand
+    auto file_frame = std::make_shared<const std::vector<char>>(fm->serialize());
 
-    for (const auto& s : deadClients)
     {
-        RemoveFileQueueForSocket(s);
+        std::scoped_lock lock(file_ingest_mutex_);
+        ++files_in_flight_;
     }
-
-    for (const auto& clientSock : fileClientsCopy)
+    boost::asio::post(room->GetStrand(), [this, room, sender_text, announcement = std::move(announcement), fm,
+                                          file_frame = std::move(file_frame)]() mutable
     {
-        if (!clientSock || !clientSock->is_open()) continue;
-        // Skip the actual sender socket (file socket)
-        if (sender && clientSock->native_handle() == sender->native_handle()) continue;
-
-        auto q = GetOrCreateFileQueueForSocket(clientSock);
-        if (q)
+        room->PublishFile(sender_text, announcement, fm, std::move(file_frame));
         {
-            q->enqueue(fm);
+            std::scoped_lock lock(file_ingest_mutex_);
+            --files_in_flight_;
         }
-    }
-
-    // --- 2. Send text log to ALL TEXT clients (including sender) ---
-    std::vector<std::shared_ptr<tcp::socket>> textClientsCopy;
-    {
-        std::scoped_lock lock(text_port_clients_mutex_);
-        text_port_clients_.erase(
-            std::remove_if(text_port_clients_.begin(), text_port_clients_.end(),
-                           [](const auto& s) { return !s || !s->is_open(); }),
-            text_port_clients_.end()
-        );
-        textClientsCopy = text_port_clients_;
-    }
-
-    for (const auto& clientSock : textClientsCopy)
-    {
-        if (!clientSock || !clientSock->is_open()) continue;
+        file_ingest_cv_.notify_one();
+    });
+}
 
-        // send to everyone except sender
-        if (sender && clientSock->native_handle() == sender->native_handle()) continue;
-        boost::system::error_code sendErr;
-        SendMessage(clientSock, text_log, sendErr);
-        if (sendErr)
-        {
-            std::cerr << "ERROR sending file log to client: " << sendErr.message() << std::endl;
-        }
-    }
+void ServerManager::WaitForFileSlot()
+{
+    std::unique_lock lock(file_ingest_mutex_);
+    file_ingest_cv_.wait(lock, [this]() { return files_in_flight_ < MAX_FILES_IN_FLIGHT || !file_ingest_open_; });
 }
 
 // --- Broadcast overload for text messages ---
-void ServerManager::Broadcast(const std::shared_ptr<tcp::socket>& sender, const std::string& text)
+void ServerManager::Broadcast(const std::shared_ptr<tcp::socket>& sender,
+                              const std::shared_ptr<const TextMessage>& message)
 {
-    std::vector<std::shared_ptr<tcp::socket>> clientsCopy;
+    if (!message) return;
+
+    // One shared-lock lookup gives the room and the preformatted sender prefix;
+    // numbering, encoding and fan-out happen on the room's strand
+    Connection connection = GetConnection(sender);
+    auto session = connection.session ? std::move(connection.session) : Session::Server();
+    auto room = connection.room ? std::move(connection.room) : GetOrCreateRoom(DEFAULT_ROOM);
+    boost::asio::post(room->GetStrand(), [room, sender, session = std::move(session), message]()
     {
-        std::scoped_lock lock(text_port_clients_mutex_);
-        // Clean up disconnected clients
-        text_port_clients_.erase(
-            std::remove_if(text_port_clients_.begin(), text_port_clients_.end(),
-                           [](const auto& s) { return !s || !s->is_open(); }),
-            text_port_clients_.end()
-        );
-        clientsCopy = text_port_clients_;
-    }
-
-    std::string sender_info = "<Server>";
-    if (sender)
-    {
-        boost::system::error_code ec;
-        auto ep = sender->remote_endpoint(ec);
-        if (!ec) sender_info = ep.address().to_string() + ":" + std::to_string(ep.port());
-    }
-
-    // Create message and add to history ONCE
-    auto msg = std::make_shared<TextMessage>("[TEXT] From " + sender_info + ": " + text);
-    {
-        std::scoped_lock lock(history_mutex_);
-        message_history_.push_back(msg);
-        // Keep the history size limited
-        if (message_history_.size() > MAX_HISTORY_MESSAGES)
-        {
-            message_history_.pop_front();
-        }
-    }
-
-    // Now, send the pre-made message to all clients
-    for (const auto& clientSock : clientsCopy)
-    {
-        if (!clientSock || !clientSock->is_open()) continue;
-        if (sender && clientSock->native_handle() == sender->native_handle()) continue;
+        room->PublishText(sender, session->GetTextPrefix(), message->get_text());
+    });
+}
 
-        boost::system::error_code sendErr;
-        SendMessage(clientSock, msg, sendErr);
-        if (sendErr) std::cerr << "ERROR sending to client: " << sendErr.message() << std::endl;
-    }
+void ServerManager::Broadcast(const std::shared_ptr<tcp::socket>& sender, std::string text)
+{
+    Broadcast(sender, std::make_shared<const TextMessage>(std::move(text)));
 }
 
 
@@ -541,8 +1138,8 @@ void ServerManager::StopServer()
 
     // 3. Close all client sockets
     {
-        std::scoped_lock lk(text_port_clients_mutex_);
-        for (const auto& s : text_port_clients_)
+        std::scoped_lock lk(text_port_clients_.mutex);
+        for (const auto& [id, s] : text_port_clients_.sockets)
         {
             if (s && s->is_open())
             {
@@ -551,12 +1148,12 @@ void ServerManager::StopServer()
                 s->close(ec);
             }
         }
-        text_port_clients_.clear();
+        text_port_clients_.sockets.clear();
     }
 
     {
-        std::scoped_lock lk(file_port_clients_mutex_);
-        for (const auto& s : file_port_clients_)
+        std::scoped_lock lk(file_port_clients_.mutex);
+        for (const auto& [id, s] : file_port_clients_.sockets)
         {
             if (s && s->is_open())
             {
@@ -565,14 +1162,31 @@ void ServerManager::StopServer()
                 s->close(ec);
             }
         }
-        file_port_clients_.clear();
+        file_port_clients_.sockets.clear();
+    }
+
+    // 4. Make the persisted history of every room durable
+    std::vector<std::shared_ptr<Room>> rooms;
+    {
+        std::shared_lock lk(rooms_mutex_);
+        for (const auto& [name, room] : rooms_) rooms.push_back(room);
     }
+    for (const auto& room : rooms) room->FlushHistoryLog();
 
-    // 4. NOW stop the io_context (after all async ops are cancelled)
+    // 5. NOW stop the io_context (after all async ops are cancelled)
     if (!io_context.stopped())
     {
         io_context.stop();
     }
+    if (!file_io_context_.stopped())
+    {
+        file_io_context_.stop();
+    }
+    {
+        std::scoped_lock lock(file_ingest_mutex_);
+        file_ingest_open_ = false;
+    }
+    file_ingest_cv_.notify_all();
     this->SetStatusUP(false);
     std::cout << "Server stopped successfully\n";
 }
@@ -0,0 +1,37 @@
+#include <Server/Session.h>
+
+Session::Session(uint64_t id, std::string ip, unsigned short port, std::string display_name)
+    : id_(id),
+      ip_(std::move(ip)),
+      port_(port),
+      display_name_(std::move(display_name)),
+      text_prefix_("[TEXT] From " + display_name_ + ": "),
+      file_prefix_("[FILE] From " + display_name_ + ": ")
+{
+}
+
+Session::Session(uint64_t id, const boost::asio::ip::tcp::socket& socket) : Session(id, RemoteOf(socket))
+{
+}
+
+Session::Session(uint64_t id, Remote remote)
+    : Session(id, std::move(remote.ip), remote.port, std::move(remote.display_name))
+{
+}
+
+Session::Remote Session::RemoteOf(const boost::asio::ip::tcp::socket& socket)
+{
+    boost::system::error_code ec;
+    const auto ep = socket.remote_endpoint(ec);
+    if (ec) return {std::string(), 0, "unknown"};
+
+    std::string ip = ep.address().to_string();
+    std::string display_name = ip + ":" + std::to_string(ep.port());
+    return {std::move(ip), ep.port(), std::move(display_name)};
+}
+
+const std::shared_ptr<const Session>& Session::Server()
+{
+    static const std::shared_ptr<const Session> server = std::make_shared<const Session>(0, std::string(), 0, "<Server>");
+    return server;
+}
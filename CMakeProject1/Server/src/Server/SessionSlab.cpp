@@ -0,0 +1,55 @@
+#include <Server/SessionSlab.h>
+#include <new>
+
+SessionSlab::~SessionSlab()
+{
+    for (void* slab : slabs_) ::operator delete(slab, std::align_val_t(BLOCK_ALIGNMENT));
+}
+
+void SessionSlab::AddSlabLocked()
+{
+    auto* slab = static_cast<char*>(::operator new(block_bytes_ * BLOCKS_PER_SLAB, std::align_val_t(BLOCK_ALIGNMENT)));
+    slabs_.push_back(slab);
+    // threaded back to front, so the slab is handed out in address order
+    for (std::size_t i = BLOCKS_PER_SLAB; i-- > 0;)
+        free_ = ::new (slab + i * block_bytes_) FreeBlock{free_};
+}
+
+void* SessionSlab::Allocate(std::size_t bytes)
+{
+    {
+        std::scoped_lock lock(mutex_);
+        if (block_bytes_ == 0)
+            block_bytes_ = (bytes + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+        if (bytes <= block_bytes_)
+        {
+            if (!free_) AddSlabLocked();
+            FreeBlock* block = free_;
+            free_ = block->next;
+            ++in_use_;
+            return block;
+        }
+    }
+    return ::operator new(bytes);
+}
+
+void SessionSlab::Deallocate(void* block, std::size_t bytes) noexcept
+{
+    if (!block) return;
+    {
+        std::scoped_lock lock(mutex_);
+        if (bytes <= block_bytes_)
+        {
+            free_ = ::new (block) FreeBlock{free_};
+            --in_use_;
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+SessionSlab::Stats SessionSlab::GetStats() const
+{
+    std::scoped_lock lock(mutex_);
+    return {block_bytes_, in_use_, slabs_.size()};
+}
@@ -0,0 +1,66 @@
+#include <Server/TimerWheel.h>
+#include <algorithm>
+
+TimerWheel::TimerWheel(Clock::duration tick, std::size_t slots)
+    : tick_(std::max(tick, Clock::duration(1))), slots_(std::max<std::size_t>(slots, 1))
+{
+}
+
+void TimerWheel::StartLocked(Clock::time_point now)
+{
+    if (origin_ == Clock::time_point{}) origin_ = now;
+}
+
+uint64_t TimerWheel::TickOf(Clock::time_point time) const
+{
+    if (time <= origin_) return 0;
+    return static_cast<uint64_t>((time - origin_) / tick_);
+}
+
+void TimerWheel::Schedule(Clock::time_point deadline, Callback callback)
+{
+    if (!callback) return;
+    std::scoped_lock lock(mutex_);
+    StartLocked(std::min(deadline, Clock::now()));
+
+    // rounded up, and never into a tick that was already processed
+    uint64_t expiry = TickOf(deadline);
+    if (origin_ + expiry * tick_ < deadline) ++expiry;
+    expiry = std::max(expiry, current_ + 1);
+
+    slots_[expiry % slots_.size()].push_back({expiry, std::move(callback)});
+    ++size_;
+}
+
+std::size_t TimerWheel::Advance(Clock::time_point now)
+{
+    std::vector<Callback> due;
+    {
+        std::scoped_lock lock(mutex_);
+        StartLocked(now);
+        const uint64_t target = TickOf(now);
+        if (target <= current_) return 0;
+
+        // a late call visits every slot at most once
+        const uint64_t steps = std::min<uint64_t>(target - current_, slots_.size());
+        for (uint64_t tick = current_ + 1; tick <= current_ + steps; ++tick)
+        {
+            auto& slot = slots_[tick % slots_.size()];
+            auto keep = std::partition(slot.begin(), slot.end(),
+                                       [target](const Entry& e) { return e.expiry > target; });
+            for (auto it = keep; it != slot.end(); ++it) due.push_back(std::move(it->callback));
+            slot.erase(keep, slot.end());
+        }
+        current_ = target;
+        size_ -= due.size();
+    }
+
+    for (auto& callback : due) callback();
+    return due.size();
+}
+
+std::size_t TimerWheel::Size() const
+{
+    std::scoped_lock lock(mutex_);
+    return size_;
+}
@@ -57,16 +57,22 @@ int main()
     std::string ip = get_ip_input("Enter server IP address", "0.0.0.0");
     int text_port = get_port_input("Enter text message port", 5555);
     int file_port = get_port_input("Enter file transfer port", 5556);
+    std::cout << "Enter history log directory (\"-\" keeps history in memory only) [chat_history]: ";
+    std::string history_dir;
+    std::getline(std::cin, history_dir);
+    if (history_dir.empty()) history_dir = "chat_history";
+    if (history_dir == "-") history_dir.clear();
 
     std::cout << "\n=== Starting Server ===" << std::endl;
     std::cout << "IP: " << ip << std::endl;
     std::cout << "Text Port: " << text_port << std::endl;
     std::cout << "File Port: " << file_port << std::endl;
+    std::cout << "History: " << (history_dir.empty() ? "in memory only" : history_dir) << std::endl;
     std::cout << "\nPress Ctrl+C to stop the server" << std::endl;
     std::cout << "========================\n" << std::endl;
 
     try {
-        ServerManager srvman(text_port, file_port, std::move(ip));
+        ServerManager srvman(text_port, file_port, std::move(ip), history_dir);
         srvman.StartServer();
     }
     catch (const std::exception& e) {
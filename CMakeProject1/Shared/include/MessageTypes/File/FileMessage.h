@@ -32,6 +32,7 @@ public:
     // Optional: get a human-readable representation
     std::string to_string() const override;
     [[nodiscard]] std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
     // Optional: save the file upon recieving
     void save_file() const override;
 
@@ -0,0 +1,47 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+
+/**
+ * @brief One piece of a file frame sent over a multiplexed connection (text and files on one socket).
+ *
+ * A complete, serialized FileMessage frame is cut into chunks that all carry the same channel id;
+ * the receiver appends them per channel and decodes the frame once the chunk flagged `last` arrived.
+ * Chunks of a file travel between chat frames, so chat never waits for a whole file.
+ **/
+class FileChunkMessage : public IMessage
+{
+public:
+    static constexpr std::size_t HEADER_SIZE = sizeof(uint32_t) + 2 * sizeof(uint64_t) + sizeof(uint32_t);
+
+private:
+    uint64_t channel_ = 0;
+    bool last_ = false;
+    std::vector<char> data_;
+
+public:
+    FileChunkMessage() = default;
+    FileChunkMessage(uint64_t channel, bool last, std::vector<char> data)
+        : channel_(channel), last_(last), data_(std::move(data)) {}
+
+    /**
+     * @brief Frame header (HEADER_SIZE bytes) of a chunk carrying `chunk_bytes` bytes, so a sender can
+     *        write the chunk straight out of the file frame instead of copying it into a message
+     **/
+    static std::vector<char> encode_header(uint64_t channel, bool last, std::size_t chunk_bytes);
+
+    uint64_t get_channel() const { return channel_; }
+    bool is_last() const { return last_; }
+    std::vector<char>& get_data() { return data_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+
+/**
+ * @brief Keepalive probe on the text connection. The server pings connections that have been silent
+ *        for a while; the peer answers a Ping with a Pong. Any received message counts as a sign of life,
+ *        so a Pong is never answered.
+ **/
+class HeartbeatMessage : public IMessage
+{
+public:
+    enum class Kind : uint32_t
+    {
+        Ping = 0,
+        Pong = 1
+    };
+
+private:
+    Kind kind_ = Kind::Ping;
+
+public:
+    HeartbeatMessage() = default;
+    explicit HeartbeatMessage(Kind kind) : kind_(kind) {}
+
+    Kind get_kind() const { return kind_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
@@ -0,0 +1,44 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+#include "Server/ConnectionProtocol.h"
+
+/**
+ * @brief First message on a text connection: protocol version, optional features, the largest frame
+ *        the sender accepts and its payload codecs in order of preference.
+ *
+ * The client says hello as soon as it connected and the server answers with what it agreed to (see
+ * ConnectionProtocol::apply). Both switch to the agreed protocol right after the server's answer.
+ * Peers that never say hello keep the legacy protocol; older servers drop the unknown message, so a
+ * client that gets no answer keeps it as well.
+ **/
+class HelloMessage : public IMessage
+{
+private:
+    uint32_t version_ = 0;
+    uint32_t features_ = 0;
+    uint64_t max_frame_bytes_ = 0;
+    std::vector<ConnectionProtocol::Codec> codecs_;
+
+public:
+    HelloMessage() = default;
+    HelloMessage(uint32_t version, uint32_t features, uint64_t max_frame_bytes,
+                 std::vector<ConnectionProtocol::Codec> codecs)
+        : version_(version), features_(features), max_frame_bytes_(max_frame_bytes), codecs_(std::move(codecs)) {}
+
+    uint32_t get_version() const { return version_; }
+    uint32_t get_features() const { return features_; }
+    uint64_t get_max_frame_bytes() const { return max_frame_bytes_; }
+    const std::vector<ConnectionProtocol::Codec>& get_codecs() const { return codecs_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
@@ -0,0 +1,35 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+
+/**
+ * @brief Client request for one page of older history: up to `limit` messages with a
+ *        sequence number lower than `before_sequence` (0 means "the newest messages").
+ *
+ * The server answers with a HistorySyncMessage (Status::Page) followed by the page, oldest first.
+ **/
+class HistoryQueryMessage : public IMessage
+{
+private:
+    uint64_t before_sequence_ = 0;
+    uint32_t limit_ = 0;
+
+public:
+    HistoryQueryMessage() = default;
+    HistoryQueryMessage(uint64_t before_sequence, uint32_t limit)
+        : before_sequence_(before_sequence), limit_(limit) {}
+
+    uint64_t get_before_sequence() const { return before_sequence_; }
+    uint32_t get_limit() const { return limit_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
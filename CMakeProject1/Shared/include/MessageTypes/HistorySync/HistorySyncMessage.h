@@ -0,0 +1,47 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+
+/**
+ * @brief Sent by the server in front of a history replay, tells the client how to apply it.
+ *
+ * Delta:      only messages newer than the client's last seen sequence follow.
+ * FullResync: the client is too far behind (or new), the newest page of history follows.
+ * Page:       answer to a HistoryQueryMessage, a page of older messages follows
+ *             (first sequence 0 means there is nothing older).
+ **/
+class HistorySyncMessage : public IMessage
+{
+public:
+    enum class Status : uint32_t
+    {
+        Delta = 0,
+        FullResync = 1,
+        Page = 2
+    };
+
+private:
+    Status status_ = Status::Delta;
+    uint64_t first_sequence_ = 0;  // oldest sequence in the replay (0 if empty)
+    uint64_t last_sequence_ = 0;   // newest sequence known to the room (newest in the page for Page)
+
+public:
+    HistorySyncMessage() = default;
+    HistorySyncMessage(Status status, uint64_t first_sequence, uint64_t last_sequence)
+        : status_(status), first_sequence_(first_sequence), last_sequence_(last_sequence) {}
+
+    Status get_status() const { return status_; }
+    uint64_t get_first_sequence() const { return first_sequence_; }
+    uint64_t get_last_sequence() const { return last_sequence_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
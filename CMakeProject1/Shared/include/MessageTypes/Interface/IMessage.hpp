@@ -1,8 +1,8 @@
 #pragma once
+#include <memory>
 #include <vector>
 #include <string>
 #include <boost/asio/ip/tcp.hpp>
-#include "Server/MessageReceiver.h"
 
 class FileTransferQueue;
 
@@ -10,7 +10,15 @@ enum class TextTypes : uint32_t
 {
     Text = 0,
     File = 1,
-    SendHistory = 2
+    SendHistory = 2,
+    SequencedText = 3,  // TextMessage carrying a room sequence number
+    HistorySync = 4,
+    HistoryQuery = 5,
+    Room = 6,
+    Heartbeat = 7,
+    FileChunk = 8,      // piece of a file frame, multiplexed with chat on one connection
+    Hello = 9,          // protocol version and capabilities, exchanged when a text connection opens
+    TextBatch = 10      // many sequenced chat lines of one room in one frame
 };
 
 class IMessage : public std::enable_shared_from_this<IMessage>
@@ -37,6 +45,11 @@ public:
      * @brief Get a vector<char> object to send over the network.
      **/
     virtual std::vector<char> to_data_send() const = 0;
+
+    /**
+     * @brief Number of payload bytes this message keeps in memory (used for history accounting)
+     **/
+    virtual std::size_t payload_size() const = 0;
     /**
      * @brief Save file to desktop
      */
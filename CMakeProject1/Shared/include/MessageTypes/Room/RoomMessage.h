@@ -0,0 +1,41 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+
+/**
+ * @brief Room membership change. A client sends Join/Leave to move its connection between rooms;
+ *        the server answers with a Join carrying the room the connection ended up in.
+ *
+ * Leaving a room moves the connection back to the default room.
+ **/
+class RoomMessage : public IMessage
+{
+public:
+    enum class Action : uint32_t
+    {
+        Join = 0,
+        Leave = 1
+    };
+
+private:
+    Action action_ = Action::Join;
+    std::string room_;
+
+public:
+    RoomMessage() = default;
+    RoomMessage(Action action, std::string room) : action_(action), room_(std::move(room)) {}
+
+    Action get_action() const { return action_; }
+    const std::string& get_room() const { return room_; }
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
@@ -6,17 +6,21 @@ class SendHistoryMessage : public IMessage
 {
 private:
     unsigned short file_port_ = 0;  // Client's file socket port
+    uint64_t last_seen_sequence_ = 0;  // Newest room sequence the client already has (0 = none)
 
 public:
     SendHistoryMessage() = default;
-    explicit SendHistoryMessage(unsigned short file_port) : file_port_(file_port) {}
+    explicit SendHistoryMessage(unsigned short file_port, uint64_t last_seen_sequence = 0)
+        : file_port_(file_port), last_seen_sequence_(last_seen_sequence) {}
 
     unsigned short get_file_port() const { return file_port_; }
+    uint64_t get_last_seen_sequence() const { return last_seen_sequence_; }
 
     std::vector<char> serialize() const override;
     void deserialize(const std::vector<char>& data) override;
     std::string to_string() const override;
     std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
     void save_file() const override;
 
     void dispatch_send(
@@ -1,22 +1,57 @@
 #pragma once
 #include "MessageTypes/Interface/IMessage.hpp"
+#include <array>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include "Server/MessageSender.h"
 
 
+/**
+ * @brief A chat line. Texts up to INLINE_CAPACITY bytes are stored inside the message, so decoding
+ *        one allocates nothing beyond the message itself; longer texts are kept in a string that is
+ *        moved in when the caller hands one over.
+ **/
 class TextMessage : public IMessage
 {
 public:
+    static constexpr std::size_t INLINE_CAPACITY = 192;  // most chat lines fit
+
     TextMessage() = default;
-    explicit TextMessage(const std::string& text);
+    /**
+     * @brief Text with a room sequence number, serialized as TextTypes::SequencedText
+     * @param sequence monotonic room sequence number (0 means unsequenced)
+     **/
+    explicit TextMessage(std::string_view text, uint64_t sequence = 0);
+    explicit TextMessage(std::string&& text, uint64_t sequence = 0);
+    explicit TextMessage(const char* text, uint64_t sequence = 0) : TextMessage(std::string_view(text), sequence) {}
+
+    uint64_t get_sequence() const { return sequence_; }
+    std::string_view get_text() const
+    {
+        return inline_text_ ? std::string_view(inline_.data(), size_) : std::string_view(heap_);
+    }
+
+    /**
+     * @brief Makes the text safe to print (see Utils::TextSanitizer), in place
+     * @return the number of bytes replaced (0 when the text was already clean)
+     **/
+    std::size_t sanitize();
+
+    /**
+     * @brief Encodes a text frame whose text is `prefix` followed by `text`: both are gathered straight
+     *        into the frame, in a single allocation and without building the concatenated string first
+     * @param sequence room sequence number (0 produces a legacy Text frame)
+     **/
+    static std::vector<char> serialize_prefixed(std::string_view prefix, std::string_view text, uint64_t sequence);
 
     std::vector<char> serialize() const override;
     void deserialize(const std::vector<char>& data) override;
     std::string to_string() const override;
 
     std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
     void save_file() const override;
 
     void dispatch_send(
@@ -24,5 +59,11 @@ public:
     std::shared_ptr<FileTransferQueue> file_queue,
     boost::system::error_code& ec) override;
 private:
-    std::vector<char> text_;
+    void assign(std::string_view text);
+
+    std::array<char, INLINE_CAPACITY> inline_{};
+    std::string heap_;  // texts longer than INLINE_CAPACITY
+    std::size_t size_ = 0;
+    bool inline_text_ = true;
+    uint64_t sequence_ = 0;
 };
@@ -0,0 +1,63 @@
+#pragma once
+#include "MessageTypes/Interface/IMessage.hpp"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Many chat lines of one room in a single frame, each with its sequence number and sender.
+ *
+ * Under heavy chat a room collects the lines published during a short window (see Room::Options)
+ * and sends them as one TextBatch frame instead of one frame and one write per line. Only sent to
+ * connections that agreed to ConnectionProtocol::BATCHED_TEXT; the client shows the lines in order.
+ **/
+class TextBatchMessage : public IMessage
+{
+public:
+    struct Record
+    {
+        uint64_t sequence = 0;
+        std::string sender;  // e.g. "[TEXT] From 10.0.0.1:5000: "
+        std::string text;
+    };
+
+    static constexpr std::size_t RECORD_OVERHEAD = sizeof(uint64_t) + 2 * sizeof(uint32_t);
+    static constexpr uint32_t MAX_RECORDS = 64 * 1024;
+
+private:
+    std::vector<Record> records_;
+
+public:
+    TextBatchMessage() = default;
+    explicit TextBatchMessage(std::vector<Record> records) : records_(std::move(records)) {}
+
+    const std::vector<Record>& get_records() const { return records_; }
+
+    /**
+     * @brief Encoded size of one record inside a batch
+     **/
+    static std::size_t record_size(const Record& record)
+    {
+        return RECORD_OVERHEAD + record.sender.size() + record.text.size();
+    }
+
+    /**
+     * @brief Encodes the records for which `keep(index)` is true (all of them without `keep`),
+     *        so a room can leave out a recipient's own lines without copying the records
+     **/
+    static std::vector<char> serialize_records(const std::vector<Record>& records,
+                                               const std::function<bool(std::size_t)>& keep = {});
+
+    std::vector<char> serialize() const override;
+    void deserialize(const std::vector<char>& data) override;
+    std::string to_string() const override;
+    std::vector<char> to_data_send() const override;
+    std::size_t payload_size() const override;
+    void save_file() const override;
+
+    void dispatch_send(
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+    std::shared_ptr<FileTransferQueue> file_queue,
+    boost::system::error_code& ec) override;
+};
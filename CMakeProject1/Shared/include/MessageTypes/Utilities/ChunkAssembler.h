@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+class FileChunkMessage;
+
+/**
+ * @brief Reassembles the file frames of one multiplexed connection from their chunks, per channel.
+ *        Partially received frames are bounded by `max_bytes` so a peer cannot grow memory without bound.
+ **/
+class ChunkAssembler
+{
+public:
+    explicit ChunkAssembler(std::size_t max_bytes);
+
+    /**
+     * @brief Appends a chunk (its data is moved out)
+     * @return the complete frame once `chunk` was the last one of its channel, otherwise null
+     * @throws std::runtime_error if the partially received frames would exceed the limit
+     **/
+    std::shared_ptr<std::vector<char>> add(FileChunkMessage& chunk);
+
+    std::size_t pending_bytes() const;
+
+private:
+    const std::size_t max_bytes_;
+    mutable std::mutex mutex_;
+    std::unordered_map<uint64_t, std::vector<char>> partial_;
+    std::size_t pending_bytes_ = 0;
+};
@@ -3,17 +3,20 @@
 #include <functional>
 #include <memory>
 #include <vector>
-#include <deque>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <atomic>
 #include <filesystem>
 #include <boost/asio.hpp>
+#include <boost/container/deque.hpp>
+#include "MessageTypes/Utilities/ZeroCopySender.h"
 class FileMessage;
 
 // Returns the socket currently associated with this queue
 using SocketGetter = std::function<std::shared_ptr<boost::asio::ip::tcp::socket>()>;
+// Writes one serialized file frame, blocking until it was sent (used instead of writing to the socket)
+using FrameWriter = std::function<void(std::vector<char> frame, boost::system::error_code& ec)>;
 
 class FileTransferQueue
 {
@@ -24,12 +27,13 @@ public:
         uint64_t id = 0;
         std::filesystem::path path;                // Used if built from a local file
         std::shared_ptr<FileMessage> message;      // Used when already built (forwarded or constructed)
+        ZeroCopySender::Frame frame;               // Used when encoded once for several queues, dropped once sent
         State state = State::Queued;
         int retries = 0;
         std::string last_error;
     };
 
-    explicit FileTransferQueue(SocketGetter socket_getter);
+    explicit FileTransferQueue(SocketGetter socket_getter, FrameWriter frame_writer = {});
     ~FileTransferQueue();
 
     // === Enqueue Methods ===
@@ -51,6 +55,11 @@ public:
      **/
     uint64_t enqueue(const std::string& filename, const std::vector<uint8_t>& bytes);
 
+    /**
+     * @brief Enqueue an already serialized file frame, shared with the other recipients of the file
+     **/
+    uint64_t enqueue(const ZeroCopySender::Frame& frame);
+
     // === Control and Management ===
 
     bool remove(uint64_t id);
@@ -62,6 +71,12 @@ public:
     std::vector<Item> list_snapshot();
     void stop();
 
+    /**
+     * @brief When socket writes use MSG_ZEROCOPY (see ZeroCopySender), applied from the next file on
+     **/
+    void set_zero_copy(const ZeroCopySender::Options& options);
+    ZeroCopySender::Stats zero_copy_stats();
+
 private:
     // === Helpers ===
 
@@ -73,13 +88,23 @@ private:
         const std::string& filename,
         const std::vector<uint8_t>& bytes);
 
-    // Background worker
+    // Background worker, started by the first enqueue: a connection that never gets a file costs no thread
+    void start_worker_locked();
     void worker_loop();
+    bool has_queued_locked() const;
+    // Forgets the oldest finished items (Done, Failed, Canceled) beyond MAX_FINISHED_ITEMS
+    void trim_finished_locked();
 
 private:
+    static constexpr std::size_t MAX_FINISHED_ITEMS = 32;  // kept for list_snapshot() and retry()
+
     SocketGetter socket_getter_;
+    FrameWriter frame_writer_;
 
-    std::deque<Item> queue_;
+    boost::container::deque<Item> queue_;  // allocates nothing until the first file
+    ZeroCopySender::Options zero_copy_;     // guarded by mutex_
+    ZeroCopySender sender_;                 // used by the worker
+    ZeroCopySender::Stats sender_stats_;    // copy of the sender's, guarded by mutex_
     std::mutex mutex_;
     std::condition_variable cv_;
     std::thread worker_;
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+
+//FrameHeader encodes and parses the two frame headers a connection may carry:
+// legacy:  [u32 type BE][u64 body length BE]                            12 bytes
+// compact: [1 byte: 0x80 | type][body length as LEB128 varint]          2 to 11 bytes
+//A legacy header always starts with a zero byte (type ids are small), so every frame says which one it uses.
+//In memory (message classes, history, logs) frames always carry the legacy header; the compact one only
+//exists on the wire, between peers that agreed on it.
+
+namespace Utils
+{
+    struct FrameHeader
+    {
+        static constexpr std::size_t LEGACY_SIZE = HeaderHelper::HEADER_SIZE;
+        static constexpr std::size_t COMPACT_MAX_SIZE = 1 + 10;
+        static constexpr uint8_t COMPACT_MARKER = 0x80;
+        static constexpr uint8_t COMPACT_TYPE_MASK = 0x3F;  // 0x40 is reserved for flags
+
+        enum class Result
+        {
+            Ok,
+            NeedMore,  // the header is not complete yet
+            Invalid
+        };
+
+        struct Parsed
+        {
+            uint32_t type = 0;
+            uint64_t body_length = 0;
+            std::size_t header_size = 0;
+            bool compact = false;
+        };
+
+        static constexpr bool fits_compact(uint32_t type) { return type <= COMPACT_TYPE_MASK; }
+
+        /**
+         * @brief Writes the compact header of a frame into `out` (at least COMPACT_MAX_SIZE bytes)
+         * @return header size, 0 if the type has no compact form
+         */
+        static constexpr std::size_t encode_compact(uint32_t type, uint64_t body_length, char* out)
+        {
+            if (!fits_compact(type)) return 0;
+            out[0] = static_cast<char>(COMPACT_MARKER | type);
+            std::size_t size = 1;
+            do
+            {
+                uint8_t byte = body_length & 0x7F;
+                body_length >>= 7;
+                if (body_length != 0) byte |= 0x80;
+                out[size++] = static_cast<char>(byte);
+            } while (body_length != 0);
+            return size;
+        }
+
+        static constexpr std::size_t compact_size(uint64_t body_length)
+        {
+            std::size_t size = 2;
+            while (body_length >= 0x80)
+            {
+                body_length >>= 7;
+                ++size;
+            }
+            return size;
+        }
+
+        /**
+         * @brief Writes the legacy header of a frame into `out` (at least LEGACY_SIZE bytes)
+         */
+        static constexpr void encode_legacy(uint32_t type, uint64_t body_length, char* out)
+        {
+            HeaderHelper::write_header(out, {type, body_length});
+        }
+
+        /**
+         * @brief Parses whichever header starts at `data`
+         */
+        static constexpr Result decode(const char* data, std::size_t size, Parsed& parsed)
+        {
+            if (size == 0) return Result::NeedMore;
+            const auto first = static_cast<uint8_t>(data[0]);
+            if ((first & COMPACT_MARKER) == 0)
+            {
+                if (size < LEGACY_SIZE) return Result::NeedMore;
+                const auto legacy = HeaderHelper::read_header(data);
+                parsed = {legacy.type, legacy.body_length, LEGACY_SIZE, false};
+                return Result::Ok;
+            }
+
+            if (first & ~(COMPACT_MARKER | COMPACT_TYPE_MASK)) return Result::Invalid;
+            uint64_t length = 0;
+            for (std::size_t i = 1; i < COMPACT_MAX_SIZE; ++i)
+            {
+                if (i >= size) return Result::NeedMore;
+                const auto byte = static_cast<uint8_t>(data[i]);
+                const unsigned shift = 7 * static_cast<unsigned>(i - 1);
+                // the tenth byte may only hold the top bit of a 64-bit length
+                if (shift == 63 && (byte & 0x7E)) return Result::Invalid;
+                length |= static_cast<uint64_t>(byte & 0x7F) << shift;
+                if ((byte & 0x80) == 0)
+                {
+                    parsed = {static_cast<uint32_t>(first & COMPACT_TYPE_MASK), length, i + 1, true};
+                    return Result::Ok;
+                }
+            }
+            return Result::Invalid;
+        }
+    };
+} // namespace Utils
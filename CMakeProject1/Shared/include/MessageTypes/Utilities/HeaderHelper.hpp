@@ -1,42 +1,146 @@
 #pragma once
-#include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <cstring>
-#include <arpa/inet.h>
+#include <string_view>
+#include <utility>
+#include <vector>
 
-//HeaderHelper contains functions useful when preparing and parsing data sent over the network
+//HeaderHelper contains functions useful when preparing and parsing data sent over the network.
+//Every message class and the frame header codec go through it; integers are big endian on the wire.
 
 namespace Utils
 {
-    inline uint64_t htonll(const uint64_t val)
+    namespace detail
     {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-        return (static_cast<uint64_t>(htonl(val & 0xFFFFFFFFULL)) << 32) | htonl(val >> 32);
-#else
-        return val;
-#endif
-    }
+        // Unrolled big-endian byte access. Usable in constant expressions; at run time GCC and Clang
+        // turn each into a single load or store plus bswap.
+        template <typename T, std::size_t... I>
+        constexpr void store_be(char* out, T value, std::index_sequence<I...>)
+        {
+            ((out[I] = static_cast<char>(value >> (8 * (sizeof(T) - 1 - I)))), ...);
+        }
 
-    inline uint64_t ntohll(uint64_t val)
-    {
-#if __BYTE_ORDER == __LITTLE_ENDIAN
-        return (static_cast<uint64_t>(ntohl(val & 0xFFFFFFFFULL)) << 32) | ntohl(val >> 32);
-#else
-        return val;
-#endif
+        template <typename T, std::size_t... I>
+        constexpr T load_be(const char* in, std::index_sequence<I...>)
+        {
+            return static_cast<T>(((static_cast<T>(static_cast<uint8_t>(in[I])) << (8 * (sizeof(T) - 1 - I))) | ...));
+        }
     }
 
     struct HeaderHelper
     {
+        static constexpr std::size_t HEADER_SIZE = sizeof(uint32_t) + sizeof(uint64_t);  // [u32 type][u64 body length]
+
+        struct Header
+        {
+            uint32_t type = 0;
+            uint64_t body_length = 0;
+        };
+
+        /**
+         * @brief Stores integers in network byte order at `out` (no bounds check)
+         */
+        static constexpr void store_u32(char* out, uint32_t value)
+        {
+            detail::store_be(out, value, std::make_index_sequence<sizeof(uint32_t)>{});
+        }
+
+        static constexpr void store_u64(char* out, uint64_t value)
+        {
+            detail::store_be(out, value, std::make_index_sequence<sizeof(uint64_t)>{});
+        }
+
+        /**
+         * @brief Loads integers stored in network byte order at `in` (no bounds check)
+         */
+        static constexpr uint32_t load_u32(const char* in)
+        {
+            return detail::load_be<uint32_t>(in, std::make_index_sequence<sizeof(uint32_t)>{});
+        }
+
+        static constexpr uint64_t load_u64(const char* in)
+        {
+            return detail::load_be<uint64_t>(in, std::make_index_sequence<sizeof(uint64_t)>{});
+        }
+
+        static constexpr void write_header(char* out, const Header& header)
+        {
+            store_u32(out, header.type);
+            store_u64(out + sizeof(uint32_t), header.body_length);
+        }
+
+        static constexpr Header read_header(const char* in)
+        {
+            return {load_u32(in), load_u64(in + sizeof(uint32_t))};
+        }
+
         /**
-     * @brief Appends a 32-bit unsigned integer to the buffer using network byte order.
-     * @param buffer Destination byte buffer to append to.
-     * @param value  32-bit integer to append.
-     */
+         * @brief Writes a fixed layout (header, then fields) front to back into memory the caller sized for it
+         */
+        class Writer
+        {
+        public:
+            constexpr explicit Writer(char* out) : out_(out) {}
+
+            constexpr Writer& header(uint32_t type, uint64_t body_length)
+            {
+                write_header(out_, {type, body_length});
+                out_ += HEADER_SIZE;
+                return *this;
+            }
+
+            constexpr Writer& u32(uint32_t value)
+            {
+                store_u32(out_, value);
+                out_ += sizeof(uint32_t);
+                return *this;
+            }
+
+            constexpr Writer& u64(uint64_t value)
+            {
+                store_u64(out_, value);
+                out_ += sizeof(uint64_t);
+                return *this;
+            }
+
+            /**
+             * @brief Copies a variable-length segment (a prefix, the text) behind the fields written so far
+             */
+            Writer& bytes(std::string_view segment)
+            {
+                if (!segment.empty()) std::memcpy(out_, segment.data(), segment.size());
+                out_ += segment.size();
+                return *this;
+            }
+
+            constexpr char* position() const { return out_; }
+
+        private:
+            char* out_;
+        };
+
+        /**
+         * @brief A frame buffer holding `fixed_size` bytes for a Writer, with capacity for `frame_size`;
+         *        the variable part (text, file bytes) is appended after the fixed layout was written
+         */
+        static std::vector<char> frame_buffer(std::size_t fixed_size, std::size_t frame_size)
+        {
+            std::vector<char> buffer;
+            buffer.reserve(frame_size);
+            buffer.resize(fixed_size);
+            return buffer;
+        }
+
+        /**
+         * @brief Appends a 32-bit unsigned integer to the buffer using network byte order.
+         * @param buffer Destination byte buffer to append to.
+         * @param value  32-bit integer to append.
+         */
         static void append_u32(std::vector<char>& buffer, uint32_t value)
         {
-            uint32_t net = htonl(value);
-            const char* ptr = reinterpret_cast<const char*>(&net);
-            buffer.insert(buffer.end(), ptr, ptr + sizeof(net));
+            buffer.resize(buffer.size() + sizeof(uint32_t));
+            store_u32(buffer.data() + buffer.size() - sizeof(uint32_t), value);
         }
 
         /**
@@ -46,9 +150,8 @@ namespace Utils
          */
         static void append_u64(std::vector<char>& buffer, uint64_t value)
         {
-            uint64_t net = htonll(value);
-            const char* ptr = reinterpret_cast<const char*>(&net);
-            buffer.insert(buffer.end(), ptr, ptr + sizeof(net));
+            buffer.resize(buffer.size() + sizeof(uint64_t));
+            store_u64(buffer.data() + buffer.size() - sizeof(uint64_t), value);
         }
 
         /**
@@ -63,9 +166,7 @@ namespace Utils
         static bool read_u32(const std::vector<char>& buffer, size_t offset, uint32_t& value)
         {
             if (offset + sizeof(uint32_t) > buffer.size()) return false;
-            uint32_t net;
-            std::memcpy(&net, buffer.data() + offset, sizeof(uint32_t));
-            value = ntohl(net);
+            value = load_u32(buffer.data() + offset);
             return true;
         }
 
@@ -81,9 +182,7 @@ namespace Utils
         static bool read_u64(const std::vector<char>& buffer, size_t offset, uint64_t& value)
         {
             if (offset + sizeof(uint64_t) > buffer.size()) return false;
-            uint64_t net;
-            std::memcpy(&net, buffer.data() + offset, sizeof(uint64_t));
-            value = ntohll(net);
+            value = load_u64(buffer.data() + offset);
             return true;
         }
     };
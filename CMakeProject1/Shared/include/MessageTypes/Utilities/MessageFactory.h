@@ -6,7 +6,7 @@
 class MessageFactory {
 public:
     /**
-     * @brief creates a message from a given id
+     * @brief creates a message from a given id (see MessageRegistry, which receivers decode with)
      * @param id Message::TextTypes id
      */
     static std::unique_ptr<IMessage> create_from_id(TextTypes id);
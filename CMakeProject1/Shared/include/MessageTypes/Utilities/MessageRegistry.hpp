@@ -0,0 +1,134 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "MessageTypes/Interface/IMessage.hpp"
+#include "MessageTypes/Text/TextMessage.h"
+#include "MessageTypes/File/FileMessage.h"
+#include "MessageTypes/SendHistory/SendHistoryMessage.h"
+#include "MessageTypes/HistorySync/HistorySyncMessage.h"
+#include "MessageTypes/HistoryQuery/HistoryQueryMessage.h"
+#include "MessageTypes/Room/RoomMessage.h"
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include "MessageTypes/Hello/HelloMessage.h"
+#include "MessageTypes/TextBatch/TextBatchMessage.h"
+
+//MessageRegistry binds every wire type id to its message class at compile time.
+//The type list below is the one place a message type is added: the dense decode table indexed by id
+//and the typed handlers of MessageReceiver are generated from it, so handlers get their own class
+//without a dynamic_pointer_cast.
+
+namespace Utils
+{
+    template <TextTypes Id, typename Message>
+    struct MessageBinding
+    {
+        static_assert(std::is_base_of_v<IMessage, Message>, "message classes implement IMessage");
+        static constexpr TextTypes id = Id;
+        using type = Message;
+    };
+
+    template <typename... Bindings>
+    struct MessageTypeList
+    {
+        static constexpr std::size_t table_size = std::max({static_cast<std::size_t>(Bindings::id)...}) + 1;
+
+        static constexpr bool unique_ids()
+        {
+            const std::array<TextTypes, sizeof...(Bindings)> ids{Bindings::id...};
+            for (std::size_t i = 0; i < ids.size(); ++i)
+                for (std::size_t j = i + 1; j < ids.size(); ++j)
+                    if (ids[i] == ids[j]) return false;
+            return true;
+        }
+    };
+
+    using RegisteredMessages = MessageTypeList<
+        MessageBinding<TextTypes::Text, TextMessage>,
+        MessageBinding<TextTypes::File, FileMessage>,
+        MessageBinding<TextTypes::SendHistory, SendHistoryMessage>,
+        MessageBinding<TextTypes::SequencedText, TextMessage>,
+        MessageBinding<TextTypes::HistorySync, HistorySyncMessage>,
+        MessageBinding<TextTypes::HistoryQuery, HistoryQueryMessage>,
+        MessageBinding<TextTypes::Room, RoomMessage>,
+        MessageBinding<TextTypes::Heartbeat, HeartbeatMessage>,
+        MessageBinding<TextTypes::FileChunk, FileChunkMessage>,
+        MessageBinding<TextTypes::Hello, HelloMessage>,
+        MessageBinding<TextTypes::TextBatch, TextBatchMessage>>;
+
+    static_assert(RegisteredMessages::unique_ids(), "a type id is bound to two message classes");
+
+    namespace detail
+    {
+        template <TextTypes Id, typename... Bindings>
+        struct FindMessage;
+
+        template <TextTypes Id, typename First, typename... Rest>
+        struct FindMessage<Id, First, Rest...>
+            : std::conditional_t<First::id == Id, First, FindMessage<Id, Rest...>> {};
+
+        template <TextTypes Id>
+        struct FindMessage<Id>
+        {
+            static_assert(Id != Id, "no message class is registered for this type id");
+        };
+
+        template <TextTypes Id, typename List>
+        struct MessageOf;
+
+        template <TextTypes Id, typename... Bindings>
+        struct MessageOf<Id, MessageTypeList<Bindings...>>
+        {
+            using type = typename FindMessage<Id, Bindings...>::type;
+        };
+
+        struct MessageEntry
+        {
+            std::unique_ptr<IMessage> (*create)() = nullptr;
+            // decodes a whole frame (legacy header included) into a message of the frame's type
+            std::shared_ptr<IMessage> (*decode)(const std::vector<char>& frame) = nullptr;
+        };
+
+        template <typename Message>
+        std::unique_ptr<IMessage> create_as() { return std::make_unique<Message>(); }
+
+        template <typename Message>
+        std::shared_ptr<IMessage> decode_as(const std::vector<char>& frame)
+        {
+            // one allocation for the message and its reference count
+            auto message = std::make_shared<Message>();
+            message->deserialize(frame);
+            return message;
+        }
+
+        template <typename... Bindings>
+        constexpr auto make_table(MessageTypeList<Bindings...>)
+        {
+            std::array<MessageEntry, MessageTypeList<Bindings...>::table_size> table{};
+            ((table[static_cast<std::size_t>(Bindings::id)] =
+                  MessageEntry{&create_as<typename Bindings::type>, &decode_as<typename Bindings::type>}), ...);
+            return table;
+        }
+    }
+
+    struct MessageRegistry
+    {
+        static constexpr std::size_t TABLE_SIZE = RegisteredMessages::table_size;
+
+        // message class of a type id, e.g. message_t<TextTypes::Room> is RoomMessage
+        template <TextTypes Id>
+        using message_t = typename detail::MessageOf<Id, RegisteredMessages>::type;
+
+        using Entry = detail::MessageEntry;
+
+        // dense: one entry per id up to the largest one, empty where no class is registered
+        static constexpr std::array<Entry, TABLE_SIZE> TABLE = detail::make_table(RegisteredMessages{});
+
+        static constexpr Entry lookup(uint32_t id) { return id < TABLE_SIZE ? TABLE[id] : Entry{}; }
+    };
+} // namespace Utils
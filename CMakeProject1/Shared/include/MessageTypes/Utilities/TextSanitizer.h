@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <string_view>
+
+//TextSanitizer keeps inbound chat text safe to print on every participant's console: valid UTF-8
+//without control characters (a tab is allowed). The check runs once per received TextMessage, so
+//it is vectorized; text that fails it is repaired in place by a scalar pass.
+
+namespace Utils
+{
+    struct TextSanitizer
+    {
+        static constexpr char REPLACEMENT = '?';
+
+        // Check implementations; Avx2 and Sse2 only exist on x86-64, Scalar is the plain byte loop
+        enum class Kernel { Scalar, Sse2, Avx2 };
+
+        /**
+         * @brief Whether `kernel` can run on this CPU
+         */
+        static bool supported(Kernel kernel);
+
+        /**
+         * @brief The fastest supported kernel, picked once at start-up
+         */
+        static Kernel best_kernel();
+
+        /**
+         * @brief True when `text` is valid UTF-8 (no overlong forms, surrogates or code points past
+         *        U+10FFFF) and holds no C0 or C1 control character or DEL, except a tab
+         */
+        static bool is_clean(std::string_view text);
+        static bool is_clean(std::string_view text, Kernel kernel);
+
+        /**
+         * @brief Replaces every byte of an invalid sequence or control character with REPLACEMENT,
+         *        so the text keeps its length and the repair needs no allocation
+         * @return the number of bytes replaced (0 when the text was clean)
+         */
+        static std::size_t sanitize(char* data, std::size_t size);
+    };
+} // namespace Utils
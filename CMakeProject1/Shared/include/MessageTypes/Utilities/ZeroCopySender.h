@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <boost/asio.hpp>
+
+/**
+ * @brief Blocking frame writer for the file port that sends large frames with Linux MSG_ZEROCOPY.
+ *
+ * A zero-copy send hands the pages of the frame to the kernel instead of copying them into socket
+ * buffers, so the frame must not change or go away until the kernel reports it released them on the
+ * socket's error queue. Every frame sent that way is pinned here (its shared_ptr is kept) until all
+ * of its sends are reported done. Frames below `min_bytes`, platforms without MSG_ZEROCOPY and sockets
+ * that refuse SO_ZEROCOPY take the plain copying path. When the kernel reports that it copied anyway
+ * (loopback does, as do devices without scatter-gather), the socket switches back to plain sends,
+ * unless `stay_on_copied` is set. One sender per socket, used by one thread at a time.
+ **/
+class ZeroCopySender
+{
+public:
+    using Frame = std::shared_ptr<const std::vector<char>>;
+
+    struct Options
+    {
+        std::size_t min_bytes = 0;    // frames this large go zero-copy, 0 = never
+        bool stay_on_copied = false;  // keep zero-copy even when the kernel reports it copied
+    };
+
+    struct Stats
+    {
+        uint64_t zero_copy_frames = 0;   // frames sent with MSG_ZEROCOPY
+        uint64_t copied_frames = 0;      // frames sent the plain way
+        uint64_t completions = 0;        // zero-copy sends the kernel reported done
+        uint64_t copied_completions = 0; // of those, sends the kernel had copied after all
+    };
+
+    // How long Flush() waits by default for the kernel to release pinned frames
+    static constexpr std::chrono::milliseconds FLUSH_TIMEOUT{1000};
+
+    ZeroCopySender() = default;
+    explicit ZeroCopySender(Options options) : options_(options) {}
+
+    void SetOptions(Options options) { options_ = options; }
+
+    /**
+     * @brief Writes the whole frame, blocking until the kernel took it; zero-copy frames stay pinned
+     *        until their completions were read (see Flush)
+     **/
+    void Send(boost::asio::ip::tcp::socket& socket, const Frame& frame, boost::system::error_code& ec);
+    /**
+     * @brief Reads the completions the kernel queued so far and unpins the frames they finish
+     * @param timeout how long to wait for the last pinned frame; zero only reads what is queued
+     * @return whether no frame is pinned any more
+     **/
+    bool Flush(boost::asio::ip::tcp::socket& socket, std::chrono::milliseconds timeout = FLUSH_TIMEOUT);
+
+    std::size_t PinnedFrames() const { return pinned_.size(); }
+    const Stats& GetStats() const { return stats_; }
+
+private:
+    // A zero-copy frame and the notification ids of the sends that carried it
+    struct Pinned
+    {
+        Frame frame;
+        uint64_t first = 0;
+        uint64_t sends = 0;
+        uint64_t remaining = 0;  // sends not reported done yet
+    };
+
+    enum class State { Unknown, On, Off };
+
+    bool Enable(boost::asio::ip::tcp::socket& socket);
+    void SendZeroCopy(boost::asio::ip::tcp::socket& socket, const Frame& frame, boost::system::error_code& ec);
+    // Reads every queued completion; false if the socket reported an error instead
+    bool ReadCompletions(int fd);
+    void Complete(uint64_t first, uint64_t last);
+    // The notification id the kernel reported as a 32-bit counter, widened next to next_id_
+    uint64_t Unwrap(uint32_t id) const;
+
+    Options options_;
+    State state_ = State::Unknown;
+    uint64_t next_id_ = 0;  // the kernel numbers the zero-copy sends of a socket from 0
+    std::vector<Pinned> pinned_;
+    Stats stats_;
+};
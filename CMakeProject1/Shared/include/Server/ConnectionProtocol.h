@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+class HelloMessage;
+
+/**
+ * @brief Protocol spoken on one connection, as agreed by the Hello exchange.
+ *
+ * A connection that never exchanged Hello messages speaks the legacy protocol (version 0): legacy
+ * headers only, and frames up to the receiver's legacy limit (MessageReceiver::set_legacy_max_frame_bytes).
+ * Written by the Hello handler, read by the connection's MessageReceiver before every frame and by
+ * whoever sends on the connection.
+ **/
+struct ConnectionProtocol
+{
+    static constexpr uint32_t VERSION = 1;  // protocol version of this build
+    // Default legacy limit of a receiver; a legacy peer sends a whole file in one frame on the file port
+    static constexpr uint64_t LEGACY_MAX_FRAME_BYTES = 1ull << 30;
+
+    // Optional features, advertised as a bit set
+    enum Feature : uint32_t
+    {
+        COMPACT_HEADERS = 1u << 0,   // frames may use the compact header (see FrameHeader)
+        MULTIPLEXED_FILES = 1u << 1, // files may travel as FileChunk frames on the text connection
+        BATCHED_TEXT = 1u << 2       // chat lines may arrive as TextBatch frames
+    };
+
+    // Payload codecs; only the identity codec exists so far, new ones are only used once both sides list them
+    enum class Codec : uint8_t
+    {
+        Identity = 0
+    };
+
+    std::atomic<uint32_t> version{0};
+    std::atomic<uint32_t> features{0};
+    std::atomic<Codec> codec{Codec::Identity};
+    std::atomic<uint64_t> max_frame_bytes{0};       // largest frame we accept, 0 = the receiver's legacy limit
+    std::atomic<uint64_t> peer_max_frame_bytes{0};  // largest frame the peer accepts, 0 = unlimited
+    std::atomic<bool> hello_received{false};        // the peer said Hello (even if it settled on version 0)
+
+    bool has(Feature feature) const { return (features.load(std::memory_order_acquire) & feature) != 0; }
+
+    /**
+     * @brief Settles the protocol from our Hello and the peer's: the lower version, the features both
+     *        advertise, the first of the peer's codecs we support, and each side's own frame limit
+     **/
+    void apply(const HelloMessage& local, const HelloMessage& peer);
+};
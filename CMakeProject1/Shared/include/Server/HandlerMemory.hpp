@@ -0,0 +1,196 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <boost/asio/buffer.hpp>
+
+//Every asynchronous operation makes Asio allocate an operation object that holds its completion handler.
+//HandlerMemory keeps those blocks per thread, in 64-byte size classes, so the few handler sizes of a
+//connection reuse the same blocks and a steady message flow takes nothing from the heap. Handlers are
+//attached with Utils::recycled(handler), which Asio finds through the handler's associated allocator.
+
+namespace Utils
+{
+    class HandlerMemory
+    {
+    public:
+        static constexpr std::size_t CLASS_BYTES = 64;  // block sizes are multiples of this
+        static constexpr std::size_t CLASSES = 16;      // up to 1 KiB, larger blocks come from the heap
+        static constexpr std::size_t MAX_FREE = 64;     // free blocks kept per class and thread
+
+        // Blocks requested on this thread, and how many of them had to come from the heap
+        struct Stats
+        {
+            uint64_t allocations = 0;
+            uint64_t heap_allocations = 0;
+        };
+
+        static void* allocate(std::size_t size)
+        {
+            Pool* pool = local();
+            const std::size_t index = class_of(size);
+            if (pool) ++pool->stats.allocations;
+            if (pool && index < CLASSES)
+            {
+                FreeList& list = pool->free[index];
+                if (list.head)
+                {
+                    Block* block = list.head;
+                    list.head = block->next;
+                    --list.count;
+                    return block;
+                }
+            }
+            if (pool) ++pool->stats.heap_allocations;
+            // a small block is always of its full class size, whichever thread ends up keeping it
+            return ::operator new(index < CLASSES ? (index + 1) * CLASS_BYTES : size);
+        }
+
+        static void deallocate(void* pointer, std::size_t size) noexcept
+        {
+            // a block allocated on another thread is kept here; both are of the same class
+            Pool* pool = local();
+            const std::size_t index = class_of(size);
+            if (pool && index < CLASSES && pool->free[index].count < MAX_FREE)
+            {
+                FreeList& list = pool->free[index];
+                list.head = ::new (pointer) Block{list.head};
+                ++list.count;
+                return;
+            }
+            ::operator delete(pointer);
+        }
+
+        static Stats stats()
+        {
+            const Pool* pool = local();
+            return pool ? pool->stats : Stats{};
+        }
+
+    private:
+        struct Block
+        {
+            Block* next;
+        };
+
+        struct FreeList
+        {
+            Block* head = nullptr;
+            std::size_t count = 0;
+        };
+
+        struct Pool
+        {
+            std::array<FreeList, CLASSES> free{};
+            Stats stats;
+
+            Pool() = default;
+            Pool(const Pool&) = delete;
+            Pool& operator=(const Pool&) = delete;
+            ~Pool()
+            {
+                for (FreeList& list : free)
+                {
+                    while (list.head)
+                    {
+                        Block* next = list.head->next;
+                        ::operator delete(list.head);
+                        list.head = next;
+                    }
+                }
+                exited() = true;
+            }
+        };
+
+        static constexpr std::size_t class_of(std::size_t size)
+        {
+            return size == 0 ? 0 : (size - 1) / CLASS_BYTES;
+        }
+
+        // set once the thread's pool is gone, for handlers destroyed during thread exit
+        static bool& exited()
+        {
+            thread_local bool flag = false;
+            return flag;
+        }
+
+        static Pool* local()
+        {
+            if (exited()) return nullptr;
+            thread_local Pool pool;
+            return &pool;
+        }
+    };
+
+    // Allocator Asio rebinds for the operation objects of a recycled handler
+    template <typename T>
+    struct HandlerAllocator
+    {
+        using value_type = T;
+
+        HandlerAllocator() noexcept = default;
+        template <typename U>
+        HandlerAllocator(const HandlerAllocator<U>&) noexcept {}
+
+        T* allocate(std::size_t n) { return static_cast<T*>(HandlerMemory::allocate(n * sizeof(T))); }
+        void deallocate(T* pointer, std::size_t n) noexcept { HandlerMemory::deallocate(pointer, n * sizeof(T)); }
+
+        template <typename U>
+        bool operator==(const HandlerAllocator<U>&) const noexcept { return true; }
+        template <typename U>
+        bool operator!=(const HandlerAllocator<U>&) const noexcept { return false; }
+    };
+
+    // A completion handler whose operations are allocated from HandlerMemory
+    template <typename Handler>
+    class RecyclingHandler
+    {
+    public:
+        using allocator_type = HandlerAllocator<void>;
+
+        explicit RecyclingHandler(Handler handler) : handler_(std::move(handler)) {}
+
+        allocator_type get_allocator() const noexcept { return {}; }
+
+        template <typename... Args>
+        void operator()(Args&&... args)
+        {
+            handler_(std::forward<Args>(args)...);
+        }
+
+    private:
+        Handler handler_;
+    };
+
+    template <typename Handler>
+    RecyclingHandler<std::decay_t<Handler>> recycled(Handler&& handler)
+    {
+        return RecyclingHandler<std::decay_t<Handler>>(std::forward<Handler>(handler));
+    }
+
+    /**
+     * @brief A gather-write's buffers by reference. Asio copies the buffer sequence into the write
+     *        operation, which for a std::vector is an allocation per write; the vector must outlive the write.
+     **/
+    class BufferView
+    {
+    public:
+        using value_type = boost::asio::const_buffer;
+        using const_iterator = const boost::asio::const_buffer*;
+
+        BufferView(const boost::asio::const_buffer* data, std::size_t size) : begin_(data), end_(data + size) {}
+        template <typename Buffers>
+        explicit BufferView(const Buffers& buffers) : BufferView(buffers.data(), buffers.size()) {}
+
+        const_iterator begin() const { return begin_; }
+        const_iterator end() const { return end_; }
+
+    private:
+        const_iterator begin_;
+        const_iterator end_;
+    };
+} // namespace Utils
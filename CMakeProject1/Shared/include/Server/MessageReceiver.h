@@ -1,42 +1,145 @@
 #pragma once
 #include <boost/asio.hpp>
+#include <array>
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <string>
 #include <functional>
-#include <unordered_map>
-
-// Forward declaration
-class IMessage;
-enum class TextTypes : uint32_t;
+#include <type_traits>
+#include <Server/ConnectionProtocol.h>
+#include <MessageTypes/Utilities/MessageRegistry.hpp>
 
 class MessageReceiver
 {
 public:
-    // Generic callback that receives the raw message
+    // Type-erased handler slot; register_handler wraps the typed handlers into it
     using MessageCallback = std::function<void(
-        std::shared_ptr<boost::asio::ip::tcp::socket>,
+        const std::shared_ptr<boost::asio::ip::tcp::socket>&,
         std::shared_ptr<IMessage>)>;
 
-    void start_read_header(std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+    // Verdict of the admission callback on one received message
+    struct Admission
+    {
+        std::chrono::steady_clock::duration pause{};  // wait this long before dispatching and reading on
+        bool disconnect = false;                      // drop the connection instead
+    };
+    using AdmissionCallback = std::function<Admission(
+        const std::shared_ptr<boost::asio::ip::tcp::socket>&, TextTypes type, std::size_t frame_bytes)>;
+    /**
+     * @brief Starts reading frames from a connection. Each frame is decoded as `protocol` says at that
+     *        moment: legacy headers until compact ones were negotiated, and frames over the negotiated
+     *        limit close the connection. Without a protocol the connection stays on legacy.
+     *        Handlers always get frames with the legacy header.
+     **/
+    void start_read_header(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                           std::shared_ptr<const ConnectionProtocol> protocol = nullptr);
 
     /**
-     * @brief Register a callback for a specific message type
-     * This is the NEW extensible way - no code changes needed for new message types!
+     * @brief Register a callback for a specific message type. The handler gets the message class the
+     *        type is bound to in MessageRegistry, e.g. register_handler<TextTypes::Room> takes
+     *        (const std::shared_ptr<tcp::socket>&, std::shared_ptr<RoomMessage>).
      */
-    void register_handler(TextTypes type, MessageCallback callback);
+    template <TextTypes Type, typename Handler>
+    void register_handler(Handler handler)
+    {
+        using Message = Utils::MessageRegistry::message_t<Type>;
+        static_assert(std::is_invocable_v<Handler&, const std::shared_ptr<boost::asio::ip::tcp::socket>&,
+                                          std::shared_ptr<Message>>,
+                      "the handler does not take the message class of this type");
+        handlers_[static_cast<std::size_t>(Type)] =
+            [handler = std::move(handler)](const std::shared_ptr<boost::asio::ip::tcp::socket>& sender,
+                                           std::shared_ptr<IMessage> message) mutable
+            {
+                // the registry decoded the frame as Message
+                handler(sender, std::static_pointer_cast<Message>(std::move(message)));
+            };
+    }
 
+    /**
+     * @brief Decodes one complete frame (legacy header) and calls its handler on the calling thread,
+     *        without admission control
+     * @return false if the frame has no handler or could not be decoded
+     **/
+    bool dispatch(const std::shared_ptr<boost::asio::ip::tcp::socket>& sender, const std::vector<char>& frame) const;
+
+    /**
+     * @brief Installs ingress admission control, consulted for every complete message. Pausing stops
+     *        reading from that socket, so an over-budget sender is held back by TCP instead of buffered.
+     **/
+    void set_admission(AdmissionCallback callback);
+
+    /**
+     * @brief Hands large messages (body of at least `min_body_bytes`) to `executor` for assembly,
+     *        deserialization and the handler call, so the io thread only moves bytes.
+     *        The next read on that socket is started once the handler returned, keeping messages in order.
+     **/
+    void set_offload(boost::asio::any_io_executor executor, std::size_t min_body_bytes);
+
+    /**
+     * @brief Largest frame accepted from connections that agreed on no limit (legacy peers), applied to
+     *        connections started afterwards; ConnectionProtocol::LEGACY_MAX_FRAME_BYTES by default
+     **/
+    void set_legacy_max_frame_bytes(uint64_t bytes);
 
 private:
-    void start_read_body(const std::shared_ptr<std::vector<char>>& header_buffer,
-                        uint64_t body_length,
-                        const std::shared_ptr<boost::asio::ip::tcp::socket>& socket);
+    // Read side of one connection: small frames are parsed out of one buffer, several per read
+    struct ReadState;
+
+    // A decoded frame and the admission verdict on it
+    struct Received
+    {
+        const MessageCallback* handler = nullptr;  // nullptr: nothing to call
+        std::shared_ptr<IMessage> message;
+        Admission admission;
+    };
+
+#ifdef CHAT_USE_COROUTINES
+    // One coroutine per connection reads, decodes and dispatches frames until the connection fails;
+    // its frame holds the read state, so a connection costs one allocation however many frames it reads
+    boost::asio::awaitable<void> read_loop(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                                           std::shared_ptr<const ConnectionProtocol> protocol);
+    // receive() and, unless the message is paused or refused, deliver() on the offload executor
+    boost::asio::awaitable<Received> receive_offloaded(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                                                       std::shared_ptr<std::vector<char>> frame);
+#else
+    void read_next(const std::shared_ptr<ReadState>& state);
+    // Reads the `missing` rest of a frame's body, growing the frame as the bytes arrive
+    void read_body(const std::shared_ptr<ReadState>& state, const std::shared_ptr<std::vector<char>>& frame,
+                   std::size_t missing);
+    void fill(const std::shared_ptr<ReadState>& state);
+    void complete_frame(const std::shared_ptr<ReadState>& state, const std::shared_ptr<std::vector<char>>& frame);
 
     void handle_read_message(const std::shared_ptr<std::vector<char>>& buffer,
                             const boost::system::error_code& error,
-                            std::size_t bytes_transferred,
-                            const std::shared_ptr<boost::asio::ip::tcp::socket>& socket);
+                            const std::shared_ptr<ReadState>& state);
+#endif
+
+    bool offloaded(const std::vector<char>& frame) const;
+    /**
+     * @brief Decodes a complete frame and asks admission control about it; a refused sender is disconnected here
+     **/
+    Received receive(const std::vector<char>& frame,
+                     const std::shared_ptr<boost::asio::ip::tcp::socket>& socket) const;
+    // Calls the handler of a received message, reporting what it throws
+    static void deliver(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket, const Received& received);
+    // Ends a connection whose read failed (an aborted read means it is being closed already)
+    static void close_after_error(boost::asio::ip::tcp::socket& socket, const boost::system::error_code& error);
+
+    /**
+     * @brief Decodes a frame for its handler
+     * @return the handler, nullptr (and no message) if the type has none or the frame is malformed
+     **/
+    const MessageCallback* decode(const std::vector<char>& frame, std::shared_ptr<IMessage>& message) const;
+
+    // Handlers by type id, dense like the registry's table
+    std::array<MessageCallback, Utils::MessageRegistry::TABLE_SIZE> handlers_;
+
+    AdmissionCallback admission_;
+
+    // optional executor for heavy messages (see set_offload)
+    boost::asio::any_io_executor offload_;
+    std::size_t offload_min_body_bytes_ = 0;
 
-    // Map of message type -> callback
-    std::unordered_map<TextTypes, MessageCallback> handlers_;
+    uint64_t legacy_max_frame_bytes_ = ConnectionProtocol::LEGACY_MAX_FRAME_BYTES;
 };
\ No newline at end of file
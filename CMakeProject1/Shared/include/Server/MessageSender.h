@@ -8,3 +8,8 @@ void SendMessage(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket,
                 const std::shared_ptr<IMessage>& message,
                 const boost::system::error_code& error);
 
+//Sends several already-encoded frames through a specified socket as a single gather-write.
+//The frames are kept alive until the write completes.
+void SendFrames(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket,
+                std::vector<std::shared_ptr<const std::vector<char>>> frames);
+
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/container/deque.hpp>
+
+/**
+ * @brief Bounded, serialized writer for one text connection.
+ *
+ * Everything the server sends to a text connection goes through its queue. Exactly one async_write
+ * is in flight per socket, and whatever queued up meanwhile leaves as the next gather-write. The
+ * queue is bounded by bytes and by frames. When a client stops reading and a limit (high-water
+ * mark) is reached, the policy decides what gives. Chat frames may be dropped; control frames
+ * (history replays, pages, replies to the client's own requests) never are. Past twice the limits
+ * the connection is closed, whatever the policy, so a stalled client cannot grow server memory
+ * without bound.
+ *
+ * Files sent over a multiplexed connection use a separate bulk lane. They are cut into FileChunk
+ * frames, and a chunk is only written when no chat or control frame is waiting, so chat waits for
+ * at most one chunk. The bulk lane is not bounded by the limits (a file is never dropped halfway).
+ *
+ * Frames are queued with their legacy 12-byte header. Once the peer agreed on compact headers, the
+ * header of every frame queued from then on is swapped for the compact one as it is written (see FrameHeader).
+ **/
+class OutboundQueue : public std::enable_shared_from_this<OutboundQueue>
+{
+public:
+    using Frame = std::shared_ptr<const std::vector<char>>;
+    using BulkDone = std::function<void(const boost::system::error_code&)>;
+
+    enum class Policy
+    {
+        DropOldest,  // discard the oldest queued chat frames to make room
+        DropNew,     // discard the incoming chat frame
+        Disconnect   // discard incoming chat frames, close the connection once over the mark for `grace`
+    };
+
+    enum class Priority
+    {
+        Chat,
+        Control
+    };
+
+    struct Limits
+    {
+        std::size_t max_bytes = 4ull * 1024 * 1024;
+        std::size_t max_frames = 4096;
+        Policy policy = Policy::DropOldest;
+        std::chrono::milliseconds grace{10000};
+    };
+
+    struct Stats
+    {
+        uint64_t high_water_hits = 0;  // a queue went over a limit
+        uint64_t dropped_oldest = 0;   // queued chat frames discarded
+        uint64_t dropped_new = 0;      // incoming chat frames discarded
+        uint64_t disconnects = 0;      // connections closed by the policy or the hard limit
+    };
+
+    // Counters shared by all queues of a server
+    struct Metrics
+    {
+        std::atomic<uint64_t> high_water_hits{0};
+        std::atomic<uint64_t> dropped_oldest{0};
+        std::atomic<uint64_t> dropped_new{0};
+        std::atomic<uint64_t> disconnects{0};
+
+        Stats Load() const;
+    };
+
+    OutboundQueue(std::shared_ptr<boost::asio::ip::tcp::socket> socket, Limits limits,
+                  std::shared_ptr<Metrics> metrics);
+
+    OutboundQueue(const OutboundQueue&) = delete;
+    OutboundQueue& operator=(const OutboundQueue&) = delete;
+
+    /**
+     * @brief Queues frames (kept in order, written as soon as the previous write completed)
+     **/
+    void Send(Frame frame, Priority priority = Priority::Chat);
+    void Send(std::vector<Frame> frames, Priority priority);
+    /**
+     * @brief Queues a file frame on the bulk lane; `on_done` runs once its last chunk was written
+     *        (or with an error when the connection closed first)
+     **/
+    void SendBulk(Frame frame, BulkDone on_done = {});
+    /**
+     * @brief Frames queued from now on are written with compact headers (the peer must accept them).
+     *        Frames already queued keep their header, so the last legacy frame can announce the switch.
+     **/
+    void SetCompactHeaders(bool compact);
+    bool UsesCompactHeaders() const;
+
+    const std::shared_ptr<boost::asio::ip::tcp::socket>& GetSocket() const { return socket_; }
+    std::size_t GetQueuedBytes() const;
+    std::size_t GetQueuedFrames() const;
+    std::size_t GetBulkBytes() const;
+    /**
+     * @brief Writes started on the socket so far, and the frames (or file chunks) they carried
+     **/
+    uint64_t GetWriteCount() const;
+    uint64_t GetFramesWritten() const;
+    bool IsClosed() const;
+
+private:
+    struct Entry
+    {
+        Frame frame;
+        Priority priority;
+        bool compact;
+    };
+
+    struct BulkEntry
+    {
+        Frame frame;
+        std::size_t offset = 0;  // bytes already written as chunks
+        uint64_t channel = 0;
+        BulkDone on_done;
+    };
+
+    /**
+     * @brief Applies the policy before `frames` are queued
+     * @return false if the frames must be discarded
+     **/
+    bool MakeRoomLocked(std::size_t bytes, std::size_t frames, Priority priority);
+    bool OverLimitsLocked(std::size_t extra_bytes, std::size_t extra_frames, std::size_t factor) const;
+    void StartWriteLocked();
+#ifdef CHAT_USE_COROUTINES
+    // Writes the prepared write, then whatever queued up meanwhile, until the queue and the bulk lane are empty
+    boost::asio::awaitable<void> WriteLoop(std::shared_ptr<OutboundQueue> self);
+#else
+    void OnWritten(const boost::system::error_code& ec);
+#endif
+    /**
+     * @brief Moves the next write out of the queue into write_batch_ and write_buffers_: up to
+     *        MAX_FRAMES_PER_WRITE frames, or one file chunk when no frame waits
+     **/
+    void PrepareWriteLocked();
+    void PrepareChunkLocked();
+    // Adds the buffers of one frame to a gather-write, swapping in a compact header (stored at `header`)
+    static void AppendFrame(const std::vector<char>& frame, bool compact, char* header,
+                            std::vector<boost::asio::const_buffer>& buffers);
+    // Accounts for a completed write; files it finished (or that failed) are added to `finished`
+    void FinishWriteLocked(const boost::system::error_code& ec,
+                           std::vector<std::pair<BulkDone, boost::system::error_code>>& finished);
+    // Disconnect policy: closes the connection once it stayed over the mark for `grace`, even if nothing is sent anymore
+    void ArmGraceTimerLocked();
+    void OnGraceExpired();
+    void DisconnectLocked();
+
+    const std::shared_ptr<boost::asio::ip::tcp::socket> socket_;
+    const Limits limits_;
+    const std::shared_ptr<Metrics> metrics_;
+
+    mutable std::mutex mutex_;
+    // boost's deque allocates nothing until the first push, std::deque already when constructed:
+    // most connections are idle most of the time
+    boost::container::deque<Entry> queue_;
+    std::size_t queued_bytes_ = 0;
+    std::size_t in_flight_bytes_ = 0;
+    std::size_t in_flight_frames_ = 0;
+    bool writing_ = false;
+    bool closed_ = false;
+    boost::container::deque<BulkEntry> bulk_;
+    std::size_t bulk_bytes_ = 0;        // not yet written
+    std::size_t in_flight_chunk_ = 0;   // bulk bytes of the write in flight
+    uint64_t next_channel_ = 1;
+    bool bulk_lowat_set_ = false;
+    bool compact_ = false;
+    // the write in flight (one at a time): its frames, their buffers and their compact headers,
+    // kept from write to write so a write allocates nothing once they have grown
+    std::vector<Frame> write_batch_;
+    std::vector<boost::asio::const_buffer> write_buffers_;
+    std::vector<char> compact_headers_;
+    bool over_mark_ = false;
+    std::chrono::steady_clock::time_point over_since_;
+    std::optional<boost::asio::steady_timer> grace_timer_;  // created the first time the mark is hit
+    uint64_t writes_ = 0;
+    uint64_t frames_written_ = 0;
+};
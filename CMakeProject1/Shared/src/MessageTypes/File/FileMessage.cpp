@@ -64,14 +64,10 @@ std::vector<char> FileMessage::serialize() const
     const uint64_t payload_size = sizeof(name_length) + sizeof(file_length) + name_length + file_length;
     const uint64_t total_size = sizeof(id) + sizeof(payload_size) + payload_size;
 
-    std::vector<char> buffer;
-    buffer.reserve(static_cast<size_t>(total_size));
-
     // HeaderHelper takes care of converting to network byte order
-    Utils::HeaderHelper::append_u32(buffer, id);
-    Utils::HeaderHelper::append_u64(buffer, payload_size);
-    Utils::HeaderHelper::append_u64(buffer, name_length);
-    Utils::HeaderHelper::append_u64(buffer, file_length);
+    constexpr std::size_t fixed_size = Utils::HeaderHelper::HEADER_SIZE + sizeof(name_length) + sizeof(file_length);
+    std::vector<char> buffer = Utils::HeaderHelper::frame_buffer(fixed_size, static_cast<size_t>(total_size));
+    Utils::HeaderHelper::Writer(buffer.data()).header(id, payload_size).u64(name_length).u64(file_length);
 
     buffer.insert(buffer.end(), filename_.begin(), filename_.end());
     buffer.insert(buffer.end(), bytes_.begin(), bytes_.end());
@@ -82,7 +78,6 @@ std::vector<char> FileMessage::serialize() const
 
 void FileMessage::deserialize(const std::vector<char>& data)
 {
-// TODO potential spam and memory overflow (we dont limit message size) (TODO also in MessageReciever.cpp)
     if (data.size() < sizeof(uint32_t) + sizeof(uint64_t))
     {
         throw std::runtime_error("Message is too short in deserialzation");
@@ -132,6 +127,12 @@ std::vector<char> FileMessage::to_data_send() const
 {
     return bytes_;
 }
+
+std::size_t FileMessage::payload_size() const
+{
+    return bytes_.size() + filename_.size();
+}
+
 void FileMessage::save_file() const
 {
     // std::cout << "[DEBUG] bytes_ size = " << bytes_.size() << "\n"; // Still useful for debugging
@@ -0,0 +1,91 @@
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u64 channel][u32 flags][chunk bytes]
+static constexpr uint64_t CHUNK_PREFIX = sizeof(uint64_t) + sizeof(uint32_t);
+static constexpr uint32_t FLAG_LAST = 1;
+
+std::vector<char> FileChunkMessage::encode_header(uint64_t channel, bool last, std::size_t chunk_bytes)
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::FileChunk);
+
+    std::vector<char> buffer(HEADER_SIZE);
+    Utils::HeaderHelper::Writer(buffer.data())
+        .header(id, CHUNK_PREFIX + chunk_bytes)
+        .u64(channel)
+        .u32(last ? FLAG_LAST : 0);
+    return buffer;
+}
+
+std::vector<char> FileChunkMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::FileChunk);
+    std::vector<char> buffer = Utils::HeaderHelper::frame_buffer(HEADER_SIZE, HEADER_SIZE + data_.size());
+    Utils::HeaderHelper::Writer(buffer.data())
+        .header(id, CHUNK_PREFIX + data_.size())
+        .u64(channel_)
+        .u32(last_ ? FLAG_LAST : 0);
+    buffer.insert(buffer.end(), data_.begin(), data_.end());
+    return buffer;
+}
+
+void FileChunkMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < HEADER_SIZE)
+        throw std::runtime_error("FileChunkMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::FileChunk))
+        throw std::runtime_error("FileChunkMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length < CHUNK_PREFIX || data.size() < offset + payload_length)
+        throw std::runtime_error("FileChunkMessage: unexpected payload length");
+
+    Utils::HeaderHelper::read_u64(data, offset, channel_);
+    offset += sizeof(uint64_t);
+    uint32_t flags = 0;
+    Utils::HeaderHelper::read_u32(data, offset, flags);
+    offset += sizeof(uint32_t);
+    last_ = (flags & FLAG_LAST) != 0;
+
+    data_.assign(data.begin() + static_cast<std::ptrdiff_t>(offset),
+                 data.begin() + static_cast<std::ptrdiff_t>(offset + payload_length - CHUNK_PREFIX));
+}
+
+std::string FileChunkMessage::to_string() const
+{
+    return "[FileChunk " + std::to_string(channel_) + ", " + std::to_string(data_.size()) + " bytes" +
+           (last_ ? ", last]" : "]");
+}
+
+std::vector<char> FileChunkMessage::to_data_send() const
+{
+    return data_;
+}
+
+std::size_t FileChunkMessage::payload_size() const
+{
+    return CHUNK_PREFIX + data_.size();
+}
+
+void FileChunkMessage::save_file() const
+{
+}
+
+void FileChunkMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                     std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                     boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -0,0 +1,71 @@
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u32 kind]
+static constexpr uint64_t PAYLOAD_LENGTH = sizeof(uint32_t);
+
+std::vector<char> HeartbeatMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::Heartbeat);
+
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + PAYLOAD_LENGTH);
+    Utils::HeaderHelper::Writer(buffer.data()).header(id, PAYLOAD_LENGTH).u32(static_cast<uint32_t>(kind_));
+
+    return buffer;
+}
+
+void HeartbeatMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + PAYLOAD_LENGTH)
+        throw std::runtime_error("HeartbeatMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::Heartbeat))
+        throw std::runtime_error("HeartbeatMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length != PAYLOAD_LENGTH)
+        throw std::runtime_error("HeartbeatMessage: unexpected payload length");
+
+    uint32_t kind = 0;
+    Utils::HeaderHelper::read_u32(data, offset, kind);
+    if (kind > static_cast<uint32_t>(Kind::Pong))
+        throw std::runtime_error("HeartbeatMessage: unknown kind");
+    kind_ = static_cast<Kind>(kind);
+}
+
+std::string HeartbeatMessage::to_string() const
+{
+    return kind_ == Kind::Ping ? "[Ping]" : "[Pong]";
+}
+
+std::vector<char> HeartbeatMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t HeartbeatMessage::payload_size() const
+{
+    return PAYLOAD_LENGTH;
+}
+
+void HeartbeatMessage::save_file() const
+{
+}
+
+void HeartbeatMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                     std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                     boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
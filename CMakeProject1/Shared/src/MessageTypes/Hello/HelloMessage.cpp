@@ -0,0 +1,93 @@
+#include "MessageTypes/Hello/HelloMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u32 version][u32 features][u64 max frame bytes][u32 codec count][u8 codec]...
+// Later versions may append fields; they are ignored here.
+static constexpr uint64_t FIXED_PAYLOAD_LENGTH = 3 * sizeof(uint32_t) + sizeof(uint64_t);
+static constexpr uint32_t MAX_CODECS = 32;
+
+std::vector<char> HelloMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::Hello);
+
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + payload_size());
+    char* codecs = Utils::HeaderHelper::Writer(buffer.data())
+                       .header(id, payload_size())
+                       .u32(version_)
+                       .u32(features_)
+                       .u64(max_frame_bytes_)
+                       .u32(static_cast<uint32_t>(codecs_.size()))
+                       .position();
+    for (const auto codec : codecs_) *codecs++ = static_cast<char>(codec);
+
+    return buffer;
+}
+
+void HelloMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + FIXED_PAYLOAD_LENGTH)
+        throw std::runtime_error("HelloMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::Hello))
+        throw std::runtime_error("HelloMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length < FIXED_PAYLOAD_LENGTH || data.size() < offset + payload_length)
+        throw std::runtime_error("HelloMessage: message too short");
+
+    Utils::HeaderHelper::read_u32(data, offset, version_);
+    offset += sizeof(uint32_t);
+    Utils::HeaderHelper::read_u32(data, offset, features_);
+    offset += sizeof(uint32_t);
+    Utils::HeaderHelper::read_u64(data, offset, max_frame_bytes_);
+    offset += sizeof(uint64_t);
+
+    uint32_t codec_count = 0;
+    Utils::HeaderHelper::read_u32(data, offset, codec_count);
+    offset += sizeof(uint32_t);
+    if (codec_count > MAX_CODECS || FIXED_PAYLOAD_LENGTH + codec_count > payload_length)
+        throw std::runtime_error("HelloMessage: bad codec list");
+
+    codecs_.clear();
+    for (uint32_t i = 0; i < codec_count; ++i)
+        codecs_.push_back(static_cast<ConnectionProtocol::Codec>(static_cast<uint8_t>(data[offset + i])));
+}
+
+std::string HelloMessage::to_string() const
+{
+    return "[Hello version " + std::to_string(version_) + ", features " + std::to_string(features_) +
+           ", max frame " + std::to_string(max_frame_bytes_) + " bytes, " + std::to_string(codecs_.size()) +
+           " codecs]";
+}
+
+std::vector<char> HelloMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t HelloMessage::payload_size() const
+{
+    return FIXED_PAYLOAD_LENGTH + codecs_.size();
+}
+
+void HelloMessage::save_file() const
+{
+}
+
+void HelloMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                 std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                 boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -0,0 +1,69 @@
+#include "MessageTypes/HistoryQuery/HistoryQueryMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u64 before sequence][u32 limit]
+static constexpr uint64_t PAYLOAD_LENGTH = sizeof(uint64_t) + sizeof(uint32_t);
+
+std::vector<char> HistoryQueryMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::HistoryQuery);
+
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + PAYLOAD_LENGTH);
+    Utils::HeaderHelper::Writer(buffer.data()).header(id, PAYLOAD_LENGTH).u64(before_sequence_).u32(limit_);
+
+    return buffer;
+}
+
+void HistoryQueryMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + PAYLOAD_LENGTH)
+        throw std::runtime_error("HistoryQueryMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::HistoryQuery))
+        throw std::runtime_error("HistoryQueryMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length != PAYLOAD_LENGTH)
+        throw std::runtime_error("HistoryQueryMessage: unexpected payload length");
+
+    Utils::HeaderHelper::read_u64(data, offset, before_sequence_);
+    offset += sizeof(uint64_t);
+    Utils::HeaderHelper::read_u32(data, offset, limit_);
+}
+
+std::string HistoryQueryMessage::to_string() const
+{
+    return "[HistoryQuery before " + std::to_string(before_sequence_) + ", limit " + std::to_string(limit_) + "]";
+}
+
+std::vector<char> HistoryQueryMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t HistoryQueryMessage::payload_size() const
+{
+    return PAYLOAD_LENGTH;
+}
+
+void HistoryQueryMessage::save_file() const
+{
+}
+
+void HistoryQueryMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                        std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                        boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -0,0 +1,84 @@
+#include "MessageTypes/HistorySync/HistorySyncMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u32 status][u64 first sequence][u64 last sequence]
+static constexpr uint64_t PAYLOAD_LENGTH = sizeof(uint32_t) + 2 * sizeof(uint64_t);
+
+std::vector<char> HistorySyncMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::HistorySync);
+
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + PAYLOAD_LENGTH);
+    Utils::HeaderHelper::Writer(buffer.data())
+        .header(id, PAYLOAD_LENGTH)
+        .u32(static_cast<uint32_t>(status_))
+        .u64(first_sequence_)
+        .u64(last_sequence_);
+
+    return buffer;
+}
+
+void HistorySyncMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + PAYLOAD_LENGTH)
+        throw std::runtime_error("HistorySyncMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::HistorySync))
+        throw std::runtime_error("HistorySyncMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length != PAYLOAD_LENGTH)
+        throw std::runtime_error("HistorySyncMessage: unexpected payload length");
+
+    uint32_t status = 0;
+    Utils::HeaderHelper::read_u32(data, offset, status);
+    offset += sizeof(uint32_t);
+    if (status > static_cast<uint32_t>(Status::Page))
+        throw std::runtime_error("HistorySyncMessage: unknown status");
+    status_ = static_cast<Status>(status);
+
+    Utils::HeaderHelper::read_u64(data, offset, first_sequence_);
+    offset += sizeof(uint64_t);
+    Utils::HeaderHelper::read_u64(data, offset, last_sequence_);
+}
+
+std::string HistorySyncMessage::to_string() const
+{
+    const char* status = status_ == Status::FullResync ? "full resync"
+                       : status_ == Status::Page     ? "page"
+                                                     : "delta";
+    return "[HistorySync " + std::string(status) + " " + std::to_string(first_sequence_) +
+           ".." + std::to_string(last_sequence_) + "]";
+}
+
+std::vector<char> HistorySyncMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t HistorySyncMessage::payload_size() const
+{
+    return PAYLOAD_LENGTH;
+}
+
+void HistorySyncMessage::save_file() const
+{
+}
+
+void HistorySyncMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                       std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                       boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -0,0 +1,79 @@
+#include "MessageTypes/Room/RoomMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u32 action][room name]
+static constexpr uint64_t MAX_ROOM_NAME = 256;
+
+std::vector<char> RoomMessage::serialize() const
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::Room);
+    const uint64_t length = sizeof(uint32_t) + room_.size();
+
+    std::vector<char> buffer = Utils::HeaderHelper::frame_buffer(Utils::HeaderHelper::HEADER_SIZE + sizeof(uint32_t),
+                                                                 Utils::HeaderHelper::HEADER_SIZE + length);
+    Utils::HeaderHelper::Writer(buffer.data()).header(id, length).u32(static_cast<uint32_t>(action_));
+    buffer.insert(buffer.end(), room_.begin(), room_.end());
+
+    return buffer;
+}
+
+void RoomMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+        throw std::runtime_error("RoomMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::Room))
+        throw std::runtime_error("RoomMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length < sizeof(uint32_t) || payload_length - sizeof(uint32_t) > MAX_ROOM_NAME ||
+        data.size() < offset + payload_length)
+        throw std::runtime_error("RoomMessage: unexpected payload length");
+
+    uint32_t action = 0;
+    Utils::HeaderHelper::read_u32(data, offset, action);
+    offset += sizeof(uint32_t);
+    if (action > static_cast<uint32_t>(Action::Leave))
+        throw std::runtime_error("RoomMessage: unknown action");
+    action_ = static_cast<Action>(action);
+
+    room_.assign(data.begin() + static_cast<std::ptrdiff_t>(offset),
+                 data.begin() + static_cast<std::ptrdiff_t>(offset + payload_length - sizeof(uint32_t)));
+}
+
+std::string RoomMessage::to_string() const
+{
+    return std::string(action_ == Action::Join ? "[Join " : "[Leave ") + room_ + "]";
+}
+
+std::vector<char> RoomMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t RoomMessage::payload_size() const
+{
+    return sizeof(uint32_t) + room_.size();
+}
+
+void RoomMessage::save_file() const
+{
+}
+
+void RoomMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -2,25 +2,21 @@
 #include <stdexcept>
 #include "MessageTypes/Utilities/HeaderHelper.hpp"
 #include <iostream>
-// In MessageTypes/SendHistory/SendHistoryMessage.cpp
-// In MessageTypes/SendHistory/SendHistoryMessage.cpp
+// Payload: [u32 file port][u64 last seen sequence]
+// Older clients send only the port (4 byte payload), which means "no history yet".
+static constexpr uint64_t LEGACY_PAYLOAD_LENGTH = sizeof(uint32_t);
+static constexpr uint64_t PAYLOAD_LENGTH = sizeof(uint32_t) + sizeof(uint64_t);
 
 std::vector<char> SendHistoryMessage::serialize() const
 {
     constexpr uint32_t id = static_cast<uint32_t>(TextTypes::SendHistory);
 
-    // Use sizeof(uint32_t) for the payload length
-    // because we must use append_u32() to send the port.
-    const uint64_t payload_length = sizeof(uint32_t);
-
-    std::vector<char> buffer;
-    buffer.reserve(sizeof(id) + sizeof(payload_length) + payload_length);
-
-    Utils::HeaderHelper::append_u32(buffer, id);
-    Utils::HeaderHelper::append_u64(buffer, payload_length);
-
-    // casted to uint32_t, padded with two zero bytes.
-    Utils::HeaderHelper::append_u32(buffer, static_cast<uint32_t>(file_port_));
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + PAYLOAD_LENGTH);
+    // the port is casted to uint32_t, padded with two zero bytes.
+    Utils::HeaderHelper::Writer(buffer.data())
+        .header(id, PAYLOAD_LENGTH)
+        .u32(static_cast<uint32_t>(file_port_))
+        .u64(last_seen_sequence_);
 
     return buffer;
 }
@@ -44,9 +40,10 @@ void SendHistoryMessage::deserialize(const std::vector<char>& data)
     Utils::HeaderHelper::read_u64(data, offset, payload_length);
     offset += sizeof(uint64_t);
 
-    // The expected payload length is now sizeof(uint32_t).
-    if (payload_length != sizeof(uint32_t))
+    if (payload_length != PAYLOAD_LENGTH && payload_length != LEGACY_PAYLOAD_LENGTH)
         throw std::runtime_error("SendHistoryMessage: unexpected payload length");
+    if (data.size() < offset + payload_length)
+        throw std::runtime_error("SendHistoryMessage: message too short");
 
     //  Read the entire 4-byte port container using read_u32
     uint32_t port_container = 0;
@@ -57,11 +54,15 @@ void SendHistoryMessage::deserialize(const std::vector<char>& data)
     // Assign the result back to the uint16_t member variable.
     file_port_ = static_cast<uint16_t>(port_container);
 
+    last_seen_sequence_ = 0;
+    if (payload_length == PAYLOAD_LENGTH)
+        Utils::HeaderHelper::read_u64(data, offset, last_seen_sequence_);
 }
 
 std::string SendHistoryMessage::to_string() const
 {
-    return "[SendHistory from file port: " + std::to_string(file_port_) + "]";
+    return "[SendHistory from file port: " + std::to_string(file_port_) +
+           ", last seen: " + std::to_string(last_seen_sequence_) + "]";
 }
 
 std::vector<char> SendHistoryMessage::to_data_send() const
@@ -69,6 +70,11 @@ std::vector<char> SendHistoryMessage::to_data_send() const
     return {};
 }
 
+std::size_t SendHistoryMessage::payload_size() const
+{
+    return PAYLOAD_LENGTH;
+}
+
 void SendHistoryMessage::save_file() const
 {
     // nic a nic
@@ -1,40 +1,71 @@
 // TextMessage.cpp
 #include <MessageTypes/Text/TextMessage.h>
+#include <cstring>
 #include <iostream>
 #include <boost/asio/buffer.hpp>
 
 #include "Server/MessageSender.h"
 
-#if defined(_WIN32) || defined(_WIN64)
-#include <winsock2.h>
-#else
-#include <arpa/inet.h>
-#endif
-
 #include <MessageTypes/Utilities/HeaderHelper.hpp>
+#include <MessageTypes/Utilities/TextSanitizer.h>
+
+// Constructors
+TextMessage::TextMessage(std::string_view text, uint64_t sequence) : sequence_(sequence)
+{
+    assign(text);
+}
 
-// Constructor
-TextMessage::TextMessage(const std::string& text) : text_({text.begin(),text.end()})
+TextMessage::TextMessage(std::string&& text, uint64_t sequence) : sequence_(sequence)
 {
-    if (text_.size() > std::numeric_limits<uint64_t>::max()) {
-        throw std::runtime_error("Text too long to serialize");
+    if (text.size() <= INLINE_CAPACITY)
+    {
+        assign(text);
+        return;
     }
+    heap_ = std::move(text);
+    size_ = heap_.size();
+    inline_text_ = false;
+}
+
+// Short texts are copied inline (and a previous long one released), longer ones into heap_
+void TextMessage::assign(std::string_view text)
+{
+    size_ = text.size();
+    inline_text_ = size_ <= INLINE_CAPACITY;
+    if (inline_text_)
+    {
+        if (size_ != 0) std::memcpy(inline_.data(), text.data(), size_);
+        heap_ = std::string();
+        return;
+    }
+    heap_.assign(text.data(), text.size());
+}
+
+std::size_t TextMessage::sanitize()
+{
+    return Utils::TextSanitizer::sanitize(inline_text_ ? inline_.data() : heap_.data(), size_);
 }
 
 // Serialize string into bytes
+// Text:          [u32 id][u64 length][text]
+// SequencedText: [u32 id][u64 length][u64 sequence][text]
 std::vector<char> TextMessage::serialize() const
 {
-    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::Text);
-    const uint64_t length = text_.size();
-
-    const size_t total_size = sizeof(id) + sizeof(length) + length;
+    return serialize_prefixed({}, get_text(), sequence_);
+}
 
-    std::vector<char> buffer;
-    buffer.reserve(total_size);
+std::vector<char> TextMessage::serialize_prefixed(std::string_view prefix, std::string_view text, uint64_t sequence)
+{
+    const bool sequenced = sequence != 0;
+    const uint32_t id = static_cast<uint32_t>(sequenced ? TextTypes::SequencedText : TextTypes::Text);
+    const uint64_t length = prefix.size() + text.size() + (sequenced ? sizeof(uint64_t) : 0);
 
-    Utils::HeaderHelper::append_u32(buffer, id);
-    Utils::HeaderHelper::append_u64(buffer, length);
-    buffer.insert(buffer.end(), text_.begin(), text_.end());
+    // the prefix and the text are gathered as segments behind the fixed layout
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + length);
+    Utils::HeaderHelper::Writer writer(buffer.data());
+    writer.header(id, length);
+    if (sequenced) writer.u64(sequence);
+    writer.bytes(prefix).bytes(text);
 
     return buffer;
 }
@@ -59,20 +90,35 @@ void TextMessage::deserialize(const std::vector<char>& data)
         throw std::runtime_error("TextMessage:t runcated data");
     };
 
-    text_.assign(data.begin() + offset, data.begin() + offset + length);
+    sequence_ = 0;
+    if (id == static_cast<uint32_t>(TextTypes::SequencedText))
+    {
+        if (length < sizeof(uint64_t))
+            throw std::runtime_error("TextMessage: sequenced frame without sequence number");
+        Utils::HeaderHelper::read_u64(data, offset, sequence_);
+        offset += sizeof(uint64_t);
+        length -= sizeof(uint64_t);
+    }
+
+    assign({data.data() + offset, static_cast<size_t>(length)});
 }
 
 
 // Return human-readable string
 std::string TextMessage::to_string() const
 {
-    return {text_.data(),text_.size()};
+    return std::string(get_text());
 }
 
 std::vector<char> TextMessage::to_data_send() const
 {
-    return {text_.data(),text_.data()+text_.size()};
+    const std::string_view text = get_text();
+    return {text.begin(), text.end()};
+}
 
+std::size_t TextMessage::payload_size() const
+{
+    return size_;
 }
 
 void TextMessage::save_file() const
@@ -0,0 +1,130 @@
+#include "MessageTypes/TextBatch/TextBatchMessage.h"
+#include <stdexcept>
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "Server/MessageSender.h"
+
+// Payload: [u32 count] then per record [u64 sequence][u32 sender length][u32 text length][sender][text]
+
+std::vector<char> TextBatchMessage::serialize_records(const std::vector<Record>& records,
+                                                      const std::function<bool(std::size_t)>& keep)
+{
+    constexpr uint32_t id = static_cast<uint32_t>(TextTypes::TextBatch);
+
+    uint64_t length = sizeof(uint32_t);
+    uint32_t count = 0;
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        if (keep && !keep(i)) continue;
+        length += record_size(records[i]);
+        ++count;
+    }
+
+    std::vector<char> buffer(Utils::HeaderHelper::HEADER_SIZE + length);
+    char* out = Utils::HeaderHelper::Writer(buffer.data()).header(id, length).u32(count).position();
+    for (std::size_t i = 0; i < records.size(); ++i)
+    {
+        if (keep && !keep(i)) continue;
+        const Record& record = records[i];
+        out = Utils::HeaderHelper::Writer(out)
+                  .u64(record.sequence)
+                  .u32(static_cast<uint32_t>(record.sender.size()))
+                  .u32(static_cast<uint32_t>(record.text.size()))
+                  .bytes(record.sender)
+                  .bytes(record.text)
+                  .position();
+    }
+
+    return buffer;
+}
+
+std::vector<char> TextBatchMessage::serialize() const
+{
+    return serialize_records(records_);
+}
+
+void TextBatchMessage::deserialize(const std::vector<char>& data)
+{
+    if (data.size() < sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t))
+        throw std::runtime_error("TextBatchMessage: message too short");
+
+    size_t offset = 0;
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(data, offset, id);
+    offset += sizeof(uint32_t);
+
+    if (id != static_cast<uint32_t>(TextTypes::TextBatch))
+        throw std::runtime_error("TextBatchMessage: wrong message id");
+
+    uint64_t payload_length = 0;
+    Utils::HeaderHelper::read_u64(data, offset, payload_length);
+    offset += sizeof(uint64_t);
+
+    if (payload_length < sizeof(uint32_t) || data.size() - offset < payload_length)
+        throw std::runtime_error("TextBatchMessage: message too short");
+    const size_t end = offset + payload_length;
+
+    uint32_t count = 0;
+    Utils::HeaderHelper::read_u32(data, offset, count);
+    offset += sizeof(uint32_t);
+    if (count > MAX_RECORDS || count > (payload_length - sizeof(uint32_t)) / RECORD_OVERHEAD)
+        throw std::runtime_error("TextBatchMessage: bad record count");
+
+    records_.clear();
+    records_.reserve(count);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (end - offset < RECORD_OVERHEAD)
+            throw std::runtime_error("TextBatchMessage: truncated record");
+        Record record;
+        uint32_t sender_length = 0;
+        uint32_t text_length = 0;
+        Utils::HeaderHelper::read_u64(data, offset, record.sequence);
+        Utils::HeaderHelper::read_u32(data, offset + sizeof(uint64_t), sender_length);
+        Utils::HeaderHelper::read_u32(data, offset + sizeof(uint64_t) + sizeof(uint32_t), text_length);
+        offset += RECORD_OVERHEAD;
+
+        if (end - offset < static_cast<uint64_t>(sender_length) + text_length)
+            throw std::runtime_error("TextBatchMessage: truncated record");
+        record.sender.assign(data.data() + offset, sender_length);
+        offset += sender_length;
+        record.text.assign(data.data() + offset, text_length);
+        offset += text_length;
+        records_.push_back(std::move(record));
+    }
+}
+
+std::string TextBatchMessage::to_string() const
+{
+    std::string out;
+    for (const auto& record : records_)
+    {
+        if (!out.empty()) out += '\n';
+        out += record.sender;
+        out += record.text;
+    }
+    return out;
+}
+
+std::vector<char> TextBatchMessage::to_data_send() const
+{
+    return {};
+}
+
+std::size_t TextBatchMessage::payload_size() const
+{
+    std::size_t bytes = 0;
+    for (const auto& record : records_) bytes += record.sender.size() + record.text.size();
+    return bytes;
+}
+
+void TextBatchMessage::save_file() const
+{
+}
+
+void TextBatchMessage::dispatch_send(const std::shared_ptr<boost::asio::ip::tcp::socket>& text_socket,
+                                     std::shared_ptr<FileTransferQueue> /*file_queue*/,
+                                     boost::system::error_code& ec)
+{
+    SendMessage(text_socket, shared_from_this(), ec);
+}
@@ -0,0 +1,46 @@
+#include "MessageTypes/Utilities/ChunkAssembler.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include <stdexcept>
+
+ChunkAssembler::ChunkAssembler(std::size_t max_bytes)
+    : max_bytes_(max_bytes)
+{
+}
+
+std::shared_ptr<std::vector<char>> ChunkAssembler::add(FileChunkMessage& chunk)
+{
+    auto& data = chunk.get_data();
+    std::scoped_lock lock(mutex_);
+    if (pending_bytes_ + data.size() > max_bytes_)
+    {
+        partial_.clear();
+        pending_bytes_ = 0;
+        throw std::runtime_error("ChunkAssembler: partial files over " + std::to_string(max_bytes_) + " bytes");
+    }
+
+    auto it = partial_.find(chunk.get_channel());
+    if (it == partial_.end())
+    {
+        // a single-chunk frame is handed over without a copy
+        if (chunk.is_last()) return std::make_shared<std::vector<char>>(std::move(data));
+        it = partial_.emplace(chunk.get_channel(), std::move(data)).first;
+        pending_bytes_ += it->second.size();
+        return nullptr;
+    }
+
+    it->second.insert(it->second.end(), data.begin(), data.end());
+    pending_bytes_ += data.size();
+    data.clear();
+    if (!chunk.is_last()) return nullptr;
+
+    auto frame = std::make_shared<std::vector<char>>(std::move(it->second));
+    pending_bytes_ -= frame->size();
+    partial_.erase(it);
+    return frame;
+}
+
+std::size_t ChunkAssembler::pending_bytes() const
+{
+    std::scoped_lock lock(mutex_);
+    return pending_bytes_;
+}
@@ -6,10 +6,9 @@
 #include "MessageTypes/File/FileMessage.h" // for constructing FileMessage directly
 using boost::asio::ip::tcp;
 
-FileTransferQueue::FileTransferQueue(SocketGetter socket_getter)
-    : socket_getter_(std::move(socket_getter))
+FileTransferQueue::FileTransferQueue(SocketGetter socket_getter, FrameWriter frame_writer)
+    : socket_getter_(std::move(socket_getter)), frame_writer_(std::move(frame_writer))
 {
-    worker_ = std::thread([this]() { worker_loop(); });
 }
 
 FileTransferQueue::~FileTransferQueue()
@@ -29,6 +28,7 @@ uint64_t FileTransferQueue::enqueue(const std::filesystem::path& path)
     it.last_error.clear();
     it.message = nullptr;
     queue_.push_back(std::move(it));
+    start_worker_locked();
     cv_.notify_one();
     return id;
 }
@@ -46,6 +46,7 @@ uint64_t FileTransferQueue::enqueue(const std::shared_ptr<FileMessage>& message)
     it.last_error.clear();
     it.message = message;
     queue_.push_back(std::move(it));
+    start_worker_locked();
     cv_.notify_one();
     return id;
 }
@@ -61,6 +62,21 @@ uint64_t FileTransferQueue::enqueue(const std::string& filename, const std::vect
     return 0;
 }
 
+uint64_t FileTransferQueue::enqueue(const ZeroCopySender::Frame& frame)
+{
+    if (!frame) return 0;
+    std::scoped_lock lk(mutex_);
+    uint64_t id = next_id_++;
+    Item it;
+    it.id = id;
+    it.frame = frame;
+    it.state = State::Queued;
+    queue_.push_back(std::move(it));
+    start_worker_locked();
+    cv_.notify_one();
+    return id;
+}
+
 bool FileTransferQueue::remove(uint64_t id)
 {
     std::scoped_lock lk(mutex_);
@@ -117,6 +133,7 @@ bool FileTransferQueue::cancel(uint64_t id)
             break;
         }
     }
+    trim_finished_locked();
 
     if (was_sending) {
         try {
@@ -148,6 +165,7 @@ void FileTransferQueue::cancel_all()
                 it.last_error = "canceled by user";
             }
         }
+        trim_finished_locked();
     }
 
     try {
@@ -177,12 +195,55 @@ std::vector<FileTransferQueue::Item> FileTransferQueue::list_snapshot()
     return out;
 }
 
+void FileTransferQueue::set_zero_copy(const ZeroCopySender::Options& options)
+{
+    std::scoped_lock lk(mutex_);
+    zero_copy_ = options;
+}
+
+ZeroCopySender::Stats FileTransferQueue::zero_copy_stats()
+{
+    std::scoped_lock lk(mutex_);
+    return sender_stats_;
+}
+
+void FileTransferQueue::start_worker_locked()
+{
+    if (!worker_.joinable() && running_.load()) worker_ = std::thread([this]() { worker_loop(); });
+}
+
+bool FileTransferQueue::has_queued_locked() const
+{
+    return std::any_of(queue_.begin(), queue_.end(), [](const Item& i) { return i.state == State::Queued; });
+}
+
+void FileTransferQueue::trim_finished_locked()
+{
+    auto finished = [](const Item& i) {
+        return i.state == State::Done || i.state == State::Failed || i.state == State::Canceled;
+    };
+    std::size_t count = static_cast<std::size_t>(std::count_if(queue_.begin(), queue_.end(), finished));
+    for (auto it = queue_.begin(); count > MAX_FINISHED_ITEMS && it != queue_.end();) {
+        if (finished(*it)) {
+            it = queue_.erase(it);
+            --count;
+        } else {
+            ++it;
+        }
+    }
+}
+
 void FileTransferQueue::stop()
 {
     if (!running_.load()) return;
-    running_.store(false);
+    std::thread worker;
+    {
+        std::scoped_lock lk(mutex_);
+        running_.store(false);
+        worker = std::move(worker_);
+    }
     cv_.notify_one();
-    if (worker_.joinable()) worker_.join();
+    if (worker.joinable()) worker.join();
 }
 
 std::shared_ptr<FileMessage> FileTransferQueue::make_file_message(const std::filesystem::path& p)
@@ -214,8 +275,9 @@ void FileTransferQueue::worker_loop()
 {
     while (running_.load()) {
         std::unique_lock lk(mutex_);
+        // finished items stay listed, but only a Queued one is work
         cv_.wait(lk, [this]() {
-            return !running_.load() || (!paused_.load() && !queue_.empty());
+            return !running_.load() || (!paused_.load() && has_queued_locked());
         });
 
         if (!running_.load()) break;
@@ -231,14 +293,15 @@ void FileTransferQueue::worker_loop()
         Item item = *it;
         it->state = State::Sending;
         it->last_error.clear();
+        sender_.SetOptions(zero_copy_);
         lk.unlock();
 
         // If message is missing but we have a path, try to build it.
-        if (!item.message && !item.path.empty()) {
+        if (!item.frame && !item.message && !item.path.empty()) {
             item.message = make_file_message(item.path);
         }
 
-        if (!item.message) {
+        if (!item.frame && !item.message) {
             std::scoped_lock lk2(mutex_);
             auto qit = std::find_if(queue_.begin(), queue_.end(), [&](const Item& x){ return x.id == item.id; });
             if (qit != queue_.end()) {
@@ -247,14 +310,13 @@ void FileTransferQueue::worker_loop()
                     qit->last_error = "failed to build FileMessage (no path/message)";
                 }
             }
+            trim_finished_locked();
             std::this_thread::sleep_for(std::chrono::milliseconds(100));
             continue;
         }
 
-        auto bytes = item.message->serialize();
-
-        auto sock = socket_getter_();
-        if (!sock || !sock->is_open()) {
+        auto sock = frame_writer_ ? nullptr : socket_getter_();
+        if (!frame_writer_ && (!sock || !sock->is_open())) {
             std::scoped_lock lk2(mutex_);
             auto qit = std::find_if(queue_.begin(), queue_.end(), [&](const Item& x){ return x.id == item.id; });
             if (qit != queue_.end()) {
@@ -263,20 +325,29 @@ void FileTransferQueue::worker_loop()
                     qit->last_error = "socket not connected";
                 }
             }
+            trim_finished_locked();
             std::this_thread::sleep_for(std::chrono::milliseconds(200));
             continue;
         }
 
         boost::system::error_code ec;
         try {
-            std::size_t written = boost::asio::write(*sock, boost::asio::buffer(bytes), ec);
-            (void)written;
+            if (frame_writer_) {
+                frame_writer_(item.frame ? *item.frame : item.message->serialize(), ec);
+            } else {
+                auto frame = item.frame ? item.frame
+                                        : std::make_shared<const std::vector<char>>(item.message->serialize());
+                sender_.Send(*sock, frame, ec);
+                // a zero-copy frame stays pinned until the peer acknowledged it, so this waits about a round trip
+                if (!ec && sender_.PinnedFrames() > 0) sender_.Flush(*sock);
+            }
         } catch (const std::exception& ex) {
             ec = boost::asio::error::operation_aborted;
             std::cerr << "Exception during write: " << ex.what() << "\n";
         }
 
         std::unique_lock lk3(mutex_);
+        sender_stats_ = sender_.GetStats();
         auto qit = std::find_if(queue_.begin(), queue_.end(), [&](const Item& i){ return i.id == item.id; });
         if (qit == queue_.end()) {
             continue;
@@ -293,10 +364,19 @@ void FileTransferQueue::worker_loop()
             qit->retries++;
             std::cerr << "File send failed (id=" << qit->id << "): " << ec.message() << "\n";
         } else {
+            // a sent item is only listed, it no longer holds the file
             qit->state = State::Done;
             qit->last_error.clear();
+            qit->frame.reset();
+            qit->message.reset();
         }
+        trim_finished_locked();
 
         std::this_thread::sleep_for(std::chrono::milliseconds(20));
     }
+
+    // Frames still pinned by a send that timed out; once the socket is closed the kernel drops them itself
+    if (sender_.PinnedFrames() > 0) {
+        if (auto sock = socket_getter_(); sock && sock->is_open()) sender_.Flush(*sock);
+    }
 }
@@ -1,22 +1,12 @@
 #include "MessageTypes/Utilities/MessageFactory.h"
-
-#include <MessageTypes/Text/TextMessage.h>
-#include <MessageTypes/File/FileMessage.h>
+#include "MessageTypes/Utilities/MessageRegistry.hpp"
 #include <stdexcept>
-#include <memory>
-
-#include "MessageTypes/SendHistory/SendHistoryMessage.h"
+#include <string>
 
 std::unique_ptr<IMessage> MessageFactory::create_from_id(TextTypes id)
 {
-    switch (const uint32_t int_id = static_cast<uint32_t>(id)) {
-    case static_cast<uint32_t>(TextTypes::Text):
-        return std::make_unique<TextMessage>();
-    case static_cast<uint32_t>(TextTypes::File):
-        return std::make_unique<FileMessage>();
-    case static_cast<uint32_t>(TextTypes::SendHistory):
-        return std::make_unique<SendHistoryMessage>();
-    default:
-        throw std::runtime_error("Unknown message type ID: " + std::to_string(int_id));
-    }
+    const auto entry = Utils::MessageRegistry::lookup(static_cast<uint32_t>(id));
+    if (!entry.create)
+        throw std::runtime_error("Unknown message type ID: " + std::to_string(static_cast<uint32_t>(id)));
+    return entry.create();
 }
@@ -0,0 +1,346 @@
+#include "MessageTypes/Utilities/TextSanitizer.h"
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define TEXT_SANITIZER_SSE2 1
+#endif
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define TEXT_SANITIZER_AVX2 1
+#endif
+
+namespace
+{
+    using Utils::TextSanitizer;
+
+    bool is_control(uint8_t byte)
+    {
+        return (byte < 0x20 && byte != '\t') || byte == 0x7F;
+    }
+
+    /**
+     * @brief Length (1-4) of the clean character at `p`, or 0 when it is a control character or
+     *        not valid UTF-8 (RFC 3629: shortest form, no surrogates, at most U+10FFFF)
+     */
+    std::size_t clean_sequence(const uint8_t* p, std::size_t remaining)
+    {
+        const uint8_t lead = p[0];
+        if (lead < 0x80) return is_control(lead) ? 0 : 1;
+
+        std::size_t length = 0;
+        uint8_t low = 0x80;   // allowed range of the second byte
+        uint8_t high = 0xBF;
+        if (lead >= 0xC2 && lead <= 0xDF) length = 2;
+        else if (lead >= 0xE0 && lead <= 0xEF) length = 3;
+        else if (lead >= 0xF0 && lead <= 0xF4) length = 4;
+        else return 0;
+
+        if (lead == 0xE0) low = 0xA0;        // overlong
+        else if (lead == 0xED) high = 0x9F;  // surrogates
+        else if (lead == 0xF0) low = 0x90;   // overlong
+        else if (lead == 0xF4) high = 0x8F;  // past U+10FFFF
+
+        if (remaining < length) return 0;
+        if (p[1] < low || p[1] > high) return 0;
+        for (std::size_t i = 2; i < length; ++i)
+        {
+            if (p[i] < 0x80 || p[i] > 0xBF) return 0;
+        }
+        // U+0080..U+009F are the C1 controls (CSI is U+009B)
+        if (lead == 0xC2 && p[1] <= 0x9F) return 0;
+        return length;
+    }
+
+    // printable ASCII without the call
+    inline std::size_t clean_length(const uint8_t* p, std::size_t remaining)
+    {
+        return p[0] >= 0x20 && p[0] < 0x7F ? 1 : clean_sequence(p, remaining);
+    }
+
+    bool is_clean_scalar(const uint8_t* data, std::size_t size)
+    {
+        std::size_t i = 0;
+        while (i < size)
+        {
+            const std::size_t length = clean_length(data + i, size - i);
+            if (length == 0) return false;
+            i += length;
+        }
+        return true;
+    }
+
+#ifdef TEXT_SANITIZER_SSE2
+    // 16 bytes at a time while the text is ASCII; a block holding other bytes is checked by the scalar
+    // loop, which resumes the vector loop after the last character it read
+    bool is_clean_sse2(const uint8_t* data, std::size_t size)
+    {
+        const __m128i control_max = _mm_set1_epi8(0x1F);
+        const __m128i tab = _mm_set1_epi8('\t');
+        const __m128i del = _mm_set1_epi8(0x7F);
+
+        std::size_t i = 0;
+        while (i + 16 <= size)
+        {
+            const __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            if (_mm_movemask_epi8(input) != 0)
+            {
+                const std::size_t block_end = i + 16;
+                while (i < block_end)
+                {
+                    const std::size_t length = clean_length(data + i, size - i);
+                    if (length == 0) return false;
+                    i += length;
+                }
+                continue;
+            }
+            const __m128i below_space = _mm_cmpeq_epi8(_mm_min_epu8(input, control_max), input);
+            const __m128i controls = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(input, tab), below_space),
+                                                  _mm_cmpeq_epi8(input, del));
+            if (_mm_movemask_epi8(controls) != 0) return false;
+            i += 16;
+        }
+        return is_clean_scalar(data + i, size - i);
+    }
+#endif
+
+#ifdef TEXT_SANITIZER_AVX2
+    // UTF-8 validation by table lookups on the high and low nibbles of each byte and of the byte before
+    // it (Keiser and Lemire, "Validating UTF-8 In Less Than One Instruction Per Byte"), plus the
+    // control character checks. Errors are accumulated and tested once at the end.
+    namespace avx2
+    {
+        constexpr uint8_t TOO_SHORT = 1 << 0;  // lead byte not followed by enough continuation bytes
+        constexpr uint8_t TOO_LONG = 1 << 1;   // ASCII followed by a continuation byte
+        constexpr uint8_t OVERLONG_3 = 1 << 2;
+        constexpr uint8_t TOO_LARGE = 1 << 3;
+        constexpr uint8_t SURROGATE = 1 << 4;
+        constexpr uint8_t OVERLONG_2 = 1 << 5;
+        constexpr uint8_t TOO_LARGE_1000 = 1 << 6;
+        constexpr uint8_t OVERLONG_4 = 1 << 6;
+        constexpr uint8_t TWO_CONTS = 1 << 7;  // two continuation bytes in a row
+        constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+
+        __attribute__((target("avx2"))) inline __m256i table(const uint8_t (&entries)[16])
+        {
+            const __m128i half = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entries));
+            return _mm256_broadcastsi128_si256(half);
+        }
+
+        __attribute__((target("avx2"))) inline __m256i load(const uint8_t* at)
+        {
+            return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+        }
+
+        __attribute__((target("avx2"))) inline __m256i high_nibbles(__m256i v)
+        {
+            return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+        }
+
+        // bytes of `input` shifted by N, with the last N bytes of `previous` in front
+        template <int N>
+        __attribute__((target("avx2"))) inline __m256i prev(__m256i input, __m256i previous)
+        {
+            return _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - N);
+        }
+
+        constexpr uint8_t BYTE_1_HIGH[16] = {
+            TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,  // 0_______
+            TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,                                      // 10______
+            TOO_SHORT | OVERLONG_2,                                                          // 1100____
+            TOO_SHORT,                                                                       // 1101____
+            TOO_SHORT | OVERLONG_3 | SURROGATE,                                              // 1110____
+            TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4};                            // 1111____
+
+        constexpr uint8_t BYTE_1_LOW[16] = {
+            CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,  // ____0000
+            CARRY | OVERLONG_2,                            // ____0001
+            CARRY, CARRY,                                  // ____001_
+            CARRY | TOO_LARGE,                             // ____0100
+            CARRY | TOO_LARGE | TOO_LARGE_1000,            // ____0101
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000,
+            CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,  // ____1101
+            CARRY | TOO_LARGE | TOO_LARGE_1000, CARRY | TOO_LARGE | TOO_LARGE_1000};
+
+        constexpr uint8_t BYTE_2_HIGH[16] = {
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,  // 0_______
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,          // 1000____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,                           // 1001____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,                            // 101_____
+            TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+            TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT};                                             // 11______
+
+        // a lead byte this close to the end of a block continues in the next one
+        constexpr uint8_t INCOMPLETE_MAX[32] = {
+            255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+            255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 0xF0 - 1, 0xE0 - 1, 0xC0 - 1};
+
+        struct State
+        {
+            __m256i error;
+            __m256i previous;
+            __m256i incomplete;
+        };
+
+        __attribute__((target("avx2"))) inline void check_block(State& state, __m256i input)
+        {
+            // controls: C0 except tab, and DEL
+            const __m256i below_space = _mm256_cmpeq_epi8(_mm256_min_epu8(input, _mm256_set1_epi8(0x1F)), input);
+            const __m256i controls = _mm256_or_si256(
+                _mm256_andnot_si256(_mm256_cmpeq_epi8(input, _mm256_set1_epi8('\t')), below_space),
+                _mm256_cmpeq_epi8(input, _mm256_set1_epi8(0x7F)));
+            state.error = _mm256_or_si256(state.error, controls);
+
+            if (_mm256_movemask_epi8(input) == 0)
+            {
+                // ASCII only: the block is fine unless the previous one ended inside a character
+                state.error = _mm256_or_si256(state.error, state.incomplete);
+                state.incomplete = _mm256_setzero_si256();
+                state.previous = input;
+                return;
+            }
+
+            const __m256i prev1 = prev<1>(input, state.previous);
+            const __m256i special = _mm256_and_si256(
+                _mm256_and_si256(_mm256_shuffle_epi8(table(BYTE_1_HIGH), high_nibbles(prev1)),
+                                 _mm256_shuffle_epi8(table(BYTE_1_LOW), _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)))),
+                _mm256_shuffle_epi8(table(BYTE_2_HIGH), high_nibbles(input)));
+
+            // third and fourth bytes of 3 and 4 byte characters must be continuation bytes
+            const __m256i third = _mm256_subs_epu8(prev<2>(input, state.previous), _mm256_set1_epi8(0xE0 - 0x80));
+            const __m256i fourth = _mm256_subs_epu8(prev<3>(input, state.previous), _mm256_set1_epi8(0xF0 - 0x80));
+            const __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+            state.error = _mm256_or_si256(state.error, _mm256_xor_si256(must_continue, special));
+
+            // C1 controls: 0xC2 followed by 0x80..0x9F
+            const __m256i c1 = _mm256_and_si256(
+                _mm256_cmpeq_epi8(prev1, _mm256_set1_epi8(char(0xC2))),
+                _mm256_cmpeq_epi8(_mm256_min_epu8(input, _mm256_set1_epi8(char(0x9F))), input));
+            state.error = _mm256_or_si256(state.error, c1);
+
+            state.incomplete = _mm256_subs_epu8(input, load(INCOMPLETE_MAX));
+            state.previous = input;
+        }
+    }
+
+    __attribute__((target("avx2"))) bool is_clean_avx2(const uint8_t* data, std::size_t size)
+    {
+        avx2::State state{_mm256_setzero_si256(), _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+        std::size_t i = 0;
+        for (; i + 32 <= size; i += 32) avx2::check_block(state, avx2::load(data + i));
+
+        if (i != size && size >= 64)
+        {
+            // the last 32 bytes once more, behind the 32 before them, instead of a padded copy
+            const std::size_t last = size - 32;
+            state.previous = avx2::load(data + last - 32);
+            state.incomplete = _mm256_subs_epu8(state.previous, avx2::load(avx2::INCOMPLETE_MAX));
+            avx2::check_block(state, avx2::load(data + last));
+        }
+        else if (i != size)
+        {
+            // the rest padded with spaces; a character cut off by the end of the text fails against them
+            alignas(32) uint8_t tail[32];
+            std::memset(tail, ' ', sizeof(tail));
+            std::memcpy(tail, data + i, size - i);
+            avx2::check_block(state, _mm256_load_si256(reinterpret_cast<const __m256i*>(tail)));
+        }
+        // the text must not end inside a character
+        state.error = _mm256_or_si256(state.error, state.incomplete);
+
+        return _mm256_testz_si256(state.error, state.error) != 0;
+    }
+#endif
+
+    TextSanitizer::Kernel detect_kernel()
+    {
+        if (TextSanitizer::supported(TextSanitizer::Kernel::Avx2)) return TextSanitizer::Kernel::Avx2;
+        if (TextSanitizer::supported(TextSanitizer::Kernel::Sse2)) return TextSanitizer::Kernel::Sse2;
+        return TextSanitizer::Kernel::Scalar;
+    }
+}
+
+namespace Utils
+{
+    bool TextSanitizer::supported(Kernel kernel)
+    {
+        switch (kernel)
+        {
+        case Kernel::Scalar:
+            return true;
+        case Kernel::Sse2:
+#ifdef TEXT_SANITIZER_SSE2
+            return true;
+#else
+            return false;
+#endif
+        case Kernel::Avx2:
+#ifdef TEXT_SANITIZER_AVX2
+            return __builtin_cpu_supports("avx2");
+#else
+            return false;
+#endif
+        }
+        return false;
+    }
+
+    TextSanitizer::Kernel TextSanitizer::best_kernel()
+    {
+        static const Kernel kernel = detect_kernel();
+        return kernel;
+    }
+
+    bool TextSanitizer::is_clean(std::string_view text)
+    {
+        return is_clean(text, best_kernel());
+    }
+
+    bool TextSanitizer::is_clean(std::string_view text, Kernel kernel)
+    {
+        const auto* data = reinterpret_cast<const uint8_t*>(text.data());
+        switch (kernel)
+        {
+#ifdef TEXT_SANITIZER_AVX2
+        case Kernel::Avx2:
+            return is_clean_avx2(data, text.size());
+#endif
+#ifdef TEXT_SANITIZER_SSE2
+        case Kernel::Sse2:
+            return is_clean_sse2(data, text.size());
+#endif
+        default:
+            return is_clean_scalar(data, text.size());
+        }
+    }
+
+    std::size_t TextSanitizer::sanitize(char* data, std::size_t size)
+    {
+        if (is_clean({data, size})) return 0;
+
+        auto* bytes = reinterpret_cast<uint8_t*>(data);
+        std::size_t replaced = 0;
+        std::size_t i = 0;
+        while (i < size)
+        {
+            const std::size_t length = clean_length(bytes + i, size - i);
+            if (length != 0)
+            {
+                i += length;
+                continue;
+            }
+            // a C1 control is a valid two-byte character: both bytes go; otherwise only the byte that
+            // failed, and whatever follows it is checked again on its own
+            const std::size_t bad = bytes[i] == 0xC2 && i + 1 < size && bytes[i + 1] >= 0x80 && bytes[i + 1] <= 0x9F
+                                        ? 2 : 1;
+            std::memset(bytes + i, REPLACEMENT, bad);
+            replaced += bad;
+            i += bad;
+        }
+        return replaced;
+    }
+} // namespace Utils
@@ -0,0 +1,185 @@
+#include "MessageTypes/Utilities/ZeroCopySender.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/errqueue.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#if defined(SO_ZEROCOPY) && defined(MSG_ZEROCOPY) && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define CHAT_HAS_ZEROCOPY 1
+#endif
+#endif
+
+namespace
+{
+#ifdef CHAT_HAS_ZEROCOPY
+    // Waits for `events`; POLLERR (which includes a non-empty error queue) and POLLHUP always wake it.
+    // Returns the events that happened, 0 on timeout
+    short WaitFor(int fd, short events, int timeout_ms)
+    {
+        pollfd descriptor{fd, events, 0};
+        int ready;
+        do ready = ::poll(&descriptor, 1, timeout_ms);
+        while (ready < 0 && errno == EINTR);
+        return ready > 0 ? descriptor.revents : 0;
+    }
+#endif
+}
+
+void ZeroCopySender::Send(boost::asio::ip::tcp::socket& socket, const Frame& frame, boost::system::error_code& ec)
+{
+    ec.clear();
+    if (!frame) return;
+#ifdef CHAT_HAS_ZEROCOPY
+    if (options_.min_bytes > 0 && frame->size() >= options_.min_bytes && Enable(socket))
+    {
+        SendZeroCopy(socket, frame, ec);
+        ++stats_.zero_copy_frames;
+        return;
+    }
+#endif
+    boost::asio::write(socket, boost::asio::buffer(*frame), ec);
+    ++stats_.copied_frames;
+    if (!pinned_.empty()) Flush(socket, std::chrono::milliseconds::zero());
+}
+
+bool ZeroCopySender::Flush(boost::asio::ip::tcp::socket& socket, std::chrono::milliseconds timeout)
+{
+#ifdef CHAT_HAS_ZEROCOPY
+    const int fd = socket.native_handle();
+    const auto deadline = std::chrono::steady_clock::now() + timeout;
+    while (!pinned_.empty() && ReadCompletions(fd) && !pinned_.empty())
+    {
+        const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now());
+        if (left <= std::chrono::milliseconds::zero()) break;
+        // only a non-empty error queue is worth another round, a hung up socket reports nothing more
+        if (!(WaitFor(fd, 0, static_cast<int>(left.count())) & POLLERR)) break;
+    }
+#else
+    (void)socket;
+    (void)timeout;
+#endif
+    return pinned_.empty();
+}
+
+#ifdef CHAT_HAS_ZEROCOPY
+
+bool ZeroCopySender::Enable(boost::asio::ip::tcp::socket& socket)
+{
+    if (state_ == State::Unknown)
+    {
+        const int on = 1;
+        state_ = ::setsockopt(socket.native_handle(), SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) == 0
+                     ? State::On
+                     : State::Off;
+    }
+    return state_ == State::On;
+}
+
+void ZeroCopySender::SendZeroCopy(boost::asio::ip::tcp::socket& socket, const Frame& frame,
+                                  boost::system::error_code& ec)
+{
+    const int fd = socket.native_handle();
+    const char* data = frame->data();
+    std::size_t left = frame->size();
+    Pinned pinned{frame, next_id_, 0, 0};
+    while (left > 0)
+    {
+        // every send that takes bytes gets the next notification id, whatever it took
+        const ssize_t sent = ::send(fd, data, left, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        if (sent >= 0)
+        {
+            data += sent;
+            left -= static_cast<std::size_t>(sent);
+            ++next_id_;
+            ++pinned.sends;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            ReadCompletions(fd);
+            // the next send reports a hang up
+            const short ready = WaitFor(fd, POLLOUT, -1);
+            if (ready && !(ready & POLLNVAL)) continue;
+            ec = boost::asio::error::bad_descriptor;
+            break;
+        }
+        if (errno == ENOBUFS)
+        {
+            // the socket's option memory is full of unread notifications: the rest is copied
+            ReadCompletions(fd);
+            boost::asio::write(socket, boost::asio::buffer(data, left), ec);
+            break;
+        }
+        ec = boost::system::error_code(errno, boost::system::system_category());
+        break;
+    }
+    pinned.remaining = pinned.sends;
+    if (pinned.sends > 0) pinned_.push_back(std::move(pinned));
+    ReadCompletions(fd);
+}
+
+bool ZeroCopySender::ReadCompletions(int fd)
+{
+    for (;;)
+    {
+        char control[CMSG_SPACE(sizeof(sock_extended_err)) + CMSG_SPACE(sizeof(sockaddr_in6))];
+        msghdr message{};
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        if (::recvmsg(fd, &message, MSG_ERRQUEUE | MSG_DONTWAIT) < 0)
+        {
+            if (errno == EINTR) continue;
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        for (cmsghdr* header = CMSG_FIRSTHDR(&message); header; header = CMSG_NXTHDR(&message, header))
+        {
+            const bool recverr = (header->cmsg_level == SOL_IP && header->cmsg_type == IP_RECVERR) ||
+                                 (header->cmsg_level == SOL_IPV6 && header->cmsg_type == IPV6_RECVERR);
+            if (!recverr) continue;
+            sock_extended_err error;
+            std::memcpy(&error, CMSG_DATA(header), sizeof(error));
+            if (error.ee_origin != SO_EE_ORIGIN_ZEROCOPY || error.ee_errno != 0) continue;
+
+            // [ee_info, ee_data] is a range of sends; consecutive ones are reported together
+            const uint64_t first = Unwrap(error.ee_info);
+            const uint64_t last = Unwrap(error.ee_data);
+            if (last < first) continue;
+            stats_.completions += last - first + 1;
+            if (error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            {
+                stats_.copied_completions += last - first + 1;
+                if (!options_.stay_on_copied) state_ = State::Off;
+            }
+            Complete(first, last);
+        }
+    }
+}
+
+#endif
+
+void ZeroCopySender::Complete(uint64_t first, uint64_t last)
+{
+    for (Pinned& pinned : pinned_)
+    {
+        const uint64_t from = std::max(first, pinned.first);
+        const uint64_t to = std::min(last, pinned.first + pinned.sends - 1);
+        if (from <= to) pinned.remaining -= std::min(pinned.remaining, to - from + 1);
+    }
+    pinned_.erase(std::remove_if(pinned_.begin(), pinned_.end(), [](const Pinned& p) { return p.remaining == 0; }),
+                  pinned_.end());
+}
+
+uint64_t ZeroCopySender::Unwrap(uint32_t id) const
+{
+    // reported ids are below next_id_ and at most 2^32 behind it
+    uint64_t wide = (next_id_ & ~uint64_t{0xFFFFFFFF}) | id;
+    if (wide >= next_id_ && wide >= (uint64_t{1} << 32)) wide -= uint64_t{1} << 32;
+    return wide;
+}
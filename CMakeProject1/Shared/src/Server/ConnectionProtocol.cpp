@@ -0,0 +1,24 @@
+#include <Server/ConnectionProtocol.h>
+#include <MessageTypes/Hello/HelloMessage.h>
+#include <algorithm>
+
+void ConnectionProtocol::apply(const HelloMessage& local, const HelloMessage& peer)
+{
+    Codec chosen = Codec::Identity;
+    const auto& supported = local.get_codecs();
+    for (const Codec candidate : peer.get_codecs())
+    {
+        if (std::find(supported.begin(), supported.end(), candidate) != supported.end())
+        {
+            chosen = candidate;
+            break;
+        }
+    }
+
+    version.store(std::min(local.get_version(), peer.get_version()), std::memory_order_relaxed);
+    codec.store(chosen, std::memory_order_relaxed);
+    max_frame_bytes.store(local.get_max_frame_bytes(), std::memory_order_relaxed);
+    peer_max_frame_bytes.store(peer.get_max_frame_bytes(), std::memory_order_relaxed);
+    // published last: the receiver switches decoders on it
+    features.store(local.get_features() & peer.get_features(), std::memory_order_release);
+}
@@ -1,10 +1,14 @@
 #include <Server/MessageReceiver.h>
+#include <Server/HandlerMemory.hpp>
 #include <MessageTypes/Text/TextMessage.h>
 #include <MessageTypes/File/FileMessage.h>
+#include <algorithm>
 #include <cstring>
 #include <iostream>
+#include <memory>
+#include <vector>
 #include <MessageTypes/Utilities/HeaderHelper.hpp>
-#include <MessageTypes/Utilities/MessageFactory.h>
+#include <MessageTypes/Utilities/FrameHeader.hpp>
 
 #ifdef _DEBUG
 #define LOG(x) std::cout << "[DEBUG] " << x << std::endl
@@ -12,152 +16,505 @@
 #define LOG(x) ((void)0)
 #endif
 
-// --- helper for 64-bit endianness ---
-static uint64_t ntohll(const uint64_t value)
+namespace
 {
-    static constexpr int num = 1;
-    if (*reinterpret_cast<const char*>(&num) == 1)
+    constexpr std::size_t READ_BUFFER_BYTES = 4096;  // one read usually brings in several chat frames
+    constexpr std::size_t SPARE_READ_BUFFERS = 64;   // drained read buffers kept per thread
+    // A large body is read into its frame in steps of at most this much, so memory follows the bytes that
+    // actually arrived rather than the length a header announced
+    constexpr std::size_t BODY_READ_STEP = 64 * 1024;
+    using Utils::FrameHeader;
+
+    // Read buffers not held by any connection, per thread. A buffer taken on one io thread may come back
+    // on another; both keep it.
+    class ReadBufferPool
     {
-        // little endian → swap 32-bit halves
-        return (static_cast<uint64_t>(ntohl(static_cast<uint32_t>(value & 0xFFFFFFFFULL))) << 32) |
-               ntohl(static_cast<uint32_t>(value >> 32));
+    public:
+        static char* take()
+        {
+            ReadBufferPool* pool = local();
+            if (pool && !pool->spare_.empty())
+            {
+                char* buffer = pool->spare_.back();
+                pool->spare_.pop_back();
+                return buffer;
+            }
+            return new char[READ_BUFFER_BYTES];
+        }
+
+        static void give_back(char* buffer) noexcept
+        {
+            ReadBufferPool* pool = local();
+            if (pool && pool->spare_.size() < SPARE_READ_BUFFERS)
+            {
+                pool->spare_.push_back(buffer);
+                return;
+            }
+            delete[] buffer;
+        }
+
+    private:
+        ReadBufferPool() { spare_.reserve(SPARE_READ_BUFFERS); }
+        ~ReadBufferPool()
+        {
+            for (char* buffer : spare_) delete[] buffer;
+            exited() = true;
+        }
+
+        // set once the thread's pool is gone, for connections destroyed during thread exit
+        static bool& exited()
+        {
+            thread_local bool flag = false;
+            return flag;
+        }
+
+        static ReadBufferPool* local()
+        {
+            if (exited()) return nullptr;
+            thread_local ReadBufferPool pool;
+            return &pool;
+        }
+
+        std::vector<char*> spare_;
+    };
+}
+
+struct MessageReceiver::ReadState
+{
+    ReadState(std::shared_ptr<boost::asio::ip::tcp::socket> s, std::shared_ptr<const ConnectionProtocol> p,
+              uint64_t legacy_limit)
+        : socket(std::move(s)), protocol(std::move(p)), legacy_max_frame_bytes(legacy_limit) {}
+
+    enum class Next { NeedMore, Invalid, Frame };
+
+    /**
+     * @brief Takes the next frame out of the buffer, handed on with the legacy header whichever header was
+     *        on the wire; `missing` is the part of its body that still has to be read from the socket
+     *        (and appended to the frame, which only holds what was buffered)
+     **/
+    Next take_frame(std::shared_ptr<std::vector<char>>& frame, std::size_t& missing);
+    // Moves the unparsed bytes (an incomplete header at most) to the front, returns the free space after them
+    boost::asio::mutable_buffer free_space();
+    // Hands the buffer back once everything in it was parsed, so a quiet connection holds none
+    void release_if_drained();
+    /**
+     * @brief Reads what a readable socket has into the buffer, without blocking
+     * @return the bytes read; 0 without an error when the readiness was spurious
+     **/
+    std::size_t read_ready(boost::system::error_code& error);
+
+    struct GiveBack
+    {
+        void operator()(char* data) const noexcept { ReadBufferPool::give_back(data); }
+    };
+
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+    std::shared_ptr<const ConnectionProtocol> protocol;
+    const uint64_t legacy_max_frame_bytes;  // limit when the protocol has none
+    std::unique_ptr<char[], GiveBack> buffer;  // READ_BUFFER_BYTES, only while it holds unparsed bytes
+    std::size_t begin = 0;  // unparsed bytes are [begin, end)
+    std::size_t end = 0;
+};
+
+MessageReceiver::ReadState::Next MessageReceiver::ReadState::take_frame(std::shared_ptr<std::vector<char>>& frame,
+                                                                        std::size_t& missing)
+{
+    FrameHeader::Parsed header;
+    if (begin == end) return Next::NeedMore;
+    const auto result = FrameHeader::decode(buffer.get() + begin, end - begin, header);
+    if (result == FrameHeader::Result::NeedMore) return Next::NeedMore;
+
+    // The negotiated protocol picks the decoder: compact headers only once agreed, frames within the limit
+    uint64_t max_frame_bytes = protocol->max_frame_bytes.load(std::memory_order_relaxed);
+    if (max_frame_bytes == 0) max_frame_bytes = legacy_max_frame_bytes;
+    if (result == FrameHeader::Result::Invalid ||
+        (header.compact && !protocol->has(ConnectionProtocol::COMPACT_HEADERS)) ||
+        header.body_length > max_frame_bytes)
+    {
+        return Next::Invalid;
     }
-    return value; // already big-endian
+    begin += header.header_size;
+
+    const std::size_t buffered = static_cast<std::size_t>(std::min<uint64_t>(header.body_length, end - begin));
+    frame = std::make_shared<std::vector<char>>(FrameHeader::LEGACY_SIZE + buffered);
+    FrameHeader::encode_legacy(header.type, header.body_length, frame->data());
+    std::memcpy(frame->data() + FrameHeader::LEGACY_SIZE, buffer.get() + begin, buffered);
+    begin += buffered;
+    missing = static_cast<std::size_t>(header.body_length - buffered);
+    return Next::Frame;
+}
+
+boost::asio::mutable_buffer MessageReceiver::ReadState::free_space()
+{
+    if (!buffer) buffer.reset(ReadBufferPool::take());
+    // only an incomplete header (less than 12 bytes) is left
+    const std::size_t pending = end - begin;
+    std::memmove(buffer.get(), buffer.get() + begin, pending);
+    begin = 0;
+    end = pending;
+    return boost::asio::buffer(buffer.get() + pending, READ_BUFFER_BYTES - pending);
+}
+
+void MessageReceiver::ReadState::release_if_drained()
+{
+    if (begin != end) return;
+    buffer.reset();
+    begin = end = 0;
+}
+
+std::size_t MessageReceiver::ReadState::read_ready(boost::system::error_code& error)
+{
+    const std::size_t bytes = socket->read_some(free_space(), error);
+    if (error == boost::asio::error::would_block || error == boost::asio::error::try_again) error.clear();
+    end += bytes;
+    return bytes;
 }
 
 // ------------------------------------------------------------------
 
-void MessageReceiver::start_read_body(const std::shared_ptr<std::vector<char>>& header_buffer,
-                                      uint64_t body_length,
-                                      const std::shared_ptr<boost::asio::ip::tcp::socket>& socket)
+#ifdef CHAT_USE_COROUTINES
+
+boost::asio::awaitable<void> MessageReceiver::read_loop(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                                                        std::shared_ptr<const ConnectionProtocol> protocol)
 {
-    auto body_buffer = std::make_shared<std::vector<char>>(static_cast<size_t>(body_length));
+    using boost::asio::redirect_error;
+    using boost::asio::use_awaitable;
+
+    ReadState state(std::move(socket), std::move(protocol), legacy_max_frame_bytes_);
+    boost::asio::steady_timer pause_timer(state.socket->get_executor());
+    boost::system::error_code error;
+    for (;;)
+    {
+        std::shared_ptr<std::vector<char>> frame;
+        std::size_t missing = 0;
+        const auto next = state.take_frame(frame, missing);
+        if (next == ReadState::Next::Invalid)
+        {
+            close_after_error(*state.socket, boost::asio::error::invalid_argument);
+            co_return;
+        }
+        if (next == ReadState::Next::NeedMore)
+        {
+            // A drained connection waits for data without a buffer and takes one once there is something to read
+            state.release_if_drained();
+            if (state.buffer)
+                state.end += co_await state.socket->async_read_some(state.free_space(),
+                                                                    redirect_error(use_awaitable, error));
+            else
+            {
+                co_await state.socket->async_wait(boost::asio::ip::tcp::socket::wait_read,
+                                                  redirect_error(use_awaitable, error));
+                if (!error) state.read_ready(error);
+            }
+            if (error)
+            {
+                close_after_error(*state.socket, error);
+                co_return;
+            }
+            continue;
+        }
+
+        // The rest of a large body is read straight into the frame, which grows as the bytes arrive
+        state.release_if_drained();
+        while (missing > 0)
+        {
+            const std::size_t offset = frame->size();
+            frame->resize(offset + std::min(missing, BODY_READ_STEP));
+            const std::size_t bytes = co_await state.socket->async_read_some(
+                boost::asio::buffer(frame->data() + offset, frame->size() - offset),
+                redirect_error(use_awaitable, error));
+            if (error)
+            {
+                close_after_error(*state.socket, error);
+                co_return;
+            }
+            frame->resize(offset + bytes);
+            missing -= bytes;
+        }
+
+        // Large bodies are decoded off the io thread; the next frame is read once their handler returned
+        Received received;
+        if (offloaded(*frame))
+            received = co_await boost::asio::co_spawn(offload_, receive_offloaded(state.socket, frame), use_awaitable);
+        else
+            received = receive(*frame, state.socket);
+        if (received.admission.disconnect) co_return;
+
+        // Admission control: a sender over its budget is not read from (nor dispatched) until it is back in budget
+        if (received.admission.pause > std::chrono::steady_clock::duration::zero())
+        {
+            pause_timer.expires_after(received.admission.pause);
+            co_await pause_timer.async_wait(redirect_error(use_awaitable, error));
+            if (error) co_return;
+        }
+        deliver(state.socket, received);
+    }
+}
+
+boost::asio::awaitable<MessageReceiver::Received> MessageReceiver::receive_offloaded(
+    std::shared_ptr<boost::asio::ip::tcp::socket> socket, std::shared_ptr<std::vector<char>> frame)
+{
+    Received received = receive(*frame, socket);
+    if (!received.admission.disconnect && received.admission.pause <= std::chrono::steady_clock::duration::zero())
+    {
+        deliver(socket, received);
+        received.handler = nullptr;
+        received.message.reset();
+    }
+    co_return received;
+}
+
+#else
+
+void MessageReceiver::read_next(const std::shared_ptr<ReadState>& state)
+{
+    std::shared_ptr<std::vector<char>> frame;
+    std::size_t missing = 0;
+    switch (state->take_frame(frame, missing))
+    {
+    case ReadState::Next::NeedMore:
+        fill(state);
+        return;
+    case ReadState::Next::Invalid:
+        handle_read_message(nullptr, boost::asio::error::invalid_argument, state);
+        return;
+    case ReadState::Next::Frame:
+        break;
+    }
+    if (missing == 0)
+    {
+        complete_frame(state, frame);
+        return;
+    }
+    state->release_if_drained();
+    read_body(state, frame, missing);
+}
 
-    boost::asio::async_read(*socket, boost::asio::buffer(*body_buffer),
-        [header_buffer, body_buffer, this, socket](const boost::system::error_code& err, std::size_t bytes_transferred)
+void MessageReceiver::read_body(const std::shared_ptr<ReadState>& state,
+                                const std::shared_ptr<std::vector<char>>& frame, std::size_t missing)
+{
+    // The rest of a large body is read straight into the frame, which grows as the bytes arrive
+    const std::size_t offset = frame->size();
+    frame->resize(offset + std::min(missing, BODY_READ_STEP));
+    state->socket->async_read_some(
+        boost::asio::buffer(frame->data() + offset, frame->size() - offset),
+        Utils::recycled([this, state, frame, offset, missing](const boost::system::error_code& err, std::size_t bytes)
         {
             if (err)
             {
-                handle_read_message(body_buffer, err, bytes_transferred, socket);
+                handle_read_message(frame, err, state);
                 return;
             }
+            frame->resize(offset + bytes);
+            if (bytes < missing) read_body(state, frame, missing - bytes);
+            else complete_frame(state, frame);
+        }));
+}
 
-            auto fulldata = std::make_shared<std::vector<char>>(*header_buffer);
-            fulldata->insert(fulldata->end(), body_buffer->begin(),
-                             body_buffer->begin() + bytes_transferred);
+void MessageReceiver::fill(const std::shared_ptr<ReadState>& state)
+{
+    // A drained connection waits for data without a buffer and takes one once there is something to read
+    state->release_if_drained();
+    if (!state->buffer)
+    {
+        state->socket->async_wait(boost::asio::ip::tcp::socket::wait_read,
+            Utils::recycled([this, state](boost::system::error_code err)
+            {
+                if (!err) state->read_ready(err);
+                if (err)
+                {
+                    handle_read_message(nullptr, err, state);
+                    return;
+                }
+                read_next(state);
+            }));
+        return;
+    }
 
-            handle_read_message(fulldata, boost::system::error_code(), fulldata->size(), socket);
-        });
+    state->socket->async_read_some(state->free_space(),
+        Utils::recycled([this, state](const boost::system::error_code& err, std::size_t bytes_transferred)
+        {
+            if (err)
+            {
+                handle_read_message(nullptr, err, state);
+                return;
+            }
+            state->end += bytes_transferred;
+            read_next(state);
+        }));
+}
+
+void MessageReceiver::complete_frame(const std::shared_ptr<ReadState>& state,
+                                     const std::shared_ptr<std::vector<char>>& frame)
+{
+    // Large bodies are decoded off the io thread
+    if (offloaded(*frame))
+    {
+        boost::asio::post(offload_, Utils::recycled([this, state, frame]()
+        {
+            handle_read_message(frame, boost::system::error_code(), state);
+        }));
+        return;
+    }
+    handle_read_message(frame, boost::system::error_code(), state);
 }
 
 void MessageReceiver::handle_read_message(
     const std::shared_ptr<std::vector<char>>& buffer,
     const boost::system::error_code& error,
-    std::size_t bytes_transferred,
-    const std::shared_ptr<boost::asio::ip::tcp::socket>& socket
+    const std::shared_ptr<ReadState>& state
     )
 {
     if (error) {
-        if (error == boost::asio::error::eof) {
-            std::cout << "Client closed the connection.\n";
-            return;
-        }
-        if (error == boost::asio::error::operation_aborted)
-        {
-            std::cout << "connection canceled.\n" << std::endl;
-            return;
-        }
-        if (error) {
-            std::cerr << "Read error: " << error.message() << std::endl;
-            return;
-        }
+        close_after_error(*state->socket, error);
+        return;
+    }
+
+    Received received = receive(*buffer, state->socket);
+    if (received.admission.disconnect) return;
 
-        if (socket->is_open())
+    // Admission control: a sender over its budget is not read from (nor dispatched) until it is back in budget
+    if (received.admission.pause > std::chrono::steady_clock::duration::zero()) {
+        auto timer = std::make_shared<boost::asio::steady_timer>(state->socket->get_executor(), received.admission.pause);
+        timer->async_wait(Utils::recycled([this, timer, state, received = std::move(received)](const boost::system::error_code& ec)
         {
-            boost::system::error_code ec;
-            socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
-            socket->close(ec);
-            if (ec)
-            {
-                std::cerr << ec.what() << std::endl;
-            }
-        }
+            if (ec) return;
+            deliver(state->socket, received);
+            read_next(state);
+        }));
         return;
     }
+    deliver(state->socket, received);
+    read_next(state);
+}
 
-    try {
-        uint32_t id;
-        Utils::HeaderHelper::read_u32(*buffer, 0, id);
+#endif
 
-        // Create the correct message type
-        auto type = static_cast<TextTypes>(id);
-        std::unique_ptr<IMessage> message = MessageFactory::create_from_id(type);
+bool MessageReceiver::offloaded(const std::vector<char>& frame) const
+{
+    return offload_ && frame.size() - FrameHeader::LEGACY_SIZE >= offload_min_body_bytes_;
+}
 
-        // Use only the bytes actually received
-        const std::vector<char> data(buffer->begin(), buffer->begin() + bytes_transferred);
+MessageReceiver::Received MessageReceiver::receive(const std::vector<char>& frame,
+                                                   const std::shared_ptr<boost::asio::ip::tcp::socket>& socket) const
+{
+    Received received;
+    received.handler = decode(frame, received.message);
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(frame, 0, id);
 
-        // Deserialize
-        message->deserialize(data);
+    if (admission_) received.admission = admission_(socket, static_cast<TextTypes>(id), frame.size());
+    if (received.admission.disconnect) {
+        boost::system::error_code ec;
+        socket->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        socket->close(ec);
+    }
+    return received;
+}
 
-        // Look up and invoke the registered handler for this message type
-        auto it = handlers_.find(type);
-        if (it != handlers_.end() && it->second) {
-            // Convert unique_ptr to shared_ptr for the callback
-            std::shared_ptr<IMessage> msg_shared(message.release());
-            it->second(socket, msg_shared);
-        } else {
-            #ifdef _DEBUG
-            std::cerr << "No handler registered for message type: " << id << std::endl;
-            #endif
-        }
+void MessageReceiver::deliver(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket, const Received& received)
+{
+    if (!received.handler) return;
+    try { (*received.handler)(socket, received.message); }
+    catch (const std::exception& e) { std::cerr << "Handler error: " << e.what() << std::endl; }
+}
 
+void MessageReceiver::close_after_error(boost::asio::ip::tcp::socket& socket, const boost::system::error_code& error)
+{
+    if (error == boost::asio::error::operation_aborted)
+    {
+        std::cout << "connection canceled.\n" << std::endl;
+        return;
     }
-    catch (const std::exception& e) {
-        std::cerr << "Deserialization error: " << e.what() << std::endl;
+    if (error == boost::asio::error::eof) {
+        std::cout << "Client closed the connection.\n";
+    }
+    else {
+        std::cerr << "Read error: " << error.message() << std::endl;
     }
 
-    this->start_read_header(socket);
+    // Close our end too, so the connection is seen as gone and gets pruned
+    if (socket.is_open())
+    {
+        boost::system::error_code ec;
+        socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        socket.close(ec);
+        if (ec)
+        {
+            std::cerr << ec.message() << std::endl;
+        }
+    }
 }
 
 
-void MessageReceiver::start_read_header(std::shared_ptr<boost::asio::ip::tcp::socket> socket)
+const MessageReceiver::MessageCallback* MessageReceiver::decode(const std::vector<char>& frame,
+                                                                std::shared_ptr<IMessage>& message) const
 {
-    // TODO potential spam and memory overflow (we dont limit message size) (TODO also in FileMessage.cpp)
-    constexpr size_t header_size = sizeof(uint32_t) + sizeof(uint64_t);
-    auto header_buffer = std::make_shared<std::vector<char>>(header_size);
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(frame, 0, id);
+    const auto entry = Utils::MessageRegistry::lookup(id);
+    if (!entry.decode)
+    {
+        std::cerr << "Deserialization error: Unknown message type ID: " << id << std::endl;
+        return nullptr;
+    }
+    // frames nobody handles are not decoded at all
+    const MessageCallback& handler = handlers_[id];
+    if (!handler)
+    {
+        #ifdef _DEBUG
+        std::cerr << "No handler registered for message type: " << id << std::endl;
+        #endif
+        return nullptr;
+    }
 
-    boost::asio::async_read(*socket, boost::asio::buffer(*header_buffer),
-        [header_buffer, this, socket](const boost::system::error_code& err, std::size_t bytes_transferred)
-        {
-            if (err) {
-                handle_read_message(header_buffer, err, bytes_transferred, socket);
-                return;
-            }
+    try
+    {
+        message = entry.decode(frame);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Deserialization error: " << e.what() << std::endl;
+        return nullptr;
+    }
+    return &handler;
+}
 
-            if (bytes_transferred < header_size) {
-                boost::system::error_code ec = boost::asio::error::operation_aborted;
-                handle_read_message(header_buffer, ec, bytes_transferred, socket);
-                return;
-            }
+bool MessageReceiver::dispatch(const std::shared_ptr<boost::asio::ip::tcp::socket>& sender,
+                               const std::vector<char>& frame) const
+{
+    std::shared_ptr<IMessage> message;
+    const MessageCallback* handler = decode(frame, message);
+    if (!handler) return false;
+    (*handler)(sender, std::move(message));
+    return true;
+}
 
-            uint32_t id;
-            uint64_t body_length;
-            std::memcpy(&id, header_buffer->data(), sizeof(uint32_t));
-            id = ntohl(id);
-            std::memcpy(&body_length, header_buffer->data() + sizeof(uint32_t), sizeof(uint64_t));
-            body_length = ntohll(body_length);   // 64-bit conversion
+void MessageReceiver::start_read_header(std::shared_ptr<boost::asio::ip::tcp::socket> socket,
+                                        std::shared_ptr<const ConnectionProtocol> protocol)
+{
+    // a connection without a negotiated protocol stays on legacy, with the legacy frame limit
+    if (!protocol) protocol = std::make_shared<const ConnectionProtocol>();
+#ifdef CHAT_USE_COROUTINES
+    auto executor = socket->get_executor();
+    boost::asio::co_spawn(executor, read_loop(std::move(socket), std::move(protocol)), boost::asio::detached);
+#else
+    read_next(std::make_shared<ReadState>(std::move(socket), std::move(protocol), legacy_max_frame_bytes_));
+#endif
+}
 
-            if (body_length != 0) {
-                start_read_body(header_buffer, body_length, socket);
-                return;
-            }
+void MessageReceiver::set_admission(AdmissionCallback callback)
+{
+    admission_ = std::move(callback);
+}
 
-            handle_read_message(header_buffer, boost::system::error_code(),
-                                header_buffer->size(), socket);
-        });
+void MessageReceiver::set_legacy_max_frame_bytes(uint64_t bytes)
+{
+    legacy_max_frame_bytes_ = bytes;
 }
 
-void MessageReceiver::register_handler(TextTypes type, MessageCallback callback)
+void MessageReceiver::set_offload(boost::asio::any_io_executor executor, std::size_t min_body_bytes)
 {
-    handlers_[type] = std::move(callback);
+    offload_ = std::move(executor);
+    offload_min_body_bytes_ = min_body_bytes;
 }
@@ -1,4 +1,5 @@
 #include <Server/MessageSender.h>
+#include <Server/HandlerMemory.hpp>
 #include <boost/asio.hpp>
 #include <MessageTypes/Interface/IMessage.hpp>
 #include <MessageTypes/Text/TextMessage.h>
@@ -17,11 +18,38 @@ void SendMessage(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket,
     if (error) {std::cerr << "Accept failed: " << error.message() << "\n"; return;}
     auto data = std::make_shared<std::vector<char>>(message->serialize());
     boost::asio::async_write(*socket, boost::asio::buffer(*data),
-                             [socket](const boost::system::error_code& ec, std::size_t /*bytes*/)
+                             Utils::recycled([socket, data](const boost::system::error_code& ec, std::size_t /*bytes*/)
                              {
                                  if (ec) std::cerr << "Error sending: " << ec.message() << "\n";
                                  LOG("Sent message to target.\n");
                                  LOG("Target ip: " + socket->remote_endpoint().address().to_string());
                                  LOG("Target port: " + socket->remote_endpoint().port());
-                             });
+                             }));
+}
+
+void SendFrames(const std::shared_ptr<boost::asio::ip::tcp::socket>& socket,
+                std::vector<std::shared_ptr<const std::vector<char>>> frames)
+{
+    if (!socket || frames.empty()) return;
+
+    // the frames and their buffers live together until the write completes
+    struct Gather
+    {
+        std::vector<std::shared_ptr<const std::vector<char>>> frames;
+        std::vector<boost::asio::const_buffer> buffers;
+    };
+    auto owned = std::make_shared<Gather>();
+    owned->frames = std::move(frames);
+    owned->buffers.reserve(owned->frames.size());
+    for (const auto& frame : owned->frames)
+    {
+        if (frame && !frame->empty()) owned->buffers.emplace_back(frame->data(), frame->size());
+    }
+
+    boost::asio::async_write(*socket, Utils::BufferView(owned->buffers),
+                             Utils::recycled([socket, owned](const boost::system::error_code& ec, std::size_t /*bytes*/)
+                             {
+                                 if (ec) std::cerr << "Error sending frames: " << ec.message() << "\n";
+                                 LOG("Sent " << owned->frames.size() << " frames to target.\n");
+                             }));
 }
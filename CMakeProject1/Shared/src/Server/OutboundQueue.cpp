@@ -0,0 +1,426 @@
+#include <Server/OutboundQueue.h>
+#include <Server/HandlerMemory.hpp>
+#include <MessageTypes/FileChunk/FileChunkMessage.h>
+#include <MessageTypes/Utilities/FrameHeader.hpp>
+#include <algorithm>
+#include <iostream>
+#include <netinet/tcp.h>
+
+namespace
+{
+    constexpr std::size_t MAX_FRAMES_PER_WRITE = 64;  // frames gathered into one async_write
+    constexpr std::size_t BULK_CHUNK_BYTES = 64 * 1024; // longest wait a file imposes on chat
+    // unsent bytes the kernel may hold once a socket carries bulk, so chat is not queued behind megabytes
+    constexpr int BULK_UNSENT_LOWAT = static_cast<int>(2 * BULK_CHUNK_BYTES);
+}
+
+OutboundQueue::Stats OutboundQueue::Metrics::Load() const
+{
+    Stats s;
+    s.high_water_hits = high_water_hits.load(std::memory_order_relaxed);
+    s.dropped_oldest = dropped_oldest.load(std::memory_order_relaxed);
+    s.dropped_new = dropped_new.load(std::memory_order_relaxed);
+    s.disconnects = disconnects.load(std::memory_order_relaxed);
+    return s;
+}
+
+OutboundQueue::OutboundQueue(std::shared_ptr<boost::asio::ip::tcp::socket> socket, Limits limits,
+                             std::shared_ptr<Metrics> metrics)
+    : socket_(std::move(socket)),
+      limits_(limits),
+      metrics_(metrics ? std::move(metrics) : std::make_shared<Metrics>())
+{
+}
+
+void OutboundQueue::Send(Frame frame, Priority priority)
+{
+    if (!frame || frame->empty()) return;
+    std::scoped_lock lock(mutex_);
+    if (closed_ || !MakeRoomLocked(frame->size(), 1, priority)) return;
+
+    queued_bytes_ += frame->size();
+    queue_.push_back({std::move(frame), priority, compact_});
+    StartWriteLocked();
+}
+
+void OutboundQueue::Send(std::vector<Frame> frames, Priority priority)
+{
+    std::size_t bytes = 0;
+    std::size_t count = 0;
+    for (const auto& frame : frames)
+    {
+        if (!frame || frame->empty()) continue;
+        bytes += frame->size();
+        ++count;
+    }
+    if (count == 0) return;
+
+    std::scoped_lock lock(mutex_);
+    if (closed_ || !MakeRoomLocked(bytes, count, priority)) return;
+
+    for (auto& frame : frames)
+    {
+        if (!frame || frame->empty()) continue;
+        queue_.push_back({std::move(frame), priority, compact_});
+    }
+    queued_bytes_ += bytes;
+    StartWriteLocked();
+}
+
+void OutboundQueue::SendBulk(Frame frame, BulkDone on_done)
+{
+    if (!frame || frame->empty()) return;
+    {
+        std::scoped_lock lock(mutex_);
+        if (!closed_)
+        {
+#ifdef TCP_NOTSENT_LOWAT
+            if (!bulk_lowat_set_)
+            {
+                boost::system::error_code ec;
+                socket_->set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(
+                    BULK_UNSENT_LOWAT), ec);
+                bulk_lowat_set_ = true;
+            }
+#endif
+            bulk_bytes_ += frame->size();
+            bulk_.push_back({std::move(frame), 0, next_channel_++, std::move(on_done)});
+            StartWriteLocked();
+            return;
+        }
+    }
+    if (on_done) on_done(boost::asio::error::operation_aborted);
+}
+
+void OutboundQueue::SetCompactHeaders(bool compact)
+{
+    std::scoped_lock lock(mutex_);
+    compact_ = compact;
+}
+
+bool OutboundQueue::UsesCompactHeaders() const
+{
+    std::scoped_lock lock(mutex_);
+    return compact_;
+}
+
+std::size_t OutboundQueue::GetBulkBytes() const
+{
+    std::scoped_lock lock(mutex_);
+    return bulk_bytes_;
+}
+
+std::size_t OutboundQueue::GetQueuedBytes() const
+{
+    std::scoped_lock lock(mutex_);
+    return queued_bytes_ + in_flight_bytes_;
+}
+
+std::size_t OutboundQueue::GetQueuedFrames() const
+{
+    std::scoped_lock lock(mutex_);
+    return queue_.size() + in_flight_frames_;
+}
+
+uint64_t OutboundQueue::GetWriteCount() const
+{
+    std::scoped_lock lock(mutex_);
+    return writes_;
+}
+
+uint64_t OutboundQueue::GetFramesWritten() const
+{
+    std::scoped_lock lock(mutex_);
+    return frames_written_;
+}
+
+bool OutboundQueue::IsClosed() const
+{
+    std::scoped_lock lock(mutex_);
+    return closed_;
+}
+
+bool OutboundQueue::OverLimitsLocked(std::size_t extra_bytes, std::size_t extra_frames, std::size_t factor) const
+{
+    return queued_bytes_ + in_flight_bytes_ + extra_bytes > factor * limits_.max_bytes ||
+           queue_.size() + in_flight_frames_ + extra_frames > factor * limits_.max_frames;
+}
+
+bool OutboundQueue::MakeRoomLocked(std::size_t bytes, std::size_t frames, Priority priority)
+{
+    if (!OverLimitsLocked(bytes, frames, 1)) return true;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (!over_mark_)
+    {
+        over_mark_ = true;
+        over_since_ = now;
+        metrics_->high_water_hits.fetch_add(1, std::memory_order_relaxed);
+        if (limits_.policy == Policy::Disconnect) ArmGraceTimerLocked();
+    }
+
+    if (priority == Priority::Chat)
+    {
+        switch (limits_.policy)
+        {
+        case Policy::DropOldest:
+            // the frames being written are owned by the write; only waiting chat frames can go
+            for (auto it = queue_.begin(); it != queue_.end() && OverLimitsLocked(bytes, frames, 1);)
+            {
+                if (it->priority != Priority::Chat) { ++it; continue; }
+                queued_bytes_ -= it->frame->size();
+                it = queue_.erase(it);
+                metrics_->dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!OverLimitsLocked(bytes, frames, 1)) return true;
+            break;
+        case Policy::Disconnect:
+            if (now - over_since_ >= limits_.grace)
+            {
+                DisconnectLocked();
+                return false;
+            }
+            break;
+        case Policy::DropNew:
+            break;
+        }
+        metrics_->dropped_new.fetch_add(frames, std::memory_order_relaxed);
+        return false;
+    }
+
+    // Control frames are always queued, up to the hard limit
+    if (OverLimitsLocked(bytes, frames, 2))
+    {
+        DisconnectLocked();
+        return false;
+    }
+    return true;
+}
+
+void OutboundQueue::StartWriteLocked()
+{
+    if (writing_ || closed_ || (queue_.empty() && bulk_.empty())) return;
+    writing_ = true;
+    PrepareWriteLocked();
+#ifdef CHAT_USE_COROUTINES
+    // The writer ends once the queue ran empty rather than waiting for more, as a waiting coroutine
+    // would keep its io_context from running out of work
+    boost::asio::co_spawn(socket_->get_executor(), WriteLoop(shared_from_this()), boost::asio::detached);
+#else
+    boost::asio::async_write(*socket_, Utils::BufferView(write_buffers_),
+                             Utils::recycled([self = shared_from_this()](const boost::system::error_code& ec, std::size_t)
+                             {
+                                 self->OnWritten(ec);
+                             }));
+#endif
+}
+
+#ifdef CHAT_USE_COROUTINES
+
+boost::asio::awaitable<void> OutboundQueue::WriteLoop(std::shared_ptr<OutboundQueue> /*self*/)
+{
+    // the frame keeps the queue alive (`self`) until the queue ran empty
+    for (;;)
+    {
+        boost::system::error_code ec;
+        co_await boost::asio::async_write(*socket_, Utils::BufferView(write_buffers_),
+                                          boost::asio::redirect_error(boost::asio::use_awaitable, ec));
+
+        std::vector<std::pair<BulkDone, boost::system::error_code>> finished;
+        bool more = false;
+        {
+            std::scoped_lock lock(mutex_);
+            FinishWriteLocked(ec, finished);
+            more = !closed_ && !(queue_.empty() && bulk_.empty());
+            if (more)
+                PrepareWriteLocked();
+            else
+                writing_ = false;
+        }
+        for (auto& [on_done, result] : finished)
+        {
+            if (on_done) on_done(result);
+        }
+        if (!more) co_return;
+    }
+}
+
+#else
+
+void OutboundQueue::OnWritten(const boost::system::error_code& ec)
+{
+    std::vector<std::pair<BulkDone, boost::system::error_code>> finished;
+    {
+        std::scoped_lock lock(mutex_);
+        writing_ = false;
+        FinishWriteLocked(ec, finished);
+        StartWriteLocked();
+    }
+
+    for (auto& [on_done, result] : finished)
+    {
+        if (on_done) on_done(result);
+    }
+}
+
+#endif
+
+void OutboundQueue::PrepareWriteLocked()
+{
+    ++writes_;
+    if (queue_.empty())
+    {
+        PrepareChunkLocked();
+        return;
+    }
+
+    const std::size_t count = std::min(queue_.size(), MAX_FRAMES_PER_WRITE);
+    write_batch_.reserve(count);
+    write_buffers_.reserve(count * 2);
+    // each frame was queued before or after the switch to compact headers, so room is kept for all of them
+    compact_headers_.resize(count * Utils::FrameHeader::COMPACT_MAX_SIZE);
+    std::size_t bytes = 0;
+    while (write_batch_.size() < count)
+    {
+        auto& frame = queue_.front().frame;
+        bytes += frame->size();
+        AppendFrame(*frame, queue_.front().compact,
+                    compact_headers_.data() + write_batch_.size() * Utils::FrameHeader::COMPACT_MAX_SIZE,
+                    write_buffers_);
+        write_batch_.push_back(std::move(frame));
+        queue_.pop_front();
+    }
+    queued_bytes_ -= bytes;
+    in_flight_bytes_ = bytes;
+    in_flight_frames_ = write_batch_.size();
+    frames_written_ += write_batch_.size();
+}
+
+void OutboundQueue::AppendFrame(const std::vector<char>& frame, bool compact, char* header,
+                                std::vector<boost::asio::const_buffer>& buffers)
+{
+    using Utils::FrameHeader;
+    uint32_t type = 0;
+    std::size_t header_size = 0;
+    if (compact && frame.size() >= FrameHeader::LEGACY_SIZE)
+    {
+        Utils::HeaderHelper::read_u32(frame, 0, type);
+        header_size = FrameHeader::encode_compact(type, frame.size() - FrameHeader::LEGACY_SIZE, header);
+    }
+    if (header_size == 0)
+    {
+        buffers.emplace_back(frame.data(), frame.size());
+        return;
+    }
+    buffers.emplace_back(header, header_size);
+    buffers.emplace_back(frame.data() + FrameHeader::LEGACY_SIZE, frame.size() - FrameHeader::LEGACY_SIZE);
+}
+
+void OutboundQueue::PrepareChunkLocked()
+{
+    // Only reached with no chat or control frame waiting: one chunk, then the queue is looked at again
+    const BulkEntry& entry = bulk_.front();
+    const std::size_t length = std::min(BULK_CHUNK_BYTES, entry.frame->size() - entry.offset);
+    const bool last = entry.offset + length == entry.frame->size();
+    auto header = std::make_shared<const std::vector<char>>(FileChunkMessage::encode_header(entry.channel, last, length));
+    if (compact_)
+    {
+        // the chunk's body is the rest of its header plus the slice
+        using Utils::FrameHeader;
+        compact_headers_.resize(FrameHeader::COMPACT_MAX_SIZE);
+        const std::size_t header_size = FrameHeader::encode_compact(
+            static_cast<uint32_t>(TextTypes::FileChunk), header->size() - FrameHeader::LEGACY_SIZE + length,
+            compact_headers_.data());
+        write_buffers_.emplace_back(compact_headers_.data(), header_size);
+        write_buffers_.emplace_back(header->data() + FrameHeader::LEGACY_SIZE, header->size() - FrameHeader::LEGACY_SIZE);
+    }
+    else
+    {
+        write_buffers_.emplace_back(header->data(), header->size());
+    }
+    write_buffers_.emplace_back(entry.frame->data() + entry.offset, length);
+    in_flight_chunk_ = length;
+    ++frames_written_;
+
+    // the write keeps the chunk header and the file alive
+    write_batch_.push_back(std::move(header));
+    write_batch_.push_back(entry.frame);
+}
+
+void OutboundQueue::FinishWriteLocked(const boost::system::error_code& ec,
+                                      std::vector<std::pair<BulkDone, boost::system::error_code>>& finished)
+{
+    write_batch_.clear();
+    write_buffers_.clear();
+    in_flight_bytes_ = 0;
+    in_flight_frames_ = 0;
+    if (in_flight_chunk_ > 0 && !ec)
+    {
+        auto& entry = bulk_.front();
+        entry.offset += in_flight_chunk_;
+        bulk_bytes_ -= in_flight_chunk_;
+        if (entry.offset == entry.frame->size())
+        {
+            finished.emplace_back(std::move(entry.on_done), boost::system::error_code());
+            bulk_.pop_front();
+        }
+    }
+    in_flight_chunk_ = 0;
+
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted && !closed_)
+            std::cerr << "Error sending frames: " << ec.message() << "\n";
+        closed_ = true;
+        queue_.clear();
+        queued_bytes_ = 0;
+    }
+
+    if (closed_)
+    {
+        if (grace_timer_) grace_timer_->cancel();
+        // files that will never be completed are reported as failed
+        for (auto& entry : bulk_)
+            finished.emplace_back(std::move(entry.on_done), ec ? ec : boost::asio::error::operation_aborted);
+        bulk_.clear();
+        bulk_bytes_ = 0;
+    }
+    else if (over_mark_ && !OverLimitsLocked(0, 0, 1))
+    {
+        over_mark_ = false;
+        if (grace_timer_) grace_timer_->cancel();
+    }
+}
+
+void OutboundQueue::ArmGraceTimerLocked()
+{
+    if (!grace_timer_) grace_timer_.emplace(socket_->get_executor());
+    grace_timer_->expires_after(limits_.grace);
+    grace_timer_->async_wait(Utils::recycled([weak = weak_from_this()](const boost::system::error_code& ec)
+    {
+        if (ec) return;
+        if (auto self = weak.lock()) self->OnGraceExpired();
+    }));
+}
+
+void OutboundQueue::OnGraceExpired()
+{
+    std::scoped_lock lock(mutex_);
+    // a wait cancelled just after it completed still runs: the mark may have cleared and been hit again since
+    if (closed_ || !over_mark_ || std::chrono::steady_clock::now() - over_since_ < limits_.grace) return;
+    DisconnectLocked();
+}
+
+void OutboundQueue::DisconnectLocked()
+{
+    if (closed_) return;
+    closed_ = true;
+    queue_.clear();
+    queued_bytes_ = 0;
+    metrics_->disconnects.fetch_add(1, std::memory_order_relaxed);
+    if (grace_timer_) grace_timer_->cancel();
+
+    // Shutting down wakes the pending read with EOF; the receiver then closes the socket
+    boost::system::error_code ec;
+    socket_->shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
@@ -3,6 +3,12 @@
 class TestableServerManager : public ServerManager {
 public:
     using ServerManager::Broadcast;
+    using ServerManager::GetOrCreateRoom;
     using ServerManager::ServerManager;
 
-};
\ No newline at end of file
+    // Runs everything posted to the room strands (the server itself is not started)
+    void RunPending() { io_context.restart(); io_context.run(); }
+
+    // Port the chat acceptor is bound to once the server is up (constructed with port 0: chosen by the OS)
+    unsigned short TextPort() const { return acceptor_ ? acceptor_->local_endpoint().port() : 0; }
+};
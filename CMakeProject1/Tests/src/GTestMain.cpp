@@ -5,11 +5,39 @@
 #include <fstream>
 #include <algorithm>
 #include <random>
+#include <map>
+#include <mutex>
+#include <csignal>
+#include <sys/resource.h>
 
 #include "MessageTypes/Text/TextMessage.h"
 #include "MessageTypes/File/FileMessage.h"
 #include "MessageTypes/Utilities/MessageFactory.h"
+#include "MessageTypes/Utilities/MessageRegistry.hpp"
 #include "MessageTypes/Utilities/FileTransferQueue.h"
+#include "Server/MessageHistory.h"
+#include "Server/HistoryLog.h"
+#include "MessageTypes/SendHistory/SendHistoryMessage.h"
+#include "MessageTypes/HistorySync/HistorySyncMessage.h"
+#include "MessageTypes/Utilities/HeaderHelper.hpp"
+#include "MessageTypes/HistoryQuery/HistoryQueryMessage.h"
+#include "MessageTypes/Room/RoomMessage.h"
+#include "MessageTypes/Heartbeat/HeartbeatMessage.h"
+#include "MessageTypes/FileChunk/FileChunkMessage.h"
+#include "MessageTypes/Utilities/ChunkAssembler.h"
+#include "MessageTypes/Utilities/FrameHeader.hpp"
+#include "MessageTypes/Utilities/TextSanitizer.h"
+#include "MessageTypes/Utilities/ZeroCopySender.h"
+#include "MessageTypes/Hello/HelloMessage.h"
+#include "MessageTypes/TextBatch/TextBatchMessage.h"
+#include "Server/MessageReceiver.h"
+#include "Server/FanOut.h"
+#include "Server/OutboundQueue.h"
+#include "Server/RateLimiter.h"
+#include "Server/Room.h"
+#include "Server/SessionSlab.h"
+#include "Server/TimerWheel.h"
+#include "ServerManagerTest.h"
 
 // =====================================================================
 // HELPER: Scoped temp file for testing
@@ -359,6 +387,35 @@ TEST_F(FileTransferQueueTest, RetryFailedFile) {
     EXPECT_GT(snapshot2[0].retries, 0u);
 }
 
+TEST(FileTransferQueueIdleTest, FinishedItemsAreCappedAndLeaveTheWorkerIdle) {
+    std::atomic<int> written{0};
+    FileTransferQueue queue([] { return nullptr; },
+                            [&](std::vector<char>, boost::system::error_code&) { ++written; });
+    for (int i = 0; i < 40; ++i)
+        queue.enqueue(std::make_shared<const std::vector<char>>(100, 'x'));
+    for (int i = 0; i < 500 && written < 40; ++i) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(written, 40);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    auto snapshot = queue.list_snapshot();
+    EXPECT_EQ(snapshot.size(), 32u);
+    for (const auto& item : snapshot) {
+        EXPECT_EQ(item.state, FileTransferQueue::State::Done);
+        EXPECT_EQ(item.frame, nullptr);
+    }
+
+    // with nothing Queued the worker sleeps instead of spinning over the finished items
+    auto cpu_time = [] {
+        rusage usage{};
+        getrusage(RUSAGE_SELF, &usage);
+        return std::chrono::seconds(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+               std::chrono::microseconds(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+    };
+    const auto before = cpu_time();
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    EXPECT_LT(cpu_time() - before, std::chrono::milliseconds(100));
+}
+
 // =====================================================================
 // TEST SUITE 4: File I/O Logic
 // =====================================================================
@@ -461,6 +518,39 @@ TEST_F(MessageProtocolTest, FileMessageHasCorrectHeader) {
     EXPECT_EQ(id, static_cast<uint32_t>(TextTypes::File));
 }
 
+// the header codec works in constant expressions
+static_assert([] {
+    char header[Utils::HeaderHelper::HEADER_SIZE]{};
+    Utils::HeaderHelper::write_header(header, {0x01020304u, 0x05060708090A0B0Cull});
+    const auto parsed = Utils::HeaderHelper::read_header(header);
+    return header[0] == 0x01 && header[11] == 0x0C && parsed.type == 0x01020304u &&
+           parsed.body_length == 0x05060708090A0B0Cull;
+}());
+
+TEST_F(MessageProtocolTest, WriterLaysOutFieldsInNetworkOrder) {
+    std::vector<char> frame(Utils::HeaderHelper::HEADER_SIZE + sizeof(uint32_t) + sizeof(uint64_t));
+    char* end = Utils::HeaderHelper::Writer(frame.data())
+                    .header(7, 12)
+                    .u32(0xA1B2C3D4u)
+                    .u64(0x1122334455667788ull)
+                    .position();
+    EXPECT_EQ(end, frame.data() + frame.size());
+
+    // same bytes as field-by-field appends
+    std::vector<char> appended;
+    Utils::HeaderHelper::append_u32(appended, 7);
+    Utils::HeaderHelper::append_u64(appended, 12);
+    Utils::HeaderHelper::append_u32(appended, 0xA1B2C3D4u);
+    Utils::HeaderHelper::append_u64(appended, 0x1122334455667788ull);
+    EXPECT_EQ(frame, appended);
+    EXPECT_EQ(static_cast<uint8_t>(frame[12]), 0xA1);
+
+    uint64_t value = 0;
+    ASSERT_TRUE(Utils::HeaderHelper::read_u64(frame, 16, value));
+    EXPECT_EQ(value, 0x1122334455667788ull);
+    EXPECT_FALSE(Utils::HeaderHelper::read_u64(frame, 17, value));
+}
+
 TEST_F(MessageProtocolTest, RoundTripPreservesData) {
     std::string original = "Round trip test message with special chars: !@#$%^&*()";
     auto msg1 = std::make_shared<TextMessage>(original);
@@ -472,6 +562,106 @@ TEST_F(MessageProtocolTest, RoundTripPreservesData) {
     EXPECT_NE(msg2->to_string().find(original), std::string::npos);
 }
 
+TEST_F(MessageProtocolTest, SequencedTextRoundTrip) {
+    TextMessage msg("numbered", 42);
+    auto serialized = msg.serialize();
+
+    uint32_t id = 0;
+    Utils::HeaderHelper::read_u32(serialized, 0, id);
+    EXPECT_EQ(id, static_cast<uint32_t>(TextTypes::SequencedText));
+
+    auto decoded = MessageFactory::create_from_id(TextTypes::SequencedText);
+    decoded->deserialize(serialized);
+    auto text = dynamic_cast<TextMessage*>(decoded.get());
+    ASSERT_NE(text, nullptr);
+    EXPECT_EQ(text->get_sequence(), 42u);
+    EXPECT_EQ(text->to_string(), "numbered");
+}
+
+TEST_F(MessageProtocolTest, UnsequencedTextKeepsLegacyFrame) {
+    TextMessage msg("plain");
+    auto serialized = msg.serialize();
+    EXPECT_EQ(serialized.size(), 12u + 5u);
+
+    TextMessage decoded;
+    decoded.deserialize(serialized);
+    EXPECT_EQ(decoded.get_sequence(), 0u);
+}
+
+TEST_F(MessageProtocolTest, SendHistoryCarriesLastSeenSequence) {
+    SendHistoryMessage msg(5556, 1234);
+    SendHistoryMessage decoded;
+    decoded.deserialize(msg.serialize());
+    EXPECT_EQ(decoded.get_file_port(), 5556);
+    EXPECT_EQ(decoded.get_last_seen_sequence(), 1234u);
+}
+
+TEST_F(MessageProtocolTest, SendHistoryAcceptsLegacyPayload) {
+    std::vector<char> legacy;
+    Utils::HeaderHelper::append_u32(legacy, static_cast<uint32_t>(TextTypes::SendHistory));
+    Utils::HeaderHelper::append_u64(legacy, sizeof(uint32_t));
+    Utils::HeaderHelper::append_u32(legacy, 6000);
+
+    SendHistoryMessage decoded;
+    ASSERT_NO_THROW(decoded.deserialize(legacy));
+    EXPECT_EQ(decoded.get_file_port(), 6000);
+    EXPECT_EQ(decoded.get_last_seen_sequence(), 0u);
+}
+
+TEST_F(MessageProtocolTest, HistorySyncRoundTrip) {
+    HistorySyncMessage msg(HistorySyncMessage::Status::FullResync, 10, 99);
+    auto decoded = MessageFactory::create_from_id(TextTypes::HistorySync);
+    decoded->deserialize(msg.serialize());
+    auto sync = dynamic_cast<HistorySyncMessage*>(decoded.get());
+    ASSERT_NE(sync, nullptr);
+    EXPECT_EQ(sync->get_status(), HistorySyncMessage::Status::FullResync);
+    EXPECT_EQ(sync->get_first_sequence(), 10u);
+    EXPECT_EQ(sync->get_last_sequence(), 99u);
+}
+
+TEST_F(MessageProtocolTest, HistoryQueryRoundTrip) {
+    HistoryQueryMessage msg(500, 25);
+    auto decoded = MessageFactory::create_from_id(TextTypes::HistoryQuery);
+    decoded->deserialize(msg.serialize());
+    auto query = dynamic_cast<HistoryQueryMessage*>(decoded.get());
+    ASSERT_NE(query, nullptr);
+    EXPECT_EQ(query->get_before_sequence(), 500u);
+    EXPECT_EQ(query->get_limit(), 25u);
+}
+
+TEST_F(MessageProtocolTest, PrefixedTextMatchesConcatenatedText) {
+    EXPECT_EQ(TextMessage::serialize_prefixed("[TEXT] From 1.2.3.4:5: ", "hi", 9),
+              TextMessage("[TEXT] From 1.2.3.4:5: hi", 9).serialize());
+    EXPECT_EQ(TextMessage::serialize_prefixed("a", "b", 0), TextMessage("ab").serialize());
+}
+
+TEST_F(MessageProtocolTest, ShortAndLongTextsSurviveReuse) {
+    const std::string short_text(TextMessage::INLINE_CAPACITY, 's');
+    std::string long_text(TextMessage::INLINE_CAPACITY + 1, 'l');
+    const char* long_data = long_text.data();
+
+    // a long text handed over is moved in, not copied
+    TextMessage moved(std::move(long_text), 3);
+    EXPECT_EQ(moved.get_text().data(), long_data);
+    EXPECT_EQ(moved.get_text(), std::string(TextMessage::INLINE_CAPACITY + 1, 'l'));
+
+    // one message decoding long, short, then long frames again
+    TextMessage decoded;
+    decoded.deserialize(moved.serialize());
+    EXPECT_EQ(decoded.get_text(), moved.get_text());
+    decoded.deserialize(TextMessage(short_text, 4).serialize());
+    EXPECT_EQ(decoded.get_text(), short_text);
+    EXPECT_EQ(decoded.get_sequence(), 4u);
+    decoded.deserialize(moved.serialize());
+    EXPECT_EQ(decoded.payload_size(), TextMessage::INLINE_CAPACITY + 1);
+
+    // copies of an inline text point at their own storage
+    const TextMessage original(std::string_view("inline"));
+    const TextMessage copy = original;
+    EXPECT_EQ(copy.get_text(), "inline");
+    EXPECT_NE(copy.get_text().data(), original.get_text().data());
+}
+
 TEST_F(MessageProtocolTest, CorruptedDataThrowsException) {
     std::vector<char> corrupt_data = {0x01, 0x02, 0x03}; // Too short
 
@@ -479,6 +669,1673 @@ TEST_F(MessageProtocolTest, CorruptedDataThrowsException) {
     EXPECT_THROW(msg->deserialize(corrupt_data), std::runtime_error);
 }
 
+// =====================================================================
+// TEST SUITE 6: MessageHistory budgets
+// =====================================================================
+class MessageHistoryTest : public ::testing::Test {
+protected:
+    std::filesystem::path spill_dir;
+
+    void SetUp() override {
+        spill_dir = std::filesystem::temp_directory_path() /
+                    ("history_test_" + std::to_string(std::random_device{}()));
+    }
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(spill_dir, ec);
+    }
+
+    static std::shared_ptr<FileMessage> make_file(const std::string& name, size_t size) {
+        return std::make_shared<FileMessage>(name, std::vector<uint8_t>(size, 0x42));
+    }
+};
+
+TEST_F(MessageHistoryTest, CountLimitHoldsWhenPushingPairs) {
+    MessageHistory history({4, 1024 * 1024, 1024 * 1024}, spill_dir);
+
+    // file broadcasts push a text log and the file itself
+    for (int i = 0; i < 10; ++i) {
+        history.push(std::make_shared<TextMessage>("log " + std::to_string(i)));
+        history.push(make_file("f.bin", 16));
+    }
+
+    auto stats = history.stats();
+    EXPECT_EQ(stats.entries, 4u);
+    EXPECT_EQ(stats.evicted_entries, 16u);
+    EXPECT_EQ(history.snapshot()->entries.size(), 4u);
+}
+
+TEST_F(MessageHistoryTest, TracksResidentBytes) {
+    MessageHistory history({100, 1024 * 1024, 1024 * 1024}, spill_dir);
+    history.push(std::make_shared<TextMessage>("12345"));
+    history.push(make_file("ab", 10));
+
+    // text entries pin their encoded frame (12 byte header + text), files their payload
+    auto stats = history.stats();
+    EXPECT_EQ(stats.resident_bytes, (12u + 5u) + (10u + 2u));
+    EXPECT_EQ(stats.spilled_bytes, 0u);
+}
+
+TEST_F(MessageHistoryTest, OldFileBlobsAreSpilledAndReloaded) {
+    MessageHistory history({100, 1500, 1024 * 1024}, spill_dir);
+    history.push(make_file("a.bin", 1000));
+    history.push(std::make_shared<TextMessage>("hello"));
+    history.push(make_file("b.bin", 1000));
+
+    auto stats = history.stats();
+    EXPECT_EQ(stats.entries, 3u);
+    EXPECT_EQ(stats.spilled_entries, 1u);
+    EXPECT_LE(stats.resident_bytes, 1500u);
+
+    auto snap = history.snapshot();
+    ASSERT_EQ(snap->entries.size(), 3u);
+    EXPECT_TRUE(snap->entries[0].is_file());
+    EXPECT_EQ(snap->entries[0].message, nullptr);
+    EXPECT_TRUE(snap->entries[0].spill);
+
+    auto reloaded = MessageHistory::load(snap->entries[0]);
+    ASSERT_NE(reloaded, nullptr);
+    EXPECT_NE(reloaded->to_string().find("a.bin"), std::string::npos);
+    EXPECT_EQ(reloaded->payload_size(), 1000u + 5u);
+}
+
+TEST_F(MessageHistoryTest, BackgroundSpillRunsOnTheSpillExecutor) {
+    boost::asio::io_context spill_io;
+    MessageHistory history({100, 1500, 1024 * 1024}, spill_dir);
+    history.set_spill_executor(spill_io.get_executor());
+    history.push(make_file("a.bin", 1000));
+    history.push(make_file("b.bin", 1000));
+
+    // nothing is written inside push(), the blobs stay resident until the executor runs
+    EXPECT_EQ(history.stats().spilled_entries, 0u);
+    EXPECT_EQ(history.stats().entries, 2u);
+
+    spill_io.run();
+    auto stats = history.stats();
+    EXPECT_EQ(stats.spilled_entries, 1u);
+    EXPECT_LE(stats.resident_bytes, 1500u);
+    auto reloaded = MessageHistory::load(history.snapshot()->entries[0]);
+    ASSERT_NE(reloaded, nullptr);
+    EXPECT_NE(reloaded->to_string().find("a.bin"), std::string::npos);
+}
+
+TEST_F(MessageHistoryTest, BackgroundSpillAndEvictionRenewTheSnapshot) {
+    boost::asio::io_context spill_io;
+    MessageHistory history({100, 1500, 1500}, spill_dir);
+    history.set_spill_executor(spill_io.get_executor());
+    auto a = make_file("a.bin", 1000);
+    std::weak_ptr<FileMessage> weak_a = a;
+    history.push(std::move(a), 1);
+    history.push(make_file("b.bin", 1000), 2);
+    EXPECT_NE(history.snapshot()->entries[0].message, nullptr);
+
+    // a.bin is spilled on the executor, after the snapshot above was cached
+    spill_io.run();
+    auto snap = history.snapshot();
+    EXPECT_EQ(snap->entries[0].message, nullptr);
+    EXPECT_TRUE(snap->entries[0].spill);
+    EXPECT_TRUE(weak_a.expired());
+
+    // c.bin pushes b.bin to the spill, which evicts a.bin over the spill budget
+    history.push(make_file("c.bin", 1000), 3);
+    EXPECT_EQ(history.snapshot()->entries.size(), 3u);
+    spill_io.restart();
+    spill_io.run();
+    EXPECT_EQ(history.stats().evicted_entries, 1u);
+    ASSERT_EQ(history.snapshot()->entries.size(), 2u);
+    EXPECT_EQ(history.snapshot()->entries[0].sequence, 2u);
+}
+
+TEST_F(MessageHistoryTest, EvictsWhenSpillIsOverBudget) {
+    MessageHistory history({100, 1500, 1500}, spill_dir);
+    for (int i = 0; i < 5; ++i) history.push(make_file("c.bin", 1000));
+
+    auto stats = history.stats();
+    EXPECT_LE(stats.resident_bytes, 1500u);
+    EXPECT_LE(stats.spilled_bytes, 1500u);
+    EXPECT_GT(stats.evicted_entries, 0u);
+}
+
+TEST_F(MessageHistoryTest, TextEntriesArePreEncoded) {
+    MessageHistory history({100, 1024 * 1024, 1024 * 1024}, spill_dir);
+    auto msg = std::make_shared<TextMessage>("pre-encoded");
+    history.push(msg);
+
+    auto snap = history.snapshot();
+    ASSERT_EQ(snap->entries.size(), 1u);
+    ASSERT_NE(snap->entries[0].frame, nullptr);
+    EXPECT_EQ(*snap->entries[0].frame, msg->serialize());
+}
+
+TEST_F(MessageHistoryTest, SnapshotIsSharedUntilNextPush) {
+    MessageHistory history({100, 1024 * 1024, 1024 * 1024}, spill_dir);
+    history.push(std::make_shared<TextMessage>("one"));
+
+    auto snap1 = history.snapshot();
+    auto snap2 = history.snapshot();
+    EXPECT_EQ(snap1, snap2);
+
+    history.push(std::make_shared<TextMessage>("two"));
+    auto snap3 = history.snapshot();
+    EXPECT_NE(snap1, snap3);
+    EXPECT_GT(snap3->generation, snap1->generation);
+    EXPECT_EQ(snap1->entries.size(), 1u); // old snapshot is immutable
+    EXPECT_EQ(snap3->entries.size(), 2u);
+}
+
+TEST_F(MessageHistoryTest, EvictsWithoutSpillDirectory) {
+    MessageHistory history({100, 1500, 1024 * 1024});
+    for (int i = 0; i < 5; ++i) history.push(make_file("d.bin", 1000));
+
+    auto stats = history.stats();
+    EXPECT_EQ(stats.entries, 1u);
+    EXPECT_EQ(stats.spilled_entries, 0u);
+    EXPECT_LE(stats.resident_bytes, 1500u);
+}
+
+TEST_F(MessageHistoryTest, FirstAfterSelectsDelta) {
+    MessageHistory history({100, 1024 * 1024, 1024 * 1024}, spill_dir);
+    for (uint64_t seq = 1; seq <= 5; ++seq)
+        history.push(std::make_shared<TextMessage>("m", seq), seq);
+    history.push(make_file("f.bin", 4), 5); // file shares its announcement's sequence
+
+    auto snap = history.snapshot();
+    EXPECT_EQ(snap->first_after(0), 0u);
+    EXPECT_EQ(snap->first_after(3), 3u);
+    EXPECT_EQ(snap->first_after(4), 4u);
+    EXPECT_EQ(snap->first_after(5), snap->entries.size());
+}
+
+// =====================================================================
+// TEST SUITE 7: HistoryLog persistence
+// =====================================================================
+class HistoryLogTest : public ::testing::Test {
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override {
+        dir = std::filesystem::temp_directory_path() /
+              ("history_log_test_" + std::to_string(std::random_device{}()));
+    }
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+
+    static HistoryLog::Frame frame(const std::string& text) {
+        return std::make_shared<const std::vector<char>>(TextMessage(text).serialize());
+    }
+};
+
+TEST_F(HistoryLogTest, AppendFlushAndReadBack) {
+    HistoryLog log(dir);
+    for (int i = 0; i < 10; ++i) log.append(frame("msg " + std::to_string(i)));
+    log.flush();
+
+    EXPECT_EQ(log.size(), 10u);
+    auto last = log.read_last(3);
+    ASSERT_EQ(last.size(), 3u);
+    EXPECT_EQ(*last[0], *frame("msg 7"));
+    EXPECT_EQ(*last[2], *frame("msg 9"));
+}
+
+TEST_F(HistoryLogTest, RecoversAfterRestart) {
+    {
+        HistoryLog log(dir);
+        for (int i = 0; i < 50; ++i) log.append(frame("persisted " + std::to_string(i)));
+    } // destructor flushes
+
+    HistoryLog log(dir);
+    EXPECT_EQ(log.size(), 50u);
+    auto last = log.read_last(5);
+    ASSERT_EQ(last.size(), 5u);
+    EXPECT_EQ(*last[4], *frame("persisted 49"));
+
+    log.append(frame("after restart"));
+    log.flush();
+    EXPECT_EQ(log.size(), 51u);
+    EXPECT_EQ(*log.read_last(1)[0], *frame("after restart"));
+}
+
+TEST_F(HistoryLogTest, LogsShareOneWriter) {
+    auto writer = std::make_shared<HistoryLogWriter>();
+    {
+        HistoryLog first(dir / "first", HistoryLogOptions{}, writer);
+        HistoryLog second(dir / "second", HistoryLogOptions{}, writer);
+        for (int i = 0; i < 10; ++i) {
+            first.append(frame("first " + std::to_string(i)));
+            second.append(frame("second " + std::to_string(i)));
+        }
+        first.flush();
+        EXPECT_EQ(first.size(), 10u);
+        EXPECT_EQ(*first.read_last(1)[0], *frame("first 9"));
+        second.append(frame("second 10"));
+    } // the second one is written by its destructor
+
+    HistoryLog second(dir / "second");
+    EXPECT_EQ(second.size(), 11u);
+    EXPECT_EQ(*second.read_last(1)[0], *frame("second 10"));
+}
+
+TEST_F(HistoryLogTest, RollsSegmentsAndReadsAcrossThem) {
+    HistoryLogOptions options;
+    options.segment_bytes = 256;
+    {
+        HistoryLog log(dir, options);
+        for (int i = 0; i < 40; ++i) {
+            log.append(frame("segment " + std::to_string(i)));
+            log.flush();
+        }
+        EXPECT_GT(log.stats().segments, 1u);
+    }
+
+    HistoryLog log(dir, options);
+    EXPECT_EQ(log.size(), 40u);
+    auto all = log.read_range(0, 40);
+    ASSERT_EQ(all.size(), 40u);
+    for (int i = 0; i < 40; ++i) EXPECT_EQ(*all[i], *frame("segment " + std::to_string(i)));
+}
+
+TEST_F(HistoryLogTest, TruncatesTornTail) {
+    {
+        HistoryLog log(dir);
+        for (int i = 0; i < 5; ++i) log.append(frame("whole " + std::to_string(i)));
+    }
+
+    // simulate a crash in the middle of writing the last frame
+    std::filesystem::path data_file;
+    for (const auto& f : std::filesystem::directory_iterator(dir))
+        if (f.path().extension() == ".log") data_file = f.path();
+    ASSERT_FALSE(data_file.empty());
+    std::filesystem::resize_file(data_file, std::filesystem::file_size(data_file) - 3);
+
+    HistoryLog log(dir);
+    EXPECT_EQ(log.size(), 4u);
+    EXPECT_EQ(*log.read_last(1)[0], *frame("whole 3"));
+}
+
+TEST_F(HistoryLogTest, FailedWriteLeavesNoPartialRecord) {
+    HistoryLog log(dir);
+    log.append(frame("before"));
+    log.flush();
+
+    // a file size limit makes the kernel take only part of the next batch and refuse the rest
+    rlimit original{};
+    ASSERT_EQ(::getrlimit(RLIMIT_FSIZE, &original), 0);
+    rlimit limited = original;
+    limited.rlim_cur = 4096;
+    const auto previous = std::signal(SIGXFSZ, SIG_IGN);
+    ASSERT_EQ(::setrlimit(RLIMIT_FSIZE, &limited), 0);
+    log.append(frame(std::string(64 * 1024, 'x')));
+    log.flush();
+    ::setrlimit(RLIMIT_FSIZE, &original);
+    std::signal(SIGXFSZ, previous);
+
+    EXPECT_EQ(log.size(), 1u);
+    log.append(frame("after"));
+    log.flush();
+    auto all = log.read_range(0, 10);
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(*all[0], *frame("before"));
+    EXPECT_EQ(*all[1], *frame("after"));
+
+    log.stop();
+    HistoryLog reopened(dir);
+    EXPECT_EQ(reopened.size(), 2u);
+    EXPECT_EQ(*reopened.read_last(1)[0], *frame("after"));
+}
+
+// =====================================================================
+// TEST SUITE 8: History pagination (no network, Broadcast without clients)
+// =====================================================================
+class HistoryPaginationTest : public ::testing::Test {
+protected:
+    std::filesystem::path dir;
+
+    void SetUp() override {
+        dir = std::filesystem::temp_directory_path() /
+              ("history_page_test_" + std::to_string(std::random_device{}()));
+    }
+    void TearDown() override {
+        std::error_code ec;
+        std::filesystem::remove_all(dir, ec);
+    }
+
+    static HistorySyncMessage page_header(const std::vector<HistoryLog::Frame>& page) {
+        HistorySyncMessage sync;
+        sync.deserialize(*page.at(0));
+        return sync;
+    }
+
+    static uint64_t sequence_of(const HistoryLog::Frame& frame) {
+        TextMessage text;
+        text.deserialize(*frame);
+        return text.get_sequence();
+    }
+};
+
+TEST_F(HistoryPaginationTest, PagesFromTheRing) {
+    TestableServerManager server(0, 0, "127.0.0.1");
+    for (int i = 1; i <= 30; ++i) server.Broadcast(nullptr, "line " + std::to_string(i));
+    server.RunPending();
+    auto room = server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM);
+
+    auto newest = room->CollectHistoryPage(0, 10);
+    ASSERT_EQ(newest.size(), 11u);
+    EXPECT_EQ(page_header(newest).get_status(), HistorySyncMessage::Status::Page);
+    EXPECT_EQ(page_header(newest).get_first_sequence(), 21u);
+    EXPECT_EQ(sequence_of(newest[1]), 21u);
+    EXPECT_EQ(sequence_of(newest.back()), 30u);
+
+    auto older = room->CollectHistoryPage(21, 100);
+    ASSERT_EQ(older.size(), 21u);
+    EXPECT_EQ(page_header(older).get_first_sequence(), 1u);
+    EXPECT_EQ(sequence_of(older.back()), 20u);
+
+    auto none = room->CollectHistoryPage(1, 10);
+    ASSERT_EQ(none.size(), 1u);
+    EXPECT_EQ(page_header(none).get_first_sequence(), 0u);
+}
+
+TEST_F(HistoryPaginationTest, OlderPagesComeFromThePersistentLog) {
+    TestableServerManager server(0, 0, "127.0.0.1", dir);
+    for (int i = 1; i <= 150; ++i) server.Broadcast(nullptr, "line " + std::to_string(i));
+    server.RunPending();
+    auto room = server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM);
+    room->FlushHistoryLog();
+
+    // the ring only keeps the newest 100 messages
+    auto page = room->CollectHistoryPage(30, 10);
+    ASSERT_EQ(page.size(), 11u);
+    EXPECT_EQ(page_header(page).get_first_sequence(), 20u);
+    for (size_t i = 1; i < page.size(); ++i) EXPECT_EQ(sequence_of(page[i]), 19u + i);
+
+    // a page straddling the ring and the log
+    auto mixed = room->CollectHistoryPage(55, 10);
+    ASSERT_EQ(mixed.size(), 11u);
+    for (size_t i = 1; i < mixed.size(); ++i) EXPECT_EQ(sequence_of(mixed[i]), 44u + i);
+}
+
+TEST_F(HistoryPaginationTest, LogPagesFollowSequencesAcrossADroppedRecord) {
+    {
+        // sequence 10 never made it into the log
+        HistoryLog log(dir);
+        for (uint64_t i = 1; i <= 150; ++i)
+            if (i != 10)
+                log.append(std::make_shared<const std::vector<char>>(
+                    TextMessage("line " + std::to_string(i), i).serialize()));
+    }
+    TestableServerManager server(0, 0, "127.0.0.1", dir);
+    auto room = server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM);
+
+    auto page = room->CollectHistoryPage(12, 5);
+    ASSERT_EQ(page.size(), 6u);
+    EXPECT_EQ(page_header(page).get_first_sequence(), 6u);
+    EXPECT_EQ(page_header(page).get_last_sequence(), 11u);
+    const std::vector<uint64_t> expected{6, 7, 8, 9, 11};
+    for (size_t i = 0; i < expected.size(); ++i) EXPECT_EQ(sequence_of(page[i + 1]), expected[i]);
+}
+
+// =====================================================================
+// TEST SUITE 9: Rooms (no network, strands drained on the test thread)
+// =====================================================================
+class RoomTest : public HistoryPaginationTest {};
+
+TEST_F(RoomTest, ValidatesNames) {
+    EXPECT_TRUE(Room::IsValidName("lobby"));
+    EXPECT_TRUE(Room::IsValidName("team-42_dev"));
+    EXPECT_FALSE(Room::IsValidName(""));
+    EXPECT_FALSE(Room::IsValidName("../etc"));
+    EXPECT_FALSE(Room::IsValidName("has space"));
+    EXPECT_FALSE(Room::IsValidName(std::string(Room::MAX_NAME_LENGTH + 1, 'a')));
+}
+
+TEST_F(RoomTest, RoomsKeepIndependentHistoryAndSequences) {
+    TestableServerManager server(0, 0, "127.0.0.1");
+    auto lobby = server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM);
+    auto dev = server.GetOrCreateRoom("dev");
+    EXPECT_EQ(server.GetOrCreateRoom("dev"), dev);
+    EXPECT_EQ(server.GetRoomCount(), 2u);
+
+    for (int i = 0; i < 5; ++i) server.Broadcast(nullptr, "lobby line");
+    for (int i = 0; i < 3; ++i)
+        boost::asio::post(dev->GetStrand(), [dev]() { dev->PublishText(nullptr, "", "dev line"); });
+    server.RunPending();
+
+    EXPECT_EQ(lobby->GetLastSequence(), 5u);
+    EXPECT_EQ(dev->GetLastSequence(), 3u);
+    EXPECT_EQ(lobby->GetHistoryStats().entries, 5u);
+    EXPECT_EQ(dev->GetHistoryStats().entries, 3u);
+
+    auto page = dev->CollectHistoryPage(0, 10);
+    ASSERT_EQ(page.size(), 4u);
+    TextMessage text;
+    text.deserialize(*page[1]);
+    EXPECT_EQ(text.to_string(), "dev line");
+}
+
+TEST_F(RoomTest, EachRoomPersistsToItsOwnLog) {
+    {
+        TestableServerManager server(0, 0, "127.0.0.1", dir);
+        auto dev = server.GetOrCreateRoom("dev");
+        server.Broadcast(nullptr, "in the lobby");
+        boost::asio::post(dev->GetStrand(), [dev]() { dev->PublishText(nullptr, "", "in dev"); });
+        boost::asio::post(dev->GetStrand(), [dev]() { dev->PublishText(nullptr, "", "in dev again"); });
+        server.RunPending();
+        server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM)->FlushHistoryLog();
+        dev->FlushHistoryLog();
+    }
+
+    TestableServerManager restarted(0, 0, "127.0.0.1", dir);
+    EXPECT_EQ(restarted.GetOrCreateRoom(ServerManager::DEFAULT_ROOM)->GetLastSequence(), 1u);
+    EXPECT_EQ(restarted.GetOrCreateRoom("dev")->GetLastSequence(), 2u);
+}
+
+TEST_F(RoomTest, RoomLimitRefusesNewRoomsUntilIdleOnesAreReclaimed) {
+    TestableServerManager server(0, 0, "127.0.0.1", dir);
+    server.SetRoomLimits(3, std::chrono::hours(1));
+    auto a = server.GetOrCreateRoom("a");
+    auto b = server.GetOrCreateRoom("b");
+    ASSERT_TRUE(a && b);
+    EXPECT_EQ(server.GetOrCreateRoom("c"), nullptr);
+
+    // b is empty and nobody refers to it, but it has not been idle long enough
+    b.reset();
+    EXPECT_EQ(server.GetOrCreateRoom("c"), nullptr);
+    EXPECT_EQ(server.GetRoomCount(), 3u);
+
+    server.SetRoomLimits(3, std::chrono::milliseconds(0));
+    auto c = server.GetOrCreateRoom("c");
+    ASSERT_NE(c, nullptr);
+    EXPECT_EQ(server.GetRoomCount(), 3u);
+    EXPECT_EQ(server.GetOrCreateRoom("a"), a);  // still referenced, so kept
+    EXPECT_EQ(server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM)->GetName(), ServerManager::DEFAULT_ROOM);
+}
+
+TEST_F(RoomTest, SessionPrefixesAreFormattedOnce) {
+    Session session(7, "10.0.0.1", 5000, "10.0.0.1:5000");
+    EXPECT_EQ(session.GetId(), 7u);
+    EXPECT_EQ(session.GetTextPrefix(), "[TEXT] From 10.0.0.1:5000: ");
+    EXPECT_EQ(session.GetFilePrefix(), "[FILE] From 10.0.0.1:5000: ");
+    EXPECT_EQ(Session::Server()->GetDisplayName(), "<Server>");
+
+    // messages without a connection are labelled with the server session
+    TestableServerManager server(0, 0, "127.0.0.1");
+    server.Broadcast(nullptr, "hello");
+    server.RunPending();
+    auto page = server.GetOrCreateRoom(ServerManager::DEFAULT_ROOM)->CollectHistoryPage(0, 1);
+    ASSERT_EQ(page.size(), 2u);
+    TextMessage text;
+    text.deserialize(*page[1]);
+    EXPECT_EQ(text.to_string(), "[TEXT] From <Server>: hello");
+}
+
+TEST_F(RoomTest, ReplayedFilesAreReloadedOnTheBulkExecutor) {
+    using boost::asio::ip::tcp;
+    boost::asio::io_context io;
+    boost::asio::io_context bulk_io;
+    FanOut fan_out(io, FanOut::Options{});
+    Room::Options options;
+    options.spill_dir = dir;
+    options.history_limits = {100, 3000, 1024 * 1024};
+    Room room("bulk", io, fan_out, options);
+    room.SetBulkExecutor(bulk_io.get_executor());
+
+    auto file = std::make_shared<FileMessage>("a.bin", std::vector<uint8_t>(4096, 0x42));
+    room.PublishFile(nullptr, "[FILE] a.bin", file, std::make_shared<const std::vector<char>>(file->serialize()));
+    bulk_io.run();
+    EXPECT_EQ(room.GetHistoryStats().spilled_entries, 1u);
+
+    auto socket = std::make_shared<tcp::socket>(io);
+    socket->open(tcp::v4());
+    auto outbound = std::make_shared<OutboundQueue>(socket, OutboundQueue::Limits{}, nullptr);
+    room.Join(socket, outbound, nullptr, true);
+    room.ReplayHistory(outbound, nullptr, 0);
+    EXPECT_EQ(outbound->GetBulkBytes(), 0u);  // nothing read back or encoded on the strand
+
+    bulk_io.restart();
+    bulk_io.run();
+    EXPECT_GT(outbound->GetBulkBytes(), 4096u);
+}
+
+TEST_F(RoomTest, LogPagesAreReadOnTheBulkExecutor) {
+    using boost::asio::ip::tcp;
+    boost::asio::io_context io;
+    boost::asio::io_context bulk_io;
+    FanOut fan_out(io, FanOut::Options{});
+    Room::Options options;
+    options.log_dir = dir;
+    Room room("paged", io, fan_out, options);
+    room.SetBulkExecutor(bulk_io.get_executor());
+    for (int i = 1; i <= 150; ++i) room.PublishText(nullptr, "", "line " + std::to_string(i));
+    room.FlushHistoryLog();
+
+    auto socket = std::make_shared<tcp::socket>(io);
+    socket->open(tcp::v4());
+    auto outbound = std::make_shared<OutboundQueue>(socket, OutboundQueue::Limits{}, nullptr);
+    room.SendHistoryPage(outbound, 30, 10);
+    EXPECT_EQ(outbound->GetQueuedFrames(), 0u);  // nothing read from the log on the strand
+
+    bulk_io.run();
+    EXPECT_EQ(outbound->GetQueuedFrames(), 11u);
+}
+
+TEST_F(RoomTest, QueuedReplayKeepsAnEvictedSpillFile) {
+    using boost::asio::ip::tcp;
+    boost::asio::io_context io;
+    boost::asio::io_context bulk_io;
+    FanOut fan_out(io, FanOut::Options{});
+    Room::Options options;
+    options.spill_dir = dir;
+    options.history_limits = {3, 3000, 1024 * 1024};
+    Room room("evict", io, fan_out, options);
+    room.SetBulkExecutor(bulk_io.get_executor());
+
+    auto file = std::make_shared<FileMessage>("a.bin", std::vector<uint8_t>(4096, 0x42));
+    room.PublishFile(nullptr, "[FILE] a.bin", file, std::make_shared<const std::vector<char>>(file->serialize()));
+    bulk_io.run();
+    ASSERT_EQ(room.GetHistoryStats().spilled_entries, 1u);
+
+    auto socket = std::make_shared<tcp::socket>(io);
+    socket->open(tcp::v4());
+    auto outbound = std::make_shared<OutboundQueue>(socket, OutboundQueue::Limits{}, nullptr);
+    room.Join(socket, outbound, nullptr, true);
+    room.ReplayHistory(outbound, nullptr, 0);
+
+    // the file is evicted while its replay is still queued on the bulk executor
+    for (int i = 0; i < 3; ++i) room.PublishText(nullptr, "[TEXT] From <Server>: ", "line");
+    ASSERT_EQ(room.GetHistoryStats().spilled_entries, 0u);
+
+    bulk_io.restart();
+    bulk_io.run();
+    EXPECT_GT(outbound->GetBulkBytes(), 4096u);
+    EXPECT_TRUE(std::filesystem::is_empty(dir));  // removed once the replay let go of it
+}
+
+TEST_F(RoomTest, RoomMessageRoundTrip) {
+    RoomMessage msg(RoomMessage::Action::Leave, "dev");
+    auto decoded = MessageFactory::create_from_id(TextTypes::Room);
+    decoded->deserialize(msg.serialize());
+    auto room = dynamic_cast<RoomMessage*>(decoded.get());
+    ASSERT_NE(room, nullptr);
+    EXPECT_EQ(room->get_action(), RoomMessage::Action::Leave);
+    EXPECT_EQ(room->get_room(), "dev");
+}
+
+// =====================================================================
+// TEST SUITE 10: FanOut engine (open but unconnected sockets, counting deliveries)
+// =====================================================================
+class FanOutTest : public ::testing::Test {
+protected:
+    boost::asio::io_context io;
+
+    std::vector<FanOut::Recipient> make_recipients(size_t n) {
+        std::vector<FanOut::Recipient> out;
+        for (size_t i = 0; i < n; ++i) {
+            auto sock = std::make_shared<boost::asio::ip::tcp::socket>(io);
+            sock->open(boost::asio::ip::tcp::v4());
+            FanOut::Recipient recipient;
+            recipient.socket = sock;
+            out.push_back(std::move(recipient));
+        }
+        return out;
+    }
+};
+
+TEST_F(FanOutTest, SmallSetsAreDeliveredInline) {
+    FanOut fan_out(io, FanOut::Options{10, 4});
+    auto stream = std::make_shared<FanOut::Stream>();
+    auto recipients = fan_out.Partition(make_recipients(5));
+    EXPECT_EQ(recipients->size, 5u);
+
+    size_t delivered = 0;
+    fan_out.Deliver(stream, recipients, [&](const FanOut::Recipient&) { ++delivered; });
+    EXPECT_EQ(delivered, 5u);
+    EXPECT_EQ(fan_out.GetStats().inline_deliveries, 1u);
+}
+
+TEST_F(FanOutTest, LargeSetsArePostedToLanes) {
+    FanOut fan_out(io, FanOut::Options{10, 4});
+    auto stream = std::make_shared<FanOut::Stream>();
+    auto members = make_recipients(200);
+    auto recipients = fan_out.Partition(members);
+
+    std::map<const void*, int> delivered;
+    std::mutex m;
+    fan_out.Deliver(stream, recipients, [&](const FanOut::Recipient& r) {
+        std::scoped_lock lk(m);
+        ++delivered[r.socket.get()];
+    });
+    EXPECT_TRUE(delivered.empty());
+    EXPECT_GT(stream->pending_lanes.load(), 1u);
+
+    io.run();
+    EXPECT_EQ(delivered.size(), 200u);
+    for (const auto& [sock, count] : delivered) EXPECT_EQ(count, 1);
+    EXPECT_EQ(stream->pending_lanes.load(), 0u);
+    EXPECT_EQ(fan_out.GetStats().parallel_deliveries, 1u);
+}
+
+TEST_F(FanOutTest, InlineNeverOvertakesPendingLanes) {
+    FanOut fan_out(io, FanOut::Options{0, 4});
+    auto stream = std::make_shared<FanOut::Stream>();
+    auto recipients = fan_out.Partition(make_recipients(20));
+
+    std::map<const void*, std::vector<int>> seen;
+    fan_out.Deliver(stream, recipients, [&](const FanOut::Recipient& r) { seen[r.socket.get()].push_back(1); });
+    fan_out.SetInlineThreshold(1000);
+    fan_out.Deliver(stream, recipients, [&](const FanOut::Recipient& r) { seen[r.socket.get()].push_back(2); });
+    io.run();
+
+    ASSERT_EQ(seen.size(), 20u);
+    for (const auto& [sock, order] : seen) EXPECT_EQ(order, (std::vector<int>{1, 2}));
+    EXPECT_EQ(fan_out.GetStats().inline_deliveries, 0u);
+}
+
+TEST_F(FanOutTest, ClosedSocketsAreSkippedAndReported) {
+    FanOut fan_out(io, FanOut::Options{100, 2});
+    auto stream = std::make_shared<FanOut::Stream>();
+    auto members = make_recipients(3);
+    members[1].socket->close();
+    auto recipients = fan_out.Partition(members);
+
+    size_t delivered = 0;
+    fan_out.Deliver(stream, recipients, [&](const FanOut::Recipient&) { ++delivered; });
+    EXPECT_EQ(delivered, 2u);
+    EXPECT_TRUE(stream->saw_closed.load());
+}
+
+// =====================================================================
+// TEST SUITE 11: Outbound queues (loopback pair; the io_context is not run until the end,
+// so the first write stays in flight and everything after it queues up)
+// =====================================================================
+class OutboundQueueTest : public ::testing::Test {
+protected:
+    boost::asio::io_context io;
+    boost::asio::io_context client_io;
+    std::shared_ptr<boost::asio::ip::tcp::socket> server_socket;
+    boost::asio::ip::tcp::socket client{client_io};
+    std::shared_ptr<OutboundQueue::Metrics> metrics = std::make_shared<OutboundQueue::Metrics>();
+
+    void SetUp() override {
+        using boost::asio::ip::tcp;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+        client.connect(acceptor.local_endpoint());
+        server_socket = std::make_shared<tcp::socket>(io);
+        acceptor.accept(*server_socket);
+    }
+
+    std::shared_ptr<OutboundQueue> make_queue(OutboundQueue::Policy policy, size_t max_frames) {
+        OutboundQueue::Limits limits;
+        limits.max_frames = max_frames;
+        limits.policy = policy;
+        limits.grace = std::chrono::milliseconds(0);
+        return std::make_shared<OutboundQueue>(server_socket, limits, metrics);
+    }
+
+    static OutboundQueue::Frame frame(const std::string& text) {
+        return std::make_shared<const std::vector<char>>(TextMessage(text).serialize());
+    }
+
+    // Lets the queue finish writing, then reads `count` frames on the client side
+    std::vector<std::string> drain(size_t count) {
+        io.run();
+        std::vector<std::string> texts;
+        for (size_t i = 0; i < count; ++i) {
+            std::vector<char> data(12);
+            boost::asio::read(client, boost::asio::buffer(data));
+            uint64_t length = 0;
+            Utils::HeaderHelper::read_u64(data, 4, length);
+            data.resize(12 + length);
+            boost::asio::read(client, boost::asio::buffer(data.data() + 12, length));
+            TextMessage msg;
+            msg.deserialize(data);
+            texts.emplace_back(msg.get_text());
+        }
+        return texts;
+    }
+};
+
+TEST_F(OutboundQueueTest, DropOldestKeepsNewestChatAndAllControl) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 4);
+    for (int i = 0; i < 10; ++i) queue->Send(frame("c" + std::to_string(i)));
+    queue->Send(frame("control"), OutboundQueue::Priority::Control);
+
+    EXPECT_EQ(queue->GetQueuedFrames(), 5u);
+    auto stats = metrics->Load();
+    EXPECT_EQ(stats.high_water_hits, 1u);
+    EXPECT_EQ(stats.dropped_oldest, 6u);
+    EXPECT_EQ(stats.dropped_new, 0u);
+    EXPECT_EQ(drain(5), (std::vector<std::string>{"c0", "c7", "c8", "c9", "control"}));
+}
+
+TEST_F(OutboundQueueTest, DropNewKeepsTheBacklog) {
+    auto queue = make_queue(OutboundQueue::Policy::DropNew, 4);
+    for (int i = 0; i < 10; ++i) queue->Send(frame("c" + std::to_string(i)));
+
+    EXPECT_EQ(metrics->Load().dropped_new, 6u);
+    EXPECT_EQ(drain(4), (std::vector<std::string>{"c0", "c1", "c2", "c3"}));
+}
+
+TEST_F(OutboundQueueTest, DisconnectPolicyClosesAfterGrace) {
+    auto queue = make_queue(OutboundQueue::Policy::Disconnect, 4);
+    for (int i = 0; i < 6; ++i) queue->Send(frame("c" + std::to_string(i)));
+
+    EXPECT_TRUE(queue->IsClosed());
+    EXPECT_EQ(metrics->Load().disconnects, 1u);
+    EXPECT_EQ(queue->GetQueuedFrames(), 1u);  // only the write already in flight
+}
+
+TEST_F(OutboundQueueTest, DisconnectPolicyClosesAQuietStalledReader) {
+    OutboundQueue::Limits limits;
+    limits.max_bytes = 64ull * 1024 * 1024;
+    limits.max_frames = 4;
+    limits.policy = OutboundQueue::Policy::Disconnect;
+    limits.grace = std::chrono::milliseconds(50);
+    auto queue = std::make_shared<OutboundQueue>(server_socket, limits, metrics);
+
+    // The client never reads: the first 16 MiB write outgrows the socket buffers and stays in flight
+    auto big = std::make_shared<const std::vector<char>>(TextMessage(std::string(16 * 1024 * 1024, 'x')).serialize());
+    for (int i = 0; i < 5; ++i) queue->Send(big);
+    EXPECT_FALSE(queue->IsClosed());
+    EXPECT_EQ(metrics->Load().high_water_hits, 1u);
+
+    // Nothing else is sent: the grace timer alone closes the connection
+    const auto start = std::chrono::steady_clock::now();
+    io.run_for(std::chrono::seconds(5));
+    EXPECT_TRUE(queue->IsClosed());
+    EXPECT_EQ(metrics->Load().disconnects, 1u);
+    EXPECT_GE(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(40));
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::seconds(5));
+}
+
+TEST_F(OutboundQueueTest, ControlFloodHitsTheHardLimit) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 4);
+    for (int i = 0; i < 8; ++i) queue->Send(frame("q"), OutboundQueue::Priority::Control);
+    EXPECT_FALSE(queue->IsClosed());
+    queue->Send(frame("q"), OutboundQueue::Priority::Control);
+    EXPECT_TRUE(queue->IsClosed());
+    EXPECT_EQ(metrics->Load().disconnects, 1u);
+}
+
+// =====================================================================
+// TEST SUITE 12: Flood protection (token buckets driven by explicit time points)
+// =====================================================================
+TEST(RateLimitTest, TokenBucketAllowsBurstThenRefills) {
+    const auto t0 = TokenBucket::Clock::now();
+    TokenBucket bucket(10.0, 5.0);
+    for (int i = 0; i < 5; ++i) EXPECT_TRUE(bucket.TryTake(1.0, t0));
+    EXPECT_FALSE(bucket.TryTake(1.0, t0));
+    EXPECT_TRUE(bucket.TryTake(1.0, t0 + std::chrono::milliseconds(100)));
+
+    // Take() goes into debt and reports how long paying it off takes
+    const auto wait = bucket.Take(3.0, t0 + std::chrono::milliseconds(100));
+    EXPECT_NEAR(std::chrono::duration<double>(wait).count(), 0.3, 1e-6);
+    EXPECT_TRUE(TokenBucket(0.0, 0.0).TryTake(1e9, t0));
+}
+
+TEST(RateLimitTest, FloodIsPausedAndPersistentOffenderDisconnected) {
+    IngressLimiter::Limits limits;
+    limits.messages_per_second = 10.0;
+    limits.message_burst = 2.0;
+    limits.offender_grace = std::chrono::seconds(1);
+    auto metrics = std::make_shared<IngressLimiter::Metrics>();
+    IngressLimiter limiter(limits, metrics);
+
+    auto t = TokenBucket::Clock::now();
+    EXPECT_EQ(limiter.Admit(10, t).pause, TokenBucket::Clock::duration::zero());
+    EXPECT_EQ(limiter.Admit(10, t).pause, TokenBucket::Clock::duration::zero());
+    auto third = limiter.Admit(10, t);
+    EXPECT_GT(third.pause, TokenBucket::Clock::duration::zero());
+    EXPECT_FALSE(third.disconnect);
+
+    // keeps sending exactly when the pause ends: always throttled, dropped after the grace period
+    MessageReceiver::Admission admission;
+    for (int i = 0; i < 30 && !admission.disconnect; ++i) {
+        t += third.pause;
+        admission = limiter.Admit(10, t);
+    }
+    EXPECT_TRUE(admission.disconnect);
+    EXPECT_EQ(metrics->Load().disconnects, 1u);
+    EXPECT_GE(metrics->Load().throttled, 9u);
+}
+
+TEST(RateLimitTest, RoomBroadcastCapDropsExcessLines) {
+    boost::asio::io_context io;
+    FanOut fan_out(io, FanOut::Options{});
+    Room::Options options;
+    options.broadcasts_per_second = 1.0;
+    options.broadcast_burst = 3.0;
+    Room room("capped", io, fan_out, options);
+
+    for (int i = 0; i < 10; ++i) room.PublishText(nullptr, "", "line " + std::to_string(i));
+    EXPECT_EQ(room.GetLastSequence(), 3u);
+    EXPECT_EQ(room.GetRateLimitedCount(), 7u);
+}
+
+// =====================================================================
+// TEST SUITE 13: Keepalive (timer wheel driven by explicit time points)
+// =====================================================================
+TEST(KeepaliveTest, TimerWheelFiresEachTimerOnceAtItsTick) {
+    using namespace std::chrono_literals;
+    TimerWheel wheel(10ms, 8);
+    const auto t0 = TimerWheel::Clock::now();
+    std::vector<int> fired;
+    wheel.Advance(t0);
+    wheel.Schedule(t0 + 25ms, [&] { fired.push_back(25); });
+    wheel.Schedule(t0 + 10ms, [&] { fired.push_back(10); });
+    wheel.Schedule(t0 + 95ms, [&] { fired.push_back(95); });  // more than one rotation away, shares the 20 ms slot
+    EXPECT_EQ(wheel.Size(), 3u);
+
+    EXPECT_EQ(wheel.Advance(t0 + 10ms), 1u);
+    EXPECT_EQ(wheel.Advance(t0 + 20ms), 0u);  // 25 ms is rounded up to the 30 ms tick
+    EXPECT_EQ(wheel.Advance(t0 + 30ms), 1u);
+    EXPECT_EQ(wheel.Advance(t0 + 90ms), 0u);
+    EXPECT_EQ(wheel.Advance(t0 + 100ms), 1u);
+    EXPECT_EQ(fired, (std::vector<int>{10, 25, 95}));
+    EXPECT_EQ(wheel.Size(), 0u);
+}
+
+TEST(KeepaliveTest, TimerWheelCatchesUpAfterALongPause) {
+    using namespace std::chrono_literals;
+    TimerWheel wheel(10ms, 4);
+    const auto t0 = TimerWheel::Clock::now();
+    wheel.Advance(t0);
+    int fired = 0;
+    for (int i = 1; i <= 20; ++i) wheel.Schedule(t0 + i * 10ms, [&] { ++fired; });
+    wheel.Schedule(t0 + 10s, [&] { ++fired; });
+
+    // one late call visits each slot once and fires everything that became due
+    EXPECT_EQ(wheel.Advance(t0 + 1s), 20u);
+    EXPECT_EQ(fired, 20);
+
+    // a callback may re-arm itself, a deadline in the past fires on the next tick
+    wheel.Schedule(t0, [&] { ++fired; wheel.Schedule(t0, [&] { ++fired; }); });
+    EXPECT_EQ(wheel.Advance(t0 + 1s + 10ms), 1u);
+    EXPECT_EQ(wheel.Advance(t0 + 1s + 20ms), 1u);
+    EXPECT_EQ(fired, 22);
+    EXPECT_EQ(wheel.Size(), 1u);
+}
+
+TEST(KeepaliveTest, HeartbeatRoundTrip) {
+    const HeartbeatMessage ping(HeartbeatMessage::Kind::Ping);
+    const auto data = ping.serialize();
+    auto decoded = MessageFactory::create_from_id(TextTypes::Heartbeat);
+    decoded->deserialize(data);
+    auto heartbeat = dynamic_cast<HeartbeatMessage*>(decoded.get());
+    ASSERT_NE(heartbeat, nullptr);
+    EXPECT_EQ(heartbeat->get_kind(), HeartbeatMessage::Kind::Ping);
+    EXPECT_EQ(data.size(), sizeof(uint32_t) + sizeof(uint64_t) + heartbeat->payload_size());
+}
+
+// =====================================================================
+// TEST SUITE 14: Multiplexed connection (file frames as chunks between chat frames)
+// =====================================================================
+class MultiplexTest : public OutboundQueueTest {
+protected:
+    static std::vector<char> file_frame(size_t bytes) {
+        std::vector<uint8_t> content(bytes);
+        for (size_t i = 0; i < bytes; ++i) content[i] = static_cast<uint8_t>(i * 31);
+        return FileMessage("blob.bin", content).serialize();
+    }
+
+    // Reads one whole frame from the client side
+    std::pair<TextTypes, std::vector<char>> read_frame() {
+        std::vector<char> data(12);
+        boost::asio::read(client, boost::asio::buffer(data));
+        uint32_t id = 0;
+        uint64_t length = 0;
+        Utils::HeaderHelper::read_u32(data, 0, id);
+        Utils::HeaderHelper::read_u64(data, 4, length);
+        data.resize(12 + length);
+        boost::asio::read(client, boost::asio::buffer(data.data() + 12, length));
+        return {static_cast<TextTypes>(id), data};
+    }
+};
+
+TEST_F(MultiplexTest, FileChunkRoundTrip) {
+    const FileChunkMessage chunk(7, true, {'a', 'b', 'c'});
+    const auto data = chunk.serialize();
+    EXPECT_EQ(data.size(), FileChunkMessage::HEADER_SIZE + 3);
+
+    auto decoded = MessageFactory::create_from_id(TextTypes::FileChunk);
+    decoded->deserialize(data);
+    auto result = dynamic_cast<FileChunkMessage*>(decoded.get());
+    ASSERT_NE(result, nullptr);
+    EXPECT_EQ(result->get_channel(), 7u);
+    EXPECT_TRUE(result->is_last());
+    EXPECT_EQ(result->get_data(), (std::vector<char>{'a', 'b', 'c'}));
+
+    // the header a sender writes in front of a slice is the serialized chunk minus its bytes
+    EXPECT_EQ(FileChunkMessage::encode_header(7, true, 3),
+              std::vector<char>(data.begin(), data.begin() + FileChunkMessage::HEADER_SIZE));
+}
+
+TEST_F(MultiplexTest, AssemblerKeepsChannelsApartAndEnforcesItsLimit) {
+    ChunkAssembler assembler(8);
+    FileChunkMessage a1(1, false, {'a', 'a'});
+    FileChunkMessage b1(2, false, {'b'});
+    FileChunkMessage a2(1, true, {'A'});
+    EXPECT_EQ(assembler.add(a1), nullptr);
+    EXPECT_EQ(assembler.add(b1), nullptr);
+    auto a = assembler.add(a2);
+    ASSERT_NE(a, nullptr);
+    EXPECT_EQ(*a, (std::vector<char>{'a', 'a', 'A'}));
+    EXPECT_EQ(assembler.pending_bytes(), 1u);
+
+    FileChunkMessage big(2, false, std::vector<char>(8, 'x'));
+    EXPECT_THROW(assembler.add(big), std::runtime_error);
+}
+
+TEST_F(MultiplexTest, ChatOvertakesAFileOnTheSameSocket) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    const auto file = file_frame(200 * 1024);  // 4 chunks
+    bool done = false;
+    queue->SendBulk(std::make_shared<const std::vector<char>>(file),
+                    [&](const boost::system::error_code& ec) { done = !ec; });
+    queue->Send(frame("chat"));  // the first chunk is in flight, the chat frame goes next
+    EXPECT_GT(queue->GetBulkBytes(), 0u);
+
+    io.run();
+    EXPECT_TRUE(done);
+    EXPECT_EQ(queue->GetBulkBytes(), 0u);
+
+    ChunkAssembler assembler(1024 * 1024);
+    std::vector<TextTypes> order;
+    std::shared_ptr<std::vector<char>> reassembled;
+    while (!reassembled) {
+        auto [type, data] = read_frame();
+        order.push_back(type);
+        if (type != TextTypes::FileChunk) continue;
+        FileChunkMessage chunk;
+        chunk.deserialize(data);
+        reassembled = assembler.add(chunk);
+    }
+    ASSERT_GE(order.size(), 3u);
+    EXPECT_EQ(order[0], TextTypes::FileChunk);
+    EXPECT_EQ(order[1], TextTypes::Text);
+    EXPECT_EQ(*reassembled, file);
+    EXPECT_EQ(assembler.pending_bytes(), 0u);
+}
+
+// =====================================================================
+// TEST SUITE 15: Compact frame headers
+// =====================================================================
+TEST(CompactHeaderTest, VarintLengthsRoundTrip) {
+    using Utils::FrameHeader;
+    const std::vector<std::pair<uint64_t, size_t>> cases = {
+        {0, 2}, {127, 2}, {128, 3}, {16383, 3}, {16384, 4}, {1ull << 32, 6}, {UINT64_MAX, 11}};
+    for (const auto& [length, size] : cases) {
+        // decode()'s legacy branch reads LEGACY_SIZE bytes; GCC cannot see that `size` rules it out here
+        char out[std::max(FrameHeader::COMPACT_MAX_SIZE, FrameHeader::LEGACY_SIZE)];
+        ASSERT_EQ(FrameHeader::encode_compact(5, length, out), size) << length;
+        EXPECT_EQ(FrameHeader::compact_size(length), size);
+
+        FrameHeader::Parsed parsed;
+        ASSERT_EQ(FrameHeader::decode(out, size, parsed), FrameHeader::Result::Ok);
+        EXPECT_TRUE(parsed.compact);
+        EXPECT_EQ(parsed.type, 5u);
+        EXPECT_EQ(parsed.body_length, length);
+        EXPECT_EQ(parsed.header_size, size);
+        EXPECT_EQ(FrameHeader::decode(out, size - 1, parsed), FrameHeader::Result::NeedMore);
+    }
+}
+
+TEST(CompactHeaderTest, LegacyHeadersAndMalformedInput) {
+    using Utils::FrameHeader;
+    const auto legacy = TextMessage("legacy").serialize();
+    FrameHeader::Parsed parsed;
+    EXPECT_EQ(FrameHeader::decode(legacy.data(), 11, parsed), FrameHeader::Result::NeedMore);
+    ASSERT_EQ(FrameHeader::decode(legacy.data(), legacy.size(), parsed), FrameHeader::Result::Ok);
+    EXPECT_FALSE(parsed.compact);
+    EXPECT_EQ(parsed.type, static_cast<uint32_t>(TextTypes::Text));
+    EXPECT_EQ(parsed.body_length, legacy.size() - FrameHeader::LEGACY_SIZE);
+
+    char too_long[12] = {static_cast<char>(0x81)};
+    std::fill(too_long + 1, too_long + 12, static_cast<char>(0xFF));
+    EXPECT_EQ(FrameHeader::decode(too_long, sizeof(too_long), parsed), FrameHeader::Result::Invalid);
+    const char reserved_flag[2] = {static_cast<char>(0xC1), 0};
+    EXPECT_EQ(FrameHeader::decode(reserved_flag, 2, parsed), FrameHeader::Result::Invalid);
+    char out[FrameHeader::COMPACT_MAX_SIZE];
+    EXPECT_EQ(FrameHeader::encode_compact(64, 1, out), 0u);
+}
+
+TEST_F(OutboundQueueTest, CompactFramesAreDecodedLikeLegacyOnes) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    queue->Send(frame("legacy"));  // queued before the switch
+    queue->SetCompactHeaders(true);
+    queue->Send(frame("compact one"));
+    queue->Send(frame(std::string(300, 'x')));  // two-byte length
+    io.run();
+
+    // the same receiver takes both headers and hands on legacy frames
+    auto client_socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(client));
+    auto protocol = std::make_shared<ConnectionProtocol>();
+    protocol->features = ConnectionProtocol::COMPACT_HEADERS;
+    MessageReceiver receiver;
+    std::vector<std::string> texts;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        texts.emplace_back(msg->get_text());
+        if (texts.size() == 3) client_io.stop();
+    });
+    receiver.start_read_header(client_socket, protocol);
+    client_io.run();
+
+    EXPECT_EQ(texts, (std::vector<std::string>{"legacy", "compact one", std::string(300, 'x')}));
+}
+
+// =====================================================================
+// TEST SUITE 16: Protocol handshake (Hello messages, negotiation, enforcement by the receiver)
+// =====================================================================
+TEST(HandshakeTest, HelloRoundTrip) {
+    const HelloMessage hello(3, ConnectionProtocol::COMPACT_HEADERS, 1 << 20,
+                             {static_cast<ConnectionProtocol::Codec>(7), ConnectionProtocol::Codec::Identity});
+    auto decoded = MessageFactory::create_from_id(TextTypes::Hello);
+    ASSERT_NE(dynamic_cast<HelloMessage*>(decoded.get()), nullptr);
+    decoded->deserialize(hello.serialize());
+    const auto& received = static_cast<const HelloMessage&>(*decoded);
+    EXPECT_EQ(received.get_version(), 3u);
+    EXPECT_EQ(received.get_features(), static_cast<uint32_t>(ConnectionProtocol::COMPACT_HEADERS));
+    EXPECT_EQ(received.get_max_frame_bytes(), 1u << 20);
+    EXPECT_EQ(received.get_codecs(), hello.get_codecs());
+}
+
+TEST(HandshakeTest, ApplySettlesOnWhatBothSidesSupport) {
+    using Codec = ConnectionProtocol::Codec;
+    const auto future_codec = static_cast<Codec>(7);
+    const HelloMessage local(1, ConnectionProtocol::COMPACT_HEADERS | ConnectionProtocol::MULTIPLEXED_FILES,
+                             1024, {Codec::Identity});
+    const HelloMessage peer(2, ConnectionProtocol::COMPACT_HEADERS | (1u << 9), 4096, {future_codec, Codec::Identity});
+
+    ConnectionProtocol protocol;
+    EXPECT_FALSE(protocol.has(ConnectionProtocol::COMPACT_HEADERS));
+    protocol.apply(local, peer);
+    EXPECT_EQ(protocol.version.load(), 1u);
+    EXPECT_EQ(protocol.features.load(), static_cast<uint32_t>(ConnectionProtocol::COMPACT_HEADERS));
+    EXPECT_FALSE(protocol.has(ConnectionProtocol::MULTIPLEXED_FILES));
+    EXPECT_EQ(protocol.codec.load(), Codec::Identity);  // the peer's favourite is unknown here
+    EXPECT_EQ(protocol.max_frame_bytes.load(), 1024u);
+    EXPECT_EQ(protocol.peer_max_frame_bytes.load(), 4096u);
+}
+
+TEST(HandshakeTest, ClientWithoutHelloKeepsTheLegacyProtocol) {
+    using boost::asio::ip::tcp;
+    using namespace std::chrono_literals;
+    TestableServerManager server(0, 0, "127.0.0.1");
+    server.SetKeepaliveOptions(50ms, 150ms, 1s);
+    std::thread server_thread([&server]() { server.StartServer(); });
+    while (!server.GetStatusUP() || server.TextPort() == 0) std::this_thread::sleep_for(1ms);
+    server.Broadcast(nullptr, "before");
+
+    // what the baseline client does: asks for the history, never says Hello and never answers a Ping
+    boost::asio::io_context io;
+    const tcp::endpoint endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), server.TextPort());
+    tcp::socket legacy(io);
+    legacy.connect(endpoint);
+    boost::asio::write(legacy, boost::asio::buffer(SendHistoryMessage(1).serialize()));
+    // a current client that went silent after its Hello
+    tcp::socket silent(io);
+    silent.connect(endpoint);
+    boost::asio::write(silent, boost::asio::buffer(HelloMessage(ConnectionProtocol::VERSION, 0, 0,
+                                                                {ConnectionProtocol::Codec::Identity}).serialize()));
+    std::this_thread::sleep_for(50ms);
+    server.Broadcast(nullptr, "after");
+
+    for (auto deadline = std::chrono::steady_clock::now() + 5s;
+         server.GetIdleExpiredCount() == 0 && std::chrono::steady_clock::now() < deadline;)
+        std::this_thread::sleep_for(5ms);
+    std::this_thread::sleep_for(300ms);  // two more idle timeouts, but the legacy client gets the longer one
+    EXPECT_EQ(server.GetIdleExpiredCount(), 1u);
+    EXPECT_GT(server.GetHeartbeatsSent(), 0u);
+
+    // only plain Text frames reached the legacy client, the replay included
+    std::vector<uint32_t> ids;
+    std::vector<std::string> texts;
+    while (legacy.available() > 0) {
+        std::vector<char> frame(Utils::HeaderHelper::HEADER_SIZE);
+        boost::asio::read(legacy, boost::asio::buffer(frame));
+        const auto header = Utils::HeaderHelper::read_header(frame.data());
+        frame.resize(frame.size() + header.body_length);
+        boost::asio::read(legacy, boost::asio::buffer(frame.data() + Utils::HeaderHelper::HEADER_SIZE,
+                                                      header.body_length));
+        ids.push_back(header.type);
+        TextMessage text;
+        if (header.type == static_cast<uint32_t>(TextTypes::Text)) text.deserialize(frame);
+        texts.push_back(std::string(text.get_text()));
+    }
+    EXPECT_EQ(ids, std::vector<uint32_t>(ids.size(), static_cast<uint32_t>(TextTypes::Text)));
+    EXPECT_NE(std::find(texts.begin(), texts.end(), "--- Begin Message History ---"), texts.end());
+    EXPECT_NE(std::find(texts.begin(), texts.end(), "[TEXT] From <Server>: before"), texts.end());
+    EXPECT_NE(std::find(texts.begin(), texts.end(), "[TEXT] From <Server>: after"), texts.end());
+
+    // silent for the legacy timeout: dropped all the same, without having been pinged
+    for (auto deadline = std::chrono::steady_clock::now() + 5s;
+         server.GetIdleExpiredCount() < 2 && std::chrono::steady_clock::now() < deadline;)
+        std::this_thread::sleep_for(5ms);
+    EXPECT_EQ(server.GetIdleExpiredCount(), 2u);
+    if (server.GetIdleExpiredCount() == 2) {  // otherwise the read would block
+        char byte;
+        boost::system::error_code ec;
+        legacy.read_some(boost::asio::buffer(&byte, 1), ec);
+        EXPECT_EQ(ec, boost::asio::error::eof);
+    }
+
+    server.StopServer();
+    server_thread.join();
+}
+
+TEST_F(OutboundQueueTest, ReceiverRejectsCompactFramesBeforeTheHandshake) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    queue->SetCompactHeaders(true);
+    queue->Send(frame("too early"));
+    io.run();
+
+    auto client_socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(client));
+    MessageReceiver receiver;
+    int received = 0;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage>) { ++received; });
+    receiver.start_read_header(client_socket);  // no protocol: legacy only
+    client_io.run();
+
+    EXPECT_EQ(received, 0);
+    EXPECT_FALSE(client_socket->is_open());
+}
+
+TEST_F(OutboundQueueTest, ReceiverRejectsFramesOverTheAdvertisedLimit) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    queue->Send(frame("small"));
+    queue->Send(frame(std::string(200, 'x')));
+    io.run();
+
+    auto protocol = std::make_shared<ConnectionProtocol>();
+    protocol->max_frame_bytes = 100;
+    auto client_socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(client));
+    MessageReceiver receiver;
+    std::vector<std::string> texts;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        texts.emplace_back(msg->get_text());
+    });
+    receiver.start_read_header(client_socket, protocol);
+    client_io.run();
+
+    EXPECT_EQ(texts, std::vector<std::string>{"small"});
+    EXPECT_FALSE(client_socket->is_open());
+}
+
+TEST_F(OutboundQueueTest, ReceiverLimitsLegacyFrames) {
+    auto huge = std::make_shared<std::vector<char>>(Utils::FrameHeader::LEGACY_SIZE);
+    Utils::FrameHeader::encode_legacy(static_cast<uint32_t>(TextTypes::Text),
+                                      ConnectionProtocol::LEGACY_MAX_FRAME_BYTES + 1, huge->data());
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    queue->Send(huge);
+    io.run();
+
+    auto client_socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(client));
+    MessageReceiver receiver;
+    int received = 0;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage>) { ++received; });
+    receiver.start_read_header(client_socket);  // no protocol: legacy limit
+    client_io.run();
+
+    EXPECT_EQ(received, 0);
+    EXPECT_FALSE(client_socket->is_open());
+}
+
+TEST_F(OutboundQueueTest, ReceiverAppliesItsOwnLegacyLimit) {
+    auto queue = make_queue(OutboundQueue::Policy::DropOldest, 16);
+    const std::string large(300 * 1024, 'x');  // read in several steps
+    queue->Send(frame(large));
+    queue->Send(frame(std::string(600 * 1024, 'y')));
+    io.run();
+
+    auto client_socket = std::make_shared<boost::asio::ip::tcp::socket>(std::move(client));
+    MessageReceiver receiver;
+    receiver.set_legacy_max_frame_bytes(512 * 1024);
+    std::vector<std::string> texts;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        texts.emplace_back(msg->get_text());
+    });
+    receiver.start_read_header(client_socket);
+    client_io.run();
+
+    ASSERT_EQ(texts.size(), 1u);
+    EXPECT_EQ(texts[0], large);
+    EXPECT_FALSE(client_socket->is_open());
+}
+
+// =====================================================================
+// TEST SUITE 17: Message registry (typed handlers, dense dispatch by type id)
+// =====================================================================
+static_assert(std::is_same_v<Utils::MessageRegistry::message_t<TextTypes::SequencedText>, TextMessage>);
+static_assert(std::is_same_v<Utils::MessageRegistry::message_t<TextTypes::Hello>, HelloMessage>);
+
+TEST(MessageRegistryTest, EveryTypeIdDecodesToItsClass) {
+    for (uint32_t id = 0; id <= static_cast<uint32_t>(TextTypes::TextBatch); ++id) {
+        const auto entry = Utils::MessageRegistry::lookup(id);
+        ASSERT_NE(entry.create, nullptr) << "type id " << id;
+        ASSERT_NE(entry.decode, nullptr) << "type id " << id;
+    }
+    EXPECT_EQ(Utils::MessageRegistry::lookup(static_cast<uint32_t>(TextTypes::TextBatch) + 1).decode, nullptr);
+    EXPECT_EQ(Utils::MessageRegistry::lookup(0xFFFFFFFF).decode, nullptr);
+
+    const auto room = Utils::MessageRegistry::lookup(static_cast<uint32_t>(TextTypes::Room))
+                          .decode(RoomMessage(RoomMessage::Action::Join, "dev").serialize());
+    ASSERT_NE(dynamic_cast<RoomMessage*>(room.get()), nullptr);
+    EXPECT_EQ(static_cast<RoomMessage&>(*room).get_room(), "dev");
+}
+
+TEST(MessageRegistryTest, DispatchCallsTheTypedHandler) {
+    MessageReceiver receiver;
+    std::vector<std::string> texts;
+    uint64_t sequence = 0;
+    int pings = 0;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        texts.emplace_back(msg->get_text());
+    });
+    receiver.register_handler<TextTypes::SequencedText>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        sequence = msg->get_sequence();
+    });
+    receiver.register_handler<TextTypes::Heartbeat>([&](const auto&, std::shared_ptr<HeartbeatMessage> msg) {
+        if (msg->get_kind() == HeartbeatMessage::Kind::Ping) ++pings;
+    });
+
+    EXPECT_TRUE(receiver.dispatch(nullptr, TextMessage("hi").serialize()));
+    EXPECT_TRUE(receiver.dispatch(nullptr, TextMessage("seq", 42).serialize()));
+    EXPECT_TRUE(receiver.dispatch(nullptr, HeartbeatMessage(HeartbeatMessage::Kind::Ping).serialize()));
+    EXPECT_FALSE(receiver.dispatch(nullptr, RoomMessage(RoomMessage::Action::Leave, "").serialize()));  // no handler
+
+    std::vector<char> unknown = TextMessage("x").serialize();
+    unknown[3] = 60;  // type id 60 has no class
+    EXPECT_FALSE(receiver.dispatch(nullptr, unknown));
+    std::vector<char> truncated = TextMessage("truncated").serialize();
+    truncated.resize(truncated.size() - 2);
+    EXPECT_FALSE(receiver.dispatch(nullptr, truncated));
+
+    EXPECT_EQ(texts, std::vector<std::string>{"hi"});
+    EXPECT_EQ(sequence, 42u);
+    EXPECT_EQ(pings, 1);
+}
+
+// =====================================================================
+// TEST SUITE 18: Batched chat (TextBatch frames, a room batching for some of its members)
+// =====================================================================
+TEST(TextBatchTest, RoundTripKeepsOrderAndSenders) {
+    std::vector<TextBatchMessage::Record> records{{7, "[TEXT] From a: ", "one"}, {8, "", ""}, {9, "[TEXT] From b: ", "three"}};
+    TextBatchMessage batch(records);
+    auto decoded = MessageFactory::create_from_id(TextTypes::TextBatch);
+    decoded->deserialize(batch.serialize());
+    const auto& out = static_cast<TextBatchMessage&>(*decoded).get_records();
+    ASSERT_EQ(out.size(), 3u);
+    EXPECT_EQ(out[0].sequence, 7u);
+    EXPECT_EQ(out[2].sender, "[TEXT] From b: ");
+    EXPECT_EQ(out[2].text, "three");
+    EXPECT_EQ(decoded->to_string(), "[TEXT] From a: one\n\n[TEXT] From b: three");
+
+    // only the kept records are encoded
+    TextBatchMessage odd;
+    odd.deserialize(TextBatchMessage::serialize_records(records, [](size_t i) { return i != 1; }));
+    ASSERT_EQ(odd.get_records().size(), 2u);
+    EXPECT_EQ(odd.get_records()[1].sequence, 9u);
+
+    auto truncated = batch.serialize();
+    truncated.resize(truncated.size() - 1);
+    EXPECT_THROW(TextBatchMessage().deserialize(truncated), std::runtime_error);
+    auto lying = batch.serialize();
+    lying[15] = 100;  // more records than the payload can hold
+    EXPECT_THROW(TextBatchMessage().deserialize(lying), std::runtime_error);
+}
+
+class RoomBatchingTest : public ::testing::Test {
+protected:
+    boost::asio::io_context io;
+    boost::asio::io_context client_io;
+    FanOut fan_out{io, FanOut::Options{}};
+    std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> servers;
+    std::vector<std::unique_ptr<boost::asio::ip::tcp::socket>> clients;
+
+    std::unique_ptr<Room> make_room(std::chrono::microseconds window, size_t max_bytes) {
+        Room::Options options;
+        options.batch_window = window;
+        options.batch_max_bytes = max_bytes;
+        return std::make_unique<Room>("batched", io, fan_out, options);
+    }
+
+    // Joins a loopback connection that agreed to the current protocol; the room writes to the accepted side
+    std::shared_ptr<boost::asio::ip::tcp::socket> join(Room& room, bool batched) {
+        using boost::asio::ip::tcp;
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+        clients.push_back(std::make_unique<tcp::socket>(client_io));
+        clients.back()->connect(acceptor.local_endpoint());
+        servers.push_back(std::make_shared<tcp::socket>(io));
+        acceptor.accept(*servers.back());
+        auto protocol = std::make_shared<ConnectionProtocol>();
+        protocol->version = ConnectionProtocol::VERSION;
+        if (batched) protocol->features = ConnectionProtocol::BATCHED_TEXT;
+        room.Join(servers.back(), std::make_shared<OutboundQueue>(servers.back(), OutboundQueue::Limits{}, nullptr), nullptr,
+                  false, batched, protocol);
+        return servers.back();
+    }
+
+    // Sequence numbers in each frame the client of member `index` received, one entry per frame
+    std::vector<std::vector<uint64_t>> received(size_t index) {
+        io.restart();
+        io.run_for(std::chrono::milliseconds(20));
+        std::vector<std::vector<uint64_t>> frames;
+        auto& client = *clients[index];
+        while (client.available() > 0) {
+            std::vector<char> data(12);
+            boost::asio::read(client, boost::asio::buffer(data));
+            uint64_t length = 0;
+            Utils::HeaderHelper::read_u64(data, 4, length);
+            data.resize(12 + length);
+            boost::asio::read(client, boost::asio::buffer(data.data() + 12, length));
+            uint32_t id = 0;
+            Utils::HeaderHelper::read_u32(data, 0, id);
+            std::vector<uint64_t> sequences;
+            if (id == static_cast<uint32_t>(TextTypes::TextBatch)) {
+                TextBatchMessage batch;
+                batch.deserialize(data);
+                for (const auto& record : batch.get_records()) sequences.push_back(record.sequence);
+            } else {
+                TextMessage text;
+                text.deserialize(data);
+                sequences.push_back(text.get_sequence());
+            }
+            frames.push_back(sequences);
+        }
+        return frames;
+    }
+};
+
+TEST_F(RoomBatchingTest, BatchedMembersShareOneFrameAndNeverGetTheirOwnLines) {
+    auto room = make_room(std::chrono::hours(1), 1024 * 1024);
+    auto a = join(*room, true);
+    join(*room, true);
+    join(*room, false);
+
+    room->PublishText(nullptr, "", "one");
+    room->PublishText(a, "[TEXT] From a: ", "two");
+    room->PublishText(nullptr, "", "three");
+    using Frames = std::vector<std::vector<uint64_t>>;
+    EXPECT_EQ(received(2), (Frames{{1}, {2}, {3}}));  // not batched: every line right away
+    EXPECT_EQ(received(1), Frames{});                 // batched: waiting for the window
+
+    room->FlushBatch();
+    EXPECT_EQ(received(0), (Frames{{1}, {3}}));  // the sender: the other lines' own frames
+    EXPECT_EQ(received(1), (Frames{{1, 2, 3}}));
+    EXPECT_EQ(received(2), Frames{});
+    EXPECT_EQ(room->GetBatchCount(), 1u);
+    EXPECT_EQ(room->GetLastSequence(), 3u);
+}
+
+TEST_F(RoomBatchingTest, WindowAndByteThresholdEndABatch) {
+    auto room = make_room(std::chrono::milliseconds(1), 2 * (TextBatchMessage::RECORD_OVERHEAD + 4));
+    auto a = join(*room, true);
+    join(*room, true);
+    using Frames = std::vector<std::vector<uint64_t>>;
+
+    // the second line reaches the byte threshold
+    room->PublishText(nullptr, "", "1234");
+    room->PublishText(nullptr, "", "5678");
+    room->PublishText(nullptr, "", "late");
+    EXPECT_EQ(room->GetBatchCount(), 1u);
+    // the window sends the third on its own, as its own frame
+    EXPECT_EQ(received(1), (Frames{{1, 2}, {3}}));
+    EXPECT_EQ(room->GetBatchCount(), 2u);
+
+    // a member that sent the only line of a batch gets nothing
+    room->PublishText(a, "", "mine");
+    EXPECT_EQ(received(0), (Frames{{1, 2}, {3}}));
+    EXPECT_EQ(received(1), (Frames{{4}}));
+}
+
+// =====================================================================
+// TEST SUITE 19: Inbound text sanitizing (every kernel this CPU runs against the scalar one)
+// =====================================================================
+class TextSanitizerTest : public ::testing::Test {
+protected:
+    using Sanitizer = Utils::TextSanitizer;
+
+    static std::vector<Sanitizer::Kernel> kernels() {
+        std::vector<Sanitizer::Kernel> out;
+        for (auto kernel : {Sanitizer::Kernel::Scalar, Sanitizer::Kernel::Sse2, Sanitizer::Kernel::Avx2})
+            if (Sanitizer::supported(kernel)) out.push_back(kernel);
+        return out;
+    }
+
+    // `bad` at every offset of a longer clean text, so the vector kernels see it at each block position
+    static void expect_rejected_everywhere(const std::string& bad) {
+        for (std::size_t offset = 0; offset < 70; ++offset) {
+            const std::string text = std::string(offset, 'a') + bad + std::string(70 - offset, 'b');
+            for (auto kernel : kernels())
+                EXPECT_FALSE(Sanitizer::is_clean(text, kernel)) << "offset " << offset << " kernel "
+                                                                << static_cast<int>(kernel);
+        }
+    }
+};
+
+TEST_F(TextSanitizerTest, AcceptsMultilingualText) {
+    const std::string text = "Zażółć gęślą jaźń \xE2\x82\xAC \xE4\xB8\xAD\xE6\x96\x87 \xF0\x9F\x98\x80\tok ~";
+    for (std::size_t repeat = 1; repeat < 8; ++repeat) {
+        std::string long_text;
+        for (std::size_t i = 0; i < repeat; ++i) long_text += text;
+        for (auto kernel : kernels()) EXPECT_TRUE(Sanitizer::is_clean(long_text, kernel));
+    }
+    for (auto kernel : kernels()) EXPECT_TRUE(Sanitizer::is_clean("", kernel));
+}
+
+TEST_F(TextSanitizerTest, RejectsInvalidUtf8AndControls) {
+    expect_rejected_everywhere("\xC0\x80");          // overlong NUL
+    expect_rejected_everywhere("\xE0\x9F\xBF");      // overlong 3-byte form
+    expect_rejected_everywhere("\xED\xA0\x80");      // surrogate
+    expect_rejected_everywhere("\xF4\x90\x80\x80");  // past U+10FFFF
+    expect_rejected_everywhere("\xBF");              // stray continuation byte
+    expect_rejected_everywhere("\xE2\x82");          // cut short
+    expect_rejected_everywhere("\x1B[2J");           // escape sequence
+    expect_rejected_everywhere("\xC2\x9B" "2J");     // C1 CSI
+    expect_rejected_everywhere("\x7F");
+    expect_rejected_everywhere("\r\n");
+
+    // a character cut off by the end of the text
+    for (std::size_t length = 0; length < 70; ++length)
+        for (auto kernel : kernels())
+            EXPECT_FALSE(Sanitizer::is_clean(std::string(length, 'a') + "\xF0\x9F\x98", kernel));
+}
+
+TEST_F(TextSanitizerTest, KernelsAgreeOnRandomText) {
+    std::mt19937 rng(46);
+    // mostly ASCII with lead and continuation bytes mixed in, like damaged chat lines
+    const std::string alphabet = std::string("abc \t\x1B\x7F") + "\xC2\x9B\xC3\xA9\xE2\x82\xAC\xED\xF0\x9F\x80\xBF\xF5";
+    std::uniform_int_distribution<std::size_t> pick(0, alphabet.size() - 1);
+    std::uniform_int_distribution<std::size_t> length(0, 100);
+    for (int round = 0; round < 20000; ++round) {
+        std::string text(length(rng), 'a');
+        for (auto& c : text) c = alphabet[pick(rng)];
+        const bool expected = Sanitizer::is_clean(text, Sanitizer::Kernel::Scalar);
+        for (auto kernel : kernels()) ASSERT_EQ(Sanitizer::is_clean(text, kernel), expected) << round;
+
+        std::string repaired = text;
+        const std::size_t replaced = Sanitizer::sanitize(repaired.data(), repaired.size());
+        EXPECT_EQ(replaced == 0, expected);
+        EXPECT_EQ(repaired.size(), text.size());
+        EXPECT_TRUE(Sanitizer::is_clean(repaired, Sanitizer::Kernel::Scalar));
+    }
+}
+
+TEST_F(TextSanitizerTest, ReceivedTextIsRepairedInPlace) {
+    TextMessage msg;
+    msg.deserialize(TextMessage("hi \x1B[31mred\xC2\x9B \xC3\xA9\xFF").serialize());
+    EXPECT_EQ(msg.sanitize(), 4u);
+    EXPECT_EQ(msg.get_text(), "hi ?[31mred?? \xC3\xA9?");
+    EXPECT_EQ(msg.sanitize(), 0u);
+
+    TextMessage long_msg(std::string(TextMessage::INLINE_CAPACITY, 'x') + "\a");
+    EXPECT_EQ(long_msg.sanitize(), 1u);
+    EXPECT_EQ(long_msg.get_text().back(), '?');
+}
+
+// =====================================================================
+// TEST SUITE 20: Session slab (per-connection blocks)
+// =====================================================================
+TEST(SessionSlabTest, FreedBlocksAreReusedAndStatsFollow) {
+    auto slab = std::make_shared<SessionSlab>();
+    SlabAllocator<std::array<char, 200>> allocator(slab);
+
+    auto first = std::allocate_shared<std::array<char, 200>>(allocator);
+    auto second = std::allocate_shared<std::array<char, 200>>(allocator);
+    auto stats = slab->GetStats();
+    EXPECT_EQ(stats.block_bytes % SessionSlab::BLOCK_ALIGNMENT, 0u);
+    EXPECT_GE(stats.block_bytes, sizeof(std::array<char, 200>));
+    EXPECT_EQ(stats.blocks_in_use, 2u);
+    EXPECT_EQ(stats.slabs, 1u);
+
+    const void* freed = second.get();
+    second.reset();
+    EXPECT_EQ(slab->GetStats().blocks_in_use, 1u);
+    auto third = std::allocate_shared<std::array<char, 200>>(allocator);
+    EXPECT_EQ(static_cast<const void*>(third.get()), freed);
+
+    // a larger object than the block size falls back to the heap
+    auto big = std::allocate_shared<std::array<char, 4096>>(SlabAllocator<std::array<char, 4096>>(slab));
+    EXPECT_EQ(slab->GetStats().blocks_in_use, 2u);
+}
+
+TEST(SessionSlabTest, GrowsSlabBySlabAndOutlivesItsOwner) {
+    std::vector<std::shared_ptr<uint64_t>> blocks;
+    {
+        auto slab = std::make_shared<SessionSlab>();
+        for (std::size_t i = 0; i < SessionSlab::BLOCKS_PER_SLAB + 1; ++i)
+            blocks.push_back(std::allocate_shared<uint64_t>(SlabAllocator<uint64_t>(slab), i));
+        EXPECT_EQ(slab->GetStats().slabs, 2u);
+    }
+    // the blocks keep the slab alive after its owner dropped it
+    for (std::size_t i = 0; i < blocks.size(); ++i) EXPECT_EQ(*blocks[i], i);
+    blocks.clear();
+}
+
+TEST(SessionSlabTest, ReceiverReadsSplitFramesBetweenIdleWaits) {
+    // an idle connection holds no read buffer; a header split across reads keeps one until it is complete
+    using boost::asio::ip::tcp;
+    boost::asio::io_context io;
+    tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+    tcp::socket writer(io);
+    writer.connect(acceptor.local_endpoint());
+    auto server_socket = std::make_shared<tcp::socket>(io);
+    acceptor.accept(*server_socket);
+
+    MessageReceiver receiver;
+    std::vector<std::string> texts;
+    receiver.register_handler<TextTypes::Text>([&](const auto&, std::shared_ptr<TextMessage> msg) {
+        texts.emplace_back(msg->get_text());
+        if (texts.size() == 3) io.stop();
+    });
+    receiver.start_read_header(server_socket);
+    std::thread reader([&io] { io.run(); });
+
+    const auto first = TextMessage("split header").serialize();
+    const auto second = TextMessage(std::string(10000, 'y')).serialize();  // larger than a read buffer
+    const auto third = TextMessage("after a pause").serialize();
+    boost::asio::write(writer, boost::asio::buffer(first.data(), 5));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    boost::asio::write(writer, boost::asio::buffer(first.data() + 5, first.size() - 5));
+    boost::asio::write(writer, boost::asio::buffer(second));
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    boost::asio::write(writer, boost::asio::buffer(third));
+    reader.join();
+
+    EXPECT_EQ(texts, (std::vector<std::string>{"split header", std::string(10000, 'y'), "after a pause"}));
+}
+
+// =====================================================================
+// TEST SUITE 21: Zero-copy file frames (MSG_ZEROCOPY, pinned until the kernel releases them)
+// =====================================================================
+class ZeroCopyTest : public ::testing::Test {
+protected:
+    using tcp = boost::asio::ip::tcp;
+
+    // A connected pair on loopback, plus a thread that reads `expected` bytes from the far end
+    void Connect(std::size_t expected) {
+        tcp::acceptor acceptor(io, tcp::endpoint(boost::asio::ip::make_address_v4("127.0.0.1"), 0));
+        sender = std::make_shared<tcp::socket>(io);
+        sender->connect(acceptor.local_endpoint());
+        acceptor.accept(receiver);
+        reader = std::thread([this, expected] {
+            received.resize(expected);
+            boost::system::error_code ec;
+            boost::asio::read(receiver, boost::asio::buffer(received), ec);
+        });
+    }
+
+    static ZeroCopySender::Frame MakeFrame(std::size_t bytes, char seed) {
+        std::vector<char> frame(bytes);
+        for (std::size_t i = 0; i < bytes; ++i) frame[i] = static_cast<char>(seed + i % 251);
+        return std::make_shared<const std::vector<char>>(std::move(frame));
+    }
+
+    void TearDown() override {
+        if (reader.joinable()) reader.join();
+    }
+
+    boost::asio::io_context io;
+    std::shared_ptr<tcp::socket> sender;
+    tcp::socket receiver{io};
+    std::thread reader;
+    std::vector<char> received;
+};
+
+TEST_F(ZeroCopyTest, FramesArriveIntactAndAreUnpinnedByFlush) {
+    const std::vector<ZeroCopySender::Frame> frames = {MakeFrame(1 << 20, 'a'), MakeFrame(100, 'b'),
+                                                       MakeFrame(3 << 20, 'c')};
+    std::size_t total = 0;
+    for (const auto& frame : frames) total += frame->size();
+    Connect(total);
+
+    ZeroCopySender zero_copy({4096, true});
+    boost::system::error_code ec;
+    for (const auto& frame : frames) {
+        zero_copy.Send(*sender, frame, ec);
+        ASSERT_FALSE(ec) << ec.message();
+    }
+    reader.join();
+
+    std::vector<char> expected;
+    for (const auto& frame : frames) expected.insert(expected.end(), frame->begin(), frame->end());
+    EXPECT_TRUE(received == expected);
+
+    EXPECT_TRUE(zero_copy.Flush(*sender));
+    EXPECT_EQ(zero_copy.PinnedFrames(), 0u);
+    const auto stats = zero_copy.GetStats();
+    EXPECT_EQ(stats.zero_copy_frames + stats.copied_frames, frames.size());
+    EXPECT_GE(stats.copied_frames, 1u);  // the small frame is always copied
+    // every zero-copy frame took at least one send, and nothing is pinned any more: all of them were reported done
+    EXPECT_GE(stats.completions, stats.zero_copy_frames);
+}
+
+TEST_F(ZeroCopyTest, FileQueuesShareOneEncodedFrame) {
+    const auto frame = std::make_shared<const std::vector<char>>(
+        FileMessage("shared.bin", std::vector<uint8_t>(2 << 20, 0x5a)).serialize());
+    Connect(frame->size());
+
+    std::weak_ptr<tcp::socket> socket = sender;
+    FileTransferQueue queue([socket] { return socket.lock(); });
+    queue.set_zero_copy({64 * 1024, true});
+    const uint64_t id = queue.enqueue(frame);
+    reader.join();
+    EXPECT_TRUE(received == *frame);
+
+    // once sent, the queue lets go of the frame
+    bool done = false;
+    for (int i = 0; i < 200 && !done; ++i) {
+        for (const auto& item : queue.list_snapshot())
+            if (item.id == id && item.state == FileTransferQueue::State::Done) done = !item.frame;
+        if (!done) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    EXPECT_TRUE(done);
+    queue.stop();
+    const auto stats = queue.zero_copy_stats();
+    EXPECT_EQ(stats.zero_copy_frames + stats.copied_frames, 1u);
+}
+
 // =====================================================================
 // Main Runner
 // =====================================================================